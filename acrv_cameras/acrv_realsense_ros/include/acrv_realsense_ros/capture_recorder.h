@@ -0,0 +1,160 @@
+/*
+Copyright 2017 Australian Centre for Robotic Vision
+*/
+
+#ifndef ACRV_REALSENSE_ROS_CAPTURE_RECORDER_H
+#define ACRV_REALSENSE_ROS_CAPTURE_RECORDER_H
+
+#include <sensor_msgs/CameraInfo.h>
+#include <sensor_msgs/PointCloud2.h>
+#include <opencv2/core/core.hpp>
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <fstream>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+namespace acrv_realsense_ros {
+
+/*
+Bounded pool of writer threads. Jobs are queued from ROS callbacks and run
+on the pool, so encoding and disk I/O never block the caller. When the queue
+is full a job is either dropped (and counted) or the caller waits, depending
+on the overflow policy.
+*/
+class AsyncWriter {
+public:
+    enum OverflowPolicy {
+        DROP_NEWEST,
+        BLOCK
+    };
+
+    AsyncWriter(std::size_t num_threads, std::size_t max_queue_size, OverflowPolicy policy = DROP_NEWEST);
+
+    // Waits for all queued jobs to finish
+    ~AsyncWriter();
+
+    // Queue a job, returns false if it was dropped. A job returns false on failure.
+    bool submit(std::function<bool()> job);
+
+    // Block until the queue is empty and no job is running
+    void flush();
+
+    std::size_t queue_depth();
+    uint64_t written() const { return written_; }
+    uint64_t failed() const { return failed_; }
+    uint64_t dropped() const { return dropped_; }
+
+private:
+    void worker();
+
+    std::size_t max_queue_size_;
+    OverflowPolicy policy_;
+
+    std::mutex mutex_;
+    std::condition_variable job_available_;
+    std::condition_variable space_available_;
+    std::deque<std::function<bool()>> jobs_;
+    std::size_t running_;
+    bool stopping_;
+    std::vector<std::thread> threads_;
+
+    std::atomic<uint64_t> written_;
+    std::atomic<uint64_t> failed_;
+    std::atomic<uint64_t> dropped_;
+};
+
+/*
+Indexed, append-only file holding every stream of every capture.
+
+Each record in <path> is
+    uint32 magic ("ACRV"), uint8 kind, int64 stamp (ns),
+    uint32 capture length, uint32 stream length, uint64 payload length,
+    capture name, stream name, payload
+and one line per record is appended to <path>.idx:
+    <capture> <stream> <kind> <stamp ns> <payload offset> <payload length>
+with whitespace and '%' in capture and stream names written as %XX hex
+escapes, so the fields stay whitespace-delimited.
+
+Image payloads are PNG encoded, clouds and camera infos are serialised ROS
+messages.
+*/
+class CaptureContainer {
+public:
+    enum RecordKind {
+        IMAGE_PNG = 1,
+        POINT_CLOUD2 = 2,
+        CAMERA_INFO = 3
+    };
+
+    static const uint32_t MAGIC = 0x56524341;  // "ACRV" little-endian
+
+    explicit CaptureContainer(const std::string &path);
+
+    bool is_open() const { return data_.is_open() && index_.is_open(); }
+
+    // Thread-safe, records are written whole and in the order appended
+    bool append(const std::string &capture, const std::string &stream, RecordKind kind,
+                const ros::Time &stamp, const std::vector<uint8_t> &payload);
+
+private:
+    std::mutex mutex_;
+    std::ofstream data_;
+    std::ofstream index_;
+};
+
+/*
+Records the streams of a capture either as files in a capture folder
+(<capture>/<stream>.png, .pcd, _camera_info.yaml) or into a
+CaptureContainer. All encoding and writing happens on an AsyncWriter.
+*/
+class CaptureRecorder {
+public:
+    // An empty container_path records into folders
+    CaptureRecorder(std::size_t num_threads, std::size_t max_queue_size,
+                    AsyncWriter::OverflowPolicy policy = AsyncWriter::DROP_NEWEST,
+                    const std::string &container_path = "");
+
+    // 8 bit images are stored as-is, 16 bit depth and IR with fast lossless PNG.
+    // The image is copied, as the caller may reuse its buffer.
+    bool record_image(const std::string &capture, const std::string &stream, const cv::Mat &image,
+                      const ros::Time &stamp = ros::Time());
+    // Takes over an image the caller no longer uses, without copying it
+    bool record_image(const std::string &capture, const std::string &stream, cv::Mat &&image,
+                      const ros::Time &stamp = ros::Time());
+    bool record_cloud(const std::string &capture, const std::string &stream,
+                      const sensor_msgs::PointCloud2ConstPtr &cloud);
+    bool record_camera_info(const std::string &capture, const std::string &stream,
+                            const sensor_msgs::CameraInfo &camera_info);
+
+    void flush() { writer_.flush(); }
+    AsyncWriter &writer() { return writer_; }
+
+private:
+    bool ensure_folder(const std::string &capture);
+
+    std::unique_ptr<CaptureContainer> container_;
+    std::mutex folders_mutex_;
+    std::vector<std::string> created_folders_;
+    // Declared last so it is destroyed (and drained) first
+    AsyncWriter writer_;
+};
+
+// Escapes whitespace and '%' as %XX for the container index
+std::string escape_index_name(const std::string &name);
+
+// PNG parameters used for recorded images: lowest zlib level, PNG row
+// filters still delta-code neighbouring pixels so 16 bit depth stays small
+std::vector<int> fast_png_params();
+
+}  // namespace acrv_realsense_ros
+
+#endif  // ACRV_REALSENSE_ROS_CAPTURE_RECORDER_H
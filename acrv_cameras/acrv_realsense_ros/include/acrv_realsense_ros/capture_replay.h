@@ -0,0 +1,107 @@
+/*
+Copyright 2017 Australian Centre for Robotic Vision
+*/
+
+#ifndef ACRV_REALSENSE_ROS_CAPTURE_REPLAY_H
+#define ACRV_REALSENSE_ROS_CAPTURE_REPLAY_H
+
+#include <opencv2/core/core.hpp>
+
+#include <condition_variable>
+#include <cstddef>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace acrv_realsense_ros {
+
+// How depth.png values are stored in a capture folder
+enum DepthEncoding {
+    DEPTH_AUTO,         // guess once per capture from the value range
+    DEPTH_MILLIMETRES,  // as published by the camera node
+    DEPTH_SCALED        // 0-2 metres stretched over the uint16 range
+};
+
+DepthEncoding depth_encoding_from_string(const std::string &name);
+
+// Convert the uint16 save format to a uint16 depth in mm format ros likes
+void from_16UC1_scaled_to_16UC1_mm(const cv::Mat &input_uint16, cv::Mat &output_uint16);
+
+// Convert a uint8 format to uint16 format
+void from_8UC1_to_16UC1(const cv::Mat &input_uint8, cv::Mat &output_uint16);
+
+/*
+The decoded streams of one capture, ready to publish. The matrices are
+read-only views into a memory-mapped cache file and stay valid for as long
+as the MappedCapture is alive.
+*/
+class MappedCapture {
+public:
+    ~MappedCapture();
+
+    cv::Mat color_hd;  // RGB8, as loaded from color.png
+    cv::Mat color;     // RGB8, 640x360 resize of color_hd
+    cv::Mat ir;        // 16UC1
+    cv::Mat depth;     // 16UC1 in mm
+
+private:
+    friend class CaptureReplay;
+    MappedCapture() : data_(NULL), size_(0) {}
+
+    void *data_;
+    std::size_t size_;
+};
+
+typedef std::shared_ptr<const MappedCapture> MappedCaptureConstPtr;
+
+/*
+Random access to every capture (a folder holding color.png, ir.png and
+depth.png) below a dataset root.
+
+The first load of a capture decodes its PNGs, converts them to the
+published formats and writes them to a raw cache file under cache_dir. Later
+loads, including by later runs, only mmap that file. Cache files are
+rebuilt when the source images are modified.
+*/
+class CaptureReplay {
+public:
+    CaptureReplay(const std::string &cache_dir, DepthEncoding depth_encoding, std::size_t max_mapped_captures);
+
+    // Walk root once and return the number of captures found, in path order
+    std::size_t index(const std::string &root);
+    const std::vector<std::string> &captures() const { return captures_; }
+
+    // Returns an empty pointer if the capture could not be read. Thread-safe,
+    // captures are decoded outside the lock and each only once at a time.
+    MappedCaptureConstPtr load(const std::string &folder);
+
+    // Load a capture that will be needed soon and ask the kernel to start
+    // paging it in. Meant to run on another thread than the publisher.
+    void prefetch(const std::string &folder);
+
+private:
+    std::string cache_path(const std::string &folder) const;
+    bool build_cache(const std::string &folder, const std::string &path);
+    MappedCaptureConstPtr map_cache(const std::string &folder, const std::string &path);
+
+    std::string cache_dir_;
+    DepthEncoding depth_encoding_;
+    std::size_t max_mapped_captures_;
+    std::vector<std::string> captures_;
+
+    // Most recently used mappings first
+    std::mutex mutex_;
+    std::list<std::pair<std::string, MappedCaptureConstPtr>> mapped_;
+    // Captures being mapped or decoded by some thread, loaded_ is notified
+    // when one finishes
+    std::set<std::string> loading_;
+    std::condition_variable loaded_;
+};
+
+}  // namespace acrv_realsense_ros
+
+#endif  // ACRV_REALSENSE_ROS_CAPTURE_REPLAY_H
@@ -3,21 +3,18 @@
 #include <cv_bridge/cv_bridge.h>
 #include <image_transport/image_transport.h>
 #include <librealsense/rs.hpp>
-#include <pcl/point_cloud.h>
-#include <pcl/point_types.h>
-#include <pcl_conversions/pcl_conversions.h>
 #include <sensor_msgs/image_encodings.h>
 #include <sensor_msgs/Image.h>
 #include <opencv2/core/core.hpp>
 #include <sensor_msgs/PointCloud2.h>
+#include <sensor_msgs/point_cloud2_iterator.h>
 #include <sensor_msgs/CameraInfo.h>
 #include <camera_info_manager/camera_info_manager.h>
 #include <math.h>
 #include <std_srvs/SetBool.h>
+#include <limits>
 #include <thread>
-
-typedef pcl::PointXYZRGB PointT;
-typedef pcl::PointCloud<PointT> PointCloud;
+#include <vector>
 
 ros::Publisher points_pub;
 ros::Publisher points_aligned_pub;
@@ -54,6 +51,150 @@ sensor_msgs::ImagePtr cvImagetoMsg(cv::Mat &image,std::string encoding, std::str
     return cv_msg_ptr->toImageMsg();
 }
 
+// Memory layout of one point in the published clouds, identical to the
+// layout PCL uses for pcl::PointXYZRGB ("xyz" padded to 16 bytes, then "rgb")
+struct PackedPointXYZRGB {
+    float x, y, z, padding_xyz;
+    uint32_t rgb;
+    uint32_t padding_rgb[3];
+};
+static_assert(sizeof(PackedPointXYZRGB) == 32, "PackedPointXYZRGB must match the PointCloud2 point_step");
+
+// Two alternating PointCloud2 messages. A published message may still be
+// held by intra-process subscribers, so a buffer is only reused once
+// nothing else references it.
+struct CloudBuffers {
+    sensor_msgs::PointCloud2Ptr clouds[2];
+    int next = 0;
+
+    sensor_msgs::PointCloud2Ptr acquire(int width, int height) {
+        next ^= 1;
+        sensor_msgs::PointCloud2Ptr &cloud = clouds[next];
+        if (!cloud || !cloud.unique()) {
+            cloud.reset(new sensor_msgs::PointCloud2);
+        }
+        if (cloud->width != (uint32_t)width || cloud->height != (uint32_t)height || cloud->data.empty()) {
+            cloud->height = height;
+            cloud->width = width;
+            sensor_msgs::PointCloud2Modifier modifier(*cloud);
+            modifier.setPointCloud2FieldsByString(2, "xyz", "rgb");
+        }
+        cloud->is_dense = false;
+        cloud->is_bigendian = false;
+        return cloud;
+    }
+};
+
+// Unit-depth ray for every pixel of `intrin`, so deprojection of a depth
+// pixel is a single multiply instead of an undistortion per frame
+void build_ray_table(const rs::intrinsics &intrin, std::vector<rs::float2> &rays) {
+    rays.resize(intrin.width * intrin.height);
+    for (int y = 0; y < intrin.height; ++y) {
+        for (int x = 0; x < intrin.width; ++x) {
+            rs::float3 point = intrin.deproject({(float)x, (float)y}, 1.0f);
+            rays[y * intrin.width + x] = {point.x, point.y};
+        }
+    }
+}
+
+// Single pass over the depth image producing any combination of:
+//  * color_reg_image / depth_cloud: colour aligned to depth and points in the depth frame
+//  * depth_reg_color_image / aligned_cloud: colour pixels covered by depth and points in the colour frame
+// Null outputs are skipped. Pixels without depth or colour become NaN points.
+void build_clouds(const uint16_t *depth_raw, const uint8_t *color_raw, float scale,
+                  const rs::intrinsics &depth_intrin, const rs::intrinsics &color_intrin,
+                  const rs::extrinsics &depth_to_color, const std::vector<rs::float2> &rays,
+                  cv::Mat *color_reg_image, sensor_msgs::PointCloud2 *depth_cloud,
+                  cv::Mat *depth_reg_color_image, sensor_msgs::PointCloud2 *aligned_cloud) {
+    const float bad_point = std::numeric_limits<float>::quiet_NaN();
+    const PackedPointXYZRGB nan_point = {bad_point, bad_point, bad_point, 0.0f, 0, {0, 0, 0}};
+
+    PackedPointXYZRGB *depth_points = depth_cloud ? reinterpret_cast<PackedPointXYZRGB *>(&depth_cloud->data[0]) : NULL;
+    PackedPointXYZRGB *aligned_points = aligned_cloud ? reinterpret_cast<PackedPointXYZRGB *>(&aligned_cloud->data[0]) : NULL;
+
+    // Colour pixel each depth pixel lands on, or -1. Several rows can land on the
+    // same colour pixel, so depth_reg_color_image is filled afterwards in one pass
+    std::vector<int> color_index;
+    if (depth_reg_color_image) {
+        color_index.resize(depth_intrin.width * depth_intrin.height);
+    }
+
+    #pragma omp parallel for schedule(static)
+    for (int dy = 0; dy < depth_intrin.height; ++dy) {
+        const int row = dy * depth_intrin.width;
+        cv::Vec3b *color_reg_row = color_reg_image ? color_reg_image->ptr<cv::Vec3b>(dy) : NULL;
+
+        for (int dx = 0; dx < depth_intrin.width; ++dx) {
+            // Obtain the depth value and apply scale factor
+            const uint16_t depth_value = depth_raw[row + dx];
+
+            // Skip over pixels with a depth value of zero, which is used to indicate no data
+            if (depth_value == 0) {
+                if (color_reg_row) color_reg_row[dx] = cv::Vec3b(0, 0, 0);
+                if (depth_points) depth_points[row + dx] = nan_point;
+                if (aligned_points) aligned_points[row + dx] = nan_point;
+                if (depth_reg_color_image) color_index[row + dx] = -1;
+                continue;
+            }
+
+            // Map from pixel coordinates in the depth image to pixel coordinates in the color image
+            const float depth_in_meters = depth_value * scale;
+            const rs::float2 &ray = rays[row + dx];
+            rs::float3 depth_point = {ray.x * depth_in_meters, ray.y * depth_in_meters, depth_in_meters};
+            rs::float3 color_point = depth_to_color.transform(depth_point);
+            rs::float2 color_pixel = color_intrin.project(color_point);
+
+            // Use the color from the nearest color pixel, ignore this point falls outside the color image
+            const int cx = (int)std::round(color_pixel.x), cy = (int)std::round(color_pixel.y);
+            if (cx < 0 || cy < 0 || cx >= color_intrin.width || cy >= color_intrin.height) {
+                if (color_reg_row) color_reg_row[dx] = cv::Vec3b(0, 0, 0);
+                if (depth_points) depth_points[row + dx] = nan_point;
+                if (aligned_points) aligned_points[row + dx] = nan_point;
+                if (depth_reg_color_image) color_index[row + dx] = -1;
+                continue;
+            }
+
+            // Obtain pointer to current colour pixel
+            const uint8_t *color_ptr = color_raw + (cy * color_intrin.width + cx) * 3;
+            const uint32_t rgb = ((uint32_t)color_ptr[0] << 16) | ((uint32_t)color_ptr[1] << 8) | color_ptr[2];
+
+            if (color_reg_row) {
+                color_reg_row[dx] = cv::Vec3b(color_ptr[0], color_ptr[1], color_ptr[2]);
+            }
+            if (depth_points) {
+                PackedPointXYZRGB &point = depth_points[row + dx];
+                point.x = depth_point.x;
+                point.y = depth_point.y;
+                point.z = depth_point.z;
+                point.rgb = rgb;
+            }
+            if (aligned_points) {
+                PackedPointXYZRGB &point = aligned_points[row + dx];
+                point.x = color_point.x;
+                point.y = color_point.y;
+                point.z = color_point.z;
+                point.rgb = rgb;
+            }
+            if (depth_reg_color_image) {
+                color_index[row + dx] = cy * color_intrin.width + cx;
+            }
+        }
+    }
+
+    if (depth_reg_color_image) {
+        // Pre-fill with 0's to account for pixels that fall outside of depth image sweep
+        depth_reg_color_image->setTo(cv::Scalar::all(0));
+        cv::Vec3b *reg = depth_reg_color_image->ptr<cv::Vec3b>(0);
+        for (size_t i = 0; i < color_index.size(); ++i) {
+            const int c = color_index[i];
+            if (c >= 0) {
+                const uint8_t *color_ptr = color_raw + c * 3;
+                reg[c] = cv::Vec3b(color_ptr[0], color_ptr[1], color_ptr[2]);
+            }
+        }
+    }
+}
+
 void intrinsToCameraInfo(rs::intrinsics &intrins, sensor_msgs::CameraInfo &cam_info) {
 
     cam_info.height = intrins.height;
@@ -198,6 +339,15 @@ int main(int argc, char * argv[]) try
     rs::extrinsics color_to_depth = dev->get_extrinsics(rs::stream::color, rs::stream::depth);
     float scale = dev->get_depth_scale();
 
+    std::vector<rs::float2> depth_rays;
+    build_ray_table(depth_intrin, depth_rays);
+
+    // Buffers reused across frames
+    cv::Mat color_reg_image(depth_intrin.height,depth_intrin.width,CV_8UC3);
+    cv::Mat depth_reg_color_image(color_intrin.height,color_intrin.width,CV_8UC3);
+    CloudBuffers depth_cloud_buffers;
+    CloudBuffers aligned_cloud_buffers;
+
     intrinsToCameraInfo(color_intrin,color_camera_info);
     intrinsToCameraInfo(depth_intrin,depth_camera_info);
     intrinsToCameraInfo(ir_intrin,ir_camera_info);
@@ -231,172 +381,47 @@ int main(int argc, char * argv[]) try
           continue;
         }
         uint8_t * color_raw;
-        const uint16_t *depth_raw;
-
-        cv::Mat color_reg_image(depth_intrin.height,depth_intrin.width,CV_8UC3);
-        PointCloud::Ptr color_reg_depth_cloud(new PointCloud);
-        color_reg_depth_cloud->points.resize(depth_intrin.width * depth_intrin.height);
-        color_reg_depth_cloud->header.frame_id = "world";
-        color_reg_depth_cloud->is_dense = false;
-        color_reg_depth_cloud->height = depth_intrin.height;
-        color_reg_depth_cloud->width = depth_intrin.width;
-
-        cv::Mat depth_reg_color_image(color_intrin.height,color_intrin.width,CV_8UC3);
-        PointCloud::Ptr depth_reg_color_cloud(new PointCloud);
-        depth_reg_color_cloud->points.resize(color_intrin.width * color_intrin.height);
-        depth_reg_color_cloud->header.frame_id = "world";
-        depth_reg_color_cloud->is_dense = false;
-        depth_reg_color_cloud->height = color_intrin.height;
-        depth_reg_color_cloud->width = color_intrin.width;
 
         // get color stream if pointcloud or color image subscribed to
-        if (points_pub.getNumSubscribers() > 0 || color_pub.getNumSubscribers() > 0 || color_reg_depth_pub.getNumSubscribers() > 0) {
+        if (points_pub.getNumSubscribers() > 0 || points_aligned_pub.getNumSubscribers() > 0 ||
+            color_pub.getNumSubscribers() > 0 || color_reg_depth_pub.getNumSubscribers() > 0 ||
+            depth_reg_color_pub.getNumSubscribers() > 0) {
             color_raw = (uint8_t *)dev->get_frame_data(rs::stream::color);
         }
 
-        // only if the pointcloud is subscibed to
-        if (points_pub.getNumSubscribers() > 0 || color_reg_depth_pub.getNumSubscribers() > 0)
-        {
-            depth_raw = (const uint16_t *)dev->get_frame_data(rs::stream::depth);
-
-            // instantiate pcl xyzrgb pointcloud
-
-            for (int dy=0; dy<depth_intrin.height; ++dy){
-
-                for (int dx=0; dx<depth_intrin.width; ++dx){
-
-                    //obtain the depth value and apply scale factor
-                    uint16_t depth_value = depth_raw[dy * depth_intrin.width + dx];
-                    float depth_in_meters = depth_value * scale;
-                    // depth_in_meters = 0.326335990598878*pow(depth_in_meters,3.0) +
-                    //                   0.228008715981488*pow(depth_in_meters,2.0) +
-                    //                   1.026086470601403*depth_in_meters -
-                    //                   0.004441013854035;
-
-                    // Skip over pixels with a depth value of zero, which is used to indicate no data
-                    if(depth_value == 0) {
-                        color_reg_image.at<cv::Vec3b>(cv::Point(dx,dy)) = cv::Vec3b(0,0,0);
-                        continue;
-                    }
-
-                    // Map from pixel coordinates in the depth image to pixel coordinates in the color image
-                    rs::float2 depth_pixel = {(float)dx, (float)dy};
-                    rs::float3 depth_point = depth_intrin.deproject(depth_pixel, depth_in_meters);
-                    rs::float3 color_point = depth_to_color.transform(depth_point);
-                    rs::float2 color_pixel = color_intrin.project(color_point);
-
-                    // Use the color from the nearest color pixel, ignore this point falls outside the color image
-                    const int cx = (int)std::round(color_pixel.x), cy = (int)std::round(color_pixel.y);
-                    if (!(cx < 0 || cy < 0 || cx >= color_intrin.width || cy >= color_intrin.height))
-                    {
-
-                        //obtain pointer to current colour pixel
-                        const uint8_t * color_ptr = color_raw + (cy * color_intrin.width + cx) * 3;
-
-                        // create xyzrgb point
-                        pcl::PointXYZRGB point(*(color_ptr), *(color_ptr+1), *(color_ptr+2));
-                        point.x = depth_point.x;
-                        point.y = depth_point.y;
-                        point.z = depth_point.z;
-
-                        //add point to color_reg_depth_cloud
-                        color_reg_depth_cloud->points[dy * depth_intrin.width + dx] = point;
-                        color_reg_image.at<cv::Vec3b>(cv::Point(dx,dy)) = cv::Vec3b(point.getRGBVector3i()[0],point.getRGBVector3i()[1],point.getRGBVector3i()[2]);
-                    } else {
-                        color_reg_image.at<cv::Vec3b>(cv::Point(dx,dy)) = cv::Vec3b(0,0,0);
-                    }
-                }
-            }
+        // only build the clouds and registered images that are subscribed to
+        sensor_msgs::PointCloud2Ptr depth_cloud;
+        sensor_msgs::PointCloud2Ptr aligned_cloud;
+        if (points_pub.getNumSubscribers() > 0) {
+            depth_cloud = depth_cloud_buffers.acquire(depth_intrin.width, depth_intrin.height);
         }
-
-        // only if the pointcloud aligned or depth reg color is subscibed to
-        if (points_aligned_pub.getNumSubscribers() > 0 || depth_reg_color_pub.getNumSubscribers() > 0)
-        {
-            depth_raw = (const uint16_t *)dev->get_frame_data(rs::stream::depth);
-
-            // instantiate pcl xyzrgb pointcloud
-
-            // Pre-fill image with 0's to account for pixels that fall outside of depth image sweep
-            for (int h=0;h<color_intrin.height;h++) {
-                for (int w=0;w<color_intrin.width;w++) {
-                    depth_reg_color_image.at<cv::Vec3b>(cv::Point(w,h)) = cv::Vec3b(0,0,0);
-                }
-            }
-
-            for (int dy=0; dy<depth_intrin.height; ++dy){
-
-                for (int dx=0; dx<depth_intrin.width; ++dx){
-
-                    // Obtain the depth value and apply scale factor
-                    uint16_t depth_value = depth_raw[dy * depth_intrin.width + dx];
-                    float depth_in_meters = depth_value * scale;
-                    // depth_in_meters = 0.326335990598878*pow(depth_in_meters,3.0) +
-                    //                   0.228008715981488*pow(depth_in_meters,2.0) +
-                    //                   1.026086470601403*depth_in_meters -
-                    //                   0.004441013854035;
-
-                    // Map from pixel coordinates in the depth image to pixel coordinates in the color image
-                    rs::float2 depth_pixel = {(float)dx, (float)dy};
-                    rs::float3 depth_point = depth_intrin.deproject(depth_pixel, depth_in_meters);
-                    rs::float3 color_point = depth_to_color.transform(depth_point);
-                    rs::float2 color_pixel = color_intrin.project(color_point);
-
-                    // Use the color from the nearest color pixel, ignore this point falls outside the color image
-                    const int cx = (int)std::round(color_pixel.x), cy = (int)std::round(color_pixel.y);
-                    if (!(cx < 0 || cy < 0 || cx >= color_intrin.width || cy >= color_intrin.height))
-                    {
-                        // Obtain pointer to current colour pixel
-                        const uint8_t * color_ptr = color_raw + (cy * color_intrin.width + cx) * 3;
-
-                        // Create xyzrgb point
-                        pcl::PointXYZRGB point(*(color_ptr), *(color_ptr+1), *(color_ptr+2));
-                        point.x = color_point.x;
-                        point.y = color_point.y;
-                        point.z = color_point.z;
-
-                        // Add point to depth_reg_color_cloud
-                        depth_reg_color_cloud->points[dy * depth_intrin.width + dx] = point;
-
-                        if (depth_value == 0) {
-                            depth_reg_color_image.at<cv::Vec3b>(cv::Point(cx,cy)) = cv::Vec3b(0,0,0);
-                        } else {
-                            depth_reg_color_image.at<cv::Vec3b>(cv::Point(cx,cy)) = cv::Vec3b(point.getRGBVector3i()[0],point.getRGBVector3i()[1],point.getRGBVector3i()[2]);
-                        }
-                    }
-                }
-            }
+        if (points_aligned_pub.getNumSubscribers() > 0) {
+            aligned_cloud = aligned_cloud_buffers.acquire(depth_intrin.width, depth_intrin.height);
+        }
+        bool want_color_reg = color_reg_depth_pub.getNumSubscribers() > 0;
+        bool want_depth_reg = depth_reg_color_pub.getNumSubscribers() > 0;
+
+        if (depth_cloud || aligned_cloud || want_color_reg || want_depth_reg) {
+            const uint16_t *depth_raw = (const uint16_t *)dev->get_frame_data(rs::stream::depth);
+            build_clouds(depth_raw, color_raw, scale, depth_intrin, color_intrin, depth_to_color, depth_rays,
+                         want_color_reg ? &color_reg_image : NULL, depth_cloud.get(),
+                         want_depth_reg ? &depth_reg_color_image : NULL, aligned_cloud.get());
         }
 
         // only if the pointcloud is subscibed to
-        if (points_pub.getNumSubscribers() > 0)
+        if (depth_cloud)
         {
-            // test if color_reg_depth_cloud empty
-            if ((*color_reg_depth_cloud).points.size() != 0) {
-                //convert pcl pointcloud to sensor_msgs pointcloud2, publish
-                pcl::PCLPointCloud2 pcl_xyz_pc2;
-                pcl::toPCLPointCloud2 (*color_reg_depth_cloud, pcl_xyz_pc2);
-                sensor_msgs::PointCloud2 realsense_xyz_cloud2;
-                pcl_conversions::moveFromPCL(pcl_xyz_pc2, realsense_xyz_cloud2);
-                realsense_xyz_cloud2.header.stamp = ros::Time::now();
-                realsense_xyz_cloud2.header.frame_id = "/" + camera_name + "_depth_optical_frame";
-                points_pub.publish(realsense_xyz_cloud2);
-            }
+            depth_cloud->header.stamp = ros::Time::now();
+            depth_cloud->header.frame_id = "/" + camera_name + "_depth_optical_frame";
+            points_pub.publish(depth_cloud);
         }
 
         // only if the pointcloud aligned is subscibed to
-        if (points_aligned_pub.getNumSubscribers() > 0)
+        if (aligned_cloud)
         {
-            // test if color_reg_depth_cloud empty
-            if ((*depth_reg_color_cloud).points.size() != 0) {
-                //convert pcl pointcloud to sensor_msgs pointcloud2, publish
-                pcl::PCLPointCloud2 pcl_xyz_pc2;
-                pcl::toPCLPointCloud2 (*depth_reg_color_cloud, pcl_xyz_pc2);
-                sensor_msgs::PointCloud2 realsense_xyz_cloud2;
-                pcl_conversions::moveFromPCL(pcl_xyz_pc2, realsense_xyz_cloud2);
-                realsense_xyz_cloud2.header.stamp = ros::Time::now();
-                realsense_xyz_cloud2.header.frame_id = "/" + camera_name + "_rgb_optical_frame";
-                points_aligned_pub.publish(realsense_xyz_cloud2);
-            }
+            aligned_cloud->header.stamp = ros::Time::now();
+            aligned_cloud->header.frame_id = "/" + camera_name + "_rgb_optical_frame";
+            points_aligned_pub.publish(aligned_cloud);
         }
 
         // only if the depth image topic is subscribed to
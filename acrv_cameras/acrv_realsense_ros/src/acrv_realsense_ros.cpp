@@ -11,10 +11,11 @@
 #include <camera_info_manager/camera_info_manager.h>
 #include <math.h>
 #include <std_srvs/SetBool.h>
+#include <acrv_realsense_ros/FrameNumber.h>
 #include <thread>
 #include "yaml-cpp/yaml.h"
 
-ros::Publisher color_hd_pub, color_pub, color_info_pub, ir_pub, depth_pub, color_hd_info_pub, ir_info_pub, depth_info_pub;
+ros::Publisher color_hd_pub, color_pub, color_info_pub, ir_pub, depth_pub, color_hd_info_pub, ir_info_pub, depth_info_pub, depth_frame_number_pub;
 sensor_msgs::CameraInfo rgb_hd_camera_info, rgb_camera_info, ir_camera_info, depth_camera_info;
 rs::device * dev;
 
@@ -80,6 +81,14 @@ int main(int argc, char * argv[]) try {
     n.param<bool>("rotate_image_180", rotate_image_180, false);
     ROS_INFO_STREAM("\"rotate_image_180\" = " << rotate_image_180);
 
+    // Per-frame latency trace of the capture, unpack, sync and publish stages, written as Chrome trace JSON on shutdown
+    std::string trace_file;
+    n.param<std::string>("trace_file", trace_file, "");
+    if (!trace_file.empty()) {
+        ROS_INFO_STREAM("Tracing frame latency to " << trace_file);
+        rs::start_tracing();
+    }
+
     bool is_serial_number_provided = false;
     std::string serial_number;
     if (n.getParam("serial_number", serial_number)) {
@@ -152,6 +161,7 @@ int main(int argc, char * argv[]) try {
     color_info_pub = n.advertise < sensor_msgs::CameraInfo > ("/" + camera_name + "/rgb/camera_info", 1);
     depth_info_pub = n.advertise < sensor_msgs::CameraInfo > ("/" + camera_name + "/depth/camera_info", 1);
     ir_info_pub = n.advertise < sensor_msgs::CameraInfo > ("/" + camera_name + "/ir/camera_info", 1);
+    depth_frame_number_pub = n.advertise < acrv_realsense_ros::FrameNumber > ("/" + camera_name + "/depth/frame_number", 5);
 
     rs::intrinsics depth_intrin = dev->get_stream_intrinsics(rs::stream::depth);
     rs::intrinsics color_intrin = dev->get_stream_intrinsics(rs::stream::color);
@@ -206,7 +216,9 @@ int main(int argc, char * argv[]) try {
                     }
                 }
             }
+            double wait_begin = rs::get_trace_time();
             dev->wait_for_frames();
+            rs::trace_event("wait_for_frames", wait_begin, rs::get_trace_time());
         } else {
             ros::spinOnce();
             r.sleep();
@@ -216,6 +228,8 @@ int main(int argc, char * argv[]) try {
         ros::Time timeNow = ros::Time::now();
 
         if (depth_pub.getNumSubscribers() > 0 || depth_info_pub.getNumSubscribers() > 0) {
+            unsigned long long depth_frame_number = dev->get_frame_number(rs::stream::depth);
+            rs::trace_scope publish_span("publish depth", rs::stream::depth, depth_frame_number);
             uint16_t *depth_raw = (uint16_t *)dev->get_frame_data(rs::stream::depth);
             cv::Mat depth_image_raw(depth_intrin.height,depth_intrin.width,CV_16UC1,depth_raw, cv::Mat::AUTO_STEP);
             cv::Mat depth_image(depth_intrin.height,depth_intrin.width,CV_16UC1);
@@ -238,11 +252,19 @@ int main(int argc, char * argv[]) try {
             depthImage->header.frame_id = camera_name + "_depth_optical_frame";
             depth_camera_info.header.stamp = timeNow;
             depth_camera_info.header.frame_id = camera_name + "_depth_optical_frame";
+
+            // Lets register_depth trace the frame it registers, it looks the frame number up by the image stamp
+            acrv_realsense_ros::FrameNumber depth_frame_number_msg;
+            depth_frame_number_msg.header = depthImage->header;
+            depth_frame_number_msg.frame_number = depth_frame_number;
+            depth_frame_number_pub.publish(depth_frame_number_msg);
+
             depth_info_pub.publish(depth_camera_info);
             depth_pub.publish(*depthImage);
         }
 
         if (color_hd_pub.getNumSubscribers() > 0 || color_hd_info_pub.getNumSubscribers() > 0) {
+            rs::trace_scope publish_span("publish color_hd", rs::stream::color, dev->get_frame_number(rs::stream::color));
             uint8_t * color_raw = (uint8_t *)dev->get_frame_data(rs::stream::color);
             cv::Mat color_image(color_intrin.height,color_intrin.width,CV_8UC3,color_raw, cv::Mat::AUTO_STEP);
 
@@ -261,6 +283,7 @@ int main(int argc, char * argv[]) try {
         }
 
         if (color_pub.getNumSubscribers() > 0 || color_info_pub.getNumSubscribers() > 0) {
+            rs::trace_scope publish_span("publish color", rs::stream::color, dev->get_frame_number(rs::stream::color));
             uint8_t * color_raw = (uint8_t *)dev->get_frame_data(rs::stream::color);
             cv::Mat color_hd_image(color_intrin.height,color_intrin.width,CV_8UC3,color_raw, cv::Mat::AUTO_STEP);
             cv::Mat color_image;
@@ -281,6 +304,7 @@ int main(int argc, char * argv[]) try {
         }
 
         if (ir_pub.getNumSubscribers() > 0 || ir_info_pub.getNumSubscribers() > 0) {
+            rs::trace_scope publish_span("publish ir", rs::stream::infrared, dev->get_frame_number(rs::stream::infrared));
             uint16_t * ir_raw = (uint16_t *)dev->get_frame_data(rs::stream::infrared);
             cv::Mat ir_image(ir_intrin.height,ir_intrin.width,CV_16UC1,ir_raw, cv::Mat::AUTO_STEP);
 
@@ -301,6 +325,10 @@ int main(int argc, char * argv[]) try {
         ros::spinOnce();
         r.sleep();
     }
+
+    if (!trace_file.empty()) {
+        rs::stop_tracing(trace_file.c_str());
+    }
 } catch(const rs::error & e) {  // If there is an error calling rs function
     std::cerr << "RealSense error calling " << e.get_failed_function() << "(" << e.get_failed_args() << "):\n    " << e.what() << std::endl;
     return EXIT_FAILURE;
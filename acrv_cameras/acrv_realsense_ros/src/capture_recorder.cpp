@@ -0,0 +1,285 @@
+/*
+Copyright 2017 Australian Centre for Robotic Vision
+*/
+
+#include <acrv_realsense_ros/capture_recorder.h>
+
+#include <ros/ros.h>
+#include <ros/serialization.h>
+#include <camera_calibration_parsers/parse.h>
+#include <opencv2/highgui/highgui.hpp>
+#include <pcl/io/pcd_io.h>
+#include <pcl_conversions/pcl_conversions.h>
+#include <boost/filesystem.hpp>
+
+#include <algorithm>
+#include <cctype>
+#include <cstdio>
+
+namespace acrv_realsense_ros {
+
+std::vector<int> fast_png_params() {
+    std::vector<int> params;
+    params.push_back(cv::IMWRITE_PNG_COMPRESSION);
+    params.push_back(1);
+    return params;
+}
+
+std::string escape_index_name(const std::string &name) {
+    std::string escaped;
+    escaped.reserve(name.size());
+    for (std::size_t i = 0; i < name.size(); ++i) {
+        unsigned char c = name[i];
+        if (c == '%' || std::isspace(c)) {
+            char hex[4];
+            std::snprintf(hex, sizeof(hex), "%%%02X", c);
+            escaped += hex;
+        } else {
+            escaped += name[i];
+        }
+    }
+    return escaped;
+}
+
+template <class M>
+static std::vector<uint8_t> serialize_message(const M &msg) {
+    std::vector<uint8_t> buffer(ros::serialization::serializationLength(msg));
+    ros::serialization::OStream stream(buffer.data(), buffer.size());
+    ros::serialization::serialize(stream, msg);
+    return buffer;
+}
+
+/*
+AsyncWriter
+*/
+
+AsyncWriter::AsyncWriter(std::size_t num_threads, std::size_t max_queue_size, OverflowPolicy policy)
+    : max_queue_size_(std::max<std::size_t>(max_queue_size, 1)), policy_(policy),
+      running_(0), stopping_(false), written_(0), failed_(0), dropped_(0) {
+    num_threads = std::max<std::size_t>(num_threads, 1);
+    for (std::size_t i = 0; i < num_threads; ++i) {
+        threads_.push_back(std::thread(&AsyncWriter::worker, this));
+    }
+}
+
+AsyncWriter::~AsyncWriter() {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stopping_ = true;
+    }
+    job_available_.notify_all();
+    space_available_.notify_all();
+    for (std::size_t i = 0; i < threads_.size(); ++i) {
+        threads_[i].join();
+    }
+}
+
+bool AsyncWriter::submit(std::function<bool()> job) {
+    std::unique_lock<std::mutex> lock(mutex_);
+    if (jobs_.size() >= max_queue_size_) {
+        if (policy_ == DROP_NEWEST) {
+            ++dropped_;
+            return false;
+        }
+        space_available_.wait(lock, [this] { return jobs_.size() < max_queue_size_ || stopping_; });
+        if (stopping_) {
+            ++dropped_;
+            return false;
+        }
+    }
+    jobs_.push_back(std::move(job));
+    lock.unlock();
+    job_available_.notify_one();
+    return true;
+}
+
+void AsyncWriter::flush() {
+    std::unique_lock<std::mutex> lock(mutex_);
+    space_available_.wait(lock, [this] { return jobs_.empty() && running_ == 0; });
+}
+
+std::size_t AsyncWriter::queue_depth() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return jobs_.size();
+}
+
+void AsyncWriter::worker() {
+    std::unique_lock<std::mutex> lock(mutex_);
+    while (true) {
+        job_available_.wait(lock, [this] { return !jobs_.empty() || stopping_; });
+        // Drain the queue before stopping so nothing recorded is lost
+        if (jobs_.empty()) {
+            return;
+        }
+        std::function<bool()> job = std::move(jobs_.front());
+        jobs_.pop_front();
+        ++running_;
+        lock.unlock();
+
+        bool success = false;
+        try {
+            success = job();
+        } catch (const std::exception &e) {
+            ROS_ERROR_STREAM("Writer job failed: " << e.what());
+        }
+        if (success) {
+            ++written_;
+        } else {
+            ++failed_;
+        }
+
+        lock.lock();
+        --running_;
+        space_available_.notify_all();
+    }
+}
+
+/*
+CaptureContainer
+*/
+
+const uint32_t CaptureContainer::MAGIC;
+
+CaptureContainer::CaptureContainer(const std::string &path)
+    : data_(path.c_str(), std::ios::binary | std::ios::app),
+      index_((path + ".idx").c_str(), std::ios::app) {
+}
+
+template <class T>
+static void write_pod(std::ofstream &stream, const T &value) {
+    stream.write(reinterpret_cast<const char *>(&value), sizeof(T));
+}
+
+bool CaptureContainer::append(const std::string &capture, const std::string &stream, RecordKind kind,
+                              const ros::Time &stamp, const std::vector<uint8_t> &payload) {
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    write_pod(data_, MAGIC);
+    write_pod(data_, static_cast<uint8_t>(kind));
+    write_pod(data_, static_cast<int64_t>(stamp.toNSec()));
+    write_pod(data_, static_cast<uint32_t>(capture.size()));
+    write_pod(data_, static_cast<uint32_t>(stream.size()));
+    write_pod(data_, static_cast<uint64_t>(payload.size()));
+    data_.write(capture.data(), capture.size());
+    data_.write(stream.data(), stream.size());
+    uint64_t offset = data_.tellp();
+    data_.write(reinterpret_cast<const char *>(payload.data()), payload.size());
+    data_.flush();
+    if (!data_) {
+        return false;
+    }
+
+    index_ << escape_index_name(capture) << " " << escape_index_name(stream) << " " << static_cast<int>(kind) << " " << stamp.toNSec() << " "
+           << offset << " " << payload.size() << "\n";
+    index_.flush();
+    return static_cast<bool>(index_);
+}
+
+/*
+CaptureRecorder
+*/
+
+CaptureRecorder::CaptureRecorder(std::size_t num_threads, std::size_t max_queue_size,
+                                 AsyncWriter::OverflowPolicy policy, const std::string &container_path)
+    : writer_(num_threads, max_queue_size, policy) {
+    if (!container_path.empty()) {
+        boost::filesystem::path parent = boost::filesystem::path(container_path).parent_path();
+        if (!parent.empty()) {
+            boost::filesystem::create_directories(parent);
+        }
+        container_.reset(new CaptureContainer(container_path));
+        if (!container_->is_open()) {
+            ROS_ERROR_STREAM("Could not open capture container " << container_path << ", recording into folders");
+            container_.reset();
+        }
+    }
+}
+
+bool CaptureRecorder::ensure_folder(const std::string &capture) {
+    std::lock_guard<std::mutex> lock(folders_mutex_);
+    if (std::find(created_folders_.begin(), created_folders_.end(), capture) != created_folders_.end()) {
+        return true;
+    }
+    boost::system::error_code error;
+    boost::filesystem::create_directories(capture, error);
+    if (error) {
+        ROS_ERROR_STREAM("Error creating directory " << capture << ": " << error.message());
+        return false;
+    }
+    created_folders_.push_back(capture);
+    return true;
+}
+
+bool CaptureRecorder::record_image(const std::string &capture, const std::string &stream, const cv::Mat &image,
+                                   const ros::Time &stamp) {
+    // The caller may reuse its buffer as soon as we return
+    return record_image(capture, stream, image.clone(), stamp);
+}
+
+bool CaptureRecorder::record_image(const std::string &capture, const std::string &stream, cv::Mat &&image,
+                                   const ros::Time &stamp) {
+    cv::Mat owned = std::move(image);
+
+    if (container_) {
+        CaptureContainer *container = container_.get();
+        return writer_.submit([container, capture, stream, owned, stamp]() {
+            std::vector<uint8_t> payload;
+            if (!cv::imencode(".png", owned, payload, fast_png_params())) {
+                return false;
+            }
+            return container->append(capture, stream, CaptureContainer::IMAGE_PNG, stamp, payload);
+        });
+    }
+
+    if (!ensure_folder(capture)) {
+        return false;
+    }
+    std::string path = (boost::filesystem::path(capture) / (stream + ".png")).string();
+    return writer_.submit([path, owned]() {
+        return cv::imwrite(path, owned, fast_png_params());
+    });
+}
+
+bool CaptureRecorder::record_cloud(const std::string &capture, const std::string &stream,
+                                   const sensor_msgs::PointCloud2ConstPtr &cloud) {
+    if (container_) {
+        CaptureContainer *container = container_.get();
+        return writer_.submit([container, capture, stream, cloud]() {
+            return container->append(capture, stream, CaptureContainer::POINT_CLOUD2, cloud->header.stamp,
+                                     serialize_message(*cloud));
+        });
+    }
+
+    if (!ensure_folder(capture)) {
+        return false;
+    }
+    std::string path = (boost::filesystem::path(capture) / (stream + ".pcd")).string();
+    return writer_.submit([path, cloud]() {
+        // Writing the PCLPointCloud2 directly keeps every field of the message
+        pcl::PCLPointCloud2 pcl_cloud;
+        pcl_conversions::toPCL(*cloud, pcl_cloud);
+        pcl::PCDWriter writer;
+        return writer.writeBinary(path, pcl_cloud) == 0;
+    });
+}
+
+bool CaptureRecorder::record_camera_info(const std::string &capture, const std::string &stream,
+                                         const sensor_msgs::CameraInfo &camera_info) {
+    if (container_) {
+        CaptureContainer *container = container_.get();
+        return writer_.submit([container, capture, stream, camera_info]() {
+            return container->append(capture, stream, CaptureContainer::CAMERA_INFO, camera_info.header.stamp,
+                                     serialize_message(camera_info));
+        });
+    }
+
+    if (!ensure_folder(capture)) {
+        return false;
+    }
+    std::string path = (boost::filesystem::path(capture) / (stream + "_camera_info.yaml")).string();
+    return writer_.submit([path, stream, camera_info]() {
+        return camera_calibration_parsers::writeCalibration(path, stream, camera_info);
+    });
+}
+
+}  // namespace acrv_realsense_ros
@@ -0,0 +1,323 @@
+/*
+Copyright 2017 Australian Centre for Robotic Vision
+*/
+
+#include <acrv_realsense_ros/capture_replay.h>
+
+#include <ros/ros.h>
+#include <opencv2/imgproc/imgproc.hpp>
+#include <opencv2/highgui/highgui.hpp>
+#include <boost/filesystem.hpp>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <functional>
+#include <sstream>
+
+namespace acrv_realsense_ros {
+
+namespace {
+
+const uint32_t CACHE_MAGIC = 0x50455241;  // "AREP" little-endian
+const uint32_t CACHE_VERSION = 1;
+const std::size_t CACHE_ALIGNMENT = 4096;
+const int NUM_CACHED_FRAMES = 4;
+
+const char *SOURCE_FILES[3] = {"color.png", "ir.png", "depth.png"};
+
+struct CachedFrame {
+    int32_t rows;
+    int32_t cols;
+    int32_t type;
+    uint64_t offset;
+};
+
+struct CacheHeader {
+    uint32_t magic;
+    uint32_t version;
+    int64_t source_mtimes[3];
+    int32_t depth_encoding;
+    CachedFrame frames[NUM_CACHED_FRAMES];  // color_hd, color, ir, depth
+};
+
+std::size_t align_up(std::size_t value) {
+    return (value + CACHE_ALIGNMENT - 1) / CACHE_ALIGNMENT * CACHE_ALIGNMENT;
+}
+
+bool source_mtimes(const std::string &folder, int64_t mtimes[3]) {
+    for (int i = 0; i < 3; ++i) {
+        struct stat info;
+        if (stat((boost::filesystem::path(folder) / SOURCE_FILES[i]).string().c_str(), &info) != 0) {
+            return false;
+        }
+        mtimes[i] = static_cast<int64_t>(info.st_mtime);
+    }
+    return true;
+}
+
+}  // namespace
+
+DepthEncoding depth_encoding_from_string(const std::string &name) {
+    if (name == "mm") {
+        return DEPTH_MILLIMETRES;
+    }
+    if (name == "scaled") {
+        return DEPTH_SCALED;
+    }
+    return DEPTH_AUTO;
+}
+
+void from_16UC1_scaled_to_16UC1_mm(const cv::Mat &input_uint16, cv::Mat &output_uint16) {
+    cv::Mat temp_float64(input_uint16.size().height, input_uint16.size().width, CV_64FC1);
+    input_uint16.convertTo(temp_float64, CV_64FC1);
+    temp_float64 *= 2.0/65536.0;  // reverse the scaling to get depth in metres
+    temp_float64 *= 1000.0; // convert from m to mm
+    temp_float64.convertTo(output_uint16, CV_16UC1);
+}
+
+void from_8UC1_to_16UC1(const cv::Mat &input_uint8, cv::Mat &output_uint16) {
+    cv::Mat temp_float64(input_uint8.size().height, input_uint8.size().width, CV_64FC1);
+    input_uint8.convertTo(temp_float64, CV_64FC1);
+    temp_float64 /= 256.0;  // scale down to 0-1
+    temp_float64 *= 65536.0;  // scale up to fill uint16
+    temp_float64.convertTo(output_uint16, CV_16UC1);
+}
+
+MappedCapture::~MappedCapture() {
+    if (data_) {
+        munmap(data_, size_);
+    }
+}
+
+CaptureReplay::CaptureReplay(const std::string &cache_dir, DepthEncoding depth_encoding,
+                             std::size_t max_mapped_captures)
+    : cache_dir_(cache_dir), depth_encoding_(depth_encoding),
+      max_mapped_captures_(std::max<std::size_t>(max_mapped_captures, 1)) {
+    boost::filesystem::create_directories(cache_dir_);
+}
+
+std::size_t CaptureReplay::index(const std::string &root) {
+    captures_.clear();
+    boost::system::error_code error;
+    for (boost::filesystem::recursive_directory_iterator it(root, error), end; it != end; it.increment(error)) {
+        if (error) {
+            ROS_WARN_STREAM("Skipping unreadable path below " << root << ": " << error.message());
+            continue;
+        }
+        if (!boost::filesystem::is_directory(it->status())) {
+            continue;
+        }
+        const boost::filesystem::path &folder = it->path();
+        bool complete = true;
+        for (int i = 0; i < 3; ++i) {
+            complete = complete && boost::filesystem::exists(folder / SOURCE_FILES[i]);
+        }
+        if (complete) {
+            captures_.push_back(folder.string() + "/");
+        }
+    }
+    // The root itself may be a capture
+    bool root_complete = true;
+    for (int i = 0; i < 3; ++i) {
+        root_complete = root_complete && boost::filesystem::exists(boost::filesystem::path(root) / SOURCE_FILES[i]);
+    }
+    if (root_complete) {
+        captures_.push_back(boost::filesystem::path(root).string() + "/");
+    }
+    std::sort(captures_.begin(), captures_.end());
+    return captures_.size();
+}
+
+std::string CaptureReplay::cache_path(const std::string &folder) const {
+    std::string canonical = folder;
+    boost::system::error_code error;
+    boost::filesystem::path resolved = boost::filesystem::canonical(folder, error);
+    if (!error) {
+        canonical = resolved.string();
+    }
+    std::stringstream name;
+    name << std::hex << std::hash<std::string>()(canonical) << ".rawcap";
+    return (boost::filesystem::path(cache_dir_) / name.str()).string();
+}
+
+bool CaptureReplay::build_cache(const std::string &folder, const std::string &path) {
+    int64_t mtimes[3];
+    if (!source_mtimes(folder, mtimes)) {
+        return false;
+    }
+
+    // Load raw-hd-color, raw-ir and raw-scaled-depth images
+    cv::Mat color_hd_bgr = cv::imread(folder + "color.png", CV_LOAD_IMAGE_COLOR);
+    cv::Mat ir_raw = cv::imread(folder + "ir.png", CV_LOAD_IMAGE_ANYDEPTH);
+    cv::Mat depth_raw = cv::imread(folder + "depth.png", CV_LOAD_IMAGE_ANYDEPTH);
+    if (color_hd_bgr.empty() || ir_raw.empty() || depth_raw.empty()) {
+        return false;
+    }
+
+    cv::Mat frames[NUM_CACHED_FRAMES];
+    cv::cvtColor(color_hd_bgr, frames[0], CV_BGR2RGB);
+    // Create SD color image from HD color image
+    cv::resize(frames[0], frames[1], cv::Size(640,360), cv::INTER_CUBIC);
+    if (ir_raw.depth() == CV_8U) {
+        from_8UC1_to_16UC1(ir_raw, frames[2]);
+    } else {
+        frames[2] = ir_raw;
+    }
+
+    DepthEncoding encoding = depth_encoding_;
+    if (encoding == DEPTH_AUTO) {
+        // Older captures were saved unscaled, newer ones scaled. An unscaled
+        // example had max depth of 786, a scaled one 25854.
+        double min, max;
+        cv::minMaxIdx(depth_raw, &min, &max);
+        encoding = max < 10000.0 ? DEPTH_MILLIMETRES : DEPTH_SCALED;
+    }
+    if (encoding == DEPTH_SCALED) {
+        from_16UC1_scaled_to_16UC1_mm(depth_raw, frames[3]);
+    } else {
+        frames[3] = depth_raw;
+    }
+
+    CacheHeader header;
+    std::memset(&header, 0, sizeof(header));
+    header.magic = CACHE_MAGIC;
+    header.version = CACHE_VERSION;
+    std::copy(mtimes, mtimes + 3, header.source_mtimes);
+    header.depth_encoding = depth_encoding_;
+    std::size_t offset = align_up(sizeof(header));
+    for (int i = 0; i < NUM_CACHED_FRAMES; ++i) {
+        header.frames[i].rows = frames[i].rows;
+        header.frames[i].cols = frames[i].cols;
+        header.frames[i].type = frames[i].type();
+        header.frames[i].offset = offset;
+        offset = align_up(offset + frames[i].total() * frames[i].elemSize());
+    }
+
+    // Write to a temporary file and rename so readers never see a partial
+    // cache. The name is per process as several may share cache_dir.
+    std::stringstream tmp_name;
+    tmp_name << path << ".tmp." << getpid();
+    std::string tmp_path = tmp_name.str();
+    std::ofstream file(tmp_path.c_str(), std::ios::binary | std::ios::trunc);
+    file.write(reinterpret_cast<const char *>(&header), sizeof(header));
+    for (int i = 0; i < NUM_CACHED_FRAMES; ++i) {
+        file.seekp(header.frames[i].offset);
+        cv::Mat continuous = frames[i].isContinuous() ? frames[i] : frames[i].clone();
+        file.write(reinterpret_cast<const char *>(continuous.data), continuous.total() * continuous.elemSize());
+    }
+    file.close();
+    if (!file || std::rename(tmp_path.c_str(), path.c_str()) != 0) {
+        std::remove(tmp_path.c_str());
+        return false;
+    }
+    return true;
+}
+
+MappedCaptureConstPtr CaptureReplay::map_cache(const std::string &folder, const std::string &path) {
+    int fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+        return MappedCaptureConstPtr();
+    }
+    struct stat info;
+    if (fstat(fd, &info) != 0 || static_cast<std::size_t>(info.st_size) < sizeof(CacheHeader)) {
+        close(fd);
+        return MappedCaptureConstPtr();
+    }
+    void *data = mmap(NULL, info.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (data == MAP_FAILED) {
+        return MappedCaptureConstPtr();
+    }
+
+    std::shared_ptr<MappedCapture> capture(new MappedCapture);
+    capture->data_ = data;
+    capture->size_ = info.st_size;
+
+    // Validate the header against the source images and requested encoding
+    const CacheHeader &header = *static_cast<const CacheHeader *>(data);
+    int64_t mtimes[3];
+    if (header.magic != CACHE_MAGIC || header.version != CACHE_VERSION ||
+        header.depth_encoding != depth_encoding_ ||
+        (source_mtimes(folder, mtimes) && !std::equal(mtimes, mtimes + 3, header.source_mtimes))) {
+        return MappedCaptureConstPtr();
+    }
+
+    cv::Mat *views[NUM_CACHED_FRAMES] = {&capture->color_hd, &capture->color, &capture->ir, &capture->depth};
+    for (int i = 0; i < NUM_CACHED_FRAMES; ++i) {
+        const CachedFrame &frame = header.frames[i];
+        cv::Mat view(frame.rows, frame.cols, frame.type, static_cast<uint8_t *>(data) + frame.offset);
+        if (frame.offset + view.total() * view.elemSize() > capture->size_) {
+            return MappedCaptureConstPtr();
+        }
+        *views[i] = view;
+    }
+    return capture;
+}
+
+MappedCaptureConstPtr CaptureReplay::load(const std::string &folder) {
+    std::unique_lock<std::mutex> lock(mutex_);
+
+    // Wait for another thread already loading this capture rather than
+    // decoding it twice
+    while (true) {
+        for (std::list<std::pair<std::string, MappedCaptureConstPtr>>::iterator it = mapped_.begin();
+             it != mapped_.end(); ++it) {
+            if (it->first == folder) {
+                mapped_.splice(mapped_.begin(), mapped_, it);
+                return it->second;
+            }
+        }
+        if (loading_.count(folder) == 0) {
+            break;
+        }
+        loaded_.wait(lock);
+    }
+    loading_.insert(folder);
+    lock.unlock();
+
+    // Map or decode without holding the lock, so other captures can be
+    // served meanwhile
+    std::string path = cache_path(folder);
+    MappedCaptureConstPtr capture;
+    try {
+        capture = map_cache(folder, path);
+        if (!capture && build_cache(folder, path)) {
+            capture = map_cache(folder, path);
+        }
+    } catch (const std::exception &e) {
+        ROS_ERROR_STREAM("Exception loading capture " << folder << ": " << e.what());
+        capture.reset();
+    }
+    if (!capture) {
+        ROS_ERROR_STREAM("Could not load capture " << folder);
+    }
+
+    lock.lock();
+    loading_.erase(folder);
+    if (capture) {
+        mapped_.push_front(std::make_pair(folder, capture));
+        if (mapped_.size() > max_mapped_captures_) {
+            mapped_.pop_back();
+        }
+    }
+    lock.unlock();
+    loaded_.notify_all();
+    return capture;
+}
+
+void CaptureReplay::prefetch(const std::string &folder) {
+    MappedCaptureConstPtr capture = load(folder);
+    if (capture) {
+        madvise(capture->data_, capture->size_, MADV_WILLNEED);
+    }
+}
+
+}  // namespace acrv_realsense_ros
@@ -17,6 +17,14 @@
 #include <pcl/io/pcd_io.h>
 #include <pcl/point_types.h>
 
+#include <acrv_realsense_ros/capture_recorder.h>
+#include <acrv_realsense_ros/capture_replay.h>
+
+#include <algorithm>
+#include <atomic>
+#include <future>
+#include <utility>
+
 
 /*
 NOTE
@@ -42,6 +50,14 @@ sensor_msgs::CameraInfo ir_camera_info;
 std::string read_folder_path;
 std::string save_folder_path;
 
+// Encodes and writes the regenerated streams off the callback threads
+std::unique_ptr<acrv_realsense_ros::CaptureRecorder> recorder;
+
+// Indexes captures and serves decoded frames from a memory-mapped cache
+std::unique_ptr<acrv_realsense_ros::CaptureReplay> replay;
+std::thread replay_thread;
+std::atomic<bool> replay_running(false);
+
 
 // cv::Mat to sensor_msgs::Image
 sensor_msgs::ImagePtr cv_mat_to_sensor_msgs_image(cv::Mat &image, std::string encoding, std::string frame) {
@@ -136,15 +152,6 @@ void from_16UC1_mm_to_16UC1_scaled(cv::Mat& input_uint16, cv::Mat& output_uint16
     temp_float64.convertTo(output_uint16, CV_16UC1);
 }
 
-void from_16UC1_scaled_to_16UC1_mm(cv::Mat& input_uint16, cv::Mat& output_uint16) {
-    // Convert the uint16 save format to a float32 depth in metres format ros likes
-    cv::Mat temp_float64(input_uint16.size().height, input_uint16.size().width, CV_64FC1);
-    input_uint16.convertTo(temp_float64, CV_64FC1);
-    temp_float64 *= 2.0/65536.0;  // reverse the scaling to get depth in metres
-    temp_float64 *= 1000.0; // convert from m to mm
-    temp_float64.convertTo(output_uint16, CV_16UC1);
-}
-
 void from_32FC1_m_to_16UC1_scaled(cv::Mat& input_float32, cv::Mat& output_uint16) {
     // Convert a float32 deoth in metres format to the uint16 save format
     cv::Mat temp_float64(input_float32.size().height, input_float32.size().width, CV_64FC1);
@@ -153,81 +160,14 @@ void from_32FC1_m_to_16UC1_scaled(cv::Mat& input_float32, cv::Mat& output_uint16
     temp_float64.convertTo(output_uint16, CV_16UC1);
 }
 
-void from_8UC1_to_16UC1(cv::Mat& input_uint8, cv::Mat& output_uint16) {
-    // Convert a uint8 format to uint16 format
-    cv::Mat temp_float64(input_uint8.size().height, input_uint8.size().width, CV_64FC1);
-    input_uint8.convertTo(temp_float64, CV_64FC1);
-    temp_float64 /= 256.0;  // scale down to 0-1
-    temp_float64 *= 65536.0;  // scale up to fill uint16
-    temp_float64.convertTo(output_uint16, CV_16UC1);
-}
-
-bool publish_raw_data_once_service(std_srvs::Trigger::Request &req,
-                                   std_srvs::Trigger::Response &res) {
-    ROS_INFO_STREAM("Service has been called...");
-    ROS_INFO_STREAM("/data_regeneration_server_node/read_folder_path = " << read_folder_path);
-    ROS_INFO_STREAM("/data_regeneration_server_node/save_folder_path = " << save_folder_path);
-
-    // Create a folder for saving the new images
-    // Ensure the stringstream is properly cleared - see: http://stackoverflow.com/questions/2848087/how-to-clear-stringstream
-    // save_folder_path.str(std::string());
-    // save_folder_path.clear();
-    // save_folder_path << "../data/img_" <<  std::setfill('0') << std::setw(5) << save_image_number;
-    // const int dir_err = system(("mkdir -p " + save_folder_path).c_str());
-    const int dir_err = system(("mkdir -p " + save_folder_path).c_str());
-    if (-1 == dir_err) {
-        printf("Error creating directory!\n");
-        exit(1);
-    }
-
-    // Load raw-hd-color, raw-ir and raw-scaled-depth images
-    cv::Mat color_hd_image_cv, color_hd_image_cv_bgr;
-    color_hd_image_cv_bgr = cv::imread(read_folder_path + "color.png", CV_LOAD_IMAGE_COLOR);
-    if (color_hd_image_cv_bgr.empty() == true) {
-        res.success = false;
-        return true;
-    }
-    cvtColor(color_hd_image_cv_bgr, color_hd_image_cv, CV_BGR2RGB);
-    cv::Mat ir_image_cv_raw;
-    ir_image_cv_raw = cv::imread(read_folder_path + "ir.png", CV_LOAD_IMAGE_ANYDEPTH);
-    if (ir_image_cv_raw.empty() == true) {
-        res.success = false;
-        return true;
-    }
-    cv::Mat ir_image_cv(ir_image_cv_raw.size().height, ir_image_cv_raw.size().width, CV_16UC1);
-    if (ir_image_cv_raw.type() == 0) {  // type 0 == 8UC1 as per -> https://stackoverflow.com/questions/10167534/how-to-find-out-what-type-of-a-mat-object-is-with-mattype-in-opencv
-        from_8UC1_to_16UC1(ir_image_cv_raw, ir_image_cv);
-    } else {
-        ir_image_cv = ir_image_cv_raw;
-    }
-    cv::Mat depth_image_cv_16UC1_scaled;
-    depth_image_cv_16UC1_scaled = cv::imread(read_folder_path + "depth.png", CV_LOAD_IMAGE_ANYDEPTH);
-    if (depth_image_cv_16UC1_scaled.empty() == true) {
-        res.success = false;
-        return true;
-    }
-
-    // It seems that some depth images are scaled and others aren't. Need a way to differentiate and scale accordingly.
-    // A non-scaled image example had max depth of 786
-    // A scaled image example had max depth of 25854
-    // Choose 10000 as threshold
-    double min, max;
-    cv::minMaxIdx(depth_image_cv_16UC1_scaled, &min, &max);
-    // printf("min: %f, max: %f\n", min, max);
-
-    cv::Mat depth_image_cv_16UC1_mm(depth_image_cv_16UC1_scaled.size().height, depth_image_cv_16UC1_scaled.size().width, CV_16UC1);
-    if (max < 10000.0) {
-        // Don't convert unscaled depth images
-        depth_image_cv_16UC1_mm = depth_image_cv_16UC1_scaled;
-    } else {
-        // Convert scaled 16UC1 depth image to 16UC1 depth image in mm as published by realsense
-        from_16UC1_scaled_to_16UC1_mm(depth_image_cv_16UC1_scaled, depth_image_cv_16UC1_mm);
-    }
-
-    // Create SD color image from HD color image
-    // cv::Mat crop_img = color_hd_image_cv(cv::Rect(240,0,1440,1080));
-    cv::Mat color_image_cv;
-    cv::resize(color_hd_image_cv, color_image_cv, cv::Size(640,360), cv::INTER_CUBIC);
+// Publish one capture's raw images (and camera info's) - camera info filled in main()
+// These images are equivalent to what the realsense publishes
+bool publish_capture(const acrv_realsense_ros::MappedCapture &capture, ros::Time &stamp) {
+    // Shallow copies of the read-only mapped frames, toImageMsg copies the pixels
+    cv::Mat color_hd_image_cv = capture.color_hd;
+    cv::Mat color_image_cv = capture.color;
+    cv::Mat ir_image_cv = capture.ir;
+    cv::Mat depth_image_cv_16UC1_mm = capture.depth;
 
     // Convert CV images to sensor_msgs/Image
     try {
@@ -243,18 +183,148 @@ bool publish_raw_data_once_service(std_srvs::Trigger::Request &req,
         ir_image_msg->header.stamp = time_now;
         depth_image_msg->header.stamp = time_now;
 
-        // Publish raw images (and camera info's) - camera info filled in main()
-        // These images are equivalent to what the realsense publishes
         color_hd_pub.publish(*color_hd_image_msg, color_hd_camera_info, time_now);
         color_pub.publish(*color_image_msg, color_camera_info, time_now);
         ir_pub.publish(*ir_image_msg, ir_camera_info, time_now);
         depth_pub.publish(*depth_image_msg, depth_camera_info, time_now);
+        stamp = time_now;
     } catch(...) {
-        ROS_ERROR_STREAM("ir_image_raw failed");
+        ROS_ERROR_STREAM("Publishing capture failed");
+        return false;
+    }
+    return true;
+}
+
+// Record the camera infos published with a capture alongside its regenerated streams
+void record_camera_infos(const std::string &capture, const ros::Time &stamp) {
+    const std::pair<const char *, const sensor_msgs::CameraInfo *> camera_infos[] = {
+        {"color_hd", &color_hd_camera_info}, {"color", &color_camera_info},
+        {"ir", &ir_camera_info}, {"depth", &depth_camera_info}};
+    for (const auto &camera_info : camera_infos) {
+        sensor_msgs::CameraInfo stamped = *camera_info.second;
+        stamped.header.stamp = stamp;
+        if (!recorder->record_camera_info(capture, camera_info.first, stamped)) {
+            ROS_WARN_STREAM("Writer queue full, dropped " << camera_info.first << "_camera_info");
+        }
+    }
+}
+
+bool publish_raw_data_once_service(std_srvs::Trigger::Request &req,
+                                   std_srvs::Trigger::Response &res) {
+    ROS_INFO_STREAM("Service has been called...");
+    ROS_INFO_STREAM("/data_regeneration_server_node/read_folder_path = " << read_folder_path);
+    ROS_INFO_STREAM("/data_regeneration_server_node/save_folder_path = " << save_folder_path);
+
+    // The folder for saving the new images is created by the recorder on first write
+
+    // Decoded on first use, memory-mapped from the replay cache afterwards
+    acrv_realsense_ros::MappedCaptureConstPtr capture = replay->load(read_folder_path);
+    if (!capture) {
+        res.success = false;
+        return true;
     }
 
     // TODO add wait until all subscribers have triggered and so saved their data
 
+    ros::Time stamp;
+    res.success = publish_capture(*capture, stamp);
+    if (res.success) {
+        record_camera_infos(save_folder_path, stamp);
+    }
+    return true;
+}
+
+// Publish captures [replay_first, replay_last] of the indexed dataset at
+// replay_rate Hz, or as fast as possible if replay_rate <= 0. Camera infos
+// are recorded into save_folder, the save_folder_path at the start.
+void replay_sequence(int first, int last, double rate, bool loop, std::string save_folder) {
+    const std::vector<std::string> &captures = replay->captures();
+    if (captures.empty()) {
+        replay_running = false;
+        return;
+    }
+    first = std::max(first, 0);
+    last = (last < 0 || last >= (int)captures.size()) ? (int)captures.size() - 1 : last;
+
+    ros::WallRate wall_rate(rate > 0.0 ? rate : 1.0);
+    ros::WallTime start = ros::WallTime::now();
+    int published = 0;
+    // Loads the next capture while the current one is published. load()
+    // waits for it if it is still in progress.
+    std::future<void> prefetched;
+
+    do {
+        for (int i = first; i <= last && replay_running && ros::ok(); ++i) {
+            acrv_realsense_ros::MappedCaptureConstPtr capture = replay->load(captures[i]);
+            if (i < last) {
+                prefetched = std::async(std::launch::async, &acrv_realsense_ros::CaptureReplay::prefetch,
+                                        replay.get(), captures[i + 1]);
+            }
+            ros::Time stamp;
+            if (capture && publish_capture(*capture, stamp)) {
+                record_camera_infos(save_folder, stamp);
+                ++published;
+            }
+            if (rate > 0.0) {
+                wall_rate.sleep();
+            }
+        }
+    } while (loop && replay_running && ros::ok());
+
+    double elapsed = (ros::WallTime::now() - start).toSec();
+    ROS_INFO_STREAM("Replayed " << published << " captures in " << elapsed << "s ("
+                    << (elapsed > 0.0 ? published / elapsed : 0.0) << " Hz)");
+    replay_running = false;
+}
+
+bool replay_index_service(std_srvs::Trigger::Request &req,
+                          std_srvs::Trigger::Response &res) {
+    if (replay_running) {
+        res.success = false;
+        res.message = "Replay in progress";
+        return true;
+    }
+    std::size_t count = replay->index(read_folder_path);
+    std::stringstream message;
+    message << "Indexed " << count << " captures below " << read_folder_path;
+    ROS_INFO_STREAM(message.str());
+    res.success = count > 0;
+    res.message = message.str();
+    return true;
+}
+
+bool replay_start_service(std_srvs::Trigger::Request &req,
+                          std_srvs::Trigger::Response &res) {
+    if (replay_running) {
+        res.success = false;
+        res.message = "Replay already running";
+        return true;
+    }
+    if (replay_thread.joinable()) {
+        replay_thread.join();
+    }
+
+    ros::NodeHandle nh("data_regeneration_server_node");
+    int first, last;
+    double rate;
+    bool loop;
+    nh.param("replay_first", first, 0);
+    nh.param("replay_last", last, -1);
+    nh.param("replay_rate", rate, 30.0);
+    nh.param("replay_loop", loop, false);
+
+    replay_running = true;
+    replay_thread = std::thread(replay_sequence, first, last, rate, loop, save_folder_path);
+    res.success = true;
+    return true;
+}
+
+bool replay_stop_service(std_srvs::Trigger::Request &req,
+                         std_srvs::Trigger::Response &res) {
+    replay_running = false;
+    if (replay_thread.joinable()) {
+        replay_thread.join();
+    }
     res.success = true;
     return true;
 }
@@ -267,10 +337,9 @@ try {
     cv::Mat im_scaled(im->image.size().height, im->image.size().width, CV_16UC1);
     from_16UC1_mm_to_16UC1_scaled(im->image, im_scaled);
 
-    std::stringstream img_path_fn;
-    img_path_fn << save_folder_path << "depth_raw.png";
-    ROS_INFO_STREAM("Saving image: " << img_path_fn.str());
-    ROS_INFO_STREAM("Success = " << cv::imwrite(img_path_fn.str(), im_scaled));
+    if (!recorder->record_image(save_folder_path, "depth_raw", std::move(im_scaled), msg.header.stamp)) {
+        ROS_WARN_STREAM("Writer queue full, dropped depth_raw");
+    }
 } catch(...) {
     ROS_ERROR_STREAM("ir_image_raw failed");
 }
@@ -284,10 +353,9 @@ try {
     cv::Mat im_scaled(im->image.size().height, im->image.size().width, CV_16UC1);
     from_32FC1_m_to_16UC1_scaled(im->image, im_scaled);
 
-    std::stringstream img_path_fn;
-    img_path_fn << save_folder_path << "depth_rect.png";
-    ROS_INFO_STREAM("Saving image: " << img_path_fn.str());
-    ROS_INFO_STREAM("Success = " << cv::imwrite(img_path_fn.str(), im_scaled));
+    if (!recorder->record_image(save_folder_path, "depth_rect", std::move(im_scaled), msg.header.stamp)) {
+        ROS_WARN_STREAM("Writer queue full, dropped depth_rect");
+    }
 } catch(...) {
     ROS_ERROR_STREAM("ir_image_raw failed");
 }
@@ -300,10 +368,9 @@ void sub_realsense_ir_image_raw_callback(const sensor_msgs::Image& msg) {
         // ROS_ERROR_STREAM("Yo " << msg.encoding);
         cv_bridge::CvImagePtr im = sensor_msgs_image_to_cv_mat(msg, sensor_msgs::image_encodings::TYPE_16UC1);
 
-        std::stringstream img_path_fn;
-        img_path_fn << save_folder_path << "ir_raw.png";
-        ROS_INFO_STREAM("Saving image: " << img_path_fn.str());
-        ROS_INFO_STREAM("Success = " << cv::imwrite(img_path_fn.str(), im->image));
+        if (!recorder->record_image(save_folder_path, "ir_raw", std::move(im->image), msg.header.stamp)) {
+            ROS_WARN_STREAM("Writer queue full, dropped ir_raw");
+        }
     } catch(...) {
         ROS_ERROR_STREAM("ir_image_raw failed");
     }
@@ -314,10 +381,9 @@ void sub_realsense_ir_image_rect_callback(const sensor_msgs::Image& msg) {
     try {
         cv_bridge::CvImagePtr im = sensor_msgs_image_to_cv_mat(msg, sensor_msgs::image_encodings::TYPE_16UC1);
 
-        std::stringstream img_path_fn;
-        img_path_fn << save_folder_path << "ir_rect.png";
-        ROS_INFO_STREAM("Saving image: " << img_path_fn.str());
-        ROS_INFO_STREAM("Success = " << cv::imwrite(img_path_fn.str(), im->image));
+        if (!recorder->record_image(save_folder_path, "ir_rect", std::move(im->image), msg.header.stamp)) {
+            ROS_WARN_STREAM("Writer queue full, dropped ir_rect");
+        }
     } catch(...) {
         ROS_ERROR_STREAM("ir_image_rect failed");
     }
@@ -328,10 +394,9 @@ void sub_realsense_rgb_image_raw_callback(const sensor_msgs::Image& msg) {
 try {
     cv_bridge::CvImagePtr im = sensor_msgs_image_to_cv_mat(msg, sensor_msgs::image_encodings::BGR8);
 
-    std::stringstream img_path_fn;
-    img_path_fn << save_folder_path << "color_raw.png";
-    ROS_INFO_STREAM("Saving image: " << img_path_fn.str());
-    ROS_INFO_STREAM("Success = " << cv::imwrite(img_path_fn.str(), im->image));
+    if (!recorder->record_image(save_folder_path, "color_raw", std::move(im->image), msg.header.stamp)) {
+        ROS_WARN_STREAM("Writer queue full, dropped color_raw");
+    }
 } catch(...) {
     ROS_ERROR_STREAM("ir_image_raw failed");
 }
@@ -342,10 +407,9 @@ void sub_realsense_rgb_image_rect_callback(const sensor_msgs::Image& msg) {
 try {
     cv_bridge::CvImagePtr im = sensor_msgs_image_to_cv_mat(msg, sensor_msgs::image_encodings::BGR8);
 
-    std::stringstream img_path_fn;
-    img_path_fn << save_folder_path << "color_rect.png";
-    ROS_INFO_STREAM("Saving image: " << img_path_fn.str());
-    ROS_INFO_STREAM("Success = " << cv::imwrite(img_path_fn.str(), im->image));
+    if (!recorder->record_image(save_folder_path, "color_rect", std::move(im->image), msg.header.stamp)) {
+        ROS_WARN_STREAM("Writer queue full, dropped color_rect");
+    }
 } catch(...) {
     ROS_ERROR_STREAM("ir_image_raw failed");
 }
@@ -356,10 +420,9 @@ void sub_realsense_rgb_hd_image_raw_callback(const sensor_msgs::Image& msg) {
 try {
     cv_bridge::CvImagePtr im = sensor_msgs_image_to_cv_mat(msg, sensor_msgs::image_encodings::BGR8);
 
-    std::stringstream img_path_fn;
-    img_path_fn << save_folder_path << "color_hd_raw.png";
-    ROS_INFO_STREAM("Saving image: " << img_path_fn.str());
-    ROS_INFO_STREAM("Success = " << cv::imwrite(img_path_fn.str(), im->image));
+    if (!recorder->record_image(save_folder_path, "color_hd_raw", std::move(im->image), msg.header.stamp)) {
+        ROS_WARN_STREAM("Writer queue full, dropped color_hd_raw");
+    }
 } catch(...) {
     ROS_ERROR_STREAM("ir_image_raw failed");
 }
@@ -370,10 +433,9 @@ void sub_realsense_rgb_hd_image_rect_callback(const sensor_msgs::Image& msg) {
 try {
     cv_bridge::CvImagePtr im = sensor_msgs_image_to_cv_mat(msg, sensor_msgs::image_encodings::BGR8);
 
-    std::stringstream img_path_fn;
-    img_path_fn << save_folder_path << "color_hd_rect.png";
-    ROS_INFO_STREAM("Saving image: " << img_path_fn.str());
-    ROS_INFO_STREAM("Success = " << cv::imwrite(img_path_fn.str(), im->image));
+    if (!recorder->record_image(save_folder_path, "color_hd_rect", std::move(im->image), msg.header.stamp)) {
+        ROS_WARN_STREAM("Writer queue full, dropped color_hd_rect");
+    }
 } catch(...) {
     ROS_ERROR_STREAM("ir_image_raw failed");
 }
@@ -387,10 +449,9 @@ try {
     cv::Mat im_scaled(im->image.size().height, im->image.size().width, CV_16UC1);
     from_32FC1_m_to_16UC1_scaled(im->image, im_scaled);
 
-    std::stringstream img_path_fn;
-    img_path_fn << save_folder_path << "depth_aligned.png";
-    ROS_INFO_STREAM("Saving image: " << img_path_fn.str());
-    ROS_INFO_STREAM("Success = " << cv::imwrite(img_path_fn.str(), im_scaled));
+    if (!recorder->record_image(save_folder_path, "depth_aligned", std::move(im_scaled), msg.header.stamp)) {
+        ROS_WARN_STREAM("Writer queue full, dropped depth_aligned");
+    }
 } catch(...) {
     ROS_ERROR_STREAM("ir_image_raw failed");
 }
@@ -404,10 +465,9 @@ try {
     cv::Mat im_scaled(im->image.size().height, im->image.size().width, CV_16UC1);
     from_32FC1_m_to_16UC1_scaled(im->image, im_scaled);
 
-    std::stringstream img_path_fn;
-    img_path_fn << save_folder_path << "depth_hd_aligned.png";
-    ROS_INFO_STREAM("Saving image: " << img_path_fn.str());
-    ROS_INFO_STREAM("Success = " << cv::imwrite(img_path_fn.str(), im_scaled));
+    if (!recorder->record_image(save_folder_path, "depth_hd_aligned", std::move(im_scaled), msg.header.stamp)) {
+        ROS_WARN_STREAM("Writer queue full, dropped depth_hd_aligned");
+    }
 } catch(...) {
     ROS_ERROR_STREAM("ir_image_raw failed");
 }
@@ -416,14 +476,10 @@ try {
 void sub_realsense_depth_registered_points_callback(const sensor_msgs::PointCloud2ConstPtr& cloud_ptr) {
     ROS_INFO_STREAM("sub_realsense_depth_registered_points_callback has been triggered");
 try {
-    pcl::PointCloud<pcl::PointXYZRGB> cloud;
-    pcl::fromROSMsg(*cloud_ptr, cloud);
-
-    std::stringstream img_path_fn;
-    img_path_fn << save_folder_path << "cloud.pcd";
-    ROS_INFO_STREAM("Saving cloud " << img_path_fn.str());
-    pcl::io::savePCDFile(img_path_fn.str(), cloud, true);  // binary format
-    ROS_INFO_STREAM("Check the pcd to see if the save was successful.");
+    // Saved as binary PCD straight from the message on a writer thread
+    if (!recorder->record_cloud(save_folder_path, "cloud", cloud_ptr)) {
+        ROS_WARN_STREAM("Writer queue full, dropped cloud");
+    }
 } catch(...) {
     ROS_ERROR_STREAM("ir_image_raw failed");
 }
@@ -432,14 +488,10 @@ try {
 void sub_realsense_depth_hd_registered_points_callback(const sensor_msgs::PointCloud2ConstPtr& cloud_ptr) {
     ROS_INFO_STREAM("sub_realsense_depth_hd_registered_points_callback has been triggered");
 try {
-    pcl::PointCloud<pcl::PointXYZRGB> cloud;
-    pcl::fromROSMsg(*cloud_ptr, cloud);
-
-    std::stringstream img_path_fn;
-    img_path_fn << save_folder_path << "cloud_hd.pcd";
-    ROS_INFO_STREAM("Saving cloud " << img_path_fn.str());
-    pcl::io::savePCDFile(img_path_fn.str(), cloud, true);  // binary format
-    ROS_INFO_STREAM("Check the pcd to see if the save was successful.");
+    // Saved as binary PCD straight from the message on a writer thread
+    if (!recorder->record_cloud(save_folder_path, "cloud_hd", cloud_ptr)) {
+        ROS_WARN_STREAM("Writer queue full, dropped cloud_hd");
+    }
 } catch(...) {
     ROS_ERROR_STREAM("ir_image_raw failed");
 }
@@ -451,6 +503,21 @@ int main(int argc, char * argv[]) try {
     ros::NodeHandle nh("data_regeneration_server_node");
     image_transport::ImageTransport image_transport(nh);
 
+    // Recording backend: writer_threads encode and write in parallel, at most
+    // writer_queue_size saves are pending. If container_path is set every
+    // capture is appended to that single indexed file instead of a folder.
+    int writer_threads, writer_queue_size;
+    bool block_when_queue_full;
+    std::string container_path;
+    nh.param("writer_threads", writer_threads, 4);
+    nh.param("writer_queue_size", writer_queue_size, 64);
+    nh.param("block_when_queue_full", block_when_queue_full, false);
+    nh.param<std::string>("container_path", container_path, "");
+    recorder.reset(new acrv_realsense_ros::CaptureRecorder(
+        writer_threads, writer_queue_size,
+        block_when_queue_full ? acrv_realsense_ros::AsyncWriter::BLOCK : acrv_realsense_ros::AsyncWriter::DROP_NEWEST,
+        container_path));
+
     // image_transport will create /realsense/*/camera_info topics for these streams
     color_hd_pub = image_transport.advertiseCamera("/realsense/rgb_hd/image_raw", 1);
     color_pub = image_transport.advertiseCamera("/realsense/rgb/image_raw", 1);
@@ -462,6 +529,19 @@ int main(int argc, char * argv[]) try {
     // /data_regeneration_server_node/publish_raw_data_once
     ros::ServiceServer service = nh.advertiseService("publish_raw_data_once", publish_raw_data_once_service);
 
+    // Replay of a whole dataset: replay_index walks read_folder_path once,
+    // replay_start publishes the indexed captures using the replay_* params
+    std::string replay_cache_dir, depth_encoding;
+    int replay_mapped_captures;
+    nh.param<std::string>("replay_cache_dir", replay_cache_dir, "/tmp/acrv_replay_cache");
+    nh.param<std::string>("depth_encoding", depth_encoding, "auto");
+    nh.param("replay_mapped_captures", replay_mapped_captures, 64);
+    replay.reset(new acrv_realsense_ros::CaptureReplay(
+        replay_cache_dir, acrv_realsense_ros::depth_encoding_from_string(depth_encoding), replay_mapped_captures));
+    ros::ServiceServer replay_index = nh.advertiseService("replay_index", replay_index_service);
+    ros::ServiceServer replay_start = nh.advertiseService("replay_start", replay_start_service);
+    ros::ServiceServer replay_stop = nh.advertiseService("replay_stop", replay_stop_service);
+
     ros::Subscriber sub_realsense_depth_image_raw = nh.subscribe("/realsense/depth/image_raw", 20, sub_realsense_depth_image_raw_callback);
     ros::Subscriber sub_realsense_depth_image_rect = nh.subscribe("/realsense/depth/image_rect", 20, sub_realsense_depth_image_rect_callback);
     ros::Subscriber sub_realsense_ir_image_raw = nh.subscribe("/realsense/ir/image_raw", 20, sub_realsense_ir_image_raw_callback);
@@ -492,6 +572,15 @@ int main(int argc, char * argv[]) try {
         ros::spinOnce();
         r.sleep();
     }
+
+    replay_running = false;
+    if (replay_thread.joinable()) {
+        replay_thread.join();
+    }
+
+    recorder->flush();
+    ROS_INFO_STREAM("Recorder wrote " << recorder->writer().written() << ", failed " << recorder->writer().failed()
+                    << ", dropped " << recorder->writer().dropped());
 }
 // some other error
 catch(const std::exception & e) {
@@ -18,6 +18,7 @@
 #include <iostream>
 #include <iomanip>
 #include <thread>
+#include <utility>
 #include <cstdio>
 #include <pcl/io/pcd_io.h>
 #include <pcl/point_types.h>
@@ -31,6 +32,8 @@
 #include <pcl/conversions.h>
 #include <pcl_ros/transforms.h>
 
+#include <acrv_realsense_ros/capture_recorder.h>
+
 
 #include <sstream>
 /*
@@ -82,6 +85,18 @@ int main(int argc, char** argv)
     // acrv_realsense_ros::get_camera_image srv_realsense_rgb_image_rect;
     acrv_realsense_ros::get_all_images srv_realsense_all_images;
 
+    // Camera infos are recorded with every capture, as <stream>_camera_info
+    const char *camera_info_streams[] = {"depth", "depth_registered", "ir", "rgb"};
+    std::vector<ros::ServiceClient> camera_info_clients;
+    for (const char *stream : camera_info_streams) {
+        camera_info_clients.push_back(n.serviceClient<acrv_realsense_ros::get_camera_info>(
+            std::string("/acrv_realsense_ros/get_realsense_") + stream + "_camera_info"));
+    }
+
+    // Images and clouds are written asynchronously so the next capture can
+    // be requested while the previous one is still being saved
+    acrv_realsense_ros::CaptureRecorder recorder(4, 64, acrv_realsense_ros::AsyncWriter::BLOCK);
+
     //File naming variables
     uint16_t capture_count = 0;
     ROS_INFO_STREAM("Enter the index you would like to start at:");
@@ -112,15 +127,9 @@ int main(int argc, char** argv)
             std::cin.ignore(std::numeric_limits<std::streamsize>::max(),'\n');   // ignore until newline
         }
 
-        // Create folder with directory
+        // Folder for this capture, created by the recorder on first write
         std::stringstream folder_name;
         folder_name << "../data/img_" <<  std::setfill('0') << std::setw(5) << capture_count;
-        const int dir_err = system(("mkdir -p " + folder_name.str()).c_str());
-        if (-1 == dir_err)
-        {
-            printf("Error creating directory!\n");
-            exit(1);
-        }
 
         // Call all images service
         if (client_realsense_all_images.call(srv_realsense_all_images)) {
@@ -137,10 +146,8 @@ int main(int argc, char** argv)
                 ROS_ERROR("cv_bridge exception: %s", e.what());
                 break;
             }
-            std::stringstream img_fn_image_depth_image_raw;
-            img_fn_image_depth_image_raw << folder_name.str() << "/depth_image_raw.png";
-            std::cout << "Saving image " << img_fn_image_depth_image_raw.str() << std::endl;
-            std::cout << "Success: " << cv::imwrite(img_fn_image_depth_image_raw.str(), cv_ptr_image_depth_image_raw->image) << std::endl;
+            std::cout << "Queueing image " << folder_name.str() << "/depth_image_raw.png" << std::endl;
+            recorder.record_image(folder_name.str(), "depth_image_raw", std::move(cv_ptr_image_depth_image_raw->image), cv_ptr_image_depth_image_raw->header.stamp);
 
             // Save depth_image_raw_m.png
             cv_bridge::CvImagePtr cv_ptr_image_depth_image_raw_m;
@@ -154,10 +161,8 @@ int main(int argc, char** argv)
                 ROS_ERROR("cv_bridge exception: %s", e.what());
                 break;
             }
-            std::stringstream img_fn_image_depth_image_raw_m;
-            img_fn_image_depth_image_raw_m << folder_name.str() << "/depth_image_raw_m.png";
-            std::cout << "Saving image " << img_fn_image_depth_image_raw_m.str() << std::endl;
-            std::cout << "Success: " << cv::imwrite(img_fn_image_depth_image_raw_m.str(), cv_ptr_image_depth_image_raw_m->image) << std::endl;
+            std::cout << "Queueing image " << folder_name.str() << "/depth_image_raw_m.png" << std::endl;
+            recorder.record_image(folder_name.str(), "depth_image_raw_m", std::move(cv_ptr_image_depth_image_raw_m->image), cv_ptr_image_depth_image_raw_m->header.stamp);
 
             // Save depth_image_rect.png
             cv_bridge::CvImagePtr cv_ptr_image_depth_image_rect;
@@ -171,10 +176,8 @@ int main(int argc, char** argv)
                 ROS_ERROR("cv_bridge exception: %s", e.what());
                 break;
             }
-            std::stringstream img_fn_image_depth_image_rect;
-            img_fn_image_depth_image_rect << folder_name.str() << "/depth_image_rect.png";
-            std::cout << "Saving image " << img_fn_image_depth_image_rect.str() << std::endl;
-            std::cout << "Success: " << cv::imwrite(img_fn_image_depth_image_rect.str(), cv_ptr_image_depth_image_rect->image) << std::endl;
+            std::cout << "Queueing image " << folder_name.str() << "/depth_image_rect.png" << std::endl;
+            recorder.record_image(folder_name.str(), "depth_image_rect", std::move(cv_ptr_image_depth_image_rect->image), cv_ptr_image_depth_image_rect->header.stamp);
 
             // Save depth_registered_image_rect.png
             cv_bridge::CvImagePtr cv_ptr_image_depth_registered_image_rect;
@@ -188,21 +191,14 @@ int main(int argc, char** argv)
                 ROS_ERROR("cv_bridge exception: %s", e.what());
                 break;
             }
-            std::stringstream img_fn_image_depth_registered_image_rect;
-            img_fn_image_depth_registered_image_rect << folder_name.str() << "/depth_registered_image_rect.png";
-            std::cout << "Saving image " << img_fn_image_depth_registered_image_rect.str() << std::endl;
-            std::cout << "Success: " << cv::imwrite(img_fn_image_depth_registered_image_rect.str(), cv_ptr_image_depth_registered_image_rect->image) << std::endl;
+            std::cout << "Queueing image " << folder_name.str() << "/depth_registered_image_rect.png" << std::endl;
+            recorder.record_image(folder_name.str(), "depth_registered_image_rect", std::move(cv_ptr_image_depth_registered_image_rect->image), cv_ptr_image_depth_registered_image_rect->header.stamp);
 
-            // Save depth_registered_points.pcd
-            pcl::PCLPointCloud2 pcl_pc2;
-            pcl_conversions::toPCL(srv_realsense_all_images.response.cloud_depth_registered_points,pcl_pc2);
-            pcl::PointCloud<pcl::PointXYZ>::Ptr temp_cloud(new pcl::PointCloud<pcl::PointXYZ>);
-            pcl::fromPCLPointCloud2(pcl_pc2,*temp_cloud);
-
-            std::stringstream img_fn;
-            img_fn << folder_name.str() << "/depth_registered_points.pcd";
-            std::cout << "Saving cloud " << img_fn.str() << std::endl;
-            std::cout << "Success: " << pcl::io::savePCDFileASCII(img_fn.str(), *temp_cloud) << std::endl;
+            // Save depth_registered_points.pcd (binary, written on a writer thread)
+            sensor_msgs::PointCloud2Ptr cloud(
+                new sensor_msgs::PointCloud2(srv_realsense_all_images.response.cloud_depth_registered_points));
+            std::cout << "Queueing cloud " << folder_name.str() << "/depth_registered_points.pcd" << std::endl;
+            recorder.record_cloud(folder_name.str(), "depth_registered_points", cloud);
 
             // Save ir_image_raw.png
             cv_bridge::CvImagePtr cv_ptr_image_ir_image_raw;
@@ -216,10 +212,8 @@ int main(int argc, char** argv)
                 ROS_ERROR("cv_bridge exception: %s", e.what());
                 break;
             }
-            std::stringstream img_fn_image_ir_image_raw;
-            img_fn_image_ir_image_raw << folder_name.str() << "/ir_image_raw.png";
-            std::cout << "Saving image " << img_fn_image_ir_image_raw.str() << std::endl;
-            std::cout << "Success: " << cv::imwrite(img_fn_image_ir_image_raw.str(), cv_ptr_image_ir_image_raw->image) << std::endl;
+            std::cout << "Queueing image " << folder_name.str() << "/ir_image_raw.png" << std::endl;
+            recorder.record_image(folder_name.str(), "ir_image_raw", std::move(cv_ptr_image_ir_image_raw->image), cv_ptr_image_ir_image_raw->header.stamp);
 
             // Save ir_image_rect.png
             cv_bridge::CvImagePtr cv_ptr_image_ir_image_rect;
@@ -233,10 +227,8 @@ int main(int argc, char** argv)
                 ROS_ERROR("cv_bridge exception: %s", e.what());
                 break;
             }
-            std::stringstream img_fn_image_ir_image_rect;
-            img_fn_image_ir_image_rect << folder_name.str() << "/ir_image_rect.png";
-            std::cout << "Saving image " << img_fn_image_ir_image_rect.str() << std::endl;
-            std::cout << "Success: " << cv::imwrite(img_fn_image_ir_image_rect.str(), cv_ptr_image_ir_image_rect->image) << std::endl;
+            std::cout << "Queueing image " << folder_name.str() << "/ir_image_rect.png" << std::endl;
+            recorder.record_image(folder_name.str(), "ir_image_rect", std::move(cv_ptr_image_ir_image_rect->image), cv_ptr_image_ir_image_rect->header.stamp);
 
             // Save rgb_image_raw.png
             cv_bridge::CvImagePtr cv_ptr_image_rgb_image_raw;
@@ -250,10 +242,8 @@ int main(int argc, char** argv)
                 ROS_ERROR("cv_bridge exception: %s", e.what());
                 break;
             }
-            std::stringstream img_fn_image_rgb_image_raw;
-            img_fn_image_rgb_image_raw << folder_name.str() << "/rgb_image_raw.png";
-            std::cout << "Saving image " << img_fn_image_rgb_image_raw.str() << std::endl;
-            std::cout << "Success: " << cv::imwrite(img_fn_image_rgb_image_raw.str(), cv_ptr_image_rgb_image_raw->image) << std::endl;
+            std::cout << "Queueing image " << folder_name.str() << "/rgb_image_raw.png" << std::endl;
+            recorder.record_image(folder_name.str(), "rgb_image_raw", std::move(cv_ptr_image_rgb_image_raw->image), cv_ptr_image_rgb_image_raw->header.stamp);
 
             // Save rgb_image_rect.png
             cv_bridge::CvImagePtr cv_ptr_image_rgb_image_rect;
@@ -267,10 +257,19 @@ int main(int argc, char** argv)
                 ROS_ERROR("cv_bridge exception: %s", e.what());
                 break;
             }
-            std::stringstream img_fn_image_rgb_image_rect;
-            img_fn_image_rgb_image_rect << folder_name.str() << "/rgb_image_rect.png";
-            std::cout << "Saving image " << img_fn_image_rgb_image_rect.str() << std::endl;
-            std::cout << "Success: " << cv::imwrite(img_fn_image_rgb_image_rect.str(), cv_ptr_image_rgb_image_rect->image) << std::endl;
+            std::cout << "Queueing image " << folder_name.str() << "/rgb_image_rect.png" << std::endl;
+            recorder.record_image(folder_name.str(), "rgb_image_rect", std::move(cv_ptr_image_rgb_image_rect->image), cv_ptr_image_rgb_image_rect->header.stamp);
+
+            // Save <stream>_camera_info for each camera
+            for (std::size_t i = 0; i < camera_info_clients.size(); ++i) {
+                acrv_realsense_ros::get_camera_info srv_camera_info;
+                if (camera_info_clients[i].call(srv_camera_info)) {
+                    std::cout << "Queueing camera info " << folder_name.str() << "/" << camera_info_streams[i] << std::endl;
+                    recorder.record_camera_info(folder_name.str(), camera_info_streams[i], srv_camera_info.response.camera_info);
+                } else {
+                    ROS_INFO_STREAM("Failed to call service: " << camera_info_clients[i].getService());
+                }
+            }
         }
         else {
             ROS_INFO_STREAM("Failed to call service.  Check that the realsense camera is properly connected.");
@@ -494,5 +493,8 @@ int main(int argc, char** argv)
         capture_count++;
     }
 
+    recorder.flush();
+    std::cout << "Saved " << recorder.writer().written() << " files, " << recorder.writer().failed() << " failed" << std::endl;
+
     return 0;
 }
@@ -17,6 +17,9 @@
 #include <Eigen/Geometry>
 #include <eigen_conversions/eigen_msg.h>
 #include <boost/algorithm/string.hpp>
+#include <acrv_realsense_ros/FrameNumber.h>
+#include <deque>
+#include <utility>
 
 
 namespace rs
@@ -59,6 +62,26 @@ ros::Publisher rgb_sync_depth_registered_camera_info_pub;
 
 double x_param, y_param, z_param, yaw_param, pitch_param, roll_param;
 
+// librealsense frame numbers of the latest depth images, by stamp, to link the registration of a frame to its spans in a merged trace
+std::deque<std::pair<ros::Time, uint64_t>> depth_frame_numbers;
+
+void frame_number_callback(const acrv_realsense_ros::FrameNumber& msg) {
+    depth_frame_numbers.push_back(std::make_pair(msg.header.stamp, msg.frame_number));
+    if (depth_frame_numbers.size() > 30) {
+        depth_frame_numbers.pop_front();
+    }
+}
+
+// 0, which leaves the span unlinked, if the frame number of that stamp was not received
+uint64_t depth_frame_number(const ros::Time &stamp) {
+    for (const auto &entry : depth_frame_numbers) {
+        if (entry.first == stamp) {
+            return entry.second;
+        }
+    }
+    return 0;
+}
+
 // sensor_msgs::CameraInfo rgb_sync_depth_registered_camera_info, depth_camera_info;
 
 
@@ -97,6 +120,7 @@ cv_bridge::CvImagePtr sensor_msgs_image_to_cv_mat(const sensor_msgs::Image& msg,
 }
 
 void callback(const sensor_msgs::Image& depth_raw_msg, const sensor_msgs::CameraInfo& depth_camera_info_msg, const sensor_msgs::Image& rgb_rect_msg, const sensor_msgs::CameraInfo& rgb_camera_info_msg) {
+    rs::trace_scope register_span("register_depth", rs::stream::depth, depth_frame_number(depth_raw_msg.header.stamp));
 
     sensor_msgs::CameraInfo rgb_sync_depth_registered_camera_info = rgb_camera_info_msg;
     sensor_msgs::CameraInfo depth_camera_info = depth_camera_info_msg;
@@ -295,11 +319,20 @@ int main(int argc, char * argv[]) {
     message_filters::Synchronizer<MySyncPolicy> sync(MySyncPolicy(5), depth_image_raw_sub, depth_camera_info_sub, rgb_image_rect_sub, rgb_camera_info_sub);
     sync.registerCallback(callback);
 
+    ros::Subscriber depth_frame_number_sub = n.subscribe("/" + camera_name + "/depth/frame_number", 30, frame_number_callback);
+
     depth_registered_pub = n.advertise<sensor_msgs::Image>("/" + camera_name + "/depth_registered/image_rect", 30);
     depth_registered_camera_info_pub = n.advertise<sensor_msgs::CameraInfo>("/" + camera_name + "/depth_registered/camera_info", 30);
     rgb_sync_depth_registered_pub = n.advertise<sensor_msgs::Image>("/" + camera_name + "/rgb_sync_depth_registered/image_rect", 30);
     rgb_sync_depth_registered_camera_info_pub = n.advertise<sensor_msgs::CameraInfo>("/" + camera_name + "/rgb_sync_depth_registered/camera_info", 30);
 
+    std::string trace_file;
+    n.param<std::string>("trace_file", trace_file, "");
+    if (!trace_file.empty()) {
+        ROS_INFO_STREAM("Tracing depth registration latency to " << trace_file);
+        rs::start_tracing();
+    }
+
     ros::Rate r(30);
 
     // Continuously publish rgb image and depth_inpainted image
@@ -307,4 +340,8 @@ int main(int argc, char * argv[]) {
         ros::spinOnce();
         r.sleep();
     }
+
+    if (!trace_file.empty()) {
+        rs::stop_tracing(trace_file.c_str());
+    }
 }
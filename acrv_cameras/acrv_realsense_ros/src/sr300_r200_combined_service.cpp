@@ -1,6 +1,10 @@
 #include <ros/ros.h>
 #include <ros/callback_queue.h>
 
+#include <cmath>
+#include <condition_variable>
+#include <limits>
+#include <mutex>
 #include <string>
 #include <vector>
 
@@ -42,6 +46,7 @@
 #include <pcl/registration/icp.h>
 #include <pcl/kdtree/impl/kdtree_flann.hpp>
 #include <pcl/kdtree/kdtree.h>
+#include <pcl/search/kdtree.h>
 #include <pcl/impl/pcl_base.hpp>
 #include <pcl/kdtree/impl/kdtree_flann.hpp>
 #include <pcl/search/impl/kdtree.hpp>
@@ -58,47 +63,77 @@
 #include <apc_msgs/GetCombinedSR300R200Cloud.h>
 
 
-boost::shared_ptr<pcl::PointCloud<pcl::PointXYZRGB>> r200_cloud;
-boost::shared_ptr<pcl::PointCloud<pcl::PointXYZRGB>> sr300_cloud;
-
-ros::Subscriber sub_r200_points;
-ros::Subscriber sub_sr300_points;
-
-bool r200_cloud_received = false;
-bool sr300_cloud_received = false;
-
+// Latest cloud received on a topic. Callbacks only swap the message pointer
+// and notify, all conversion happens on the service thread.
+struct CloudSlot {
+    std::mutex mutex;
+    std::condition_variable cond;
+    sensor_msgs::PointCloud2::ConstPtr msg;
+};
+
+CloudSlot r200_slot;
+CloudSlot sr300_slot;
+
+// SR300 <- R200 extrinsic found by ICP. Cached once the grid search has
+// converged and only re-estimated when its fitness degrades. The baseline is
+// the grid search fitness, refinements don't move it, so gradual drift still
+// triggers a new search.
+std::mutex extrinsic_mutex;
+bool extrinsic_cached = false;
+Eigen::Affine3f cached_extrinsic = Eigen::Affine3f::Identity();
+double baseline_fitness = 0.0;
+
+// Parameters (private namespace)
+double r200_max_depth = 1.5;
+double emitter_settle_time = 0.5;
+double capture_timeout = 5.0;
+double leaf_size = 0.01;
+double fitness_degradation_ratio = 1.5;
+double max_correspondence_distance = 0.05;
+double max_capture_skew = 2.0;
+
+void store_cloud(CloudSlot &slot, const sensor_msgs::PointCloud2::ConstPtr &msg) {
+    {
+        std::lock_guard<std::mutex> lock(slot.mutex);
+        slot.msg = msg;
+    }
+    slot.cond.notify_all();
+}
 
 void r200_cloud_callback(const sensor_msgs::PointCloud2::ConstPtr msg) {
-    // ROS_INFO_STREAM("Received r200 msg");
-    pcl::fromROSMsg(*msg, *r200_cloud);
+    store_cloud(r200_slot, msg);
+}
 
-    pcl::io::savePCDFileASCII("r200_cloud.pcd", *r200_cloud);
+void sr300_cloud_callback(const sensor_msgs::PointCloud2::ConstPtr msg) {
+    store_cloud(sr300_slot, msg);
+}
 
-    // Use max depth of 2m for R200
-    double max_depth = 1.5;
-    pcl::PointCloud<pcl::PointXYZRGB>::iterator itr = (*r200_cloud).begin();
-    for (; itr != (*r200_cloud).end(); ++itr) {
-        if (itr->z > max_depth) {
-           itr->z = NAN;
-        }
+// Block until a cloud stamped at or after `not_before` arrives on the slot.
+// Returns an empty pointer on timeout.
+// The two cameras can't both have their emitter on, so their clouds are
+// captured one after the other, and the scene has to hold still in between.
+// Pairs stamped further apart than max_capture_skew are rejected.
+sensor_msgs::PointCloud2::ConstPtr wait_for_cloud(CloudSlot &slot, const ros::Time &not_before,
+                                                  double timeout) {
+    std::unique_lock<std::mutex> lock(slot.mutex);
+    bool received = slot.cond.wait_for(lock, std::chrono::duration<double>(timeout), [&] {
+        return slot.msg && slot.msg->header.stamp >= not_before;
+    });
+    if (!received) {
+        return sensor_msgs::PointCloud2::ConstPtr();
     }
-    std::vector<int> indices;
-    pcl::removeNaNFromPointCloud(*r200_cloud, *r200_cloud, indices);
-
-    pcl::io::savePCDFileASCII("r200_cloud_cropped_depth.pcd", *r200_cloud);
-
-    r200_cloud_received = true;
-    sub_r200_points.shutdown();
+    return slot.msg;
 }
 
-void sr300_cloud_callback(const sensor_msgs::PointCloud2::ConstPtr msg) {
-    // ROS_INFO_STREAM("Received sr300 msg");
-    pcl::fromROSMsg(*msg, *sr300_cloud);
-    // std::vector<int> indices;
-    // pcl::removeNaNFromPointCloud(*sr300_cloud, *sr300_cloud, indices);
-    // pcl::io::savePCDFileASCII("sr300_cloud.pcd", *sr300_cloud);
-    sr300_cloud_received = true;
-    sub_sr300_points.shutdown();
+// Enable one camera's emitter, then wait for the first cloud from that camera
+// captured after the emitter has settled.
+sensor_msgs::PointCloud2::ConstPtr capture_with_emitter(ros::NodeHandle &n, CloudSlot &slot,
+                                                        const std::string &on_param,
+                                                        const std::string &off_param) {
+    n.setParam(off_param, 0);
+    n.setParam(on_param, 1);
+    ros::Time not_before = ros::Time::now() + ros::Duration(emitter_settle_time);
+    return wait_for_cloud(slot, not_before, emitter_settle_time + capture_timeout);
 }
 
 bool approximate_voxel_grid(
@@ -137,39 +172,142 @@ bool outlier_removal(
     return true;
 }
 
+// Run one ICP from `guess`. Returns false if ICP did not converge.
+bool run_icp(const boost::shared_ptr<pcl::PointCloud<pcl::PointXYZ>> &input_cloud,
+             const boost::shared_ptr<pcl::PointCloud<pcl::PointXYZ>> &target_cloud,
+             const pcl::search::KdTree<pcl::PointXYZ>::Ptr &target_tree,
+             const Eigen::Affine3f &guess, Eigen::Affine3f &result, double &fitness) {
+    pcl::IterativeClosestPoint<pcl::PointXYZ, pcl::PointXYZ> icp;
+    icp.setInputTarget(target_cloud);
+    // The target tree is built once per request and shared by every ICP run
+    icp.setSearchMethodTarget(target_tree, true);
+    icp.setInputSource(input_cloud);
+    icp.setMaxCorrespondenceDistance(max_correspondence_distance);  // 0.05 worked best
+
+    pcl::PointCloud<pcl::PointXYZ> reg_result;
+    try {
+        icp.align(reg_result, guess.matrix());
+    } catch (...) {
+        return false;
+    }
+    if (!icp.hasConverged()) {
+        return false;
+    }
+
+    result = Eigen::Affine3f(icp.getFinalTransformation());
+    fitness = icp.getFitnessScore();
+    return true;
+}
+
+// Fitness of `transform` without running ICP, as ICP's getFitnessScore():
+// mean squared distance from each transformed input point to its nearest target
+double evaluate_fitness(const boost::shared_ptr<pcl::PointCloud<pcl::PointXYZ>> &input_cloud,
+                        const pcl::search::KdTree<pcl::PointXYZ>::Ptr &target_tree,
+                        const Eigen::Affine3f &transform) {
+    pcl::PointCloud<pcl::PointXYZ> transformed;
+    pcl::transformPointCloud(*input_cloud, transformed, transform);
+    if (transformed.empty()) {
+        return std::numeric_limits<double>::max();
+    }
+
+    std::vector<int> index(1);
+    std::vector<float> sqr_distance(1);
+    double total = 0.0;
+    for (size_t i = 0; i < transformed.size(); ++i) {
+        target_tree->nearestKSearch(transformed[i], 1, index, sqr_distance);
+        total += sqr_distance[0];
+    }
+    return total / transformed.size();
+}
+
+// Coarse 5x5x5 grid of translation guesses, +-10cm in 5cm steps, each refined
+// by ICP in parallel against the shared target tree.
+bool grid_search_extrinsic(const boost::shared_ptr<pcl::PointCloud<pcl::PointXYZ>> &input_cloud,
+                           const boost::shared_ptr<pcl::PointCloud<pcl::PointXYZ>> &target_cloud,
+                           const pcl::search::KdTree<pcl::PointXYZ>::Ptr &target_tree,
+                           Eigen::Affine3f &best_transform, double &lowest_fitness_score) {
+    const int steps = 5;
+    const int grid_size = steps * steps * steps;
+
+    std::vector<Eigen::Affine3f, Eigen::aligned_allocator<Eigen::Affine3f>> results(grid_size);
+    std::vector<double> fitness_scores(grid_size, std::numeric_limits<double>::max());
+    std::vector<char> converged(grid_size, 0);
+
+    #pragma omp parallel for schedule(dynamic)
+    for (int i = 0; i < grid_size; ++i) {
+        Eigen::Affine3f guess = Eigen::Affine3f::Identity();
+        guess.translation() << -0.1 + 0.05 * (i / (steps * steps)),
+                               -0.1 + 0.05 * ((i / steps) % steps),
+                               -0.1 + 0.05 * (i % steps);
+        converged[i] = run_icp(input_cloud, target_cloud, target_tree, guess, results[i], fitness_scores[i]);
+    }
+
+    bool found = false;
+    for (int i = 0; i < grid_size; ++i) {
+        if (converged[i] && (!found || fitness_scores[i] < lowest_fitness_score)) {
+            found = true;
+            lowest_fitness_score = fitness_scores[i];
+            best_transform = results[i];
+        }
+    }
+    return found;
+}
+
 bool get_combined_sr300_r200_cloud_service_callback(apc_msgs::GetCombinedSR300R200Cloud::Request &req,
                                                     apc_msgs::GetCombinedSR300R200Cloud::Response &res) {
-    //
     ros::NodeHandle n;
 
-    boost::shared_ptr<pcl::PointCloud<pcl::PointXYZ>> _sr300_cloud;
-    _sr300_cloud.reset(new pcl::PointCloud<pcl::PointXYZ>);
-    boost::shared_ptr<pcl::PointCloud<pcl::PointXYZ>> _r200_cloud;
-    _r200_cloud.reset(new pcl::PointCloud<pcl::PointXYZ>);
+    // Capture one cloud per camera, each with only its own emitter enabled
+    ros::Subscriber sub_sr300_points = n.subscribe("/realsense_wrist_local/depth_registered/points", 1, sr300_cloud_callback);
+    ros::Subscriber sub_r200_points = n.subscribe("/realsense/points", 1, r200_cloud_callback);
 
-    sub_sr300_points = n.subscribe("/realsense_wrist_local/depth_registered/points", 1, sr300_cloud_callback);
     ROS_INFO_STREAM("Waiting for sr300 cloud");
-    n.setParam("/realsense_camera_ag_node/emitter_enabled", 0);  // Just using this as an extra wait
+    sensor_msgs::PointCloud2::ConstPtr sr300_msg = capture_with_emitter(
+        n, sr300_slot, "/realsense_camera_ag_node/emitter_enabled", "/realsense_camera_r200_node/emitter_enabled");
+    ROS_INFO_STREAM("Waiting for r200 cloud");
+    sensor_msgs::PointCloud2::ConstPtr r200_msg = capture_with_emitter(
+        n, r200_slot, "/realsense_camera_r200_node/emitter_enabled", "/realsense_camera_ag_node/emitter_enabled");
+
+    n.setParam("/realsense_camera_r200_node/emitter_enabled", 0);
     n.setParam("/realsense_camera_ag_node/emitter_enabled", 1);
-    while (!sr300_cloud_received) {
-        ros::spinOnce();
+    sub_sr300_points.shutdown();
+    sub_r200_points.shutdown();
+
+    if (!sr300_msg || !r200_msg) {
+        ROS_ERROR_STREAM("Timed out waiting for " << (sr300_msg ? "r200" : "sr300") << " cloud");
+        return false;
     }
-    ROS_INFO_STREAM("Got sr300 cloud");
-    sr300_cloud_received = false;
-    pcl::copyPointCloud(*sr300_cloud, *_sr300_cloud);
-    n.setParam("/realsense_camera_ag_node/emitter_enabled", 0);
-    n.setParam("/realsense_camera_r200_node/emitter_enabled", 1);
+    double skew = std::fabs((r200_msg->header.stamp - sr300_msg->header.stamp).toSec());
+    if (max_capture_skew > 0.0 && skew > max_capture_skew) {
+        ROS_ERROR_STREAM("Clouds captured " << skew << "s apart, more than max_capture_skew " << max_capture_skew << "s");
+        return false;
+    }
+    ROS_INFO_STREAM("Got clouds, capture skew " << skew << "s");
 
-    sub_r200_points = n.subscribe("/realsense/points", 1, r200_cloud_callback);
-    ROS_INFO_STREAM("Waiting for r200 cloud");
-    while (!r200_cloud_received) {
-        ros::spinOnce();
+    boost::shared_ptr<pcl::PointCloud<pcl::PointXYZRGB>> r200_cloud;
+    r200_cloud.reset(new pcl::PointCloud<pcl::PointXYZRGB>);
+    boost::shared_ptr<pcl::PointCloud<pcl::PointXYZRGB>> sr300_cloud;
+    sr300_cloud.reset(new pcl::PointCloud<pcl::PointXYZRGB>);
+    pcl::fromROSMsg(*r200_msg, *r200_cloud);
+    pcl::fromROSMsg(*sr300_msg, *sr300_cloud);
+
+    // Crop the R200 cloud to its useful depth range
+    pcl::PointCloud<pcl::PointXYZRGB>::iterator itr = (*r200_cloud).begin();
+    for (; itr != (*r200_cloud).end(); ++itr) {
+        if (itr->z > r200_max_depth) {
+           itr->z = NAN;
+        }
     }
-    ROS_INFO_STREAM("Got r200 cloud");
-    r200_cloud_received = false;
+    std::vector<int> indices;
+    pcl::removeNaNFromPointCloud(*r200_cloud, *r200_cloud, indices);
+
+    boost::shared_ptr<pcl::PointCloud<pcl::PointXYZ>> _sr300_cloud;
+    _sr300_cloud.reset(new pcl::PointCloud<pcl::PointXYZ>);
+    boost::shared_ptr<pcl::PointCloud<pcl::PointXYZ>> _r200_cloud;
+    _r200_cloud.reset(new pcl::PointCloud<pcl::PointXYZ>);
+    pcl::copyPointCloud(*sr300_cloud, *_sr300_cloud);
+    pcl::removeNaNFromPointCloud(*_sr300_cloud, *_sr300_cloud, indices);
     pcl::copyPointCloud(*r200_cloud, *_r200_cloud);
-    n.setParam("/realsense_camera_ag_node/emitter_enabled", 1);
-    n.setParam("/realsense_camera_r200_node/emitter_enabled", 0);
 
     /*
     Downsample Input Cloud
@@ -177,135 +315,74 @@ bool get_combined_sr300_r200_cloud_service_callback(apc_msgs::GetCombinedSR300R2
     boost::shared_ptr<pcl::PointCloud<pcl::PointXYZ>> l_input_cloud;
     l_input_cloud.reset(new pcl::PointCloud<pcl::PointXYZ>);
 
-    approximate_voxel_grid(_r200_cloud, l_input_cloud, 0.01, true);
-    // l_input_cloud = _r200_cloud;
-
     /*
     Downsample Target Cloud
     */
     boost::shared_ptr<pcl::PointCloud<pcl::PointXYZ>> l_target_cloud;
     l_target_cloud.reset(new pcl::PointCloud<pcl::PointXYZ>);
 
-    approximate_voxel_grid(_sr300_cloud, l_target_cloud, 0.01, true);
-    // l_target_cloud = _sr300_cloud;
+    if (!approximate_voxel_grid(_r200_cloud, l_input_cloud, leaf_size, true) ||
+        !approximate_voxel_grid(_sr300_cloud, l_target_cloud, leaf_size, true)) {
+        return false;
+    }
 
     outlier_removal(l_input_cloud, l_input_cloud, 50.0, 1.0);
     outlier_removal(l_target_cloud, l_target_cloud, 50.0, 1.0);
 
-    pcl::io::savePCDFileBinary("sr300_cloud_approximate_outlier_binary.pcd", *l_target_cloud);
-    pcl::io::savePCDFileBinary("r200_cloud_approximate_outlier_binary.pcd", *l_input_cloud);
-
-    // /*
-
-    // Initializing Iterative Closest Point (ICP).
-    pcl::IterativeClosestPoint<pcl::PointXYZ, pcl::PointXYZ> icp;
-
-    // Setting point cloud to be aligned to.
-    icp.setInputTarget(l_target_cloud);
-
-    // Set the max correspondence distance to 5cm (e.g., correspondences with
-    // higher distances will be ignored)
-    // icp.setMaxCorrespondenceDistance(0.1);
-    icp.setMaxCorrespondenceDistance(0.05);  // worked best
-    // icp.setMaxCorrespondenceDistance(0.01);
-    // Set the maximum number of iterations (criterion 1)
-    // icp.setMaximumIterations(50);
-    // Set the transformation epsilon (criterion 2)
-    // icp.setTransformationEpsilon(1e-8);
-    // Set the euclidean distance difference epsilon (criterion 3)
-    // icp.setEuclideanFitnessEpsilon(1);
-
-    boost::shared_ptr<pcl::PointCloud<pcl::PointXYZ>> reg_result;
-    reg_result.reset(new pcl::PointCloud<pcl::PointXYZ>);
-    boost::shared_ptr<pcl::PointCloud<pcl::PointXYZ>> transformed;
-    transformed.reset(new pcl::PointCloud<pcl::PointXYZ>);
-
-    icp.setInputSource(transformed);
-
-    double fitness_score = 1.0;
-    double lowest_fitness_score = 100.0;
-    Eigen::Affine3f best_guess = Eigen::Affine3f::Identity();
-    Eigen::Affine3f best_final = Eigen::Affine3f::Identity();
-    Eigen::Affine3f transform_2 = Eigen::Affine3f::Identity();
-
-    for (double x = -0.1; x < 0.1; x+=0.05) {
-        for (double y = -0.1; y < 0.1; y+=0.05) {
-            for (double z = -0.1; z < 0.1; z+=0.05) {
-                ROS_INFO_STREAM("x = " << x << ", y = " << y << ", z = " << z);
-                transform_2.translation() << x, y, z;
-
-                pcl::transformPointCloud(*l_input_cloud, *transformed, transform_2);
-
-                try {
-                    icp.align(*reg_result);
-                } catch (...) {}
-
-                fitness_score = icp.getFitnessScore();
-                if (fitness_score < lowest_fitness_score && icp.hasConverged()) {
-                    lowest_fitness_score = fitness_score;
-                    best_guess = transform_2;
-                    best_final = icp.getFinalTransformation();
-                }
-            }
+    pcl::search::KdTree<pcl::PointXYZ>::Ptr target_tree(new pcl::search::KdTree<pcl::PointXYZ>);
+    target_tree->setInputCloud(l_target_cloud);
+
+    Eigen::Affine3f combined_transform = Eigen::Affine3f::Identity();
+    double fitness_score = 0.0;
+    bool have_transform = false;
+
+    std::lock_guard<std::mutex> lock(extrinsic_mutex);
+
+    // Use the cached extrinsic as is while it fits about as well as when the
+    // grid search found it. Once it degrades refine it with one ICP run, and
+    // fall back to the full grid search if that doesn't recover the fit.
+    if (extrinsic_cached) {
+        const double max_fitness = baseline_fitness * fitness_degradation_ratio;
+        fitness_score = evaluate_fitness(l_input_cloud, target_tree, cached_extrinsic);
+        if (fitness_score <= max_fitness) {
+            combined_transform = cached_extrinsic;
+            have_transform = true;
+        } else if (run_icp(l_input_cloud, l_target_cloud, target_tree, cached_extrinsic, combined_transform, fitness_score) &&
+                   fitness_score <= max_fitness) {
+            ROS_INFO_STREAM("Refined degraded cached extrinsic, fitness " << fitness_score);
+            cached_extrinsic = combined_transform;
+            have_transform = true;
+        } else {
+            ROS_WARN_STREAM("Cached extrinsic degraded (fitness " << fitness_score << " vs "
+                            << baseline_fitness << "), re-running grid search");
         }
     }
 
-    Eigen::Affine3f combined_transform = best_final * best_guess;
+    if (!have_transform) {
+        have_transform = grid_search_extrinsic(l_input_cloud, l_target_cloud, target_tree,
+                                               combined_transform, fitness_score);
+        if (!have_transform) {
+            ROS_ERROR_STREAM("ICP did not converge for any initial guess");
+            return false;
+        }
+        ROS_INFO_STREAM("Grid search converged, fitness " << fitness_score);
+        cached_extrinsic = combined_transform;
+        baseline_fitness = fitness_score;
+        extrinsic_cached = true;
+    }
 
     boost::shared_ptr<pcl::PointCloud<pcl::PointXYZRGB>> _r200_cloud_transformed;
     _r200_cloud_transformed.reset(new pcl::PointCloud<pcl::PointXYZRGB>);
 
     pcl::transformPointCloud(*r200_cloud, *_r200_cloud_transformed, combined_transform);
 
-    pcl::toROSMsg(*_r200_cloud_transformed, res.combined_cloud);
-
-    pcl::io::savePCDFileBinary("sr300_cloud_binary.pcd", *sr300_cloud);
-
-    // */
-
-    /*
-
-    pcl::NormalDistributionsTransform<pcl::PointXYZ, pcl::PointXYZ> ndt;
-
-    boost::shared_ptr<pcl::PointCloud<pcl::PointXYZRGB>> _r200_cloud_transformed;
-    _r200_cloud_transformed.reset(new pcl::PointCloud<pcl::PointXYZRGB>);
-
-    // Setting scale dependent NDT parameters
-    // Setting minimum transformation difference for termination condition.
-    ndt.setTransformationEpsilon(0.01);  // 0.001
-    // Setting maximum step size for More-Thuente line search.
-    ndt.setStepSize(0.1);  // 0.02
-    // Setting Resolution of NDT grid structure (VoxelGridCovariance).
-    ndt.setResolution(0.05);  // 1.0
-
-    // Setting max number of registration iterations.
-    ndt.setMaximumIterations(10);
-
-    // Setting point cloud to be aligned.
-    ndt.setInputSource(l_input_cloud);
-    // Setting point cloud to be aligned to.
-    ndt.setInputTarget(l_target_cloud);
-
-    // Set initial alignment estimate found using robot odometry.
-    Eigen::AngleAxisf init_rotation (0.0, Eigen::Vector3f::UnitZ ());
-    Eigen::Translation3f init_translation (0.0, 0.0, 0.0);
-    Eigen::Matrix4f init_guess = (init_translation * init_rotation).matrix ();
-
-    // Calculating required rigid transform to align the input cloud to the target cloud.
-    pcl::PointCloud<pcl::PointXYZ>::Ptr output_cloud (new pcl::PointCloud<pcl::PointXYZ>);
-    ndt.align (*output_cloud, init_guess);
-
-    std::cout << "Normal Distributions Transform has converged:" << ndt.hasConverged ()
-            << " score: " << ndt.getFitnessScore () << std::endl;
-
-    // Transforming unfiltered, input cloud using found transform.
-    pcl::transformPointCloud (*r200_cloud, *_r200_cloud_transformed, ndt.getFinalTransformation());
+    // Fuse both clouds in the SR300 frame
+    pcl::removeNaNFromPointCloud(*sr300_cloud, *sr300_cloud, indices);
+    *_r200_cloud_transformed += *sr300_cloud;
 
     pcl::toROSMsg(*_r200_cloud_transformed, res.combined_cloud);
-
-    pcl::io::savePCDFileBinary("sr300_cloud_binary.pcd", *sr300_cloud);
-
-    */
+    res.combined_cloud.header.frame_id = sr300_msg->header.frame_id;
+    res.combined_cloud.header.stamp = sr300_msg->header.stamp;
 
     ROS_INFO_STREAM("Done");
 
@@ -317,26 +394,28 @@ int main(int argc, char** argv) {
 
     ros::NodeHandle n;
 
-    // TODO service that asks for a point r200_cloud
-    // Service should:
-    //  * grab sr300 pc
-    //  * turn off sr300 emitter
-    //  * turn on r200 emitter
-    //  * grab r200 pc
-    //  * turn off r200 emitter
-    //  * turn on sr300 emitter
-
-    r200_cloud.reset(new pcl::PointCloud<pcl::PointXYZRGB>);
-    sr300_cloud.reset(new pcl::PointCloud<pcl::PointXYZRGB>);
+    // Service that asks for a combined point cloud:
+    //  * grab sr300 pc with only the sr300 emitter on
+    //  * grab r200 pc with only the r200 emitter on
+    //  * turn off r200 emitter, turn on sr300 emitter
+    //  * align r200 pc to sr300 pc and fuse them
+
+    ros::NodeHandle pn("~");
+    pn.param("r200_max_depth", r200_max_depth, r200_max_depth);
+    pn.param("emitter_settle_time", emitter_settle_time, emitter_settle_time);
+    pn.param("capture_timeout", capture_timeout, capture_timeout);
+    pn.param("leaf_size", leaf_size, leaf_size);
+    pn.param("fitness_degradation_ratio", fitness_degradation_ratio, fitness_degradation_ratio);
+    pn.param("max_correspondence_distance", max_correspondence_distance, max_correspondence_distance);
+    pn.param("max_capture_skew", max_capture_skew, max_capture_skew);
 
     ros::ServiceServer service_handle = n.advertiseService("/get_combined_sr300_r200_cloud", get_combined_sr300_r200_cloud_service_callback);
 
-    ros::Rate rate(30);
-
-    while (n.ok()) {
-        ros::spinOnce();
-        rate.sleep();
-    }
+    // The service blocks waiting for clouds, so subscriber callbacks need
+    // their own threads
+    ros::AsyncSpinner spinner(3);
+    spinner.start();
+    ros::waitForShutdown();
 
     return 0;
 }
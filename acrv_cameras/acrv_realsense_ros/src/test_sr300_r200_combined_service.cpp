@@ -35,7 +35,7 @@ int main(int argc, char **argv) {
     // Call the service
     if (sr300_r200_combined_service_client.call(get_combined_cloud_srv)) {
         pcl::fromROSMsg(get_combined_cloud_srv.response.combined_cloud, combined_cloud);
-        pcl::io::savePCDFileASCII("combined_cloud.pcd", combined_cloud);
+        pcl::io::savePCDFileBinaryCompressed("combined_cloud.pcd", combined_cloud);
         ROS_INFO_STREAM("Saved combined_cloud.pcd");
     } else {
         ROS_INFO_STREAM("Failed to call service!");
@@ -0,0 +1,77 @@
+/*
+Copyright 2017 Australian Centre for Robotic Vision
+*/
+
+#include <acrv_realsense_ros/capture_recorder.h>
+#include <ros/serialization.h>
+#include <gtest/gtest.h>
+
+#include <boost/filesystem.hpp>
+
+#include <fstream>
+#include <string>
+#include <vector>
+
+using acrv_realsense_ros::AsyncWriter;
+using acrv_realsense_ros::CaptureContainer;
+using acrv_realsense_ros::CaptureRecorder;
+
+// A camera info recorded into a container can be found through the index and
+// deserialised back from the payload it points at
+TEST(CaptureRecorder, cameraInfoReadsBackFromContainer) {
+    boost::filesystem::path dir = boost::filesystem::temp_directory_path() / boost::filesystem::unique_path();
+    boost::filesystem::create_directories(dir);
+    const std::string container_path = (dir / "captures.bin").string();
+
+    sensor_msgs::CameraInfo info;
+    info.header.stamp = ros::Time(1500000000, 123456789);
+    info.header.frame_id = "realsense_depth_optical_frame";
+    info.width = 640;
+    info.height = 480;
+    info.distortion_model = "plumb_bob";
+    info.D = {-0.12, -0.07, 0.0006, -0.003, 0.068};
+    info.K = {478.7, 0.0, 326.9, 0.0, 478.9, 239.1, 0.0, 0.0, 1.0};
+    info.P = {442.5, 0.0, 325.7, 0.0, 0.0, 460.9, 239.3, 0.0, 0.0, 0.0, 1.0, 0.0};
+
+    {
+        CaptureRecorder recorder(2, 8, AsyncWriter::BLOCK, container_path);
+        ASSERT_TRUE(recorder.record_camera_info("img 00001", "depth", info));
+        recorder.flush();
+        EXPECT_EQ(recorder.writer().written(), 1u);
+        EXPECT_EQ(recorder.writer().failed(), 0u);
+    }
+
+    std::ifstream index((container_path + ".idx").c_str());
+    std::string capture, stream;
+    int kind;
+    uint64_t stamp, offset, length;
+    ASSERT_TRUE(static_cast<bool>(index >> capture >> stream >> kind >> stamp >> offset >> length));
+    EXPECT_EQ(capture, "img%2000001");
+    EXPECT_EQ(stream, "depth");
+    EXPECT_EQ(kind, static_cast<int>(CaptureContainer::CAMERA_INFO));
+    EXPECT_EQ(stamp, info.header.stamp.toNSec());
+
+    std::vector<uint8_t> payload(length);
+    std::ifstream data(container_path.c_str(), std::ios::binary);
+    data.seekg(offset);
+    ASSERT_TRUE(static_cast<bool>(data.read(reinterpret_cast<char *>(payload.data()), payload.size())));
+
+    sensor_msgs::CameraInfo read;
+    ros::serialization::IStream payload_stream(payload.data(), payload.size());
+    ros::serialization::deserialize(payload_stream, read);
+    EXPECT_EQ(read.header.stamp, info.header.stamp);
+    EXPECT_EQ(read.header.frame_id, info.header.frame_id);
+    EXPECT_EQ(read.width, info.width);
+    EXPECT_EQ(read.height, info.height);
+    EXPECT_EQ(read.distortion_model, info.distortion_model);
+    EXPECT_EQ(read.D, info.D);
+    EXPECT_EQ(read.K, info.K);
+    EXPECT_EQ(read.P, info.P);
+
+    boost::filesystem::remove_all(dir);
+}
+
+int main(int argc, char **argv) {
+    testing::InitGoogleTest(&argc, argv);
+    return RUN_ALL_TESTS();
+}
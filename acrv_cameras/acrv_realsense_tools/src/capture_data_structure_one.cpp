@@ -156,7 +156,7 @@ int main() try
 
         std::stringstream cloud_fn;
         cloud_fn << "../data/" << capture_count << "_cloud.pcd";
-        pcl::io::savePCDFileASCII(cloud_fn.str(), *color_reg_depth_cloud);
+        pcl::io::savePCDFileBinary(cloud_fn.str(), *color_reg_depth_cloud);
         // Point Cloud
 
         std::vector<int> compression_params;
@@ -183,7 +183,7 @@ int main() try
         }
 
         cloud_fn << folder_name.str() << "/cloud.pcd";
-        pcl::io::savePCDFileASCII(cloud_fn.str(), *color_reg_depth_cloud);
+        pcl::io::savePCDFileBinary(cloud_fn.str(), *color_reg_depth_cloud);
         // Point Cloud
         std::vector<int> compression_params;
         compression_params.push_back(CV_IMWRITE_PNG_COMPRESSION);
@@ -0,0 +1,306 @@
+/*********************************************************************
+* Software License Agreement (BSD License)
+* 
+*  Copyright (c) 2008, Willow Garage, Inc.
+*  All rights reserved.
+* 
+*  Redistribution and use in source and binary forms, with or without
+*  modification, are permitted provided that the following conditions
+*  are met:
+* 
+*   * Redistributions of source code must retain the above copyright
+*     notice, this list of conditions and the following disclaimer.
+*   * Redistributions in binary form must reproduce the above
+*     copyright notice, this list of conditions and the following
+*     disclaimer in the documentation and/or other materials provided
+*     with the distribution.
+*   * Neither the name of the Willow Garage nor the names of its
+*     contributors may be used to endorse or promote products derived
+*     from this software without specific prior written permission.
+* 
+*  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+*  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+*  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+*  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+*  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+*  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+*  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+*  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+*  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+*  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+*  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+*  POSSIBILITY OF SUCH DAMAGE.
+*********************************************************************/
+#ifndef DEPTH_IMAGE_PROC_DEPTH_REGISTRATION
+#define DEPTH_IMAGE_PROC_DEPTH_REGISTRATION
+
+#include <sensor_msgs/Image.h>
+#include <image_geometry/pinhole_camera_model.h>
+#include <Eigen/Geometry>
+#include <opencv2/core/core.hpp>
+#include <depth_image_proc/depth_traits.h>
+
+#include <algorithm>
+#include <climits>
+#include <cmath>
+#include <limits>
+#include <vector>
+
+namespace depth_image_proc {
+
+// Maps a depth pixel (u,v) with depth d in meters to the RGB camera with a single matrix multiply: (x,y,z) = M * (u*d, v*d, d, 1)
+// lands on RGB pixel (x/z, y/z) at depth z. M folds together the depth back-projection, the depth to RGB transform and the
+// RGB projection.
+typedef Eigen::Matrix<float, 3, 4> RegistrationMatrix;
+
+// Per-frame working memory of the registration, kept between frames to avoid reallocating it
+struct RegistrationBuffers
+{
+  std::vector<float> u, v, z;         // Projection of every depth pixel, z <= 0 where there is nothing to register
+  std::vector<int> row_min, row_max;  // Range of RGB rows each depth row lands on, empty rows have row_min > row_max
+  std::vector<float> z_buffer;        // Nearest depth registered onto every RGB pixel, infinity where nothing landed
+};
+
+// Projects whole depth rows of type T into the RGB image. The matrix multiply itself is branch free so the compiler can vectorize it.
+template<typename T>
+class ProjectDepthRows : public cv::ParallelLoopBody
+{
+  const cv::Mat& depth_;
+  const RegistrationMatrix& m_;
+  int rgb_height_;
+  RegistrationBuffers& buffers_;
+
+public:
+  ProjectDepthRows(const cv::Mat& depth, const RegistrationMatrix& m, int rgb_height, RegistrationBuffers& buffers)
+    : depth_(depth), m_(m), rgb_height_(rgb_height), buffers_(buffers) {}
+
+  virtual void operator()(const cv::Range& rows) const
+  {
+    const int width = depth_.cols;
+    for (int v = rows.start; v < rows.end; ++v)
+    {
+      const T* depth_row = depth_.ptr<T>(v);
+      float* pu = &buffers_.u[v * width];
+      float* pv = &buffers_.v[v * width];
+      float* pz = &buffers_.z[v * width];
+
+      // Depth in meters, zero where missing
+      for (int u = 0; u < width; ++u)
+      {
+        T raw_depth = depth_row[u];
+        pz[u] = DepthTraits<T>::valid(raw_depth) ? DepthTraits<T>::toMeters(raw_depth) : 0.0f;
+      }
+
+      // The v terms of M are constant along the row
+      const float m00 = m_(0,0), m10 = m_(1,0), m20 = m_(2,0);
+      const float m03 = m_(0,3), m13 = m_(1,3), m23 = m_(2,3);
+      const float cx = m_(0,1) * v + m_(0,2), cy = m_(1,1) * v + m_(1,2), cz = m_(2,1) * v + m_(2,2);
+      for (int u = 0; u < width; ++u)
+      {
+        const float d = pz[u], fu = u;
+        const float x = (m00 * fu + cx) * d + m03;
+        const float y = (m10 * fu + cy) * d + m13;
+        const float z = (m20 * fu + cz) * d + m23;
+        const float inv_z = 1.0f / z;
+        pu[u] = x * inv_z;
+        pv[u] = y * inv_z;
+        pz[u] = d > 0.0f ? z : 0.0f;
+      }
+
+      float lowest = std::numeric_limits<float>::infinity(), highest = -lowest;
+      for (int u = 0; u < width; ++u)
+      {
+        if (pz[u] > 0.0f)
+        {
+          lowest = std::min(lowest, pv[u]);
+          highest = std::max(highest, pv[u]);
+        }
+      }
+      if (lowest <= highest)
+      {
+        buffers_.row_min[v] = std::floor(std::max(lowest, -1.0f) + 0.5f);
+        buffers_.row_max[v] = std::floor(std::min(highest, (float)rgb_height_) + 0.5f);
+      }
+      else
+      {
+        buffers_.row_min[v] = INT_MAX;
+        buffers_.row_max[v] = INT_MIN;
+      }
+    }
+  }
+};
+
+// Z-buffers the projected depth pixels onto bands of RGB rows, writing depth as U. Every band owns its rows of the z-buffer and of the output,
+// and only visits the depth rows landing on it, so bands run in parallel without sharing writes. The nearest depth wins each
+// RGB pixel, which is independent of the order pixels are visited in and therefore of the number of threads.
+//
+// When rasterizing, the two triangles of every 2x2 block of depth pixels are also filled in, interpolating 1/z so depth is
+// perspective correct. Triangles spanning a depth jump larger than max_jump times their nearest depth straddle an object
+// boundary and are skipped, leaving only their corners.
+template<typename T, typename U>
+class RegisterDepthBands : public cv::ParallelLoopBody
+{
+  RegistrationBuffers& buffers_;
+  int depth_width_, depth_height_;
+  int width_, height_, band_rows_;
+  bool rasterize_;
+  float max_jump_;
+  U* registered_;
+
+  void splatRow(int v, int y0, int y1) const
+  {
+    const int first = v * depth_width_;
+    for (int i = first; i < first + depth_width_; ++i)
+    {
+      const float z = buffers_.z[i], fu = buffers_.u[i], fv = buffers_.v[i];
+      if (!(z > 0.0f && fu > -0.5f && fu < width_ && fv > -0.5f && fv < height_))
+        continue;
+      const int x = fu + 0.5f, y = fv + 0.5f;
+      if (x >= width_ || y < y0 || y >= y1)
+        continue;
+      float& nearest = buffers_.z_buffer[y * width_ + x];
+      nearest = std::min(nearest, z);
+    }
+  }
+
+  void rasterizeTriangle(int i0, int i1, int i2, int y0, int y1) const
+  {
+    const float z0 = buffers_.z[i0], z1 = buffers_.z[i1], z2 = buffers_.z[i2];
+    if (!(z0 > 0.0f && z1 > 0.0f && z2 > 0.0f))
+      return;
+    const float z_min = std::min(z0, std::min(z1, z2)), z_max = std::max(z0, std::max(z1, z2));
+    if (z_max - z_min > max_jump_ * z_min)
+      return;
+
+    const float u0 = buffers_.u[i0], u1 = buffers_.u[i1], u2 = buffers_.u[i2];
+    const float v0 = buffers_.v[i0], v1 = buffers_.v[i1], v2 = buffers_.v[i2];
+    const float area = (u1 - u0) * (v2 - v0) - (u2 - u0) * (v1 - v0);
+    if (!(std::fabs(area) > 0.0f))
+      return;
+    const float inv_area = 1.0f / area;
+
+    // Pixel centers inside the bounding box, clamped to the band before converting to int
+    const float left   = std::max(std::min(u0, std::min(u1, u2)), 0.0f);
+    const float right  = std::min(std::max(u0, std::max(u1, u2)), width_ - 1.0f);
+    const float top    = std::max(std::min(v0, std::min(v1, v2)), (float)y0);
+    const float bottom = std::min(std::max(v0, std::max(v1, v2)), y1 - 1.0f);
+    if (!(left <= right && top <= bottom))
+      return;
+
+    for (int y = std::ceil(top); y <= (int)std::floor(bottom); ++y)
+    {
+      for (int x = std::ceil(left); x <= (int)std::floor(right); ++x)
+      {
+        const float w0 = ((u1 - x) * (v2 - y) - (u2 - x) * (v1 - y)) * inv_area;
+        const float w1 = ((u2 - x) * (v0 - y) - (u0 - x) * (v2 - y)) * inv_area;
+        const float w2 = 1.0f - w0 - w1;
+        if (w0 < 0.0f || w1 < 0.0f || w2 < 0.0f)
+          continue;
+        float& nearest = buffers_.z_buffer[y * width_ + x];
+        nearest = std::min(nearest, 1.0f / (w0 / z0 + w1 / z1 + w2 / z2));
+      }
+    }
+  }
+
+public:
+  RegisterDepthBands(RegistrationBuffers& buffers, int depth_width, int depth_height, int width, int height,
+                     int band_rows, bool rasterize, float max_jump, U* registered)
+    : buffers_(buffers), depth_width_(depth_width), depth_height_(depth_height),
+      width_(width), height_(height), band_rows_(band_rows), rasterize_(rasterize), max_jump_(max_jump),
+      registered_(registered) {}
+
+  virtual void operator()(const cv::Range& bands) const
+  {
+    for (int band = bands.start; band < bands.end; ++band)
+    {
+      const int y0 = band * band_rows_, y1 = std::min(y0 + band_rows_, height_);
+      std::fill(buffers_.z_buffer.begin() + y0 * width_, buffers_.z_buffer.begin() + y1 * width_, std::numeric_limits<float>::infinity());
+
+      for (int v = 0; v < depth_height_; ++v)
+      {
+        if (buffers_.row_min[v] < y1 && buffers_.row_max[v] >= y0)
+          splatRow(v, y0, y1);
+
+        if (!rasterize_ || v + 1 == depth_height_ ||
+            std::min(buffers_.row_min[v], buffers_.row_min[v + 1]) >= y1 ||
+            std::max(buffers_.row_max[v], buffers_.row_max[v + 1]) < y0)
+          continue;
+        for (int i = v * depth_width_; i + 1 < (v + 1) * depth_width_; ++i)
+        {
+          rasterizeTriangle(i, i + 1, i + depth_width_, y0, y1);
+          rasterizeTriangle(i + 1, i + depth_width_ + 1, i + depth_width_, y0, y1);
+        }
+      }
+
+      for (int i = y0 * width_; i < y1 * width_; ++i)
+      {
+        if (buffers_.z_buffer[i] != std::numeric_limits<float>::infinity())
+          registered_[i] = DepthTraits<U>::fromMeters(buffers_.z_buffer[i]);
+      }
+    }
+  }
+};
+
+// Registers a single channel depth image of type T onto the RGB camera as an image of type U. registered_msg must already
+// have the RGB image width and height, its step and data are set here. Pixels nothing lands on are left invalid.
+template<typename T, typename U>
+void registerDepth(const cv::Mat& depth,
+                   const image_geometry::PinholeCameraModel& depth_model,
+                   const image_geometry::PinholeCameraModel& rgb_model,
+                   const Eigen::Affine3d& depth_to_rgb,
+                   bool rasterize, double max_jump,
+                   RegistrationBuffers& buffers,
+                   sensor_msgs::Image& registered_msg)
+{
+  // Allocate memory for registered depth image
+  registered_msg.step = registered_msg.width * sizeof(U);
+  registered_msg.data.resize( registered_msg.height * registered_msg.step );
+  // data is already zero-filled in the uint16 case, but for floats we want to initialize everything to NaN.
+  DepthTraits<U>::initializeBuffer(registered_msg.data);
+
+  // Reproject (u*d,v*d,d,1) to (X,Y,Z,1) in depth camera frame
+  Eigen::Matrix4d depth_inverse = Eigen::Matrix4d::Identity();
+  depth_inverse(0,0) = 1.0 / depth_model.fx();
+  depth_inverse(0,2) = -depth_model.cx() / depth_model.fx();
+  depth_inverse(0,3) = -depth_model.Tx() / depth_model.fx();
+  depth_inverse(1,1) = 1.0 / depth_model.fy();
+  depth_inverse(1,2) = -depth_model.cy() / depth_model.fy();
+  depth_inverse(1,3) = -depth_model.Ty() / depth_model.fy();
+
+  // Project (X,Y,Z,1) in RGB camera frame to (u*Z,v*Z,Z)
+  Eigen::Matrix<double, 3, 4> rgb_projection = Eigen::Matrix<double, 3, 4>::Zero();
+  rgb_projection(0,0) = rgb_model.fx();
+  rgb_projection(0,2) = rgb_model.cx();
+  rgb_projection(0,3) = rgb_model.Tx();
+  rgb_projection(1,1) = rgb_model.fy();
+  rgb_projection(1,2) = rgb_model.cy();
+  rgb_projection(1,3) = rgb_model.Ty();
+  rgb_projection(2,2) = 1.0;
+
+  RegistrationMatrix m = (rgb_projection * depth_to_rgb.matrix() * depth_inverse).cast<float>();
+
+  const int depth_width = depth.cols, depth_height = depth.rows;
+  const int width = registered_msg.width, height = registered_msg.height;
+  if (width == 0 || height == 0 || depth_width == 0 || depth_height == 0)
+    return;
+  buffers.u.resize(depth_width * depth_height);
+  buffers.v.resize(depth_width * depth_height);
+  buffers.z.resize(depth_width * depth_height);
+  buffers.row_min.resize(depth_height);
+  buffers.row_max.resize(depth_height);
+  buffers.z_buffer.resize(width * height);
+
+  cv::parallel_for_(cv::Range(0, depth_height), ProjectDepthRows<T>(depth, m, height, buffers));
+
+  // A few bands per thread balances the load, while keeping the number of depth rows visited by more than one band low
+  int band_rows = std::max(8, height / (4 * std::max(1, cv::getNumThreads())));
+  int bands = (height + band_rows - 1) / band_rows;
+  U* registered_data = reinterpret_cast<U*>(&registered_msg.data[0]);
+  cv::parallel_for_(cv::Range(0, bands),
+                    RegisterDepthBands<T, U>(buffers, depth_width, depth_height, width, height, band_rows,
+                                             rasterize, max_jump, registered_data));
+}
+
+} // namespace depth_image_proc
+
+#endif
@@ -0,0 +1,226 @@
+/*********************************************************************
+* Software License Agreement (BSD License)
+* 
+*  Copyright (c) 2008, Willow Garage, Inc.
+*  All rights reserved.
+* 
+*  Redistribution and use in source and binary forms, with or without
+*  modification, are permitted provided that the following conditions
+*  are met:
+* 
+*   * Redistributions of source code must retain the above copyright
+*     notice, this list of conditions and the following disclaimer.
+*   * Redistributions in binary form must reproduce the above
+*     copyright notice, this list of conditions and the following
+*     disclaimer in the documentation and/or other materials provided
+*     with the distribution.
+*   * Neither the name of the Willow Garage nor the names of its
+*     contributors may be used to endorse or promote products derived
+*     from this software without specific prior written permission.
+* 
+*  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+*  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+*  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+*  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+*  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+*  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+*  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+*  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+*  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+*  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+*  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+*  POSSIBILITY OF SUCH DAMAGE.
+*********************************************************************/
+#ifndef DEPTH_IMAGE_PROC_POINT_CLOUD_XYZRGB
+#define DEPTH_IMAGE_PROC_POINT_CLOUD_XYZRGB
+
+#include <ros/assert.h>
+#include <sensor_msgs/Image.h>
+#include <sensor_msgs/PointCloud2.h>
+#include <image_geometry/pinhole_camera_model.h>
+#include <opencv2/core/core.hpp>
+#include <depth_image_proc/depth_traits.h>
+
+#include <algorithm>
+#include <limits>
+#include <vector>
+
+namespace depth_image_proc {
+
+// A point as laid out by setPointCloud2FieldsByString(2, "xyz", "rgb"), which pads both fields to 16 bytes
+struct PointXyzrgb
+{
+  float x, y, z, padding_xyz;
+  uint8_t b, g, r, a;
+  uint8_t padding_rgb[12];
+};
+
+// Builds the points of whole rows, one packed store per point. X and Y are the raw depth times a factor precomputed for
+// each column and each row, which folds in the principal point, focal length and unit conversion.
+//
+// Organized clouds get a point for every pixel, NaN where depth is invalid. Dense clouds only get the valid pixels, each
+// row starting at a precomputed offset so rows can be filled in parallel, and every pixel of the index image gets the index
+// of its point or -1.
+template<typename T>
+class BuildXyzrgbRows : public cv::ParallelLoopBody
+{
+  const sensor_msgs::Image& depth_;
+  const sensor_msgs::Image& rgb_;
+  const std::vector<float>& column_x_;
+  const std::vector<float>& row_y_;
+  int red_offset_, green_offset_, blue_offset_, color_step_;
+  const std::vector<int>* row_start_;
+  PointXyzrgb* points_;
+  int32_t* indices_;
+
+public:
+  BuildXyzrgbRows(const sensor_msgs::Image& depth, const sensor_msgs::Image& rgb,
+                  const std::vector<float>& column_x, const std::vector<float>& row_y,
+                  int red_offset, int green_offset, int blue_offset, int color_step,
+                  const std::vector<int>* row_start, PointXyzrgb* points, int32_t* indices)
+    : depth_(depth), rgb_(rgb), column_x_(column_x), row_y_(row_y),
+      red_offset_(red_offset), green_offset_(green_offset), blue_offset_(blue_offset), color_step_(color_step),
+      row_start_(row_start), points_(points), indices_(indices) {}
+
+  virtual void operator()(const cv::Range& rows) const
+  {
+    const int width = depth_.width;
+    const float bad_point = std::numeric_limits<float>::quiet_NaN();
+    for (int v = rows.start; v < rows.end; ++v)
+    {
+      const T* depth_row = reinterpret_cast<const T*>(&depth_.data[v * depth_.step]);
+      const uint8_t* rgb = &rgb_.data[v * rgb_.step];
+      const float y_factor = row_y_[v];
+
+      if (!row_start_)
+      {
+        PointXyzrgb* point = points_ + v * width;
+        for (int u = 0; u < width; ++u, rgb += color_step_)
+        {
+          T depth = depth_row[u];
+          PointXyzrgb p = PointXyzrgb();
+          if (DepthTraits<T>::valid(depth))
+          {
+            p.x = column_x_[u] * depth;
+            p.y = y_factor * depth;
+            p.z = DepthTraits<T>::toMeters(depth);
+          }
+          else
+          {
+            p.x = p.y = p.z = bad_point;
+          }
+          p.r = rgb[red_offset_];
+          p.g = rgb[green_offset_];
+          p.b = rgb[blue_offset_];
+          p.a = 255;
+          point[u] = p;
+        }
+        continue;
+      }
+
+      int32_t index = (*row_start_)[v];
+      int32_t* index_row = indices_ + v * width;
+      for (int u = 0; u < width; ++u, rgb += color_step_)
+      {
+        T depth = depth_row[u];
+        if (!DepthTraits<T>::valid(depth))
+        {
+          index_row[u] = -1;
+          continue;
+        }
+        PointXyzrgb p = PointXyzrgb();
+        p.x = column_x_[u] * depth;
+        p.y = y_factor * depth;
+        p.z = DepthTraits<T>::toMeters(depth);
+        p.r = rgb[red_offset_];
+        p.g = rgb[green_offset_];
+        p.b = rgb[blue_offset_];
+        p.a = 255;
+        points_[index] = p;
+        index_row[u] = index++;
+      }
+    }
+  }
+};
+
+// Per-frame working memory of convertXyzrgb, kept between frames to avoid reallocating it
+struct XyzrgbBuffers
+{
+  std::vector<float> column_x, row_y;
+  std::vector<int> row_start;
+};
+
+// Fills cloud_msg, whose fields must have been set with setPointCloud2FieldsByString(2, "xyz", "rgb"), from a depth image
+// of type T and a color image of the same size. Without an index image the cloud is organized. With one, the cloud is
+// dense and index_msg, a 32SC1 image the size of the depth image, maps every pixel to its point.
+template<typename T>
+void convertXyzrgb(const sensor_msgs::Image& depth_msg,
+                   const sensor_msgs::Image& rgb_msg,
+                   const image_geometry::PinholeCameraModel& model,
+                   int red_offset, int green_offset, int blue_offset, int color_step,
+                   XyzrgbBuffers& buffers,
+                   sensor_msgs::PointCloud2& cloud_msg,
+                   sensor_msgs::Image* index_msg)
+{
+  // Use correct principal point from calibration
+  float center_x = model.cx();
+  float center_y = model.cy();
+
+  // Combine unit conversion (if necessary) with scaling by focal length for computing (X,Y)
+  double unit_scaling = DepthTraits<T>::toMeters( T(1) );
+  float constant_x = unit_scaling / model.fx();
+  float constant_y = unit_scaling / model.fy();
+
+  const int width = depth_msg.width, height = depth_msg.height;
+  if (width == 0 || height == 0)
+    return;
+  buffers.column_x.resize(width);
+  for (int u = 0; u < width; ++u)
+    buffers.column_x[u] = (u - center_x) * constant_x;
+  buffers.row_y.resize(height);
+  for (int v = 0; v < height; ++v)
+    buffers.row_y[v] = (v - center_y) * constant_y;
+
+  if (!index_msg)
+  {
+    ROS_ASSERT(cloud_msg.point_step == sizeof(PointXyzrgb));
+    PointXyzrgb* points = reinterpret_cast<PointXyzrgb*>(&cloud_msg.data[0]);
+    cv::parallel_for_(cv::Range(0, height),
+                      BuildXyzrgbRows<T>(depth_msg, rgb_msg, buffers.column_x, buffers.row_y,
+                                         red_offset, green_offset, blue_offset, color_step, NULL, points, NULL));
+    return;
+  }
+
+  // Dense cloud: one row of valid points, in the order of the pixels they come from
+  buffers.row_start.resize(height);
+  int count = 0;
+  for (int v = 0; v < height; ++v)
+  {
+    buffers.row_start[v] = count;
+    const T* depth_row = reinterpret_cast<const T*>(&depth_msg.data[v * depth_msg.step]);
+    for (int u = 0; u < width; ++u)
+      count += DepthTraits<T>::valid(depth_row[u]);
+  }
+
+  cloud_msg.height = 1;
+  cloud_msg.width = count;
+  cloud_msg.row_step = count * cloud_msg.point_step;
+  cloud_msg.data.resize(cloud_msg.row_step);
+  cloud_msg.is_dense = true;
+  if (count == 0)
+  {
+    std::fill(index_msg->data.begin(), index_msg->data.end(), 0xff);
+    return;
+  }
+
+  ROS_ASSERT(cloud_msg.point_step == sizeof(PointXyzrgb));
+  PointXyzrgb* points = reinterpret_cast<PointXyzrgb*>(&cloud_msg.data[0]);
+  int32_t* indices = reinterpret_cast<int32_t*>(&index_msg->data[0]);
+  cv::parallel_for_(cv::Range(0, height),
+                    BuildXyzrgbRows<T>(depth_msg, rgb_msg, buffers.column_x, buffers.row_y,
+                                       red_offset, green_offset, blue_offset, color_step, &buffers.row_start, points, indices));
+}
+
+} // namespace depth_image_proc
+
+#endif
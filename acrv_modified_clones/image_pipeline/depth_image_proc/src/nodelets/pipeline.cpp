@@ -0,0 +1,584 @@
+/*********************************************************************
+* Software License Agreement (BSD License)
+* 
+*  Copyright (c) 2008, Willow Garage, Inc.
+*  All rights reserved.
+* 
+*  Redistribution and use in source and binary forms, with or without
+*  modification, are permitted provided that the following conditions
+*  are met:
+* 
+*   * Redistributions of source code must retain the above copyright
+*     notice, this list of conditions and the following disclaimer.
+*   * Redistributions in binary form must reproduce the above
+*     copyright notice, this list of conditions and the following
+*     disclaimer in the documentation and/or other materials provided
+*     with the distribution.
+*   * Neither the name of the Willow Garage nor the names of its
+*     contributors may be used to endorse or promote products derived
+*     from this software without specific prior written permission.
+* 
+*  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+*  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+*  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+*  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+*  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+*  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+*  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+*  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+*  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+*  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+*  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+*  POSSIBILITY OF SUCH DAMAGE.
+*********************************************************************/
+#include <boost/version.hpp>
+#if ((BOOST_VERSION / 100) % 1000) >= 53
+#include <boost/thread/lock_guard.hpp>
+#endif
+
+#include <ros/ros.h>
+#include <nodelet/nodelet.h>
+#include <image_transport/image_transport.h>
+#include <image_transport/subscriber_filter.h>
+#include <message_filters/subscriber.h>
+#include <message_filters/synchronizer.h>
+#include <message_filters/sync_policies/approximate_time.h>
+#include <tf2_ros/buffer.h>
+#include <tf2_ros/transform_listener.h>
+#include <sensor_msgs/image_encodings.h>
+#include <sensor_msgs/point_cloud2_iterator.h>
+#include <diagnostic_msgs/DiagnosticArray.h>
+#include <image_geometry/pinhole_camera_model.h>
+#include <eigen_conversions/eigen_msg.h>
+#include <cv_bridge/cv_bridge.h>
+#include <depth_image_proc/depth_registration.h>
+#include <depth_image_proc/point_cloud_xyzrgb.h>
+
+#include <algorithm>
+#include <limits>
+#include <sstream>
+
+namespace depth_image_proc {
+
+using namespace message_filters::sync_policies;
+namespace enc = sensor_msgs::image_encodings;
+
+// Runs convert_metric, rectify, register and point_cloud_xyzrgb as one nodelet. Every stage reads the buffers the previous
+// one wrote, and each output is published once as a shared message, so nodelets in the same manager receive it without
+// serialization or copies. Stages run only when something downstream of them is subscribed, and their timing is published
+// as diagnostics.
+class PipelineNodelet : public nodelet::Nodelet
+{
+  ros::NodeHandlePtr nh_depth_, nh_rgb_;
+  boost::shared_ptr<image_transport::ImageTransport> it_depth_, it_rgb_;
+
+  // Subscriptions
+  image_transport::SubscriberFilter sub_depth_, sub_rgb_;
+  message_filters::Subscriber<sensor_msgs::CameraInfo> sub_depth_info_, sub_rgb_info_;
+  boost::shared_ptr<tf2_ros::Buffer> tf_buffer_;
+  boost::shared_ptr<tf2_ros::TransformListener> tf_;
+  typedef ApproximateTime<sensor_msgs::Image, sensor_msgs::CameraInfo,
+                          sensor_msgs::Image, sensor_msgs::CameraInfo> SyncPolicy;
+  typedef message_filters::Synchronizer<SyncPolicy> Synchronizer;
+  boost::shared_ptr<Synchronizer> sync_;
+
+  // Publications
+  boost::mutex connect_mutex_;
+  image_transport::Publisher pub_rgb_rect_, pub_depth_metric_, pub_depth_rect_;
+  image_transport::CameraPublisher pub_registered_;
+  ros::Publisher pub_point_cloud_, pub_index_, pub_diagnostics_;
+  ros::WallTimer diagnostics_timer_;
+
+  // Parameters
+  int rgb_interpolation_, depth_interpolation_;
+  bool metric_, upsample_, dense_;
+  double upsample_max_jump_;
+
+  // Processing state, only touched by the synchronized callback
+  image_geometry::PinholeCameraModel depth_model_, rgb_model_;
+  cv::Mat depth_rect_;
+  RegistrationBuffers registration_buffers_;
+  XyzrgbBuffers cloud_buffers_;
+
+  // Time spent in every stage since diagnostics were last published
+  enum Stage { RECTIFY, REGISTER, CLOUD, NUM_STAGES };
+  struct StageTiming
+  {
+    int frames;
+    double total, max;
+    StageTiming() : frames(0), total(0.0), max(0.0) {}
+  };
+  boost::mutex timing_mutex_;
+  StageTiming timing_[NUM_STAGES];
+  ros::WallTime timing_start_;
+
+  virtual void onInit();
+
+  void connectCb();
+
+  void imageCb(const sensor_msgs::ImageConstPtr& depth_msg,
+               const sensor_msgs::CameraInfoConstPtr& depth_info_msg,
+               const sensor_msgs::ImageConstPtr& rgb_msg,
+               const sensor_msgs::CameraInfoConstPtr& rgb_info_msg);
+
+  sensor_msgs::ImageConstPtr rectifyRgb(const sensor_msgs::ImageConstPtr& rgb_msg,
+                                        const sensor_msgs::CameraInfoConstPtr& rgb_info_msg);
+
+  bool rectifyDepth(const sensor_msgs::ImageConstPtr& depth_msg,
+                    const sensor_msgs::CameraInfoConstPtr& depth_info_msg,
+                    cv::Mat& depth_rect);
+
+  void publishDepthMetric(const sensor_msgs::ImageConstPtr& depth_msg);
+
+  void publishDepthRect(const sensor_msgs::ImageConstPtr& depth_msg, const cv::Mat& depth_rect);
+
+  sensor_msgs::ImagePtr registerRectifiedDepth(const sensor_msgs::ImageConstPtr& depth_msg,
+                                               const cv::Mat& depth_rect,
+                                               const sensor_msgs::CameraInfoConstPtr& depth_info_msg,
+                                               const sensor_msgs::CameraInfoConstPtr& rgb_info_msg);
+
+  void publishCloud(const sensor_msgs::ImageConstPtr& registered_msg,
+                    const sensor_msgs::ImageConstPtr& rgb_rect_msg);
+
+  void recordTiming(Stage stage, const ros::WallTime& start);
+
+  void diagnosticsCb(const ros::WallTimerEvent& event);
+};
+
+static bool hasDistortion(const sensor_msgs::CameraInfo& info)
+{
+  for (size_t i = 0; i < info.D.size(); ++i)
+  {
+    if (info.D[i] != 0.0)
+      return true;
+  }
+  return false;
+}
+
+// Fills msg with depth in millimeters converted to meters, NaN where there is no depth
+static void fillMetric(const cv::Mat& depth_mm, sensor_msgs::Image& msg)
+{
+  msg.height   = depth_mm.rows;
+  msg.width    = depth_mm.cols;
+  msg.encoding = enc::TYPE_32FC1;
+  msg.step     = msg.width * sizeof(float);
+  msg.data.resize(msg.height * msg.step);
+  for (int v = 0; v < depth_mm.rows; ++v)
+  {
+    const uint16_t* raw_row = depth_mm.ptr<uint16_t>(v);
+    float* depth_row = reinterpret_cast<float*>(&msg.data[v * msg.step]);
+    for (int u = 0; u < depth_mm.cols; ++u)
+      depth_row[u] = DepthTraits<uint16_t>::valid(raw_row[u]) ? DepthTraits<uint16_t>::toMeters(raw_row[u])
+                                                              : std::numeric_limits<float>::quiet_NaN();
+  }
+}
+
+void PipelineNodelet::onInit()
+{
+  ros::NodeHandle& nh         = getNodeHandle();
+  ros::NodeHandle& private_nh = getPrivateNodeHandle();
+  nh_depth_.reset( new ros::NodeHandle(nh, "depth") );
+  nh_rgb_.reset( new ros::NodeHandle(nh, "rgb") );
+  it_depth_.reset( new image_transport::ImageTransport(*nh_depth_) );
+  it_rgb_.reset( new image_transport::ImageTransport(*nh_rgb_) );
+  tf_buffer_.reset( new tf2_ros::Buffer );
+  tf_.reset( new tf2_ros::TransformListener(*tf_buffer_) );
+
+  // Read parameters
+  int queue_size;
+  double diagnostics_period;
+  private_nh.param("queue_size", queue_size, 5);
+  private_nh.param("interpolation", rgb_interpolation_, (int)cv::INTER_LINEAR);
+  private_nh.param("depth_interpolation", depth_interpolation_, (int)cv::INTER_NEAREST);
+  private_nh.param("metric", metric_, true);
+  private_nh.param("upsample", upsample_, false);
+  private_nh.param("upsample_max_jump", upsample_max_jump_, 0.05);
+  private_nh.param("dense", dense_, false);
+  private_nh.param("diagnostics_period", diagnostics_period, 1.0);
+
+  // Synchronize inputs. Topic subscriptions happen on demand in the connection callback.
+  sync_.reset( new Synchronizer(SyncPolicy(queue_size), sub_depth_, sub_depth_info_, sub_rgb_, sub_rgb_info_) );
+  sync_->registerCallback(boost::bind(&PipelineNodelet::imageCb, this, _1, _2, _3, _4));
+
+  timing_start_ = ros::WallTime::now();
+  pub_diagnostics_ = nh.advertise<diagnostic_msgs::DiagnosticArray>("diagnostics", 1);
+  if (diagnostics_period > 0.0)
+    diagnostics_timer_ = nh.createWallTimer(ros::WallDuration(diagnostics_period), &PipelineNodelet::diagnosticsCb, this);
+
+  // Monitor whether anyone is subscribed to the outputs
+  ros::NodeHandle depth_registered_nh(nh, "depth_registered");
+  image_transport::ImageTransport it_depth_reg(depth_registered_nh);
+  image_transport::SubscriberStatusCallback image_connect_cb = boost::bind(&PipelineNodelet::connectCb, this);
+  ros::SubscriberStatusCallback connect_cb = boost::bind(&PipelineNodelet::connectCb, this);
+  // Make sure we don't enter connectCb() between advertising and assigning to the publishers
+  boost::lock_guard<boost::mutex> lock(connect_mutex_);
+  pub_rgb_rect_ = it_rgb_->advertise("image_rect_color", 1, image_connect_cb, image_connect_cb);
+  pub_depth_metric_ = it_depth_->advertise("image_raw_m", 1, image_connect_cb, image_connect_cb);
+  pub_depth_rect_ = it_depth_->advertise("image_rect", 1, image_connect_cb, image_connect_cb);
+  pub_registered_ = it_depth_reg.advertiseCamera("image_rect", 1,
+                                                 image_connect_cb, image_connect_cb,
+                                                 connect_cb, connect_cb);
+  pub_point_cloud_ = depth_registered_nh.advertise<sensor_msgs::PointCloud2>("points", 1, connect_cb, connect_cb);
+  if (dense_)
+    pub_index_ = depth_registered_nh.advertise<sensor_msgs::Image>("points_index", 1, connect_cb, connect_cb);
+}
+
+// Handles (un)subscribing when clients (un)subscribe
+void PipelineNodelet::connectCb()
+{
+  boost::lock_guard<boost::mutex> lock(connect_mutex_);
+  if (pub_rgb_rect_.getNumSubscribers() == 0 && pub_depth_metric_.getNumSubscribers() == 0 &&
+      pub_depth_rect_.getNumSubscribers() == 0 &&
+      pub_registered_.getNumSubscribers() == 0 && pub_point_cloud_.getNumSubscribers() == 0 &&
+      pub_index_.getNumSubscribers() == 0)
+  {
+    sub_depth_     .unsubscribe();
+    sub_depth_info_.unsubscribe();
+    sub_rgb_       .unsubscribe();
+    sub_rgb_info_  .unsubscribe();
+  }
+  else if (!sub_depth_.getSubscriber())
+  {
+    image_transport::TransportHints hints("raw", ros::TransportHints(), getPrivateNodeHandle());
+    sub_depth_     .subscribe(*it_depth_, "image_raw",   1, hints);
+    sub_depth_info_.subscribe(*nh_depth_, "camera_info", 1);
+    sub_rgb_       .subscribe(*it_rgb_,   "image_raw",   1, hints);
+    sub_rgb_info_  .subscribe(*nh_rgb_,   "camera_info", 1);
+  }
+}
+
+void PipelineNodelet::imageCb(const sensor_msgs::ImageConstPtr& depth_msg,
+                              const sensor_msgs::CameraInfoConstPtr& depth_info_msg,
+                              const sensor_msgs::ImageConstPtr& rgb_msg,
+                              const sensor_msgs::CameraInfoConstPtr& rgb_info_msg)
+{
+  // Verify the cameras are actually calibrated
+  if (depth_info_msg->K[0] == 0.0 || rgb_info_msg->K[0] == 0.0)
+  {
+    NODELET_ERROR_THROTTLE(30, "Pipeline requested but the depth or RGB camera is uncalibrated");
+    return;
+  }
+
+  // Update camera models - these take binning & ROI into account
+  depth_model_.fromCameraInfo(depth_info_msg);
+  rgb_model_  .fromCameraInfo(rgb_info_msg);
+
+  bool want_cloud = pub_point_cloud_.getNumSubscribers() > 0 || pub_index_.getNumSubscribers() > 0;
+  bool want_registered = want_cloud || pub_registered_.getNumSubscribers() > 0;
+  bool want_rgb_rect = want_cloud || pub_rgb_rect_.getNumSubscribers() > 0;
+  bool want_depth_rect = pub_depth_rect_.getNumSubscribers() > 0;
+
+  if (pub_depth_metric_.getNumSubscribers() > 0)
+    publishDepthMetric(depth_msg);
+
+  ros::WallTime start = ros::WallTime::now();
+  sensor_msgs::ImageConstPtr rgb_rect_msg;
+  if (want_rgb_rect)
+  {
+    rgb_rect_msg = rectifyRgb(rgb_msg, rgb_info_msg);
+    if (!rgb_rect_msg)
+      return;
+  }
+  cv::Mat depth_rect;
+  if ((want_registered || want_depth_rect) && !rectifyDepth(depth_msg, depth_info_msg, depth_rect))
+    return;
+  recordTiming(RECTIFY, start);
+
+  if (rgb_rect_msg && pub_rgb_rect_.getNumSubscribers() > 0)
+    pub_rgb_rect_.publish(rgb_rect_msg);
+  if (want_depth_rect)
+    publishDepthRect(depth_msg, depth_rect);
+  if (!want_registered)
+    return;
+
+  start = ros::WallTime::now();
+  sensor_msgs::ImagePtr registered_msg = registerRectifiedDepth(depth_msg, depth_rect, depth_info_msg, rgb_info_msg);
+  if (!registered_msg)
+    return;
+  recordTiming(REGISTER, start);
+
+  // Registered camera info is the same as the RGB info, but uses the depth timestamp
+  sensor_msgs::CameraInfoPtr registered_info_msg( new sensor_msgs::CameraInfo(*rgb_info_msg) );
+  registered_info_msg->header.stamp = registered_msg->header.stamp;
+  pub_registered_.publish(registered_msg, registered_info_msg);
+
+  if (want_cloud)
+  {
+    start = ros::WallTime::now();
+    publishCloud(registered_msg, rgb_rect_msg);
+    recordTiming(CLOUD, start);
+  }
+}
+
+sensor_msgs::ImageConstPtr PipelineNodelet::rectifyRgb(const sensor_msgs::ImageConstPtr& rgb_msg,
+                                                       const sensor_msgs::CameraInfoConstPtr& rgb_info_msg)
+{
+  // If zero distortion, just pass the message along
+  if (!hasDistortion(*rgb_info_msg))
+    return rgb_msg;
+
+  cv_bridge::CvImageConstPtr raw;
+  try
+  {
+    raw = cv_bridge::toCvShare(rgb_msg);
+  }
+  catch (cv_bridge::Exception& e)
+  {
+    NODELET_ERROR_THROTTLE(5, "cv_bridge exception: %s", e.what());
+    return sensor_msgs::ImageConstPtr();
+  }
+
+  // Rectify straight into the buffer of the message to be published
+  sensor_msgs::ImagePtr rect_msg( new sensor_msgs::Image );
+  rect_msg->header   = rgb_msg->header;
+  rect_msg->encoding = rgb_msg->encoding;
+  rect_msg->height   = raw->image.rows;
+  rect_msg->width    = raw->image.cols;
+  rect_msg->step     = raw->image.cols * raw->image.elemSize();
+  rect_msg->data.resize(rect_msg->height * rect_msg->step);
+  cv::Mat rect(rect_msg->height, rect_msg->width, raw->image.type(), &rect_msg->data[0], rect_msg->step);
+  rgb_model_.rectifyImage(raw->image, rect, rgb_interpolation_);
+  return rect_msg;
+}
+
+bool PipelineNodelet::rectifyDepth(const sensor_msgs::ImageConstPtr& depth_msg,
+                                   const sensor_msgs::CameraInfoConstPtr& depth_info_msg,
+                                   cv::Mat& depth_rect)
+{
+  if (depth_msg->encoding != enc::TYPE_16UC1 && depth_msg->encoding != enc::TYPE_32FC1)
+  {
+    NODELET_ERROR_THROTTLE(5, "Depth image has unsupported encoding [%s]", depth_msg->encoding.c_str());
+    return false;
+  }
+
+  const cv::Mat raw = cv_bridge::toCvShare(depth_msg)->image;
+  if (!hasDistortion(*depth_info_msg))
+  {
+    depth_rect = raw;
+    return true;
+  }
+
+  // Only read by the register stage and copied out by publishDepthRect, so the same buffer is reused for every frame
+  depth_model_.rectifyImage(raw, depth_rect_, depth_interpolation_);
+  depth_rect = depth_rect_;
+  return true;
+}
+
+void PipelineNodelet::publishDepthMetric(const sensor_msgs::ImageConstPtr& depth_msg)
+{
+  // The raw depth in meters, as convert_metric publishes it. Depth that already is in meters is passed along.
+  if (depth_msg->encoding != enc::TYPE_16UC1)
+  {
+    pub_depth_metric_.publish(depth_msg);
+    return;
+  }
+  sensor_msgs::ImagePtr metric_msg( new sensor_msgs::Image );
+  metric_msg->header = depth_msg->header;
+  fillMetric(cv_bridge::toCvShare(depth_msg)->image, *metric_msg);
+  pub_depth_metric_.publish(metric_msg);
+}
+
+void PipelineNodelet::publishDepthRect(const sensor_msgs::ImageConstPtr& depth_msg, const cv::Mat& depth_rect)
+{
+  // The unregistered rectified depth, in meters like convert_metric's output when metric is set
+  sensor_msgs::ImagePtr rect_msg( new sensor_msgs::Image );
+  rect_msg->header = depth_msg->header;
+  if (depth_msg->encoding == enc::TYPE_16UC1 && metric_)
+  {
+    fillMetric(depth_rect, *rect_msg);
+  }
+  else
+  {
+    rect_msg->height = depth_rect.rows;
+    rect_msg->width  = depth_rect.cols;
+    rect_msg->encoding = depth_msg->encoding;
+    rect_msg->step = rect_msg->width * depth_rect.elemSize();
+    rect_msg->data.resize(rect_msg->height * rect_msg->step);
+    cv::Mat rect(rect_msg->height, rect_msg->width, depth_rect.type(), &rect_msg->data[0], rect_msg->step);
+    depth_rect.copyTo(rect);
+  }
+  pub_depth_rect_.publish(rect_msg);
+}
+
+sensor_msgs::ImagePtr PipelineNodelet::registerRectifiedDepth(const sensor_msgs::ImageConstPtr& depth_msg,
+                                                              const cv::Mat& depth_rect,
+                                                              const sensor_msgs::CameraInfoConstPtr& depth_info_msg,
+                                                              const sensor_msgs::CameraInfoConstPtr& rgb_info_msg)
+{
+  // Query tf2 for transform from (X,Y,Z) in depth camera frame to RGB camera frame
+  Eigen::Affine3d depth_to_rgb;
+  try
+  {
+    geometry_msgs::TransformStamped transform = tf_buffer_->lookupTransform (
+                          rgb_info_msg->header.frame_id, depth_info_msg->header.frame_id,
+                          depth_info_msg->header.stamp);
+
+    tf::transformMsgToEigen(transform.transform, depth_to_rgb);
+  }
+  catch (tf2::TransformException& ex)
+  {
+    NODELET_WARN_THROTTLE(2, "TF2 exception:\n%s", ex.what());
+    return sensor_msgs::ImagePtr();
+  }
+
+  // Registered depth image at full RGB resolution, step and data set by the registration
+  sensor_msgs::ImagePtr registered_msg( new sensor_msgs::Image );
+  registered_msg->header.stamp    = depth_msg->header.stamp;
+  registered_msg->header.frame_id = rgb_info_msg->header.frame_id;
+  registered_msg->height = rgb_model_.fullResolution().height;
+  registered_msg->width  = rgb_model_.fullResolution().width;
+
+  bool rasterize = upsample_ && (registered_msg->width > depth_msg->width ||
+                                 registered_msg->height > depth_msg->height);
+
+  if (depth_msg->encoding == enc::TYPE_16UC1 && !metric_)
+  {
+    registered_msg->encoding = enc::TYPE_16UC1;
+    registerDepth<uint16_t, uint16_t>(depth_rect, depth_model_, rgb_model_, depth_to_rgb, rasterize,
+                                      upsample_max_jump_, registration_buffers_, *registered_msg);
+  }
+  else if (depth_msg->encoding == enc::TYPE_16UC1)
+  {
+    registered_msg->encoding = enc::TYPE_32FC1;
+    registerDepth<uint16_t, float>(depth_rect, depth_model_, rgb_model_, depth_to_rgb, rasterize,
+                                   upsample_max_jump_, registration_buffers_, *registered_msg);
+  }
+  else
+  {
+    registered_msg->encoding = enc::TYPE_32FC1;
+    registerDepth<float, float>(depth_rect, depth_model_, rgb_model_, depth_to_rgb, rasterize,
+                                upsample_max_jump_, registration_buffers_, *registered_msg);
+  }
+  return registered_msg;
+}
+
+void PipelineNodelet::publishCloud(const sensor_msgs::ImageConstPtr& registered_msg,
+                                   const sensor_msgs::ImageConstPtr& rgb_rect_msg)
+{
+  if (registered_msg->width != rgb_rect_msg->width || registered_msg->height != rgb_rect_msg->height)
+  {
+    NODELET_ERROR_THROTTLE(5, "Registered depth resolution (%ux%u) does not match rectified RGB resolution (%ux%u)",
+                           registered_msg->width, registered_msg->height, rgb_rect_msg->width, rgb_rect_msg->height);
+    return;
+  }
+
+  // Supported color encodings: RGB8, BGR8, MONO8
+  sensor_msgs::ImageConstPtr rgb_msg = rgb_rect_msg;
+  int red_offset = 0, green_offset = 1, blue_offset = 2, color_step = 3;
+  if (rgb_msg->encoding == enc::BGR8)
+  {
+    red_offset   = 2;
+    blue_offset  = 0;
+  }
+  else if (rgb_msg->encoding == enc::MONO8)
+  {
+    green_offset = 0;
+    blue_offset  = 0;
+    color_step   = 1;
+  }
+  else if (rgb_msg->encoding != enc::RGB8)
+  {
+    try
+    {
+      rgb_msg = cv_bridge::toCvCopy(rgb_msg, enc::RGB8)->toImageMsg();
+    }
+    catch (cv_bridge::Exception& e)
+    {
+      NODELET_ERROR_THROTTLE(5, "Unsupported encoding [%s]: %s", rgb_msg->encoding.c_str(), e.what());
+      return;
+    }
+  }
+
+  sensor_msgs::PointCloud2Ptr cloud_msg( new sensor_msgs::PointCloud2 );
+  cloud_msg->header = registered_msg->header;
+  cloud_msg->height = registered_msg->height;
+  cloud_msg->width  = registered_msg->width;
+  cloud_msg->is_dense = false;
+  cloud_msg->is_bigendian = false;
+
+  sensor_msgs::PointCloud2Modifier pcd_modifier(*cloud_msg);
+  pcd_modifier.setPointCloud2FieldsByString(2, "xyz", "rgb");
+
+  sensor_msgs::ImagePtr index_msg;
+  if (dense_)
+  {
+    index_msg.reset( new sensor_msgs::Image );
+    index_msg->header   = registered_msg->header;
+    index_msg->height   = registered_msg->height;
+    index_msg->width    = registered_msg->width;
+    index_msg->encoding = enc::TYPE_32SC1;
+    index_msg->step     = index_msg->width * sizeof(int32_t);
+    index_msg->data.resize( index_msg->height * index_msg->step );
+  }
+
+  if (registered_msg->encoding == enc::TYPE_16UC1)
+    convertXyzrgb<uint16_t>(*registered_msg, *rgb_msg, rgb_model_, red_offset, green_offset, blue_offset, color_step,
+                            cloud_buffers_, *cloud_msg, index_msg.get());
+  else
+    convertXyzrgb<float>(*registered_msg, *rgb_msg, rgb_model_, red_offset, green_offset, blue_offset, color_step,
+                         cloud_buffers_, *cloud_msg, index_msg.get());
+
+  pub_point_cloud_.publish(cloud_msg);
+  if (index_msg)
+    pub_index_.publish(index_msg);
+}
+
+void PipelineNodelet::recordTiming(Stage stage, const ros::WallTime& start)
+{
+  double elapsed = (ros::WallTime::now() - start).toSec();
+  boost::lock_guard<boost::mutex> lock(timing_mutex_);
+  StageTiming& timing = timing_[stage];
+  ++timing.frames;
+  timing.total += elapsed;
+  timing.max = std::max(timing.max, elapsed);
+}
+
+void PipelineNodelet::diagnosticsCb(const ros::WallTimerEvent& event)
+{
+  static const char* stage_names[NUM_STAGES] = { "rectify", "register", "cloud" };
+
+  StageTiming timing[NUM_STAGES];
+  ros::WallTime now = ros::WallTime::now();
+  double period;
+  {
+    boost::lock_guard<boost::mutex> lock(timing_mutex_);
+    std::copy(timing_, timing_ + NUM_STAGES, timing);
+    std::fill(timing_, timing_ + NUM_STAGES, StageTiming());
+    period = (now - timing_start_).toSec();
+    timing_start_ = now;
+  }
+
+  diagnostic_msgs::DiagnosticStatus status;
+  status.name = getName() + ": pipeline";
+  status.level = diagnostic_msgs::DiagnosticStatus::OK;
+  for (int i = 0; i < NUM_STAGES; ++i)
+  {
+    diagnostic_msgs::KeyValue value;
+    std::ostringstream rate, mean, max;
+    rate << (period > 0.0 ? timing[i].frames / period : 0.0);
+    mean << (timing[i].frames ? timing[i].total / timing[i].frames * 1000.0 : 0.0);
+    max << timing[i].max * 1000.0;
+
+    value.key = std::string(stage_names[i]) + " rate (Hz)";
+    value.value = rate.str();
+    status.values.push_back(value);
+    value.key = std::string(stage_names[i]) + " mean (ms)";
+    value.value = mean.str();
+    status.values.push_back(value);
+    value.key = std::string(stage_names[i]) + " max (ms)";
+    value.value = max.str();
+    status.values.push_back(value);
+  }
+  status.message = timing[RECTIFY].frames ? "Processing" : "No frames processed";
+
+  diagnostic_msgs::DiagnosticArray diagnostics;
+  diagnostics.header.stamp = ros::Time::now();
+  diagnostics.status.push_back(status);
+  pub_diagnostics_.publish(diagnostics);
+}
+
+} // namespace depth_image_proc
+
+// Register as nodelet
+#include <pluginlib/class_list_macros.h>
+PLUGINLIB_EXPORT_CLASS(depth_image_proc::PipelineNodelet,nodelet::Nodelet);
@@ -48,7 +48,7 @@
 #include <sensor_msgs/point_cloud2_iterator.h>
 #include <sensor_msgs/PointCloud2.h>
 #include <image_geometry/pinhole_camera_model.h>
-#include <depth_image_proc/depth_traits.h>
+#include <depth_image_proc/point_cloud_xyzrgb.h>
 #include <cv_bridge/cv_bridge.h>
 #include <opencv2/imgproc/imgproc.hpp>
 
@@ -75,10 +75,15 @@ class PointCloudXyzrgbNodelet : public nodelet::Nodelet
   // Publications
   boost::mutex connect_mutex_;
   typedef sensor_msgs::PointCloud2 PointCloud;
-  ros::Publisher pub_point_cloud_;
+  ros::Publisher pub_point_cloud_, pub_index_;
 
   image_geometry::PinholeCameraModel model_;
 
+  // Parameters
+  bool dense_;
+
+  XyzrgbBuffers buffers_;
+
   virtual void onInit();
 
   void connectCb();
@@ -91,6 +96,7 @@ class PointCloudXyzrgbNodelet : public nodelet::Nodelet
   void convert(const sensor_msgs::ImageConstPtr& depth_msg,
                const sensor_msgs::ImageConstPtr& rgb_msg,
                const PointCloud::Ptr& cloud_msg,
+               const sensor_msgs::ImagePtr& index_msg,
                int red_offset, int green_offset, int blue_offset, int color_step);
 };
 
@@ -108,6 +114,7 @@ void PointCloudXyzrgbNodelet::onInit()
   private_nh.param("queue_size", queue_size, 5);
   bool use_exact_sync;
   private_nh.param("exact_sync", use_exact_sync, false);
+  private_nh.param("dense", dense_, false);
 
   // Synchronize inputs. Topic subscriptions happen on demand in the connection callback.
   if (use_exact_sync)
@@ -126,13 +133,16 @@ void PointCloudXyzrgbNodelet::onInit()
   // Make sure we don't enter connectCb() between advertising and assigning to pub_point_cloud_
   boost::lock_guard<boost::mutex> lock(connect_mutex_);
   pub_point_cloud_ = depth_nh.advertise<PointCloud>("points", 1, connect_cb, connect_cb);
+  // Dense clouds drop invalid points, the index image maps every depth pixel to its point, or -1 if it has none
+  if (dense_)
+    pub_index_ = depth_nh.advertise<sensor_msgs::Image>("points_index", 1, connect_cb, connect_cb);
 }
 
 // Handles (un)subscribing when clients (un)subscribe
 void PointCloudXyzrgbNodelet::connectCb()
 {
   boost::lock_guard<boost::mutex> lock(connect_mutex_);
-  if (pub_point_cloud_.getNumSubscribers() == 0)
+  if (pub_point_cloud_.getNumSubscribers() == 0 && pub_index_.getNumSubscribers() == 0)
   {
     sub_depth_.unsubscribe();
     sub_rgb_  .unsubscribe();
@@ -273,13 +283,25 @@ void PointCloudXyzrgbNodelet::imageCb(const sensor_msgs::ImageConstPtr& depth_ms
   sensor_msgs::PointCloud2Modifier pcd_modifier(*cloud_msg);
   pcd_modifier.setPointCloud2FieldsByString(2, "xyz", "rgb");
 
+  sensor_msgs::ImagePtr index_msg;
+  if (dense_)
+  {
+    index_msg.reset( new sensor_msgs::Image );
+    index_msg->header   = depth_msg->header;
+    index_msg->height   = depth_msg->height;
+    index_msg->width    = depth_msg->width;
+    index_msg->encoding = enc::TYPE_32SC1;
+    index_msg->step     = index_msg->width * sizeof(int32_t);
+    index_msg->data.resize( index_msg->height * index_msg->step );
+  }
+
   if (depth_msg->encoding == enc::TYPE_16UC1)
   {
-    convert<uint16_t>(depth_msg, rgb_msg, cloud_msg, red_offset, green_offset, blue_offset, color_step);
+    convert<uint16_t>(depth_msg, rgb_msg, cloud_msg, index_msg, red_offset, green_offset, blue_offset, color_step);
   }
   else if (depth_msg->encoding == enc::TYPE_32FC1)
   {
-    convert<float>(depth_msg, rgb_msg, cloud_msg, red_offset, green_offset, blue_offset, color_step);
+    convert<float>(depth_msg, rgb_msg, cloud_msg, index_msg, red_offset, green_offset, blue_offset, color_step);
   }
   else
   {
@@ -288,63 +310,19 @@ void PointCloudXyzrgbNodelet::imageCb(const sensor_msgs::ImageConstPtr& depth_ms
   }
 
   pub_point_cloud_.publish (cloud_msg);
+  if (index_msg)
+    pub_index_.publish (index_msg);
 }
 
 template<typename T>
 void PointCloudXyzrgbNodelet::convert(const sensor_msgs::ImageConstPtr& depth_msg,
                                       const sensor_msgs::ImageConstPtr& rgb_msg,
                                       const PointCloud::Ptr& cloud_msg,
+                                      const sensor_msgs::ImagePtr& index_msg,
                                       int red_offset, int green_offset, int blue_offset, int color_step)
 {
-  // Use correct principal point from calibration
-  float center_x = model_.cx();
-  float center_y = model_.cy();
-
-  // Combine unit conversion (if necessary) with scaling by focal length for computing (X,Y)
-  double unit_scaling = DepthTraits<T>::toMeters( T(1) );
-  float constant_x = unit_scaling / model_.fx();
-  float constant_y = unit_scaling / model_.fy();
-  float bad_point = std::numeric_limits<float>::quiet_NaN ();
-
-  const T* depth_row = reinterpret_cast<const T*>(&depth_msg->data[0]);
-  int row_step = depth_msg->step / sizeof(T);
-  const uint8_t* rgb = &rgb_msg->data[0];
-  int rgb_skip = rgb_msg->step - rgb_msg->width * color_step;
-
-  sensor_msgs::PointCloud2Iterator<float> iter_x(*cloud_msg, "x");
-  sensor_msgs::PointCloud2Iterator<float> iter_y(*cloud_msg, "y");
-  sensor_msgs::PointCloud2Iterator<float> iter_z(*cloud_msg, "z");
-  sensor_msgs::PointCloud2Iterator<uint8_t> iter_r(*cloud_msg, "r");
-  sensor_msgs::PointCloud2Iterator<uint8_t> iter_g(*cloud_msg, "g");
-  sensor_msgs::PointCloud2Iterator<uint8_t> iter_b(*cloud_msg, "b");
-  sensor_msgs::PointCloud2Iterator<uint8_t> iter_a(*cloud_msg, "a");
-
-  for (int v = 0; v < int(cloud_msg->height); ++v, depth_row += row_step, rgb += rgb_skip)
-  {
-    for (int u = 0; u < int(cloud_msg->width); ++u, rgb += color_step, ++iter_x, ++iter_y, ++iter_z, ++iter_a, ++iter_r, ++iter_g, ++iter_b)
-    {
-      T depth = depth_row[u];
-
-      // Check for invalid measurements
-      if (!DepthTraits<T>::valid(depth))
-      {
-        *iter_x = *iter_y = *iter_z = bad_point;
-      }
-      else
-      {
-        // Fill in XYZ
-        *iter_x = (u - center_x) * depth * constant_x;
-        *iter_y = (v - center_y) * depth * constant_y;
-        *iter_z = DepthTraits<T>::toMeters(depth);
-      }
-
-      // Fill in color
-      *iter_a = 255;
-      *iter_r = rgb[red_offset];
-      *iter_g = rgb[green_offset];
-      *iter_b = rgb[blue_offset];
-    }
-  }
+  convertXyzrgb<T>(*depth_msg, *rgb_msg, model_, red_offset, green_offset, blue_offset, color_step,
+                   buffers_, *cloud_msg, index_msg.get());
 }
 
 } // namespace depth_image_proc
@@ -44,7 +44,8 @@
 #include <image_geometry/pinhole_camera_model.h>
 #include <Eigen/Geometry>
 #include <eigen_conversions/eigen_msg.h>
-#include <depth_image_proc/depth_traits.h>
+#include <cv_bridge/cv_bridge.h>
+#include <depth_image_proc/depth_registration.h>
 
 namespace depth_image_proc {
 
@@ -71,6 +72,12 @@ class RegisterNodelet : public nodelet::Nodelet
 
   image_geometry::PinholeCameraModel depth_model_, rgb_model_;
 
+  // Parameters
+  bool upsample_;
+  double upsample_max_jump_;
+
+  RegistrationBuffers buffers_;
+
   virtual void onInit();
 
   void connectCb();
@@ -82,7 +89,8 @@ class RegisterNodelet : public nodelet::Nodelet
   template<typename T>
   void convert(const sensor_msgs::ImageConstPtr& depth_msg,
                const sensor_msgs::ImagePtr& registered_msg,
-               const Eigen::Affine3d& depth_to_rgb);
+               const Eigen::Affine3d& depth_to_rgb,
+               bool rasterize);
 };
 
 void RegisterNodelet::onInit()
@@ -98,6 +106,8 @@ void RegisterNodelet::onInit()
   // Read parameters
   int queue_size;
   private_nh.param("queue_size", queue_size, 5);
+  private_nh.param("upsample", upsample_, false);
+  private_nh.param("upsample_max_jump", upsample_max_jump_, 0.05);
 
   // Synchronize inputs. Topic subscriptions happen on demand in the connection callback.
   sync_.reset( new Synchronizer(SyncPolicy(queue_size), sub_depth_image_, sub_depth_info_, sub_rgb_info_) );
@@ -184,13 +194,17 @@ void RegisterNodelet::imageCb(const sensor_msgs::ImageConstPtr& depth_image_msg,
 
   // step and data set in convert(), depend on depth data type
 
+  // Only fill in between depth pixels when they would otherwise leave holes in the registered image
+  bool rasterize = upsample_ && (registered_msg->width > depth_image_msg->width ||
+                                 registered_msg->height > depth_image_msg->height);
+
   if (depth_image_msg->encoding == enc::TYPE_16UC1)
   {
-    convert<uint16_t>(depth_image_msg, registered_msg, depth_to_rgb);
+    convert<uint16_t>(depth_image_msg, registered_msg, depth_to_rgb, rasterize);
   }
   else if (depth_image_msg->encoding == enc::TYPE_32FC1)
   {
-    convert<float>(depth_image_msg, registered_msg, depth_to_rgb);
+    convert<float>(depth_image_msg, registered_msg, depth_to_rgb, rasterize);
   }
   else
   {
@@ -208,66 +222,11 @@ void RegisterNodelet::imageCb(const sensor_msgs::ImageConstPtr& depth_image_msg,
 template<typename T>
 void RegisterNodelet::convert(const sensor_msgs::ImageConstPtr& depth_msg,
                               const sensor_msgs::ImagePtr& registered_msg,
-                              const Eigen::Affine3d& depth_to_rgb)
+                              const Eigen::Affine3d& depth_to_rgb,
+                              bool rasterize)
 {
-  // Allocate memory for registered depth image
-  registered_msg->step = registered_msg->width * sizeof(T);
-  registered_msg->data.resize( registered_msg->height * registered_msg->step );
-  // data is already zero-filled in the uint16 case, but for floats we want to initialize everything to NaN.
-  DepthTraits<T>::initializeBuffer(registered_msg->data);
-
-  // Extract all the parameters we need
-  double inv_depth_fx = 1.0 / depth_model_.fx();
-  double inv_depth_fy = 1.0 / depth_model_.fy();
-  double depth_cx = depth_model_.cx(), depth_cy = depth_model_.cy();
-  double depth_Tx = depth_model_.Tx(), depth_Ty = depth_model_.Ty();
-  double rgb_fx = rgb_model_.fx(), rgb_fy = rgb_model_.fy();
-  double rgb_cx = rgb_model_.cx(), rgb_cy = rgb_model_.cy();
-  double rgb_Tx = rgb_model_.Tx(), rgb_Ty = rgb_model_.Ty();
-
-  // Transform the depth values into the RGB frame
-  /// @todo When RGB is higher res, interpolate by rasterizing depth triangles onto the registered image
-  const T* depth_row = reinterpret_cast<const T*>(&depth_msg->data[0]);
-  int row_step = depth_msg->step / sizeof(T);
-  T* registered_data = reinterpret_cast<T*>(&registered_msg->data[0]);
-  int raw_index = 0;
-  for (unsigned v = 0; v < depth_msg->height; ++v, depth_row += row_step)
-  {
-    for (unsigned u = 0; u < depth_msg->width; ++u, ++raw_index)
-    {
-      T raw_depth = depth_row[u];
-      if (!DepthTraits<T>::valid(raw_depth))
-        continue;
-
-      double depth = DepthTraits<T>::toMeters(raw_depth);
-
-      /// @todo Combine all operations into one matrix multiply on (u,v,d)
-      // Reproject (u,v,Z) to (X,Y,Z,1) in depth camera frame
-      Eigen::Vector4d xyz_depth;
-      xyz_depth << ((u - depth_cx)*depth - depth_Tx) * inv_depth_fx,
-                   ((v - depth_cy)*depth - depth_Ty) * inv_depth_fy,
-                   depth,
-                   1;
-
-      // Transform to RGB camera frame
-      Eigen::Vector4d xyz_rgb = depth_to_rgb * xyz_depth;
-
-      // Project to (u,v) in RGB image
-      double inv_Z = 1.0 / xyz_rgb.z();
-      int u_rgb = (rgb_fx*xyz_rgb.x() + rgb_Tx)*inv_Z + rgb_cx + 0.5;
-      int v_rgb = (rgb_fy*xyz_rgb.y() + rgb_Ty)*inv_Z + rgb_cy + 0.5;
-
-      if (u_rgb < 0 || u_rgb >= (int)registered_msg->width ||
-          v_rgb < 0 || v_rgb >= (int)registered_msg->height)
-        continue;
-
-      T& reg_depth = registered_data[v_rgb*registered_msg->width + u_rgb];
-      T  new_depth = DepthTraits<T>::fromMeters(xyz_rgb.z());
-      // Validity and Z-buffer checks
-      if (!DepthTraits<T>::valid(reg_depth) || reg_depth > new_depth)
-        reg_depth = new_depth;
-    }
-  }
+  registerDepth<T, T>(cv_bridge::toCvShare(depth_msg)->image, depth_model_, rgb_model_, depth_to_rgb, rasterize, upsample_max_jump_,
+                      buffers_, *registered_msg);
 }
 
 } // namespace depth_image_proc
@@ -0,0 +1,188 @@
+/*********************************************************************
+* Software License Agreement (BSD License)
+* 
+*  Copyright (c) 2008, Willow Garage, Inc.
+*  All rights reserved.
+* 
+*  Redistribution and use in source and binary forms, with or without
+*  modification, are permitted provided that the following conditions
+*  are met:
+* 
+*   * Redistributions of source code must retain the above copyright
+*     notice, this list of conditions and the following disclaimer.
+*   * Redistributions in binary form must reproduce the above
+*     copyright notice, this list of conditions and the following
+*     disclaimer in the documentation and/or other materials provided
+*     with the distribution.
+*   * Neither the name of the Willow Garage nor the names of its
+*     contributors may be used to endorse or promote products derived
+*     from this software without specific prior written permission.
+* 
+*  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+*  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+*  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+*  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+*  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+*  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+*  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+*  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+*  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+*  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+*  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+*  POSSIBILITY OF SUCH DAMAGE.
+*********************************************************************/
+#include <gtest/gtest.h>
+#include <ros/ros.h>
+#include <diagnostic_msgs/DiagnosticArray.h>
+#include <sensor_msgs/CameraInfo.h>
+#include <sensor_msgs/Image.h>
+#include <sensor_msgs/PointCloud2.h>
+#include <sensor_msgs/distortion_models.h>
+#include <sensor_msgs/image_encodings.h>
+
+#include <algorithm>
+#include <cmath>
+#include <string>
+
+namespace enc = sensor_msgs::image_encodings;
+
+// Feeds the pipeline nodelet an undistorted depth and RGB pair from cameras with the same intrinsics and an identity
+// transform between them, so every registered pixel lands where it started
+class PipelineTest : public testing::Test
+{
+protected:
+  virtual void SetUp()
+  {
+    depth_.header.frame_id = "depth_frame";
+    depth_.width = 32;
+    depth_.height = 24;
+    depth_.encoding = enc::TYPE_16UC1;
+    depth_.step = depth_.width * sizeof(uint16_t);
+    depth_.data.resize(depth_.height * depth_.step);
+    uint16_t* depth_data = reinterpret_cast<uint16_t*>(&depth_.data[0]);
+    for (unsigned i = 0; i < depth_.width * depth_.height; ++i)
+      depth_data[i] = i % 5 == 0 ? 0 : 1000 + i;
+
+    rgb_.header.frame_id = "rgb_frame";
+    rgb_.width = depth_.width;
+    rgb_.height = depth_.height;
+    rgb_.encoding = enc::RGB8;
+    rgb_.step = rgb_.width * 3;
+    rgb_.data.assign(rgb_.height * rgb_.step, 128);
+
+    depth_info_.header.frame_id = depth_.header.frame_id;
+    depth_info_.width = depth_.width;
+    depth_info_.height = depth_.height;
+    depth_info_.distortion_model = sensor_msgs::distortion_models::PLUMB_BOB;
+    depth_info_.D.resize(5, 0.0);
+    double K[] = {30.0, 0.0, 15.5, 0.0, 30.0, 11.5, 0.0, 0.0, 1.0};
+    double R[] = {1.0, 0.0, 0.0, 0.0, 1.0, 0.0, 0.0, 0.0, 1.0};
+    double P[] = {30.0, 0.0, 15.5, 0.0, 0.0, 30.0, 11.5, 0.0, 0.0, 0.0, 1.0, 0.0};
+    std::copy(K, K+9, depth_info_.K.begin());
+    std::copy(R, R+9, depth_info_.R.begin());
+    std::copy(P, P+12, depth_info_.P.begin());
+    rgb_info_ = depth_info_;
+    rgb_info_.header.frame_id = rgb_.header.frame_id;
+
+    pub_depth_ = nh_.advertise<sensor_msgs::Image>("camera/depth/image_raw", 1);
+    pub_depth_info_ = nh_.advertise<sensor_msgs::CameraInfo>("camera/depth/camera_info", 1);
+    pub_rgb_ = nh_.advertise<sensor_msgs::Image>("camera/rgb/image_raw", 1);
+    pub_rgb_info_ = nh_.advertise<sensor_msgs::CameraInfo>("camera/rgb/camera_info", 1);
+
+    sub_registered_ = nh_.subscribe("camera/depth_registered/image_rect", 1, &PipelineTest::registeredCb, this);
+    sub_depth_metric_ = nh_.subscribe("camera/depth/image_raw_m", 1, &PipelineTest::depthMetricCb, this);
+    sub_depth_rect_ = nh_.subscribe("camera/depth/image_rect", 1, &PipelineTest::depthRectCb, this);
+    sub_points_ = nh_.subscribe("camera/depth_registered/points", 1, &PipelineTest::pointsCb, this);
+    sub_diagnostics_ = nh_.subscribe("camera/diagnostics", 1, &PipelineTest::diagnosticsCb, this);
+  }
+
+  void registeredCb(const sensor_msgs::ImageConstPtr& msg) { registered_ = msg; }
+  void depthMetricCb(const sensor_msgs::ImageConstPtr& msg) { depth_metric_ = msg; }
+  void depthRectCb(const sensor_msgs::ImageConstPtr& msg) { depth_rect_ = msg; }
+  void pointsCb(const sensor_msgs::PointCloud2ConstPtr& msg) { points_ = msg; }
+  void diagnosticsCb(const diagnostic_msgs::DiagnosticArrayConstPtr& msg)
+  {
+    // Only keep diagnostics once the pipeline has processed frames
+    if (!msg->status.empty() && msg->status[0].message == "Processing")
+      diagnostics_ = msg;
+  }
+
+  // Publishes synchronized frames until every output has been received, or gives up after ten seconds
+  bool spinUntilReceived()
+  {
+    ros::Time deadline = ros::Time::now() + ros::Duration(10.0);
+    while (ros::ok() && ros::Time::now() < deadline)
+    {
+      ros::Time stamp = ros::Time::now();
+      depth_.header.stamp = rgb_.header.stamp = depth_info_.header.stamp = rgb_info_.header.stamp = stamp;
+      pub_depth_.publish(depth_);
+      pub_depth_info_.publish(depth_info_);
+      pub_rgb_.publish(rgb_);
+      pub_rgb_info_.publish(rgb_info_);
+      ros::Duration(0.05).sleep();
+      ros::spinOnce();
+      if (registered_ && depth_metric_ && depth_rect_ && points_ && diagnostics_)
+        return true;
+    }
+    return false;
+  }
+
+  ros::NodeHandle nh_;
+  sensor_msgs::Image depth_, rgb_;
+  sensor_msgs::CameraInfo depth_info_, rgb_info_;
+  ros::Publisher pub_depth_, pub_depth_info_, pub_rgb_, pub_rgb_info_;
+  ros::Subscriber sub_registered_, sub_depth_metric_, sub_depth_rect_, sub_points_, sub_diagnostics_;
+  sensor_msgs::ImageConstPtr registered_, depth_metric_, depth_rect_;
+  sensor_msgs::PointCloud2ConstPtr points_;
+  diagnostic_msgs::DiagnosticArrayConstPtr diagnostics_;
+};
+
+TEST_F(PipelineTest, publishesEveryStage)
+{
+  ASSERT_TRUE(spinUntilReceived());
+  const uint16_t* depth_data = reinterpret_cast<const uint16_t*>(&depth_.data[0]);
+
+  // Raw, unregistered and registered depth are all converted to meters
+  ASSERT_EQ(enc::TYPE_32FC1, depth_metric_->encoding);
+  ASSERT_EQ(depth_.width, depth_metric_->width);
+  ASSERT_EQ(depth_.height, depth_metric_->height);
+  ASSERT_EQ(enc::TYPE_32FC1, depth_rect_->encoding);
+  ASSERT_EQ(enc::TYPE_32FC1, registered_->encoding);
+  ASSERT_EQ(depth_.width, registered_->width);
+  ASSERT_EQ(depth_.height, registered_->height);
+  const float* depth_metric_data = reinterpret_cast<const float*>(&depth_metric_->data[0]);
+  const float* depth_rect_data = reinterpret_cast<const float*>(&depth_rect_->data[0]);
+  const float* registered_data = reinterpret_cast<const float*>(&registered_->data[0]);
+  for (unsigned i = 0; i < depth_.width * depth_.height; ++i)
+  {
+    if (depth_data[i] == 0)
+    {
+      EXPECT_TRUE(std::isnan(depth_metric_data[i])) << "pixel " << i;
+      EXPECT_TRUE(std::isnan(depth_rect_data[i])) << "pixel " << i;
+      EXPECT_TRUE(std::isnan(registered_data[i])) << "pixel " << i;
+      continue;
+    }
+    EXPECT_FLOAT_EQ(depth_data[i] * 0.001f, depth_metric_data[i]) << "pixel " << i;
+    EXPECT_FLOAT_EQ(depth_data[i] * 0.001f, depth_rect_data[i]) << "pixel " << i;
+    EXPECT_NEAR(depth_data[i] * 0.001f, registered_data[i], 1e-5f) << "pixel " << i;
+  }
+
+  // One point per registered pixel
+  EXPECT_EQ(registered_->width, points_->width);
+  EXPECT_EQ(registered_->height, points_->height);
+  EXPECT_EQ(registered_->header.frame_id, points_->header.frame_id);
+
+  // Timing is published on the pipeline's own relative diagnostics topic
+  ASSERT_EQ(1u, diagnostics_->status.size());
+  bool has_rectify_rate = false;
+  for (size_t i = 0; i < diagnostics_->status[0].values.size(); ++i)
+    has_rectify_rate |= diagnostics_->status[0].values[i].key == "rectify rate (Hz)";
+  EXPECT_TRUE(has_rectify_rate);
+}
+
+int main(int argc, char** argv)
+{
+  ros::init(argc, argv, "depth_image_proc_test_pipeline");
+  testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
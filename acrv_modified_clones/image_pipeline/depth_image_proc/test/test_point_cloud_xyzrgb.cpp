@@ -0,0 +1,195 @@
+/*********************************************************************
+* Software License Agreement (BSD License)
+* 
+*  Copyright (c) 2008, Willow Garage, Inc.
+*  All rights reserved.
+* 
+*  Redistribution and use in source and binary forms, with or without
+*  modification, are permitted provided that the following conditions
+*  are met:
+* 
+*   * Redistributions of source code must retain the above copyright
+*     notice, this list of conditions and the following disclaimer.
+*   * Redistributions in binary form must reproduce the above
+*     copyright notice, this list of conditions and the following
+*     disclaimer in the documentation and/or other materials provided
+*     with the distribution.
+*   * Neither the name of the Willow Garage nor the names of its
+*     contributors may be used to endorse or promote products derived
+*     from this software without specific prior written permission.
+* 
+*  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+*  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+*  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+*  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+*  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+*  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+*  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+*  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+*  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+*  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+*  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+*  POSSIBILITY OF SUCH DAMAGE.
+*********************************************************************/
+#include <gtest/gtest.h>
+#include <opencv2/core/core.hpp>
+#include <sensor_msgs/CameraInfo.h>
+#include <sensor_msgs/point_cloud2_iterator.h>
+
+#include <depth_image_proc/point_cloud_xyzrgb.h>
+
+#include <cmath>
+#include <cstring>
+#include <vector>
+
+using namespace depth_image_proc;
+
+static image_geometry::PinholeCameraModel cameraModel(int width, int height, double fx, double fy, double cx, double cy)
+{
+  sensor_msgs::CameraInfo info;
+  info.width = width;
+  info.height = height;
+  info.distortion_model = "plumb_bob";
+  info.D.resize(5, 0.0);
+  info.K[0] = fx; info.K[2] = cx; info.K[4] = fy; info.K[5] = cy; info.K[8] = 1.0;
+  info.R[0] = info.R[4] = info.R[8] = 1.0;
+  info.P[0] = fx; info.P[2] = cx; info.P[5] = fy; info.P[6] = cy; info.P[10] = 1.0;
+  image_geometry::PinholeCameraModel model;
+  model.fromCameraInfo(info);
+  return model;
+}
+
+// 16UC1 depth in millimeters with every depth_gap'th pixel missing, and an RGB8 image whose color encodes the pixel
+static void makeImages(int width, int height, int depth_gap, sensor_msgs::Image& depth, sensor_msgs::Image& rgb)
+{
+  depth.width = rgb.width = width;
+  depth.height = rgb.height = height;
+  depth.step = width * sizeof(uint16_t);
+  depth.data.resize(height * depth.step);
+  rgb.step = width * 3;
+  rgb.data.resize(height * rgb.step);
+  for (int v = 0; v < height; ++v)
+    for (int u = 0; u < width; ++u)
+    {
+      const int i = v * width + u;
+      reinterpret_cast<uint16_t*>(&depth.data[0])[i] = i % depth_gap == 0 ? 0 : 500 + u + 2 * v;
+      rgb.data[i * 3 + 0] = u;
+      rgb.data[i * 3 + 1] = v;
+      rgb.data[i * 3 + 2] = u + v;
+    }
+}
+
+static void convert(const sensor_msgs::Image& depth, const sensor_msgs::Image& rgb, const image_geometry::PinholeCameraModel& model,
+                    bool dense, sensor_msgs::PointCloud2& cloud, sensor_msgs::Image& index)
+{
+  cloud.height = depth.height;
+  cloud.width = depth.width;
+  cloud.is_dense = false;
+  cloud.is_bigendian = false;
+  sensor_msgs::PointCloud2Modifier pcd_modifier(cloud);
+  pcd_modifier.setPointCloud2FieldsByString(2, "xyz", "rgb");
+
+  index.width = depth.width;
+  index.height = depth.height;
+  index.step = index.width * sizeof(int32_t);
+  index.data.resize(index.height * index.step);
+
+  XyzrgbBuffers buffers;
+  convertXyzrgb<uint16_t>(depth, rgb, model, 0, 1, 2, 3, buffers, cloud, dense ? &index : NULL);
+}
+
+TEST(PointCloudXyzrgb, organizedCloudHasEveryPixel)
+{
+  sensor_msgs::Image depth, rgb, index;
+  makeImages(67, 41, 7, depth, rgb);
+  image_geometry::PinholeCameraModel model = cameraModel(67, 41, 60.0, 61.0, 33.2, 20.4);
+  sensor_msgs::PointCloud2 cloud;
+  convert(depth, rgb, model, false, cloud, index);
+
+  ASSERT_EQ(sizeof(PointXyzrgb), cloud.point_step);
+  ASSERT_EQ(41u, cloud.height);
+  ASSERT_EQ(67u, cloud.width);
+  EXPECT_FALSE(cloud.is_dense);
+  const PointXyzrgb* points = reinterpret_cast<const PointXyzrgb*>(&cloud.data[0]);
+  const uint16_t* depth_data = reinterpret_cast<const uint16_t*>(&depth.data[0]);
+  for (int v = 0; v < 41; ++v)
+    for (int u = 0; u < 67; ++u)
+    {
+      const int i = v * 67 + u;
+      const PointXyzrgb& p = points[i];
+      if (depth_data[i] == 0)
+      {
+        EXPECT_TRUE(std::isnan(p.x) && std::isnan(p.y) && std::isnan(p.z)) << "pixel " << u << ", " << v;
+        continue;
+      }
+      const float z = depth_data[i] * 0.001f;
+      EXPECT_NEAR(z, p.z, 1e-6f);
+      EXPECT_NEAR((u - 33.2f) * z / 60.0f, p.x, 1e-5f);
+      EXPECT_NEAR((v - 20.4f) * z / 61.0f, p.y, 1e-5f);
+      EXPECT_EQ(rgb.data[i * 3 + 0], p.r);
+      EXPECT_EQ(rgb.data[i * 3 + 1], p.g);
+      EXPECT_EQ(rgb.data[i * 3 + 2], p.b);
+    }
+}
+
+TEST(PointCloudXyzrgb, denseCloudIndexMapsPixelsToPoints)
+{
+  sensor_msgs::Image depth, rgb, index;
+  makeImages(67, 41, 7, depth, rgb);
+  image_geometry::PinholeCameraModel model = cameraModel(67, 41, 60.0, 61.0, 33.2, 20.4);
+  sensor_msgs::PointCloud2 organized, dense;
+  convert(depth, rgb, model, false, organized, index);
+  convert(depth, rgb, model, true, dense, index);
+
+  const uint16_t* depth_data = reinterpret_cast<const uint16_t*>(&depth.data[0]);
+  int valid = 0;
+  for (int i = 0; i < 67 * 41; ++i)
+    valid += depth_data[i] != 0;
+
+  ASSERT_EQ(1u, dense.height);
+  ASSERT_EQ((unsigned)valid, dense.width);
+  EXPECT_EQ(dense.width * dense.point_step, dense.row_step);
+  EXPECT_EQ(dense.row_step, dense.data.size());
+  EXPECT_TRUE(dense.is_dense);
+
+  // Valid pixels get consecutive indices in pixel order, and their point is the one the organized cloud has for that pixel
+  const PointXyzrgb* organized_points = reinterpret_cast<const PointXyzrgb*>(&organized.data[0]);
+  const PointXyzrgb* dense_points = reinterpret_cast<const PointXyzrgb*>(&dense.data[0]);
+  const int32_t* indices = reinterpret_cast<const int32_t*>(&index.data[0]);
+  int32_t next = 0;
+  for (int i = 0; i < 67 * 41; ++i)
+  {
+    if (depth_data[i] == 0)
+    {
+      EXPECT_EQ(-1, indices[i]);
+      continue;
+    }
+    ASSERT_EQ(next++, indices[i]);
+    const PointXyzrgb& p = dense_points[indices[i]];
+    EXPECT_FALSE(std::isnan(p.x) || std::isnan(p.y) || std::isnan(p.z));
+    EXPECT_EQ(0, memcmp(&organized_points[i], &p, sizeof(p)));
+  }
+  EXPECT_EQ(valid, next);
+}
+
+TEST(PointCloudXyzrgb, denseCloudWithoutValidDepth)
+{
+  sensor_msgs::Image depth, rgb, index;
+  makeImages(16, 9, 1, depth, rgb);
+  image_geometry::PinholeCameraModel model = cameraModel(16, 9, 15.0, 15.0, 7.5, 4.5);
+  sensor_msgs::PointCloud2 dense;
+  convert(depth, rgb, model, true, dense, index);
+
+  EXPECT_EQ(1u, dense.height);
+  EXPECT_EQ(0u, dense.width);
+  EXPECT_TRUE(dense.data.empty());
+  const int32_t* indices = reinterpret_cast<const int32_t*>(&index.data[0]);
+  for (int i = 0; i < 16 * 9; ++i)
+    EXPECT_EQ(-1, indices[i]);
+}
+
+int main(int argc, char** argv)
+{
+  testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -0,0 +1,243 @@
+/*********************************************************************
+* Software License Agreement (BSD License)
+* 
+*  Copyright (c) 2008, Willow Garage, Inc.
+*  All rights reserved.
+* 
+*  Redistribution and use in source and binary forms, with or without
+*  modification, are permitted provided that the following conditions
+*  are met:
+* 
+*   * Redistributions of source code must retain the above copyright
+*     notice, this list of conditions and the following disclaimer.
+*   * Redistributions in binary form must reproduce the above
+*     copyright notice, this list of conditions and the following
+*     disclaimer in the documentation and/or other materials provided
+*     with the distribution.
+*   * Neither the name of the Willow Garage nor the names of its
+*     contributors may be used to endorse or promote products derived
+*     from this software without specific prior written permission.
+* 
+*  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+*  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+*  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+*  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+*  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+*  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+*  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+*  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+*  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+*  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+*  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+*  POSSIBILITY OF SUCH DAMAGE.
+*********************************************************************/
+#include <gtest/gtest.h>
+#include <opencv2/core/core.hpp>
+#include <sensor_msgs/CameraInfo.h>
+
+#include <depth_image_proc/depth_registration.h>
+
+#include <cmath>
+#include <cstdlib>
+#include <limits>
+#include <vector>
+
+using namespace depth_image_proc;
+
+static image_geometry::PinholeCameraModel cameraModel(int width, int height, double fx, double fy, double cx, double cy)
+{
+  sensor_msgs::CameraInfo info;
+  info.width = width;
+  info.height = height;
+  info.distortion_model = "plumb_bob";
+  info.D.resize(5, 0.0);
+  info.K[0] = fx; info.K[2] = cx; info.K[4] = fy; info.K[5] = cy; info.K[8] = 1.0;
+  info.R[0] = info.R[4] = info.R[8] = 1.0;
+  info.P[0] = fx; info.P[2] = cx; info.P[5] = fy; info.P[6] = cy; info.P[10] = 1.0;
+  image_geometry::PinholeCameraModel model;
+  model.fromCameraInfo(info);
+  return model;
+}
+
+// Steps of depth across the columns, a nearer box in the middle and one pixel in ten missing, in millimeters
+static cv::Mat depthImage(int width, int height)
+{
+  cv::Mat depth(height, width, CV_16UC1);
+  cv::RNG rng(1);
+  for (int v = 0; v < height; ++v)
+    for (int u = 0; u < width; ++u)
+    {
+      uint16_t d = 800 + (u / 40) * 37 + v + rng.uniform(0, 5);
+      if (u > 300 && u < 340 && v > 200 && v < 260)
+        d = 500;
+      depth.at<uint16_t>(v, u) = rng.uniform(0, 10) == 0 ? 0 : d;
+    }
+  return depth;
+}
+
+static Eigen::Affine3d depthToRgb()
+{
+  return Eigen::Translation3d(0.025, 0.003, -0.002) * Eigen::AngleAxisd(0.02, Eigen::Vector3d(0.3, 1.0, 0.1).normalized());
+}
+
+// The original per-pixel registration: back-project, transform and project each depth pixel with Eigen in double precision
+static std::vector<uint16_t> registerPerPixel(const cv::Mat& depth,
+                                              const image_geometry::PinholeCameraModel& depth_model,
+                                              const image_geometry::PinholeCameraModel& rgb_model,
+                                              const Eigen::Affine3d& depth_to_rgb, int width, int height)
+{
+  std::vector<uint16_t> registered(width * height, 0);
+  for (int v = 0; v < depth.rows; ++v)
+  {
+    for (int u = 0; u < depth.cols; ++u)
+    {
+      uint16_t raw_depth = depth.at<uint16_t>(v, u);
+      if (!DepthTraits<uint16_t>::valid(raw_depth))
+        continue;
+      double d = DepthTraits<uint16_t>::toMeters(raw_depth);
+
+      Eigen::Vector4d xyz_depth;
+      xyz_depth << ((u - depth_model.cx())*d - depth_model.Tx()) / depth_model.fx(),
+                   ((v - depth_model.cy())*d - depth_model.Ty()) / depth_model.fy(),
+                   d,
+                   1;
+      Eigen::Vector4d xyz_rgb = depth_to_rgb * xyz_depth;
+
+      double inv_Z = 1.0 / xyz_rgb.z();
+      int u_rgb = (rgb_model.fx()*xyz_rgb.x() + rgb_model.Tx())*inv_Z + rgb_model.cx() + 0.5;
+      int v_rgb = (rgb_model.fy()*xyz_rgb.y() + rgb_model.Ty())*inv_Z + rgb_model.cy() + 0.5;
+      if (u_rgb < 0 || u_rgb >= width || v_rgb < 0 || v_rgb >= height)
+        continue;
+
+      uint16_t& reg_depth = registered[v_rgb*width + u_rgb];
+      uint16_t new_depth = DepthTraits<uint16_t>::fromMeters(xyz_rgb.z());
+      if (!DepthTraits<uint16_t>::valid(reg_depth) || reg_depth > new_depth)
+        reg_depth = new_depth;
+    }
+  }
+  return registered;
+}
+
+template<typename U>
+static sensor_msgs::Image registerOnThreads(const cv::Mat& depth,
+                                            const image_geometry::PinholeCameraModel& depth_model,
+                                            const image_geometry::PinholeCameraModel& rgb_model,
+                                            bool rasterize, int threads)
+{
+  const int old_threads = cv::getNumThreads();
+  cv::setNumThreads(threads);
+  RegistrationBuffers buffers;
+  sensor_msgs::Image registered;
+  registered.width = rgb_model.cameraInfo().width;
+  registered.height = rgb_model.cameraInfo().height;
+  registerDepth<uint16_t, U>(depth, depth_model, rgb_model, depthToRgb(), rasterize, 0.05, buffers, registered);
+  cv::setNumThreads(old_threads);
+  return registered;
+}
+
+TEST(RegisterDepth, matchesPerPixelReference)
+{
+  cv::Mat depth = depthImage(640, 480);
+  image_geometry::PinholeCameraModel depth_model = cameraModel(640, 480, 580.0, 580.0, 319.5, 239.5);
+  image_geometry::PinholeCameraModel rgb_model = cameraModel(640, 480, 520.0, 521.0, 320.1, 240.7);
+
+  std::vector<uint16_t> reference = registerPerPixel(depth, depth_model, rgb_model, depthToRgb(), 640, 480);
+  sensor_msgs::Image registered = registerOnThreads<uint16_t>(depth, depth_model, rgb_model, false, 4);
+  ASSERT_EQ(registered.step, 640 * sizeof(uint16_t));
+  const uint16_t* folded = reinterpret_cast<const uint16_t*>(&registered.data[0]);
+
+  // The folded matrix is applied in single precision, so a depth pixel projecting right onto the border between two RGB
+  // pixels may round to the other one, and occasionally win or lose a z-buffer test because of it
+  int valid = 0, mismatched = 0, off_by_more = 0;
+  for (size_t i = 0; i < reference.size(); ++i)
+  {
+    valid += reference[i] != 0;
+    if (folded[i] == reference[i])
+      continue;
+    ++mismatched;
+    if (folded[i] != 0 && reference[i] != 0 && std::abs(folded[i] - reference[i]) > 1)
+      ++off_by_more;
+  }
+  EXPECT_GT(valid, 640 * 480 / 2);
+  EXPECT_LE(mismatched, valid / 1000);
+  EXPECT_LE(off_by_more, valid / 10000);
+}
+
+TEST(RegisterDepth, zBufferDoesNotDependOnThreads)
+{
+  cv::Mat depth = depthImage(640, 480);
+  image_geometry::PinholeCameraModel depth_model = cameraModel(640, 480, 580.0, 580.0, 319.5, 239.5);
+  image_geometry::PinholeCameraModel rgb_model = cameraModel(1920, 1080, 1385.0, 1386.0, 959.5, 539.5);
+
+  for (int rasterize = 0; rasterize < 2; ++rasterize)
+  {
+    sensor_msgs::Image one_band = registerOnThreads<uint16_t>(depth, depth_model, rgb_model, rasterize, 1);
+    const int threads[] = {2, 3, 8};
+    for (size_t t = 0; t < sizeof(threads) / sizeof(threads[0]); ++t)
+      EXPECT_TRUE(registerOnThreads<uint16_t>(depth, depth_model, rgb_model, rasterize, threads[t]).data == one_band.data)
+        << "rasterize " << rasterize << ", " << threads[t] << " threads";
+  }
+}
+
+TEST(RegisterDepth, rasterizingFillsUpsampledImage)
+{
+  cv::Mat depth = depthImage(640, 480);
+  image_geometry::PinholeCameraModel depth_model = cameraModel(640, 480, 580.0, 580.0, 319.5, 239.5);
+  image_geometry::PinholeCameraModel rgb_model = cameraModel(1920, 1080, 1385.0, 1386.0, 959.5, 539.5);
+
+  sensor_msgs::Image splatted = registerOnThreads<uint16_t>(depth, depth_model, rgb_model, false, 4);
+  sensor_msgs::Image rasterized = registerOnThreads<uint16_t>(depth, depth_model, rgb_model, true, 4);
+  const uint16_t* splatted_depth = reinterpret_cast<const uint16_t*>(&splatted.data[0]);
+  const uint16_t* rasterized_depth = reinterpret_cast<const uint16_t*>(&rasterized.data[0]);
+  int splatted_count = 0, rasterized_count = 0;
+  for (int i = 0; i < 1920 * 1080; ++i)
+  {
+    splatted_count += splatted_depth[i] != 0;
+    rasterized_count += rasterized_depth[i] != 0;
+    // Triangles only ever add nearer or new depth to a pixel
+    if (splatted_depth[i] != 0)
+      EXPECT_LE(rasterized_depth[i], splatted_depth[i]);
+  }
+  EXPECT_GT(rasterized_count, 2 * splatted_count);
+}
+
+// The pipeline registers 16UC1 millimeters straight to 32FC1 meters instead of running convert_metric first
+TEST(RegisterDepth, registeringToMetersMatchesConvertingFirst)
+{
+  cv::Mat depth = depthImage(640, 480);
+  image_geometry::PinholeCameraModel depth_model = cameraModel(640, 480, 580.0, 580.0, 319.5, 239.5);
+  image_geometry::PinholeCameraModel rgb_model = cameraModel(640, 480, 520.0, 521.0, 320.1, 240.7);
+
+  // What convert_metric publishes
+  cv::Mat metric(480, 640, CV_32FC1);
+  for (int v = 0; v < 480; ++v)
+    for (int u = 0; u < 640; ++u)
+    {
+      uint16_t raw = depth.at<uint16_t>(v, u);
+      metric.at<float>(v, u) = raw == 0 ? std::numeric_limits<float>::quiet_NaN() : (float)raw * 0.001f;
+    }
+
+  RegistrationBuffers buffers;
+  sensor_msgs::Image direct, converted;
+  direct.width = converted.width = 640;
+  direct.height = converted.height = 480;
+  registerDepth<uint16_t, float>(depth, depth_model, rgb_model, depthToRgb(), false, 0.05, buffers, direct);
+  registerDepth<float, float>(metric, depth_model, rgb_model, depthToRgb(), false, 0.05, buffers, converted);
+  ASSERT_EQ(converted.step, direct.step);
+
+  const float* direct_depth = reinterpret_cast<const float*>(&direct.data[0]);
+  const float* converted_depth = reinterpret_cast<const float*>(&converted.data[0]);
+  for (int i = 0; i < 640 * 480; ++i)
+  {
+    if (std::isnan(converted_depth[i]))
+      EXPECT_TRUE(std::isnan(direct_depth[i])) << "pixel " << i;
+    else
+      EXPECT_EQ(converted_depth[i], direct_depth[i]) << "pixel " << i;
+  }
+}
+
+int main(int argc, char** argv)
+{
+  testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -45,6 +45,8 @@
 #include <image_proc/CropDecimateConfig.h>
 #include <opencv2/imgproc/imgproc.hpp>
 
+#include "decimate.h"
+
 namespace image_proc {
 
 using namespace cv_bridge; // CvImage, toCvShare
@@ -114,59 +116,6 @@ void CropDecimateNodelet::connectCb()
   }
 }
 
-template <typename T>
-void debayer2x2toBGR(const cv::Mat& src, cv::Mat& dst, int R, int G1, int G2, int B)
-{
-  typedef cv::Vec<T, 3> DstPixel; // 8- or 16-bit BGR
-  dst.create(src.rows / 2, src.cols / 2, cv::DataType<DstPixel>::type);
-
-  int src_row_step = src.step1();
-  int dst_row_step = dst.step1();
-  const T* src_row = src.ptr<T>();
-  T* dst_row = dst.ptr<T>();
-
-  // 2x2 downsample and debayer at once
-  for (int y = 0; y < dst.rows; ++y)
-  {
-    for (int x = 0; x < dst.cols; ++x)
-    {
-      dst_row[x*3 + 0] = src_row[x*2 + B];
-      dst_row[x*3 + 1] = (src_row[x*2 + G1] + src_row[x*2 + G2]) / 2;
-      dst_row[x*3 + 2] = src_row[x*2 + R];
-    }
-    src_row += src_row_step * 2;
-    dst_row += dst_row_step;
-  }
-}
-
-// Templated on pixel size, in bytes (MONO8 = 1, BGR8 = 3, RGBA16 = 8, ...)
-template <int N>
-void decimate(const cv::Mat& src, cv::Mat& dst, int decimation_x, int decimation_y)
-{
-  dst.create(src.rows / decimation_y, src.cols / decimation_x, src.type());
-
-  int src_row_step = src.step[0] * decimation_y;
-  int src_pixel_step = N * decimation_x;
-  int dst_row_step = dst.step[0];
-
-  const uint8_t* src_row = src.ptr();
-  uint8_t* dst_row = dst.ptr();
-  
-  for (int y = 0; y < dst.rows; ++y)
-  {
-    const uint8_t* src_pixel = src_row;
-    uint8_t* dst_pixel = dst_row;
-    for (int x = 0; x < dst.cols; ++x)
-    {
-      memcpy(dst_pixel, src_pixel, N); // Should inline with small, fixed N
-      src_pixel += src_pixel_step;
-      dst_pixel += N;
-    }
-    src_row += src_row_step;
-    dst_row += dst_row_step;
-  }
-}
-
 void CropDecimateNodelet::imageCb(const sensor_msgs::ImageConstPtr& image_msg,
                                   const sensor_msgs::CameraInfoConstPtr& info_msg)
 {
@@ -233,22 +182,19 @@ void CropDecimateNodelet::imageCb(const sensor_msgs::ImageConstPtr& image_msg,
 
     cv::Mat bgr;
     int step = output.image.step1();
-    if (image_msg->encoding == sensor_msgs::image_encodings::BAYER_RGGB8)
-      debayer2x2toBGR<uint8_t>(output.image, bgr, 0, 1, step, step + 1);
-    else if (image_msg->encoding == sensor_msgs::image_encodings::BAYER_BGGR8)
-      debayer2x2toBGR<uint8_t>(output.image, bgr, step + 1, 1, step, 0);
-    else if (image_msg->encoding == sensor_msgs::image_encodings::BAYER_GBRG8)
-      debayer2x2toBGR<uint8_t>(output.image, bgr, step, 0, step + 1, 1);
-    else if (image_msg->encoding == sensor_msgs::image_encodings::BAYER_GRBG8)
-      debayer2x2toBGR<uint8_t>(output.image, bgr, 1, 0, step + 1, step);
-    else if (image_msg->encoding == sensor_msgs::image_encodings::BAYER_RGGB16)
-      debayer2x2toBGR<uint16_t>(output.image, bgr, 0, 1, step, step + 1);
-    else if (image_msg->encoding == sensor_msgs::image_encodings::BAYER_BGGR16)
-      debayer2x2toBGR<uint16_t>(output.image, bgr, step + 1, 1, step, 0);
-    else if (image_msg->encoding == sensor_msgs::image_encodings::BAYER_GBRG16)
-      debayer2x2toBGR<uint16_t>(output.image, bgr, step, 0, step + 1, 1);
-    else if (image_msg->encoding == sensor_msgs::image_encodings::BAYER_GRBG16)
-      debayer2x2toBGR<uint16_t>(output.image, bgr, 1, 0, step + 1, step);
+    const std::string& encoding = image_msg->encoding;
+    if (encoding == sensor_msgs::image_encodings::BAYER_RGGB8 ||
+        encoding == sensor_msgs::image_encodings::BAYER_RGGB16)
+      debayer2x2toBGR(output.image, bgr, 0, 1, step, step + 1);
+    else if (encoding == sensor_msgs::image_encodings::BAYER_BGGR8 ||
+             encoding == sensor_msgs::image_encodings::BAYER_BGGR16)
+      debayer2x2toBGR(output.image, bgr, step + 1, 1, step, 0);
+    else if (encoding == sensor_msgs::image_encodings::BAYER_GBRG8 ||
+             encoding == sensor_msgs::image_encodings::BAYER_GBRG16)
+      debayer2x2toBGR(output.image, bgr, step, 0, step + 1, 1);
+    else if (encoding == sensor_msgs::image_encodings::BAYER_GRBG8 ||
+             encoding == sensor_msgs::image_encodings::BAYER_GRBG16)
+      debayer2x2toBGR(output.image, bgr, 1, 0, step + 1, step);
     else
     {
       NODELET_ERROR_THROTTLE(2, "Unrecognized Bayer encoding '%s'", image_msg->encoding.c_str());
@@ -270,42 +216,16 @@ void CropDecimateNodelet::imageCb(const sensor_msgs::ImageConstPtr& image_msg,
     if (config.interpolation == image_proc::CropDecimate_NN)
     {
       // Use optimized method instead of OpenCV's more general NN resize
-      int pixel_size = output.image.elemSize();
-      switch (pixel_size)
+      if (!decimateNearest(output.image, decimated, decimation_x, decimation_y))
       {
-        // Currently support up through 4-channel float
-        case 1:
-          decimate<1>(output.image, decimated, decimation_x, decimation_y);
-          break;
-        case 2:
-          decimate<2>(output.image, decimated, decimation_x, decimation_y);
-          break;
-        case 3:
-          decimate<3>(output.image, decimated, decimation_x, decimation_y);
-          break;
-        case 4:
-          decimate<4>(output.image, decimated, decimation_x, decimation_y);
-          break;
-        case 6:
-          decimate<6>(output.image, decimated, decimation_x, decimation_y);
-          break;
-        case 8:
-          decimate<8>(output.image, decimated, decimation_x, decimation_y);
-          break;
-        case 12:
-          decimate<12>(output.image, decimated, decimation_x, decimation_y);
-          break;
-        case 16:
-          decimate<16>(output.image, decimated, decimation_x, decimation_y);
-          break;
-        default:
-          NODELET_ERROR_THROTTLE(2, "Unsupported pixel size, %d bytes", pixel_size);
-          return;
+        NODELET_ERROR_THROTTLE(2, "Unsupported pixel size, %d bytes", (int)output.image.elemSize());
+        return;
       }
     }
-    else
+    else if (config.interpolation != image_proc::CropDecimate_Area ||
+             !decimateArea(output.image, decimated, decimation_x, decimation_y))
     {
-      // Linear, cubic, area, ...
+      // Linear, cubic, area on depths decimateArea doesn't handle, ...
       cv::Size size(output.image.cols / decimation_x, output.image.rows / decimation_y);
       cv::resize(output.image, decimated, size, 0.0, 0.0, config.interpolation);
     }
@@ -0,0 +1,541 @@
+/*********************************************************************
+* Software License Agreement (BSD License)
+* 
+*  Copyright (c) 2008, Willow Garage, Inc.
+*  All rights reserved.
+* 
+*  Redistribution and use in source and binary forms, with or without
+*  modification, are permitted provided that the following conditions
+*  are met:
+* 
+*   * Redistributions of source code must retain the above copyright
+*     notice, this list of conditions and the following disclaimer.
+*   * Redistributions in binary form must reproduce the above
+*     copyright notice, this list of conditions and the following
+*     disclaimer in the documentation and/or other materials provided
+*     with the distribution.
+*   * Neither the name of the Willow Garage nor the names of its
+*     contributors may be used to endorse or promote products derived
+*     from this software without specific prior written permission.
+* 
+*  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+*  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+*  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+*  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+*  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+*  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+*  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+*  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+*  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+*  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+*  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+*  POSSIBILITY OF SUCH DAMAGE.
+*********************************************************************/
+#include "decimate.h"
+
+#include <stdint.h>
+#include <algorithm>
+#include <cstring>
+#include <vector>
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+namespace image_proc {
+
+namespace {
+
+// Output rows are too cheap to be scheduled one at a time, hand them out in stripes of about this many bytes
+const double STRIPE_BYTES = 64 * 1024;
+
+double stripes(const cv::Mat& dst)
+{
+  return std::max(1.0, dst.rows * dst.cols * dst.elemSize() / STRIPE_BYTES);
+}
+
+#if defined(__SSE2__)
+inline __m128i load(const void* p)
+{
+  return _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+}
+
+inline void store(void* p, __m128i v)
+{
+  _mm_storeu_si128(reinterpret_cast<__m128i*>(p), v);
+}
+
+// Low 16 bits of each 32 bit lane of a then b
+inline __m128i packLow16(__m128i a, __m128i b)
+{
+  return _mm_packs_epi32(_mm_srai_epi32(_mm_slli_epi32(a, 16), 16), _mm_srai_epi32(_mm_slli_epi32(b, 16), 16));
+}
+
+// 32 bit lanes 0 and 2 of a then b
+inline __m128i evenLanes32(__m128i a, __m128i b)
+{
+  return _mm_unpacklo_epi64(_mm_shuffle_epi32(a, _MM_SHUFFLE(3, 1, 2, 0)), _mm_shuffle_epi32(b, _MM_SHUFFLE(3, 1, 2, 0)));
+}
+
+// 32 bit lane 0 of a, b, c and d
+inline __m128i firstLanes32(__m128i a, __m128i b, __m128i c, __m128i d)
+{
+  return _mm_unpacklo_epi64(_mm_unpacklo_epi32(a, b), _mm_unpacklo_epi32(c, d));
+}
+#endif
+
+// Copies the first N byte pixel of every decimation_x of a row with whole vector loads and shuffles instead of per
+// pixel moves, for the pixel sizes and decimations where that is possible. Returns the number of pixels done, the caller does the rest.
+template <int N>
+inline int decimateRowSimd(const uint8_t*, uint8_t*, int, int)
+{
+  return 0;
+}
+
+#if defined(__SSE2__)
+template <>
+inline int decimateRowSimd<1>(const uint8_t* src, uint8_t* dst, int cols, int decimation_x)
+{
+  int x = 0;
+  if (decimation_x == 2)
+  {
+    const __m128i mask = _mm_set1_epi16(0xff);
+    for (; x + 16 <= cols; x += 16, src += 32)
+      store(dst + x, _mm_packus_epi16(_mm_and_si128(load(src), mask), _mm_and_si128(load(src + 16), mask)));
+  }
+  else if (decimation_x == 4)
+  {
+    const __m128i mask = _mm_set1_epi32(0xff);
+    for (; x + 16 <= cols; x += 16, src += 64)
+    {
+      __m128i lo = _mm_packs_epi32(_mm_and_si128(load(src), mask), _mm_and_si128(load(src + 16), mask));
+      __m128i hi = _mm_packs_epi32(_mm_and_si128(load(src + 32), mask), _mm_and_si128(load(src + 48), mask));
+      store(dst + x, _mm_packus_epi16(lo, hi));
+    }
+  }
+  return x;
+}
+
+template <>
+inline int decimateRowSimd<2>(const uint8_t* src, uint8_t* dst, int cols, int decimation_x)
+{
+  int x = 0;
+  if (decimation_x == 2)
+  {
+    for (; x + 8 <= cols; x += 8, src += 32)
+      store(dst + 2 * x, packLow16(load(src), load(src + 16)));
+  }
+  else if (decimation_x == 4)
+  {
+    for (; x + 8 <= cols; x += 8, src += 64)
+      store(dst + 2 * x, packLow16(evenLanes32(load(src), load(src + 16)), evenLanes32(load(src + 32), load(src + 48))));
+  }
+  return x;
+}
+
+template <>
+inline int decimateRowSimd<4>(const uint8_t* src, uint8_t* dst, int cols, int decimation_x)
+{
+  int x = 0;
+  if (decimation_x == 2)
+  {
+    for (; x + 4 <= cols; x += 4, src += 32)
+      store(dst + 4 * x, evenLanes32(load(src), load(src + 16)));
+  }
+  else if (decimation_x == 4)
+  {
+    for (; x + 4 <= cols; x += 4, src += 64)
+      store(dst + 4 * x, firstLanes32(load(src), load(src + 16), load(src + 32), load(src + 48)));
+  }
+  return x;
+}
+#endif
+
+template <int N>
+inline void decimateRow(const uint8_t* src, uint8_t* dst, int cols, int decimation_x)
+{
+  int x = decimateRowSimd<N>(src, dst, cols, decimation_x);
+  src += x * N * decimation_x;
+  dst += x * N;
+  for (; x < cols; ++x)
+  {
+    memcpy(dst, src, N); // Should inline with small, fixed N
+    src += N * decimation_x;
+    dst += N;
+  }
+}
+
+// Three byte pixels are moved four bytes at a time, the extra byte is overwritten by the next pixel. The source byte
+// after each pixel but the last is the start of the next source pixel, so it is always readable.
+template <>
+inline void decimateRow<3>(const uint8_t* src, uint8_t* dst, int cols, int decimation_x)
+{
+  for (int x = 0; x < cols - 1; ++x, src += 3 * decimation_x, dst += 3)
+    memcpy(dst, src, 4);
+  if (cols > 0)
+    memcpy(dst, src, 3);
+}
+
+// Templated on pixel size, in bytes (MONO8 = 1, BGR8 = 3, RGBA16 = 8, ...)
+template <int N>
+class DecimateNearestRows : public cv::ParallelLoopBody
+{
+public:
+  DecimateNearestRows(const cv::Mat& src, cv::Mat& dst, int decimation_x, int decimation_y)
+    : src_(src), dst_(dst), decimation_x_(decimation_x), decimation_y_(decimation_y)
+  {
+  }
+
+  void operator()(const cv::Range& range) const
+  {
+    for (int y = range.start; y < range.end; ++y)
+    {
+      const uint8_t* src_row = src_.ptr(y * decimation_y_);
+      if (decimation_x_ == 1)
+        memcpy(dst_.ptr(y), src_row, dst_.cols * N);
+      else
+        decimateRow<N>(src_row, dst_.ptr(y), dst_.cols, decimation_x_);
+    }
+  }
+
+private:
+  const cv::Mat& src_;
+  cv::Mat& dst_;
+  int decimation_x_, decimation_y_;
+};
+
+template <int N>
+void decimatePixels(const cv::Mat& src, cv::Mat& dst, int decimation_x, int decimation_y)
+{
+  dst.create(src.rows / decimation_y, src.cols / decimation_x, src.type());
+  cv::parallel_for_(cv::Range(0, dst.rows), DecimateNearestRows<N>(src, dst, decimation_x, decimation_y),
+                    stripes(dst));
+}
+
+// Accumulator types of area decimation, for up to 16x16 blocks: Column holds the sum of decimation_y values of T,
+// Block the sum of decimation_x Columns
+template <typename T> struct AreaSum;
+template <> struct AreaSum<uint8_t>  { typedef uint16_t Column; typedef uint32_t Block; };
+template <> struct AreaSum<uint16_t> { typedef uint32_t Column; typedef uint32_t Block; };
+template <> struct AreaSum<float>    { typedef float    Column; typedef float    Block; };
+
+// Division by the block area with rounding, as a multiplication by 2^32 / area rounded up. The sums are below 2^24, so
+// the error of the reciprocal stays below 1 / area and the quotient is exact.
+template <typename T>
+class BlockAverage
+{
+public:
+  explicit BlockAverage(uint32_t area) : half_(area / 2), reciprocal_((((uint64_t)1 << 32) + area - 1) / area) {}
+
+  T operator()(uint32_t sum) const
+  {
+    return T(((sum + half_) * reciprocal_) >> 32);
+  }
+
+private:
+  uint64_t half_, reciprocal_;
+};
+
+template <>
+class BlockAverage<float>
+{
+public:
+  explicit BlockAverage(float area) : scale_(1.0f / area) {}
+
+  float operator()(float sum) const
+  {
+    return sum * scale_;
+  }
+
+private:
+  float scale_;
+};
+
+// Averages the column sums of each group of decimation_x pixels. Templated on the decimation and number of channels
+// for the common ones, 0 for any other.
+template <typename T, typename S, int DX, int CN>
+inline void averageBlocks(const S* sums, T* dst, int cols, int decimation_x, int channels,
+                          const BlockAverage<T>& average)
+{
+  typedef typename AreaSum<T>::Block Block;
+  const int dx = DX ? DX : decimation_x;
+  const int cn = CN ? CN : channels;
+  for (int x = 0; x < cols; ++x, sums += dx * cn, dst += cn)
+  {
+    for (int c = 0; c < cn; ++c)
+    {
+      Block sum = sums[c];
+      for (int i = 1; i < dx; ++i)
+        sum += sums[i * cn + c];
+      dst[c] = average(sum);
+    }
+  }
+}
+
+template <typename T, typename S, int DX>
+inline void averageBlocks(const S* sums, T* dst, int cols, int decimation_x, int channels,
+                          const BlockAverage<T>& average)
+{
+  switch (channels)
+  {
+    case 1:
+      averageBlocks<T, S, DX, 1>(sums, dst, cols, decimation_x, channels, average);
+      break;
+    case 3:
+      averageBlocks<T, S, DX, 3>(sums, dst, cols, decimation_x, channels, average);
+      break;
+    case 4:
+      averageBlocks<T, S, DX, 4>(sums, dst, cols, decimation_x, channels, average);
+      break;
+    default:
+      averageBlocks<T, S, DX, 0>(sums, dst, cols, decimation_x, channels, average);
+      break;
+  }
+}
+
+// Sums of the first width elements of rows consecutive rows
+template <typename T, typename S>
+inline void sumColumns(const T* src, size_t src_step, int rows, int width, S* sums)
+{
+  for (int i = 0; i < width; ++i)
+    sums[i] = src[i];
+  for (int r = 1; r < rows; ++r)
+  {
+    src += src_step;
+    for (int i = 0; i < width; ++i)
+      sums[i] += src[i];
+  }
+}
+
+#if defined(__SSE2__)
+template <>
+inline void sumColumns<uint8_t, uint16_t>(const uint8_t* src, size_t src_step, int rows, int width, uint16_t* sums)
+{
+  const __m128i zero = _mm_setzero_si128();
+  int i = 0;
+  for (; i + 16 <= width; i += 16)
+  {
+    __m128i lo = zero, hi = zero;
+    const uint8_t* column = src + i;
+    for (int r = 0; r < rows; ++r, column += src_step)
+    {
+      __m128i v = load(column);
+      lo = _mm_add_epi16(lo, _mm_unpacklo_epi8(v, zero));
+      hi = _mm_add_epi16(hi, _mm_unpackhi_epi8(v, zero));
+    }
+    store(sums + i, lo);
+    store(sums + i + 8, hi);
+  }
+  for (; i < width; ++i)
+  {
+    uint16_t sum = 0;
+    const uint8_t* column = src + i;
+    for (int r = 0; r < rows; ++r, column += src_step)
+      sum += *column;
+    sums[i] = sum;
+  }
+}
+#endif
+
+template <typename T>
+class DecimateAreaRows : public cv::ParallelLoopBody
+{
+  typedef typename AreaSum<T>::Column Column;
+
+public:
+  DecimateAreaRows(const cv::Mat& src, cv::Mat& dst, int decimation_x, int decimation_y)
+    : src_(src), dst_(dst), decimation_x_(decimation_x), decimation_y_(decimation_y)
+  {
+  }
+
+  void operator()(const cv::Range& range) const
+  {
+    const int channels = src_.channels();
+    const BlockAverage<T> average(decimation_x_ * decimation_y_);
+    std::vector<Column> sums(dst_.cols * decimation_x_ * channels);
+
+    for (int y = range.start; y < range.end; ++y)
+    {
+      sumColumns(src_.ptr<T>(y * decimation_y_), src_.step1(), decimation_y_, (int)sums.size(), &sums[0]);
+
+      T* dst_row = dst_.ptr<T>(y);
+      switch (decimation_x_)
+      {
+        case 2:
+          averageBlocks<T, Column, 2>(&sums[0], dst_row, dst_.cols, decimation_x_, channels, average);
+          break;
+        case 4:
+          averageBlocks<T, Column, 4>(&sums[0], dst_row, dst_.cols, decimation_x_, channels, average);
+          break;
+        default:
+          averageBlocks<T, Column, 0>(&sums[0], dst_row, dst_.cols, decimation_x_, channels, average);
+          break;
+      }
+    }
+  }
+
+private:
+  const cv::Mat& src_;
+  cv::Mat& dst_;
+  int decimation_x_, decimation_y_;
+};
+
+template <typename T>
+void decimateBlocks(const cv::Mat& src, cv::Mat& dst, int decimation_x, int decimation_y)
+{
+  dst.create(src.rows / decimation_y, src.cols / decimation_x, src.type());
+  if (dst.empty())
+    return;
+  cv::parallel_for_(cv::Range(0, dst.rows), DecimateAreaRows<T>(src, dst, decimation_x, decimation_y), stripes(dst));
+}
+
+// Debayers the first pixels of a row pair with SIMD, returns the number of pixels done
+template <typename T>
+inline int debayerRowSimd(const T*, T*, int, int, int, int, int, int)
+{
+  return 0;
+}
+
+#if defined(__SSE2__)
+// One colour of 8 2x2 blocks, at offset (0, 1, step or step + 1) in each block
+inline __m128i bayerPlane(__m128i top, __m128i bottom, int offset, int step)
+{
+  __m128i row = offset >= step ? bottom : top;
+  return (offset >= step ? offset - step : offset) ? _mm_srli_epi16(row, 8) : _mm_and_si128(row, _mm_set1_epi16(0xff));
+}
+
+template <>
+inline int debayerRowSimd<uint8_t>(const uint8_t* src, uint8_t* dst, int cols, int src_row_step,
+                                   int R, int G1, int G2, int B)
+{
+  int x = 0;
+  // The last store spills into pixel x + 8, which must be written afterwards
+  for (; x + 9 <= cols; x += 8, src += 16, dst += 24)
+  {
+    __m128i top = load(src), bottom = load(src + src_row_step);
+    __m128i g = _mm_srli_epi16(_mm_add_epi16(bayerPlane(top, bottom, G1, src_row_step),
+                                             bayerPlane(top, bottom, G2, src_row_step)), 1);
+    __m128i bg = _mm_or_si128(bayerPlane(top, bottom, B, src_row_step), _mm_slli_epi16(g, 8));
+    __m128i r = bayerPlane(top, bottom, R, src_row_step);
+
+    // BGR0 words of pixels 0-3 and 4-7, squeezed to two pixels in the low six bytes of each 64 bit lane. Each lane is
+    // stored with eight bytes, the two extra ones are overwritten by the next pixel.
+    const __m128i low_pixel = _mm_set_epi32(0, -1, 0, -1);
+    __m128i lo = _mm_unpacklo_epi16(bg, r), hi = _mm_unpackhi_epi16(bg, r);
+    lo = _mm_or_si128(_mm_and_si128(lo, low_pixel), _mm_srli_epi64(_mm_andnot_si128(low_pixel, lo), 8));
+    hi = _mm_or_si128(_mm_and_si128(hi, low_pixel), _mm_srli_epi64(_mm_andnot_si128(low_pixel, hi), 8));
+    _mm_storel_epi64(reinterpret_cast<__m128i*>(dst), lo);
+    _mm_storel_epi64(reinterpret_cast<__m128i*>(dst + 6), _mm_unpackhi_epi64(lo, lo));
+    _mm_storel_epi64(reinterpret_cast<__m128i*>(dst + 12), hi);
+    _mm_storel_epi64(reinterpret_cast<__m128i*>(dst + 18), _mm_unpackhi_epi64(hi, hi));
+  }
+  return x;
+}
+#endif
+
+template <typename T>
+class Debayer2x2Rows : public cv::ParallelLoopBody
+{
+public:
+  Debayer2x2Rows(const cv::Mat& src, cv::Mat& dst, int R, int G1, int G2, int B)
+    : src_(src), dst_(dst), R_(R), G1_(G1), G2_(G2), B_(B)
+  {
+  }
+
+  void operator()(const cv::Range& range) const
+  {
+    // Locals, the stores below may alias members as far as the compiler knows
+    const int src_row_step = src_.step1(), cols = dst_.cols;
+    const int R = R_, G1 = G1_, G2 = G2_, B = B_;
+    for (int y = range.start; y < range.end; ++y)
+    {
+      const T* src_row = src_.ptr<T>(2 * y);
+      T* dst_row = dst_.ptr<T>(y);
+      for (int x = debayerRowSimd(src_row, dst_row, cols, src_row_step, R, G1, G2, B); x < cols; ++x)
+      {
+        dst_row[x*3 + 0] = src_row[x*2 + B];
+        dst_row[x*3 + 1] = (src_row[x*2 + G1] + src_row[x*2 + G2]) / 2;
+        dst_row[x*3 + 2] = src_row[x*2 + R];
+      }
+    }
+  }
+
+private:
+  const cv::Mat& src_;
+  cv::Mat& dst_;
+  int R_, G1_, G2_, B_;
+};
+
+template <typename T>
+void debayer2x2(const cv::Mat& src, cv::Mat& dst, int R, int G1, int G2, int B)
+{
+  typedef cv::Vec<T, 3> DstPixel; // 8- or 16-bit BGR
+  dst.create(src.rows / 2, src.cols / 2, cv::DataType<DstPixel>::type);
+  cv::parallel_for_(cv::Range(0, dst.rows), Debayer2x2Rows<T>(src, dst, R, G1, G2, B), stripes(dst));
+}
+
+} // namespace
+
+bool decimateNearest(const cv::Mat& src, cv::Mat& dst, int decimation_x, int decimation_y)
+{
+  switch (src.elemSize())
+  {
+    // Currently support up through 4-channel float
+    case 1:
+      decimatePixels<1>(src, dst, decimation_x, decimation_y);
+      return true;
+    case 2:
+      decimatePixels<2>(src, dst, decimation_x, decimation_y);
+      return true;
+    case 3:
+      decimatePixels<3>(src, dst, decimation_x, decimation_y);
+      return true;
+    case 4:
+      decimatePixels<4>(src, dst, decimation_x, decimation_y);
+      return true;
+    case 6:
+      decimatePixels<6>(src, dst, decimation_x, decimation_y);
+      return true;
+    case 8:
+      decimatePixels<8>(src, dst, decimation_x, decimation_y);
+      return true;
+    case 12:
+      decimatePixels<12>(src, dst, decimation_x, decimation_y);
+      return true;
+    case 16:
+      decimatePixels<16>(src, dst, decimation_x, decimation_y);
+      return true;
+    default:
+      return false;
+  }
+}
+
+bool decimateArea(const cv::Mat& src, cv::Mat& dst, int decimation_x, int decimation_y)
+{
+  if (decimation_x > 16 || decimation_y > 16)
+    return false;
+
+  switch (src.depth())
+  {
+    case CV_8U:
+      decimateBlocks<uint8_t>(src, dst, decimation_x, decimation_y);
+      return true;
+    case CV_16U:
+      decimateBlocks<uint16_t>(src, dst, decimation_x, decimation_y);
+      return true;
+    case CV_32F:
+      decimateBlocks<float>(src, dst, decimation_x, decimation_y);
+      return true;
+    default:
+      return false;
+  }
+}
+
+void debayer2x2toBGR(const cv::Mat& src, cv::Mat& dst, int R, int G1, int G2, int B)
+{
+  if (src.depth() == CV_8U)
+    debayer2x2<uint8_t>(src, dst, R, G1, G2, B);
+  else
+    debayer2x2<uint16_t>(src, dst, R, G1, G2, B);
+}
+
+} // namespace image_proc
@@ -0,0 +1,58 @@
+/*********************************************************************
+* Software License Agreement (BSD License)
+* 
+*  Copyright (c) 2008, Willow Garage, Inc.
+*  All rights reserved.
+* 
+*  Redistribution and use in source and binary forms, with or without
+*  modification, are permitted provided that the following conditions
+*  are met:
+* 
+*   * Redistributions of source code must retain the above copyright
+*     notice, this list of conditions and the following disclaimer.
+*   * Redistributions in binary form must reproduce the above
+*     copyright notice, this list of conditions and the following
+*     disclaimer in the documentation and/or other materials provided
+*     with the distribution.
+*   * Neither the name of the Willow Garage nor the names of its
+*     contributors may be used to endorse or promote products derived
+*     from this software without specific prior written permission.
+* 
+*  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+*  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+*  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+*  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+*  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+*  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+*  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+*  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+*  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+*  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+*  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+*  POSSIBILITY OF SUCH DAMAGE.
+*********************************************************************/
+#ifndef IMAGE_PROC_DECIMATE
+#define IMAGE_PROC_DECIMATE
+
+#include <opencv2/core/core.hpp>
+
+// Integer factor downsampling kernels used by CropDecimateNodelet. All of them work on rows in parallel and drop the
+// last src.cols % decimation_x columns and src.rows % decimation_y rows.
+
+namespace image_proc {
+
+// Keeps the top left pixel of each decimation_x by decimation_y block. Supports pixels of 1, 2, 3, 4, 6, 8, 12 and 16
+// bytes, returns false for any other size.
+bool decimateNearest(const cv::Mat& src, cv::Mat& dst, int decimation_x, int decimation_y);
+
+// Averages each decimation_x by decimation_y block, rounding to nearest for integer types. Supports 8 and 16 bit
+// unsigned and float images with any number of channels and decimations up to 16, returns false otherwise.
+bool decimateArea(const cv::Mat& src, cv::Mat& dst, int decimation_x, int decimation_y);
+
+// 2x2 downsample and debayer at once, to 8 or 16 bit BGR. R, G1, G2 and B are the offsets, in elements, of each
+// colour within a 2x2 block of src.
+void debayer2x2toBGR(const cv::Mat& src, cv::Mat& dst, int R, int G1, int G2, int B);
+
+} // namespace image_proc
+
+#endif
@@ -1,13 +1,13 @@
 /*********************************************************************
 * Software License Agreement (BSD License)
-* 
+*
 *  Copyright (c) 2008, Willow Garage, Inc.
 *  All rights reserved.
-* 
+*
 *  Redistribution and use in source and binary forms, with or without
 *  modification, are permitted provided that the following conditions
 *  are met:
-* 
+*
 *   * Redistributions of source code must retain the above copyright
 *     notice, this list of conditions and the following disclaimer.
 *   * Redistributions in binary form must reproduce the above
@@ -17,7 +17,7 @@
 *   * Neither the name of the Willow Garage nor the names of its
 *     contributors may be used to endorse or promote products derived
 *     from this software without specific prior written permission.
-* 
+*
 *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
 *  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
 *  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
@@ -33,6 +33,12 @@
 *********************************************************************/
 #include "edge_aware.h"
 
+#include <algorithm>
+#include <cstdlib>
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
 #define AVG(a,b) (((int)(a) + (int)(b)) >> 1)
 #define AVG3(a,b,c) (((int)(a) + (int)(b) + (int)(c)) / 3)
 #define AVG4(a,b,c,d) (((int)(a) + (int)(b) + (int)(c) + (int)(d)) >> 2)
@@ -41,20 +47,227 @@ using namespace std;
 
 namespace image_proc {
 
-void debayerEdgeAware(const cv::Mat& bayer, cv::Mat& color)
+namespace {
+
+// Each strip of row pairs handled by one thread should fit in L2 together with its output. A strip also reads the
+// line above and below it, those halo lines are shared with the neighbouring strips and never written.
+const size_t STRIP_BYTES = 128 * 1024;
+
+// Green at a red or blue pixel from its vertical (v0, v1) and horizontal (h0, h1) green neighbours, given the
+// horizontal and vertical gradients. The plain algorithm interpolates along the smoother direction, the weighted one
+// weights each direction by the gradient across the other.
+template<bool Weighted>
+inline int edgeAwareGreen(int v0, int v1, int h0, int h1, int dh, int dv);
+
+template<>
+inline int edgeAwareGreen<false>(int v0, int v1, int h0, int h1, int dh, int dv)
+{
+  if (dh > dv)
+    return AVG (v0, v1);
+  else if (dv > dh)
+    return AVG (h0, h1);
+  else
+    return AVG4 (v0, v1, h0, h1);
+}
+
+template<>
+inline int edgeAwareGreen<true>(int v0, int v1, int h0, int h1, int dh, int dv)
+{
+  if (dv == 0 && dh == 0)
+    return AVG4 (v0, v1, h0, h1);
+  else
+    return WAVG4 (v0, v1, h0, h1, dh, dv);
+}
+
+#if defined(__SSE2__)
+// SSE2 versions of the averages on 16 bit lanes, each holding one pixel value
+
+inline __m128i load(const unsigned char* p)
+{
+  return _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+}
+
+// Even and odd bytes of 16 consecutive pixels, i.e. the first and second pixel of 8 pixel pairs
+inline __m128i evens(__m128i v)
+{
+  return _mm_and_si128(v, _mm_set1_epi16(0xff));
+}
+
+inline __m128i odds(__m128i v)
+{
+  return _mm_srli_epi16(v, 8);
+}
+
+inline __m128i avg(__m128i a, __m128i b)
+{
+  return _mm_srli_epi16(_mm_add_epi16(a, b), 1);
+}
+
+inline __m128i avg4(__m128i a, __m128i b, __m128i c, __m128i d)
+{
+  return _mm_srli_epi16(_mm_add_epi16(_mm_add_epi16(a, b), _mm_add_epi16(c, d)), 2);
+}
+
+inline __m128i absDiff(__m128i a, __m128i b)
+{
+  return _mm_sub_epi16(_mm_max_epi16(a, b), _mm_min_epi16(a, b));
+}
+
+inline __m128i select(__m128i mask, __m128i a, __m128i b)
+{
+  return _mm_or_si128(_mm_and_si128(mask, a), _mm_andnot_si128(mask, b));
+}
+
+template<bool Weighted>
+inline __m128i edgeAwareGreen(__m128i v0, __m128i v1, __m128i h0, __m128i h1, __m128i dh, __m128i dv);
+
+template<>
+inline __m128i edgeAwareGreen<false>(__m128i v0, __m128i v1, __m128i h0, __m128i h1, __m128i dh, __m128i dv)
+{
+  return select(_mm_cmpgt_epi16(dh, dv), avg(v0, v1),
+                select(_mm_cmpgt_epi16(dv, dh), avg(h0, h1), avg4(v0, v1, h0, h1)));
+}
+
+// The weighted sum is below 2^18 and the divisor at most 1020, so the single precision quotient truncates to the same
+// integer as the division in WAVG4
+template<>
+inline __m128i edgeAwareGreen<true>(__m128i v0, __m128i v1, __m128i h0, __m128i h1, __m128i dh, __m128i dv)
+{
+  const __m128i zero = _mm_setzero_si128();
+  __m128i sum_v = _mm_add_epi16(v0, v1);
+  __m128i sum_h = _mm_add_epi16(h0, h1);
+  __m128i d = _mm_add_epi16(dh, dv);
+  __m128i divisor = _mm_add_epi16(d, d);
+
+  __m128i num_lo = _mm_madd_epi16(_mm_unpacklo_epi16(sum_v, sum_h), _mm_unpacklo_epi16(dh, dv));
+  __m128i num_hi = _mm_madd_epi16(_mm_unpackhi_epi16(sum_v, sum_h), _mm_unpackhi_epi16(dh, dv));
+  __m128i q_lo = _mm_cvttps_epi32(_mm_div_ps(_mm_cvtepi32_ps(num_lo), _mm_cvtepi32_ps(_mm_unpacklo_epi16(divisor, zero))));
+  __m128i q_hi = _mm_cvttps_epi32(_mm_div_ps(_mm_cvtepi32_ps(num_hi), _mm_cvtepi32_ps(_mm_unpackhi_epi16(divisor, zero))));
+
+  return select(_mm_cmpeq_epi16(d, zero), avg4(v0, v1, h0, h1), _mm_packs_epi32(q_lo, q_hi));
+}
+
+// Writes 16 RGB pixels, given as 8 pixel pairs per channel
+inline void storeRgb(unsigned char* rgb_buffer, __m128i r_even, __m128i r_odd, __m128i g_even, __m128i g_odd,
+                     __m128i b_even, __m128i b_odd)
+{
+  unsigned char r[16], g[16], b[16];
+  _mm_storeu_si128(reinterpret_cast<__m128i*>(r), _mm_or_si128(r_even, _mm_slli_epi16(r_odd, 8)));
+  _mm_storeu_si128(reinterpret_cast<__m128i*>(g), _mm_or_si128(g_even, _mm_slli_epi16(g_odd, 8)));
+  _mm_storeu_si128(reinterpret_cast<__m128i*>(b), _mm_or_si128(b_even, _mm_slli_epi16(b_odd, 8)));
+  for (int i = 0; i < 16; ++i, rgb_buffer += 3)
+  {
+    rgb_buffer[0] = r[i];
+    rgb_buffer[1] = g[i];
+    rgb_buffer[2] = b[i];
+  }
+}
+
+// Same as debayerPixelPair, for the 8 pixel pairs starting at bayer_pixel
+template<bool Weighted>
+inline void debayerPixelPairs8(const unsigned char* bayer_pixel, unsigned char* rgb_buffer, int bayer_line_step,
+                               int rgb_line_step)
+{
+  const unsigned char* prev = bayer_pixel - bayer_line_step;
+  const unsigned char* next = bayer_pixel + bayer_line_step;
+  const unsigned char* next2 = bayer_pixel + 2 * bayer_line_step;
+
+  __m128i cur_m2 = load(bayer_pixel - 2), cur_0 = load(bayer_pixel), cur_2 = load(bayer_pixel + 2);
+  __m128i prev_0 = load(prev), prev_2 = load(prev + 2);
+  __m128i next_m2 = load(next - 2), next_0 = load(next), next_2 = load(next + 2);
+  __m128i next2_m2 = load(next2 - 2), next2_0 = load(next2);
+
+  // GRGR line
+  __m128i g_at_g = evens(cur_0), r_at_r = odds(cur_0);
+  __m128i g_right = evens(cur_2);
+  __m128i g_above = odds(prev_0), g_below = odds(next_0);
+  __m128i b_below = evens(next_0);
+
+  storeRgb(rgb_buffer,
+           avg(odds(cur_m2), r_at_r), r_at_r,
+           g_at_g, edgeAwareGreen<Weighted>(g_above, g_below, g_at_g, g_right,
+                                            absDiff(g_at_g, g_right), absDiff(g_above, g_below)),
+           avg(evens(prev_0), b_below), avg4(evens(prev_0), evens(prev_2), b_below, evens(next_2)));
+
+  // BGBG line
+  __m128i r_above = odds(cur_0), r_below = odds(next2_0);
+  __m128i g_left = odds(next_m2), g_at_g2 = odds(next_0);
+  __m128i g_up = evens(cur_0), g_down = evens(next2_0);
+
+  storeRgb(rgb_buffer + rgb_line_step,
+           avg4(r_above, r_below, odds(cur_m2), odds(next2_m2)), avg(r_above, r_below),
+           edgeAwareGreen<Weighted>(g_up, g_down, g_left, g_at_g2, absDiff(g_left, g_at_g2), absDiff(g_up, g_down)), g_at_g2,
+           b_below, avg(b_below, evens(next_2)));
+}
+#endif
+
+// Interior pixel pair at bayer_pixel, an even column, of a GRGR line and the BGBG line below it
+template<bool Weighted>
+inline void debayerPixelPair(const unsigned char* bayer_pixel, unsigned char* rgb_buffer, int bayer_line_step,
+                             int rgb_line_step)
+{
+  int bayer_line_step2 = bayer_line_step * 2;
+  int dh, dv;
+
+  // GRGR line
+  // Bayer        -1 0 1 2
+  //          -1   g b g b
+  //           0   r G r g
+  //   line_step   g b g b
+  // line_step2    r g r g
+  rgb_buffer[0] = AVG (bayer_pixel[1], bayer_pixel[-1]);
+  rgb_buffer[1] = bayer_pixel[0];
+  rgb_buffer[2] = AVG (bayer_pixel[bayer_line_step], bayer_pixel[-bayer_line_step]);
+
+  // Bayer        -1 0 1 2
+  //          -1   g b g b
+  //          0    r g R g
+  //  line_step    g b g b
+  // line_step2    r g r g
+
+  dh = abs (bayer_pixel[0] - bayer_pixel[2]);
+  dv = abs (bayer_pixel[-bayer_line_step + 1] - bayer_pixel[bayer_line_step + 1]);
+  rgb_buffer[4] = edgeAwareGreen<Weighted> (bayer_pixel[-bayer_line_step + 1], bayer_pixel[bayer_line_step + 1],
+                                            bayer_pixel[0], bayer_pixel[2], dh, dv);
+
+  rgb_buffer[3] = bayer_pixel[1];
+  rgb_buffer[5] = AVG4 (bayer_pixel[-bayer_line_step], bayer_pixel[2 - bayer_line_step], bayer_pixel[bayer_line_step], bayer_pixel[bayer_line_step + 2]);
+
+  // BGBG line
+  // Bayer         -1 0 1 2
+  //         -1     g b g b
+  //          0     r g r g
+  // line_step      g B g b
+  // line_step2     r g r g
+  rgb_buffer[rgb_line_step ] = AVG4 (bayer_pixel[1], bayer_pixel[bayer_line_step2 + 1], bayer_pixel[-1], bayer_pixel[bayer_line_step2 - 1]);
+  rgb_buffer[rgb_line_step + 2] = bayer_pixel[bayer_line_step];
+
+  dv = abs (bayer_pixel[0] - bayer_pixel[bayer_line_step2]);
+  dh = abs (bayer_pixel[bayer_line_step - 1] - bayer_pixel[bayer_line_step + 1]);
+  rgb_buffer[rgb_line_step + 1] = edgeAwareGreen<Weighted> (bayer_pixel[0], bayer_pixel[bayer_line_step2],
+                                                            bayer_pixel[bayer_line_step - 1], bayer_pixel[bayer_line_step + 1], dh, dv);
+
+  // Bayer         -1 0 1 2
+  //         -1     g b g b
+  //          0     r g r g
+  // line_step      g b G b
+  // line_step2     r g r g
+  rgb_buffer[rgb_line_step + 3] = AVG (bayer_pixel[1], bayer_pixel[bayer_line_step2 + 1]);
+  rgb_buffer[rgb_line_step + 4] = bayer_pixel[bayer_line_step + 1];
+  rgb_buffer[rgb_line_step + 5] = AVG (bayer_pixel[bayer_line_step], bayer_pixel[bayer_line_step + 2]);
+}
+
+// First two lines, where the line above is missing
+void debayerFirstLines(const cv::Mat& bayer, cv::Mat& color)
 {
   unsigned width = bayer.cols;
-  unsigned height = bayer.rows;
   unsigned rgb_line_step = color.step[0];
-  unsigned rgb_line_skip = rgb_line_step - width * 3;
   int bayer_line_step = bayer.step[0];
   int bayer_line_step2 = bayer_line_step * 2;
 
   unsigned char* rgb_buffer = color.data;
-  unsigned char* bayer_pixel = bayer.data;
-  unsigned yIdx, xIdx;
-
-  int dh, dv;
+  const unsigned char* bayer_pixel = bayer.data;
+  unsigned xIdx;
 
   // first two pixel values for first two lines
   // Bayer         0 1 2
@@ -165,297 +378,41 @@ void debayerEdgeAware(const cv::Mat& bayer, cv::Mat& color)
   rgb_buffer[rgb_line_step + 3] = AVG (bayer_pixel[1], bayer_pixel[bayer_line_step2 + 1]);
   rgb_buffer[rgb_line_step + 4] = bayer_pixel[bayer_line_step + 1];
   //rgb_pixel[rgb_line_step + 5] = bayer_pixel[line_step];
-
-  bayer_pixel += bayer_line_step + 2;
-  rgb_buffer += rgb_line_step + 6 + rgb_line_skip;
-  // main processing
-  for (yIdx = 2; yIdx < height - 2; yIdx += 2)
-  {
-    // first two pixel values
-    // Bayer         0 1 2
-    //        -1     b g b
-    //         0     G r g
-    // line_step     b g b
-    // line_step2    g r g
-    
-    rgb_buffer[3] = rgb_buffer[0] = bayer_pixel[1]; // red pixel
-    rgb_buffer[1] = bayer_pixel[0]; // green pixel
-    rgb_buffer[2] = AVG (bayer_pixel[bayer_line_step], bayer_pixel[-bayer_line_step]); // blue;
-    
-    // Bayer         0 1 2
-    //        -1     b g b
-    //         0     g R g
-    // line_step     b g b
-    // line_step2    g r g
-    //rgb_pixel[3] = bayer_pixel[1];
-    rgb_buffer[4] = AVG4 (bayer_pixel[0], bayer_pixel[2], bayer_pixel[bayer_line_step + 1], bayer_pixel[1 - bayer_line_step]);
-    rgb_buffer[5] = AVG4 (bayer_pixel[bayer_line_step], bayer_pixel[bayer_line_step + 2], bayer_pixel[-bayer_line_step], bayer_pixel[2 - bayer_line_step]);
-    
-    // BGBG line
-    // Bayer         0 1 2
-    //         0     g r g
-    // line_step     B g b
-    // line_step2    g r g
-    rgb_buffer[rgb_line_step + 3] = rgb_buffer[rgb_line_step ] = AVG (bayer_pixel[1], bayer_pixel[bayer_line_step2 + 1]);
-    rgb_buffer[rgb_line_step + 1] = AVG3 (bayer_pixel[0], bayer_pixel[bayer_line_step + 1], bayer_pixel[bayer_line_step2]);
-    rgb_buffer[rgb_line_step + 2] = bayer_pixel[bayer_line_step];
-    
-    // pixel (1, 1)  0 1 2
-    //         0     g r g
-    // line_step     b G b
-    // line_step2    g r g
-    //rgb_pixel[rgb_line_step + 3] = AVG( bayer_pixel[1] , bayer_pixel[line_step2+1] );
-    rgb_buffer[rgb_line_step + 4] = bayer_pixel[bayer_line_step + 1];
-    rgb_buffer[rgb_line_step + 5] = AVG (bayer_pixel[bayer_line_step], bayer_pixel[bayer_line_step + 2]);
-    
-    rgb_buffer += 6;
-    bayer_pixel += 2;
-    // continue with rest of the line
-    for (xIdx = 2; xIdx < width - 2; xIdx += 2, rgb_buffer += 6, bayer_pixel += 2)
-    {
-      // GRGR line
-      // Bayer        -1 0 1 2
-      //          -1   g b g b
-      //           0   r G r g
-      //   line_step   g b g b
-      // line_step2    r g r g
-      rgb_buffer[0] = AVG (bayer_pixel[1], bayer_pixel[-1]);
-      rgb_buffer[1] = bayer_pixel[0];
-      rgb_buffer[2] = AVG (bayer_pixel[bayer_line_step], bayer_pixel[-bayer_line_step]);
-      
-      // Bayer        -1 0 1 2
-      //          -1   g b g b
-      //          0    r g R g
-      //  line_step    g b g b
-      // line_step2    r g r g
-      
-      dh = abs (bayer_pixel[0] - bayer_pixel[2]);
-      dv = abs (bayer_pixel[-bayer_line_step + 1] - bayer_pixel[bayer_line_step + 1]);
-      
-      if (dh > dv)
-        rgb_buffer[4] = AVG (bayer_pixel[-bayer_line_step + 1], bayer_pixel[bayer_line_step + 1]);
-      else if (dv > dh)
-        rgb_buffer[4] = AVG (bayer_pixel[0], bayer_pixel[2]);
-      else
-        rgb_buffer[4] = AVG4 (bayer_pixel[-bayer_line_step + 1], bayer_pixel[bayer_line_step + 1], bayer_pixel[0], bayer_pixel[2]);
-      
-      rgb_buffer[3] = bayer_pixel[1];
-      rgb_buffer[5] = AVG4 (bayer_pixel[-bayer_line_step], bayer_pixel[2 - bayer_line_step], bayer_pixel[bayer_line_step], bayer_pixel[bayer_line_step + 2]);
-      
-      // BGBG line
-      // Bayer         -1 0 1 2
-      //         -1     g b g b
-      //          0     r g r g
-      // line_step      g B g b
-      // line_step2     r g r g
-      rgb_buffer[rgb_line_step ] = AVG4 (bayer_pixel[1], bayer_pixel[bayer_line_step2 + 1], bayer_pixel[-1], bayer_pixel[bayer_line_step2 - 1]);
-      rgb_buffer[rgb_line_step + 2] = bayer_pixel[bayer_line_step];
-      
-      dv = abs (bayer_pixel[0] - bayer_pixel[bayer_line_step2]);
-      dh = abs (bayer_pixel[bayer_line_step - 1] - bayer_pixel[bayer_line_step + 1]);
-      
-      if (dv > dh)
-        rgb_buffer[rgb_line_step + 1] = AVG (bayer_pixel[bayer_line_step - 1], bayer_pixel[bayer_line_step + 1]);
-      else if (dh > dv)
-        rgb_buffer[rgb_line_step + 1] = AVG (bayer_pixel[0], bayer_pixel[bayer_line_step2]);
-      else
-        rgb_buffer[rgb_line_step + 1] = AVG4 (bayer_pixel[0], bayer_pixel[bayer_line_step2], bayer_pixel[bayer_line_step - 1], bayer_pixel[bayer_line_step + 1]);
-      
-      // Bayer         -1 0 1 2
-      //         -1     g b g b
-      //          0     r g r g
-      // line_step      g b G b
-      // line_step2     r g r g
-      rgb_buffer[rgb_line_step + 3] = AVG (bayer_pixel[1], bayer_pixel[bayer_line_step2 + 1]);
-      rgb_buffer[rgb_line_step + 4] = bayer_pixel[bayer_line_step + 1];
-      rgb_buffer[rgb_line_step + 5] = AVG (bayer_pixel[bayer_line_step], bayer_pixel[bayer_line_step + 2]);
-    }
-    
-    // last two pixels of the line
-    // last two pixel values for first two lines
-    // GRGR line
-    // Bayer        -1 0 1
-    //           0   r G r
-    //   line_step   g b g
-    // line_step2    r g r
-    rgb_buffer[0] = AVG (bayer_pixel[1], bayer_pixel[-1]);
-    rgb_buffer[1] = bayer_pixel[0];
-    rgb_buffer[rgb_line_step + 5] = rgb_buffer[rgb_line_step + 2] = rgb_buffer[5] = rgb_buffer[2] = bayer_pixel[bayer_line_step];
-    
-    // Bayer        -1 0 1
-    //          0    r g R
-    //  line_step    g b g
-    // line_step2    r g r
-    rgb_buffer[3] = bayer_pixel[1];
-    rgb_buffer[4] = AVG (bayer_pixel[0], bayer_pixel[bayer_line_step + 1]);
-    //rgb_pixel[5] = bayer_pixel[line_step];
-    
-    // BGBG line
-    // Bayer        -1 0 1
-    //          0    r g r
-    //  line_step    g B g
-    // line_step2    r g r
-    rgb_buffer[rgb_line_step ] = AVG4 (bayer_pixel[1], bayer_pixel[bayer_line_step2 + 1], bayer_pixel[-1], bayer_pixel[bayer_line_step2 - 1]);
-    rgb_buffer[rgb_line_step + 1] = AVG4 (bayer_pixel[0], bayer_pixel[bayer_line_step2], bayer_pixel[bayer_line_step - 1], bayer_pixel[bayer_line_step + 1]);
-    //rgb_pixel[rgb_line_step + 2] = bayer_pixel[line_step];
-    
-    // Bayer         -1 0 1
-    //         0      r g r
-    // line_step      g b G
-    // line_step2     r g r
-    rgb_buffer[rgb_line_step + 3] = AVG (bayer_pixel[1], bayer_pixel[bayer_line_step2 + 1]);
-    rgb_buffer[rgb_line_step + 4] = bayer_pixel[bayer_line_step + 1];
-    //rgb_pixel[rgb_line_step + 5] = bayer_pixel[line_step];
-    
-    bayer_pixel += bayer_line_step + 2;
-    rgb_buffer += rgb_line_step + 6 + rgb_line_skip;
-  }
-  
-  //last two lines
-  // Bayer         0 1 2
-  //        -1     b g b
-  //         0     G r g
-  // line_step     b g b
-  
-  rgb_buffer[rgb_line_step + 3] = rgb_buffer[rgb_line_step ] = rgb_buffer[3] = rgb_buffer[0] = bayer_pixel[1]; // red pixel
-  rgb_buffer[1] = bayer_pixel[0]; // green pixel
-  rgb_buffer[rgb_line_step + 2] = rgb_buffer[2] = bayer_pixel[bayer_line_step]; // blue;
-  
-  // Bayer         0 1 2
-  //        -1     b g b
-  //         0     g R g
-  // line_step     b g b
-  //rgb_pixel[3] = bayer_pixel[1];
-  rgb_buffer[4] = AVG4 (bayer_pixel[0], bayer_pixel[2], bayer_pixel[bayer_line_step + 1], bayer_pixel[1 - bayer_line_step]);
-  rgb_buffer[5] = AVG4 (bayer_pixel[bayer_line_step], bayer_pixel[bayer_line_step + 2], bayer_pixel[-bayer_line_step], bayer_pixel[2 - bayer_line_step]);
-  
-  // BGBG line
-  // Bayer         0 1 2
-  //        -1     b g b
-  //         0     g r g
-  // line_step     B g b
-  //rgb_pixel[rgb_line_step    ] = bayer_pixel[1];
-  rgb_buffer[rgb_line_step + 1] = AVG (bayer_pixel[0], bayer_pixel[bayer_line_step + 1]);
-  rgb_buffer[rgb_line_step + 2] = bayer_pixel[bayer_line_step];
-  
-  // Bayer         0 1 2
-  //        -1     b g b
-  //         0     g r g
-  // line_step     b G b
-  //rgb_pixel[rgb_line_step + 3] = AVG( bayer_pixel[1] , bayer_pixel[line_step2+1] );
-  rgb_buffer[rgb_line_step + 4] = bayer_pixel[bayer_line_step + 1];
-  rgb_buffer[rgb_line_step + 5] = AVG (bayer_pixel[bayer_line_step], bayer_pixel[bayer_line_step + 2]);
-  
-  rgb_buffer += 6;
-  bayer_pixel += 2;
-  // rest of the last two lines
-  for (xIdx = 2; xIdx < width - 2; xIdx += 2, rgb_buffer += 6, bayer_pixel += 2)
-  {
-    // GRGR line
-    // Bayer       -1 0 1 2
-    //        -1    g b g b
-    //         0    r G r g
-    // line_step    g b g b
-    rgb_buffer[0] = AVG (bayer_pixel[1], bayer_pixel[-1]);
-    rgb_buffer[1] = bayer_pixel[0];
-    rgb_buffer[2] = AVG (bayer_pixel[bayer_line_step], bayer_pixel[-bayer_line_step]);
-    
-    // Bayer       -1 0 1 2
-    //        -1    g b g b
-    //         0    r g R g
-    // line_step    g b g b
-    rgb_buffer[rgb_line_step + 3] = rgb_buffer[3] = bayer_pixel[1];
-    rgb_buffer[4] = AVG4 (bayer_pixel[0], bayer_pixel[2], bayer_pixel[bayer_line_step + 1], bayer_pixel[1 - bayer_line_step]);
-    rgb_buffer[5] = AVG4 (bayer_pixel[bayer_line_step], bayer_pixel[bayer_line_step + 2], bayer_pixel[-bayer_line_step], bayer_pixel[-bayer_line_step + 2]);
-    
-    // BGBG line
-    // Bayer       -1 0 1 2
-    //        -1    g b g b
-    //         0    r g r g
-    // line_step    g B g b
-    rgb_buffer[rgb_line_step ] = AVG (bayer_pixel[-1], bayer_pixel[1]);
-    rgb_buffer[rgb_line_step + 1] = AVG3 (bayer_pixel[0], bayer_pixel[bayer_line_step - 1], bayer_pixel[bayer_line_step + 1]);
-    rgb_buffer[rgb_line_step + 2] = bayer_pixel[bayer_line_step];
-    
-    
-    // Bayer       -1 0 1 2
-    //        -1    g b g b
-    //         0    r g r g
-    // line_step    g b G b
-    //rgb_pixel[rgb_line_step + 3] = bayer_pixel[1];
-    rgb_buffer[rgb_line_step + 4] = bayer_pixel[bayer_line_step + 1];
-    rgb_buffer[rgb_line_step + 5] = AVG (bayer_pixel[bayer_line_step], bayer_pixel[bayer_line_step + 2]);
-  }
-  
-  // last two pixel values for first two lines
-  // GRGR line
-  // Bayer       -1 0 1
-  //        -1    g b g
-  //         0    r G r
-  // line_step    g b g
-  rgb_buffer[rgb_line_step ] = rgb_buffer[0] = AVG (bayer_pixel[1], bayer_pixel[-1]);
-  rgb_buffer[1] = bayer_pixel[0];
-  rgb_buffer[5] = rgb_buffer[2] = AVG (bayer_pixel[bayer_line_step], bayer_pixel[-bayer_line_step]);
-  
-  // Bayer       -1 0 1
-  //        -1    g b g
-  //         0    r g R
-  // line_step    g b g
-  rgb_buffer[rgb_line_step + 3] = rgb_buffer[3] = bayer_pixel[1];
-  rgb_buffer[4] = AVG3 (bayer_pixel[0], bayer_pixel[bayer_line_step + 1], bayer_pixel[-bayer_line_step + 1]);
-  //rgb_pixel[5] = AVG( bayer_pixel[line_step], bayer_pixel[-line_step] );
-  
-  // BGBG line
-  // Bayer       -1 0 1
-  //        -1    g b g
-  //         0    r g r
-  // line_step    g B g
-  //rgb_pixel[rgb_line_step    ] = AVG2( bayer_pixel[-1], bayer_pixel[1] );
-  rgb_buffer[rgb_line_step + 1] = AVG3 (bayer_pixel[0], bayer_pixel[bayer_line_step - 1], bayer_pixel[bayer_line_step + 1]);
-  rgb_buffer[rgb_line_step + 5] = rgb_buffer[rgb_line_step + 2] = bayer_pixel[bayer_line_step];
-  
-  // Bayer       -1 0 1
-  //        -1    g b g
-  //         0    r g r
-  // line_step    g b G
-  //rgb_pixel[rgb_line_step + 3] = bayer_pixel[1];
-  rgb_buffer[rgb_line_step + 4] = bayer_pixel[bayer_line_step + 1];
-  //rgb_pixel[rgb_line_step + 5] = bayer_pixel[line_step];
 }
 
-void debayerEdgeAwareWeighted(const cv::Mat& bayer, cv::Mat& color)
+// Interior GRGR line y and the BGBG line below it
+template<bool Weighted>
+void debayerLinePair(const cv::Mat& bayer, cv::Mat& color, int y)
 {
   unsigned width = bayer.cols;
-  unsigned height = bayer.rows;
   unsigned rgb_line_step = color.step[0];
-  unsigned rgb_line_skip = rgb_line_step - width * 3;
   int bayer_line_step = bayer.step[0];
   int bayer_line_step2 = bayer_line_step * 2;
 
-  unsigned char* rgb_buffer = color.data;
-  unsigned char* bayer_pixel = bayer.data;
-  unsigned yIdx, xIdx;
+  unsigned char* rgb_buffer = color.ptr(y);
+  const unsigned char* bayer_pixel = bayer.ptr(y);
+  unsigned xIdx = 2;
 
-  int dh, dv;
-
-  // first two pixel values for first two lines
+  // first two pixel values
   // Bayer         0 1 2
+  //        -1     b g b
   //         0     G r g
   // line_step     b g b
   // line_step2    g r g
 
   rgb_buffer[3] = rgb_buffer[0] = bayer_pixel[1]; // red pixel
   rgb_buffer[1] = bayer_pixel[0]; // green pixel
-  rgb_buffer[rgb_line_step + 2] = rgb_buffer[2] = bayer_pixel[bayer_line_step]; // blue;
-  
+  rgb_buffer[2] = AVG (bayer_pixel[bayer_line_step], bayer_pixel[-bayer_line_step]); // blue;
+
   // Bayer         0 1 2
+  //        -1     b g b
   //         0     g R g
   // line_step     b g b
   // line_step2    g r g
   //rgb_pixel[3] = bayer_pixel[1];
-  rgb_buffer[4] = AVG3 (bayer_pixel[0], bayer_pixel[2], bayer_pixel[bayer_line_step + 1]);
-  rgb_buffer[rgb_line_step + 5] = rgb_buffer[5] = AVG (bayer_pixel[bayer_line_step], bayer_pixel[bayer_line_step + 2]);
-  
+  rgb_buffer[4] = AVG4 (bayer_pixel[0], bayer_pixel[2], bayer_pixel[bayer_line_step + 1], bayer_pixel[1 - bayer_line_step]);
+  rgb_buffer[5] = AVG4 (bayer_pixel[bayer_line_step], bayer_pixel[bayer_line_step + 2], bayer_pixel[-bayer_line_step], bayer_pixel[2 - bayer_line_step]);
+
   // BGBG line
   // Bayer         0 1 2
   //         0     g r g
@@ -463,56 +420,28 @@ void debayerEdgeAwareWeighted(const cv::Mat& bayer, cv::Mat& color)
   // line_step2    g r g
   rgb_buffer[rgb_line_step + 3] = rgb_buffer[rgb_line_step ] = AVG (bayer_pixel[1], bayer_pixel[bayer_line_step2 + 1]);
   rgb_buffer[rgb_line_step + 1] = AVG3 (bayer_pixel[0], bayer_pixel[bayer_line_step + 1], bayer_pixel[bayer_line_step2]);
-  //rgb_pixel[rgb_line_step + 2] = bayer_pixel[line_step];
-  
+  rgb_buffer[rgb_line_step + 2] = bayer_pixel[bayer_line_step];
+
   // pixel (1, 1)  0 1 2
   //         0     g r g
   // line_step     b G b
   // line_step2    g r g
   //rgb_pixel[rgb_line_step + 3] = AVG( bayer_pixel[1] , bayer_pixel[line_step2+1] );
   rgb_buffer[rgb_line_step + 4] = bayer_pixel[bayer_line_step + 1];
-  //rgb_pixel[rgb_line_step + 5] = AVG( bayer_pixel[line_step] , bayer_pixel[line_step+2] );
-  
+  rgb_buffer[rgb_line_step + 5] = AVG (bayer_pixel[bayer_line_step], bayer_pixel[bayer_line_step + 2]);
+
   rgb_buffer += 6;
   bayer_pixel += 2;
-  // rest of the first two lines
-  for (xIdx = 2; xIdx < width - 2; xIdx += 2, rgb_buffer += 6, bayer_pixel += 2)
-  {
-    // GRGR line
-    // Bayer        -1 0 1 2
-    //           0   r G r g
-    //   line_step   g b g b
-    // line_step2    r g r g
-    rgb_buffer[0] = AVG (bayer_pixel[1], bayer_pixel[-1]);
-    rgb_buffer[1] = bayer_pixel[0];
-    rgb_buffer[2] = bayer_pixel[bayer_line_step + 1];
-    
-    // Bayer        -1 0 1 2
-    //          0    r g R g
-    //  line_step    g b g b
-    // line_step2    r g r g
-    rgb_buffer[3] = bayer_pixel[1];
-    rgb_buffer[4] = AVG3 (bayer_pixel[0], bayer_pixel[2], bayer_pixel[bayer_line_step + 1]);
-    rgb_buffer[rgb_line_step + 5] = rgb_buffer[5] = AVG (bayer_pixel[bayer_line_step], bayer_pixel[bayer_line_step + 2]);
-    
-    // BGBG line
-    // Bayer         -1 0 1 2
-    //         0      r g r g
-    // line_step      g B g b
-    // line_step2     r g r g
-    rgb_buffer[rgb_line_step ] = AVG4 (bayer_pixel[1], bayer_pixel[bayer_line_step2 + 1], bayer_pixel[-1], bayer_pixel[bayer_line_step2 - 1]);
-    rgb_buffer[rgb_line_step + 1] = AVG4 (bayer_pixel[0], bayer_pixel[bayer_line_step2], bayer_pixel[bayer_line_step - 1], bayer_pixel[bayer_line_step + 1]);
-    rgb_buffer[rgb_line_step + 2] = bayer_pixel[bayer_line_step];
-    
-    // Bayer         -1 0 1 2
-    //         0      r g r g
-    // line_step      g b G b
-    // line_step2     r g r g
-    rgb_buffer[rgb_line_step + 3] = AVG (bayer_pixel[1], bayer_pixel[bayer_line_step2 + 1]);
-    rgb_buffer[rgb_line_step + 4] = bayer_pixel[bayer_line_step + 1];
-    //rgb_pixel[rgb_line_step + 5] = AVG( bayer_pixel[line_step] , bayer_pixel[line_step+2] );
-  }
-  
+
+  // continue with rest of the line
+#if defined(__SSE2__)
+  for (; xIdx + 18 <= width; xIdx += 16, rgb_buffer += 48, bayer_pixel += 16)
+    debayerPixelPairs8<Weighted> (bayer_pixel, rgb_buffer, bayer_line_step, rgb_line_step);
+#endif
+  for (; xIdx < width - 2; xIdx += 2, rgb_buffer += 6, bayer_pixel += 2)
+    debayerPixelPair<Weighted> (bayer_pixel, rgb_buffer, bayer_line_step, rgb_line_step);
+
+  // last two pixels of the line
   // last two pixel values for first two lines
   // GRGR line
   // Bayer        -1 0 1
@@ -522,7 +451,7 @@ void debayerEdgeAwareWeighted(const cv::Mat& bayer, cv::Mat& color)
   rgb_buffer[0] = AVG (bayer_pixel[1], bayer_pixel[-1]);
   rgb_buffer[1] = bayer_pixel[0];
   rgb_buffer[rgb_line_step + 5] = rgb_buffer[rgb_line_step + 2] = rgb_buffer[5] = rgb_buffer[2] = bayer_pixel[bayer_line_step];
-  
+
   // Bayer        -1 0 1
   //          0    r g R
   //  line_step    g b g
@@ -530,7 +459,7 @@ void debayerEdgeAwareWeighted(const cv::Mat& bayer, cv::Mat& color)
   rgb_buffer[3] = bayer_pixel[1];
   rgb_buffer[4] = AVG (bayer_pixel[0], bayer_pixel[bayer_line_step + 1]);
   //rgb_pixel[5] = bayer_pixel[line_step];
-  
+
   // BGBG line
   // Bayer        -1 0 1
   //          0    r g r
@@ -539,7 +468,7 @@ void debayerEdgeAwareWeighted(const cv::Mat& bayer, cv::Mat& color)
   rgb_buffer[rgb_line_step ] = AVG4 (bayer_pixel[1], bayer_pixel[bayer_line_step2 + 1], bayer_pixel[-1], bayer_pixel[bayer_line_step2 - 1]);
   rgb_buffer[rgb_line_step + 1] = AVG4 (bayer_pixel[0], bayer_pixel[bayer_line_step2], bayer_pixel[bayer_line_step - 1], bayer_pixel[bayer_line_step + 1]);
   //rgb_pixel[rgb_line_step + 2] = bayer_pixel[line_step];
-  
+
   // Bayer         -1 0 1
   //         0      r g r
   // line_step      g b G
@@ -547,157 +476,30 @@ void debayerEdgeAwareWeighted(const cv::Mat& bayer, cv::Mat& color)
   rgb_buffer[rgb_line_step + 3] = AVG (bayer_pixel[1], bayer_pixel[bayer_line_step2 + 1]);
   rgb_buffer[rgb_line_step + 4] = bayer_pixel[bayer_line_step + 1];
   //rgb_pixel[rgb_line_step + 5] = bayer_pixel[line_step];
-  
-  bayer_pixel += bayer_line_step + 2;
-  rgb_buffer += rgb_line_step + 6 + rgb_line_skip;
-  // main processing
-  for (yIdx = 2; yIdx < height - 2; yIdx += 2)
-  {
-    // first two pixel values
-    // Bayer         0 1 2
-    //        -1     b g b
-    //         0     G r g
-    // line_step     b g b
-    // line_step2    g r g
-    
-    rgb_buffer[3] = rgb_buffer[0] = bayer_pixel[1]; // red pixel
-    rgb_buffer[1] = bayer_pixel[0]; // green pixel
-    rgb_buffer[2] = AVG (bayer_pixel[bayer_line_step], bayer_pixel[-bayer_line_step]); // blue;
-    
-    // Bayer         0 1 2
-    //        -1     b g b
-    //         0     g R g
-    // line_step     b g b
-    // line_step2    g r g
-    //rgb_pixel[3] = bayer_pixel[1];
-    rgb_buffer[4] = AVG4 (bayer_pixel[0], bayer_pixel[2], bayer_pixel[bayer_line_step + 1], bayer_pixel[1 - bayer_line_step]);
-    rgb_buffer[5] = AVG4 (bayer_pixel[bayer_line_step], bayer_pixel[bayer_line_step + 2], bayer_pixel[-bayer_line_step], bayer_pixel[2 - bayer_line_step]);
-    
-    // BGBG line
-    // Bayer         0 1 2
-    //         0     g r g
-    // line_step     B g b
-    // line_step2    g r g
-    rgb_buffer[rgb_line_step + 3] = rgb_buffer[rgb_line_step ] = AVG (bayer_pixel[1], bayer_pixel[bayer_line_step2 + 1]);
-    rgb_buffer[rgb_line_step + 1] = AVG3 (bayer_pixel[0], bayer_pixel[bayer_line_step + 1], bayer_pixel[bayer_line_step2]);
-    rgb_buffer[rgb_line_step + 2] = bayer_pixel[bayer_line_step];
-    
-    // pixel (1, 1)  0 1 2
-    //         0     g r g
-    // line_step     b G b
-    // line_step2    g r g
-    //rgb_pixel[rgb_line_step + 3] = AVG( bayer_pixel[1] , bayer_pixel[line_step2+1] );
-    rgb_buffer[rgb_line_step + 4] = bayer_pixel[bayer_line_step + 1];
-    rgb_buffer[rgb_line_step + 5] = AVG (bayer_pixel[bayer_line_step], bayer_pixel[bayer_line_step + 2]);
-    
-    rgb_buffer += 6;
-    bayer_pixel += 2;
-    // continue with rest of the line
-    for (xIdx = 2; xIdx < width - 2; xIdx += 2, rgb_buffer += 6, bayer_pixel += 2)
-    {
-      // GRGR line
-      // Bayer        -1 0 1 2
-      //          -1   g b g b
-      //           0   r G r g
-      //   line_step   g b g b
-      // line_step2    r g r g
-      rgb_buffer[0] = AVG (bayer_pixel[1], bayer_pixel[-1]);
-      rgb_buffer[1] = bayer_pixel[0];
-      rgb_buffer[2] = AVG (bayer_pixel[bayer_line_step], bayer_pixel[-bayer_line_step]);
-      
-      // Bayer        -1 0 1 2
-      //          -1   g b g b
-      //          0    r g R g
-      //  line_step    g b g b
-      // line_step2    r g r g
-      
-      dh = abs (bayer_pixel[0] - bayer_pixel[2]);
-      dv = abs (bayer_pixel[-bayer_line_step + 1] - bayer_pixel[bayer_line_step + 1]);
-      
-      if (dv == 0 && dh == 0)
-        rgb_buffer[4] = AVG4 (bayer_pixel[1 - bayer_line_step], bayer_pixel[1 + bayer_line_step], bayer_pixel[0], bayer_pixel[2]);
-      else
-        rgb_buffer[4] = WAVG4 (bayer_pixel[1 - bayer_line_step], bayer_pixel[1 + bayer_line_step], bayer_pixel[0], bayer_pixel[2], dh, dv);
-      rgb_buffer[3] = bayer_pixel[1];
-      rgb_buffer[5] = AVG4 (bayer_pixel[-bayer_line_step], bayer_pixel[2 - bayer_line_step], bayer_pixel[bayer_line_step], bayer_pixel[bayer_line_step + 2]);
-      
-      // BGBG line
-      // Bayer         -1 0 1 2
-      //         -1     g b g b
-      //          0     r g r g
-      // line_step      g B g b
-      // line_step2     r g r g
-      rgb_buffer[rgb_line_step ] = AVG4 (bayer_pixel[1], bayer_pixel[bayer_line_step2 + 1], bayer_pixel[-1], bayer_pixel[bayer_line_step2 - 1]);
-      rgb_buffer[rgb_line_step + 2] = bayer_pixel[bayer_line_step];
-      
-      dv = abs (bayer_pixel[0] - bayer_pixel[bayer_line_step2]);
-      dh = abs (bayer_pixel[bayer_line_step - 1] - bayer_pixel[bayer_line_step + 1]);
-      
-      if (dv == 0 && dh == 0)
-        rgb_buffer[rgb_line_step + 1] = AVG4 (bayer_pixel[0], bayer_pixel[bayer_line_step2], bayer_pixel[bayer_line_step - 1], bayer_pixel[bayer_line_step + 1]);
-      else
-        rgb_buffer[rgb_line_step + 1] = WAVG4 (bayer_pixel[0], bayer_pixel[bayer_line_step2], bayer_pixel[bayer_line_step - 1], bayer_pixel[bayer_line_step + 1], dh, dv);
-      
-      // Bayer         -1 0 1 2
-      //         -1     g b g b
-      //          0     r g r g
-      // line_step      g b G b
-      // line_step2     r g r g
-      rgb_buffer[rgb_line_step + 3] = AVG (bayer_pixel[1], bayer_pixel[bayer_line_step2 + 1]);
-      rgb_buffer[rgb_line_step + 4] = bayer_pixel[bayer_line_step + 1];
-      rgb_buffer[rgb_line_step + 5] = AVG (bayer_pixel[bayer_line_step], bayer_pixel[bayer_line_step + 2]);
-    }
-    
-    // last two pixels of the line
-    // last two pixel values for first two lines
-    // GRGR line
-    // Bayer        -1 0 1
-    //           0   r G r
-    //   line_step   g b g
-    // line_step2    r g r
-    rgb_buffer[0] = AVG (bayer_pixel[1], bayer_pixel[-1]);
-    rgb_buffer[1] = bayer_pixel[0];
-    rgb_buffer[rgb_line_step + 5] = rgb_buffer[rgb_line_step + 2] = rgb_buffer[5] = rgb_buffer[2] = bayer_pixel[bayer_line_step];
-    
-    // Bayer        -1 0 1
-    //          0    r g R
-    //  line_step    g b g
-    // line_step2    r g r
-    rgb_buffer[3] = bayer_pixel[1];
-    rgb_buffer[4] = AVG (bayer_pixel[0], bayer_pixel[bayer_line_step + 1]);
-    //rgb_pixel[5] = bayer_pixel[line_step];
-    
-    // BGBG line
-    // Bayer        -1 0 1
-    //          0    r g r
-    //  line_step    g B g
-    // line_step2    r g r
-    rgb_buffer[rgb_line_step ] = AVG4 (bayer_pixel[1], bayer_pixel[bayer_line_step2 + 1], bayer_pixel[-1], bayer_pixel[bayer_line_step2 - 1]);
-    rgb_buffer[rgb_line_step + 1] = AVG4 (bayer_pixel[0], bayer_pixel[bayer_line_step2], bayer_pixel[bayer_line_step - 1], bayer_pixel[bayer_line_step + 1]);
-    //rgb_pixel[rgb_line_step + 2] = bayer_pixel[line_step];
-    
-    // Bayer         -1 0 1
-    //         0      r g r
-    // line_step      g b G
-    // line_step2     r g r
-    rgb_buffer[rgb_line_step + 3] = AVG (bayer_pixel[1], bayer_pixel[bayer_line_step2 + 1]);
-    rgb_buffer[rgb_line_step + 4] = bayer_pixel[bayer_line_step + 1];
-    //rgb_pixel[rgb_line_step + 5] = bayer_pixel[line_step];
-    
-    bayer_pixel += bayer_line_step + 2;
-    rgb_buffer += rgb_line_step + 6 + rgb_line_skip;
-  }
-  
+}
+
+// Last two lines, where the line below is missing
+void debayerLastLines(const cv::Mat& bayer, cv::Mat& color)
+{
+  unsigned width = bayer.cols;
+  unsigned height = bayer.rows;
+  unsigned rgb_line_step = color.step[0];
+  int bayer_line_step = bayer.step[0];
+
+  unsigned char* rgb_buffer = color.ptr(height - 2);
+  const unsigned char* bayer_pixel = bayer.ptr(height - 2);
+  unsigned xIdx;
+
   //last two lines
   // Bayer         0 1 2
   //        -1     b g b
   //         0     G r g
   // line_step     b g b
-  
+
   rgb_buffer[rgb_line_step + 3] = rgb_buffer[rgb_line_step ] = rgb_buffer[3] = rgb_buffer[0] = bayer_pixel[1]; // red pixel
   rgb_buffer[1] = bayer_pixel[0]; // green pixel
   rgb_buffer[rgb_line_step + 2] = rgb_buffer[2] = bayer_pixel[bayer_line_step]; // blue;
-  
+
   // Bayer         0 1 2
   //        -1     b g b
   //         0     g R g
@@ -705,7 +507,7 @@ void debayerEdgeAwareWeighted(const cv::Mat& bayer, cv::Mat& color)
   //rgb_pixel[3] = bayer_pixel[1];
   rgb_buffer[4] = AVG4 (bayer_pixel[0], bayer_pixel[2], bayer_pixel[bayer_line_step + 1], bayer_pixel[1 - bayer_line_step]);
   rgb_buffer[5] = AVG4 (bayer_pixel[bayer_line_step], bayer_pixel[bayer_line_step + 2], bayer_pixel[-bayer_line_step], bayer_pixel[2 - bayer_line_step]);
-  
+
   // BGBG line
   // Bayer         0 1 2
   //        -1     b g b
@@ -722,7 +524,7 @@ void debayerEdgeAwareWeighted(const cv::Mat& bayer, cv::Mat& color)
   //rgb_pixel[rgb_line_step + 3] = AVG( bayer_pixel[1] , bayer_pixel[line_step2+1] );
   rgb_buffer[rgb_line_step + 4] = bayer_pixel[bayer_line_step + 1];
   rgb_buffer[rgb_line_step + 5] = AVG (bayer_pixel[bayer_line_step], bayer_pixel[bayer_line_step + 2]);
-  
+
   rgb_buffer += 6;
   bayer_pixel += 2;
   // rest of the last two lines
@@ -736,7 +538,7 @@ void debayerEdgeAwareWeighted(const cv::Mat& bayer, cv::Mat& color)
     rgb_buffer[0] = AVG (bayer_pixel[1], bayer_pixel[-1]);
     rgb_buffer[1] = bayer_pixel[0];
     rgb_buffer[2] = AVG (bayer_pixel[bayer_line_step], bayer_pixel[-bayer_line_step]);
-    
+
     // Bayer       -1 0 1 2
     //        -1    g b g b
     //         0    r g R g
@@ -753,8 +555,8 @@ void debayerEdgeAwareWeighted(const cv::Mat& bayer, cv::Mat& color)
     rgb_buffer[rgb_line_step ] = AVG (bayer_pixel[-1], bayer_pixel[1]);
     rgb_buffer[rgb_line_step + 1] = AVG3 (bayer_pixel[0], bayer_pixel[bayer_line_step - 1], bayer_pixel[bayer_line_step + 1]);
     rgb_buffer[rgb_line_step + 2] = bayer_pixel[bayer_line_step];
-    
-    
+
+
     // Bayer       -1 0 1 2
     //        -1    g b g b
     //         0    r g r g
@@ -763,7 +565,7 @@ void debayerEdgeAwareWeighted(const cv::Mat& bayer, cv::Mat& color)
     rgb_buffer[rgb_line_step + 4] = bayer_pixel[bayer_line_step + 1];
     rgb_buffer[rgb_line_step + 5] = AVG (bayer_pixel[bayer_line_step], bayer_pixel[bayer_line_step + 2]);
   }
-  
+
   // last two pixel values for first two lines
   // GRGR line
   // Bayer       -1 0 1
@@ -773,7 +575,7 @@ void debayerEdgeAwareWeighted(const cv::Mat& bayer, cv::Mat& color)
   rgb_buffer[rgb_line_step ] = rgb_buffer[0] = AVG (bayer_pixel[1], bayer_pixel[-1]);
   rgb_buffer[1] = bayer_pixel[0];
   rgb_buffer[5] = rgb_buffer[2] = AVG (bayer_pixel[bayer_line_step], bayer_pixel[-bayer_line_step]);
-  
+
   // Bayer       -1 0 1
   //        -1    g b g
   //         0    r g R
@@ -781,7 +583,7 @@ void debayerEdgeAwareWeighted(const cv::Mat& bayer, cv::Mat& color)
   rgb_buffer[rgb_line_step + 3] = rgb_buffer[3] = bayer_pixel[1];
   rgb_buffer[4] = AVG3 (bayer_pixel[0], bayer_pixel[bayer_line_step + 1], bayer_pixel[-bayer_line_step + 1]);
   //rgb_pixel[5] = AVG( bayer_pixel[line_step], bayer_pixel[-line_step] );
-  
+
   // BGBG line
   // Bayer       -1 0 1
   //        -1    g b g
@@ -790,7 +592,7 @@ void debayerEdgeAwareWeighted(const cv::Mat& bayer, cv::Mat& color)
   //rgb_pixel[rgb_line_step    ] = AVG2( bayer_pixel[-1], bayer_pixel[1] );
   rgb_buffer[rgb_line_step + 1] = AVG3 (bayer_pixel[0], bayer_pixel[bayer_line_step - 1], bayer_pixel[bayer_line_step + 1]);
   rgb_buffer[rgb_line_step + 5] = rgb_buffer[rgb_line_step + 2] = bayer_pixel[bayer_line_step];
-  
+
   // Bayer       -1 0 1
   //        -1    g b g
   //         0    r g r
@@ -798,7 +600,62 @@ void debayerEdgeAwareWeighted(const cv::Mat& bayer, cv::Mat& color)
   //rgb_pixel[rgb_line_step + 3] = bayer_pixel[1];
   rgb_buffer[rgb_line_step + 4] = bayer_pixel[bayer_line_step + 1];
   //rgb_pixel[rgb_line_step + 5] = bayer_pixel[line_step];
+}
 
+// Debayers strips of line pairs. Strips only write their own lines, so they can run on any number of threads.
+template<bool Weighted>
+class DebayerStrips : public cv::ParallelLoopBody
+{
+public:
+  DebayerStrips(const cv::Mat& bayer, cv::Mat& color, int pairs_per_strip)
+    : bayer_(bayer), color_(color), pairs_per_strip_(pairs_per_strip)
+  {
+  }
+
+  void operator()(const cv::Range& range) const
+  {
+    int pairs = bayer_.rows / 2;
+    for (int strip = range.start; strip < range.end; ++strip)
+    {
+      int end = std::min((strip + 1) * pairs_per_strip_, pairs);
+      for (int pair = strip * pairs_per_strip_; pair < end; ++pair)
+      {
+        if (pair == 0)
+          debayerFirstLines(bayer_, color_);
+        else if (pair == pairs - 1)
+          debayerLastLines(bayer_, color_);
+        else
+          debayerLinePair<Weighted>(bayer_, color_, 2 * pair);
+      }
+    }
+  }
+
+private:
+  const cv::Mat& bayer_;
+  cv::Mat& color_;
+  int pairs_per_strip_;
+};
+
+template<bool Weighted>
+void debayerEdgeAwareStrips(const cv::Mat& bayer, cv::Mat& color)
+{
+  int pairs = bayer.rows / 2;
+  size_t pair_bytes = 2 * (bayer.step[0] + color.step[0]);
+  int pairs_per_strip = std::max(1, int(STRIP_BYTES / pair_bytes));
+  int strips = (pairs + pairs_per_strip - 1) / pairs_per_strip;
+  cv::parallel_for_(cv::Range(0, strips), DebayerStrips<Weighted>(bayer, color, pairs_per_strip));
+}
+
+} // namespace
+
+void debayerEdgeAware(const cv::Mat& bayer, cv::Mat& color)
+{
+  debayerEdgeAwareStrips<false>(bayer, color);
+}
+
+void debayerEdgeAwareWeighted(const cv::Mat& bayer, cv::Mat& color)
+{
+  debayerEdgeAwareStrips<true>(bayer, color);
 }
 
 } // namespace image_proc
@@ -0,0 +1,139 @@
+/*********************************************************************
+* Software License Agreement (BSD License)
+* 
+*  Copyright (c) 2008, Willow Garage, Inc.
+*  All rights reserved.
+* 
+*  Redistribution and use in source and binary forms, with or without
+*  modification, are permitted provided that the following conditions
+*  are met:
+* 
+*   * Redistributions of source code must retain the above copyright
+*     notice, this list of conditions and the following disclaimer.
+*   * Redistributions in binary form must reproduce the above
+*     copyright notice, this list of conditions and the following
+*     disclaimer in the documentation and/or other materials provided
+*     with the distribution.
+*   * Neither the name of the Willow Garage nor the names of its
+*     contributors may be used to endorse or promote products derived
+*     from this software without specific prior written permission.
+* 
+*  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+*  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+*  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+*  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+*  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+*  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+*  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+*  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+*  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+*  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+*  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+*  POSSIBILITY OF SUCH DAMAGE.
+*********************************************************************/
+// Times the CropDecimate kernels against cv::resize on a colour image and a Bayer image, synthetic HD frames unless
+// files are given.
+//
+//   image_proc_bench_decimate [colour image] [raw Bayer image]
+#include <cstdio>
+
+#include <opencv2/core/core.hpp>
+#include <opencv2/highgui/highgui.hpp>
+#include <opencv2/imgproc/imgproc.hpp>
+
+#include "../src/nodelets/decimate.h"
+
+static const int ITERATIONS = 50;
+
+// Mean milliseconds per call
+template <typename F>
+static double timeIt(F f)
+{
+  f();
+  int64 start = cv::getTickCount();
+  for (int i = 0; i < ITERATIONS; ++i)
+    f();
+  return (cv::getTickCount() - start) * 1000.0 / cv::getTickFrequency() / ITERATIONS;
+}
+
+struct Nearest
+{
+  const cv::Mat& src; cv::Mat& dst; int decimation;
+  void operator()() const { image_proc::decimateNearest(src, dst, decimation, decimation); }
+};
+
+struct Area
+{
+  const cv::Mat& src; cv::Mat& dst; int decimation;
+  void operator()() const { image_proc::decimateArea(src, dst, decimation, decimation); }
+};
+
+struct Resize
+{
+  const cv::Mat& src; cv::Mat& dst; int decimation; int interpolation;
+  void operator()() const
+  {
+    cv::resize(src, dst, cv::Size(src.cols / decimation, src.rows / decimation), 0.0, 0.0, interpolation);
+  }
+};
+
+struct Debayer2x2
+{
+  const cv::Mat& src; cv::Mat& dst;
+  void operator()() const { image_proc::debayer2x2toBGR(src, dst, 0, 1, src.step1(), src.step1() + 1); }
+};
+
+struct DebayerResize
+{
+  const cv::Mat& src; cv::Mat& dst;
+  void operator()() const
+  {
+    cv::Mat bgr;
+    cv::cvtColor(src, bgr, CV_BayerBG2BGR);
+    cv::resize(bgr, dst, cv::Size(src.cols / 2, src.rows / 2), 0.0, 0.0, cv::INTER_AREA);
+  }
+};
+
+int main(int argc, char** argv)
+{
+  cv::Mat colour, bayer, dst;
+  if (argc > 1)
+    colour = cv::imread(argv[1], CV_LOAD_IMAGE_COLOR);
+  if (argc > 2)
+    bayer = cv::imread(argv[2], CV_LOAD_IMAGE_GRAYSCALE);
+  if (colour.empty())
+  {
+    colour.create(1080, 1920, CV_8UC3);
+    cv::randu(colour, cv::Scalar::all(0), cv::Scalar::all(256));
+  }
+  if (bayer.empty())
+  {
+    bayer.create(1080, 1920, CV_8UC1);
+    cv::randu(bayer, cv::Scalar::all(0), cv::Scalar::all(256));
+  }
+
+  printf("%d threads\n", cv::getNumThreads());
+  const int decimations[] = {2, 4};
+  const cv::Mat* images[] = {&colour, &bayer};
+  for (int i = 0; i < 2; ++i)
+  {
+    const cv::Mat& src = *images[i];
+    for (int d = 0; d < 2; ++d)
+    {
+      int decimation = decimations[d];
+      Nearest nearest = {src, dst, decimation};
+      Resize resize_nearest = {src, dst, decimation, cv::INTER_NEAREST};
+      Area area = {src, dst, decimation};
+      Resize resize_area = {src, dst, decimation, cv::INTER_AREA};
+      printf("%dx%d %d channel(s) / %d\n", src.cols, src.rows, src.channels(), decimation);
+      printf("  nearest  %8.3f ms   cv::resize INTER_NEAREST %8.3f ms\n", timeIt(nearest), timeIt(resize_nearest));
+      printf("  area     %8.3f ms   cv::resize INTER_AREA    %8.3f ms\n", timeIt(area), timeIt(resize_area));
+    }
+  }
+
+  Debayer2x2 debayer = {bayer, dst};
+  DebayerResize debayer_resize = {bayer, dst};
+  printf("Bayer %dx%d to BGR / 2\n", bayer.cols, bayer.rows);
+  printf("  debayer2x2toBGR %8.3f ms   cvtColor + INTER_AREA %8.3f ms\n", timeIt(debayer), timeIt(debayer_resize));
+  return 0;
+}
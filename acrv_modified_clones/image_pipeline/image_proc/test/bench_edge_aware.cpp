@@ -0,0 +1,155 @@
+/*********************************************************************
+* Software License Agreement (BSD License)
+* 
+*  Copyright (c) 2008, Willow Garage, Inc.
+*  All rights reserved.
+* 
+*  Redistribution and use in source and binary forms, with or without
+*  modification, are permitted provided that the following conditions
+*  are met:
+* 
+*   * Redistributions of source code must retain the above copyright
+*     notice, this list of conditions and the following disclaimer.
+*   * Redistributions in binary form must reproduce the above
+*     copyright notice, this list of conditions and the following
+*     disclaimer in the documentation and/or other materials provided
+*     with the distribution.
+*   * Neither the name of the Willow Garage nor the names of its
+*     contributors may be used to endorse or promote products derived
+*     from this software without specific prior written permission.
+* 
+*  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+*  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+*  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+*  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+*  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+*  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+*  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+*  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+*  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+*  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+*  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+*  POSSIBILITY OF SUCH DAMAGE.
+*********************************************************************/
+// Times the tiled edge-aware debayering against the original scalar implementation on recorded frames and checks that
+// both produce the same images.
+//
+//   bench_edge_aware <file.bag> [topic] [iterations]   bayer_grbg8 images recorded on the topic, every topic by default
+//   bench_edge_aware <image> [<image> ...]             raw Bayer images stored as single channel files
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <vector>
+
+#include <boost/foreach.hpp>
+#include <cv_bridge/cv_bridge.h>
+#include <opencv2/highgui/highgui.hpp>
+#include <rosbag/bag.h>
+#include <rosbag/view.h>
+#include <sensor_msgs/Image.h>
+#include <sensor_msgs/image_encodings.h>
+
+#include "../src/nodelets/edge_aware.h"
+#include "edge_aware_reference.h"
+
+typedef void (*DebayerFunction)(const cv::Mat&, cv::Mat&);
+
+static bool endsWith(const std::string& s, const std::string& suffix)
+{
+  return s.size() >= suffix.size() && s.compare(s.size() - suffix.size(), suffix.size(), suffix) == 0;
+}
+
+static std::vector<cv::Mat> loadBag(const std::string& file_name, const std::string& topic)
+{
+  std::vector<cv::Mat> frames;
+  rosbag::Bag bag(file_name);
+  rosbag::View view(bag);
+  BOOST_FOREACH(const rosbag::MessageInstance& m, view)
+  {
+    if (!topic.empty() && m.getTopic() != topic)
+      continue;
+    sensor_msgs::ImageConstPtr image = m.instantiate<sensor_msgs::Image>();
+    if (image && image->encoding == sensor_msgs::image_encodings::BAYER_GRBG8)
+      frames.push_back(cv_bridge::toCvCopy(image)->image);
+  }
+  return frames;
+}
+
+// Mean milliseconds per frame
+static double timeDebayer(DebayerFunction debayer, const std::vector<cv::Mat>& frames, std::vector<cv::Mat>& colors,
+                          int iterations)
+{
+  int64 start = cv::getTickCount();
+  for (int i = 0; i < iterations; ++i)
+    for (size_t f = 0; f < frames.size(); ++f)
+      debayer(frames[f], colors[f]);
+  return (cv::getTickCount() - start) * 1000.0 / cv::getTickFrequency() / (iterations * frames.size());
+}
+
+static bool compare(const char* name, DebayerFunction reference, DebayerFunction tiled,
+                    const std::vector<cv::Mat>& frames, int iterations)
+{
+  std::vector<cv::Mat> expected, actual;
+  for (size_t f = 0; f < frames.size(); ++f)
+  {
+    expected.push_back(cv::Mat(frames[f].size(), CV_8UC3));
+    actual.push_back(cv::Mat(frames[f].size(), CV_8UC3));
+  }
+
+  double reference_ms = timeDebayer(reference, frames, expected, iterations);
+  double tiled_ms = timeDebayer(tiled, frames, actual, iterations);
+
+  size_t mismatches = 0;
+  for (size_t f = 0; f < frames.size(); ++f)
+    if (cv::norm(expected[f], actual[f], cv::NORM_INF) != 0)
+      ++mismatches;
+
+  printf("%-20s reference %8.3f ms  tiled %8.3f ms  speedup %5.2fx  %s\n", name, reference_ms, tiled_ms,
+         reference_ms / tiled_ms, mismatches ? "MISMATCH" : "bit-exact");
+  if (mismatches)
+    printf("  %zu of %zu frames differ\n", mismatches, frames.size());
+  return mismatches == 0;
+}
+
+int main(int argc, char** argv)
+{
+  if (argc < 2)
+  {
+    fprintf(stderr, "usage: %s <file.bag> [topic] [iterations]\n       %s <image> [<image> ...]\n", argv[0], argv[0]);
+    return 2;
+  }
+
+  std::vector<cv::Mat> frames;
+  int iterations = 10;
+  if (endsWith(argv[1], ".bag"))
+  {
+    frames = loadBag(argv[1], argc > 2 ? argv[2] : "");
+    if (argc > 3)
+      iterations = std::max(1, atoi(argv[3]));
+  }
+  else
+  {
+    for (int i = 1; i < argc; ++i)
+    {
+      cv::Mat frame = cv::imread(argv[i], CV_LOAD_IMAGE_GRAYSCALE);
+      if (frame.empty())
+        fprintf(stderr, "cannot read %s\n", argv[i]);
+      else
+        frames.push_back(frame);
+    }
+  }
+  if (frames.empty())
+  {
+    fprintf(stderr, "no bayer_grbg8 frames found\n");
+    return 2;
+  }
+
+  printf("%zu frames of %dx%d, %d iterations, %d threads\n", frames.size(), frames[0].cols, frames[0].rows, iterations,
+         cv::getNumThreads());
+  bool exact = compare("edge-aware", image_proc::reference::debayerEdgeAware, image_proc::debayerEdgeAware,
+                       frames, iterations);
+  exact &= compare("edge-aware weighted", image_proc::reference::debayerEdgeAwareWeighted,
+                   image_proc::debayerEdgeAwareWeighted, frames, iterations);
+  return exact ? 0 : 1;
+}
@@ -0,0 +1,152 @@
+/*********************************************************************
+* Software License Agreement (BSD License)
+* 
+*  Copyright (c) 2008, Willow Garage, Inc.
+*  All rights reserved.
+* 
+*  Redistribution and use in source and binary forms, with or without
+*  modification, are permitted provided that the following conditions
+*  are met:
+* 
+*   * Redistributions of source code must retain the above copyright
+*     notice, this list of conditions and the following disclaimer.
+*   * Redistributions in binary form must reproduce the above
+*     copyright notice, this list of conditions and the following
+*     disclaimer in the documentation and/or other materials provided
+*     with the distribution.
+*   * Neither the name of the Willow Garage nor the names of its
+*     contributors may be used to endorse or promote products derived
+*     from this software without specific prior written permission.
+* 
+*  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+*  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+*  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+*  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+*  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+*  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+*  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+*  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+*  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+*  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+*  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+*  POSSIBILITY OF SUCH DAMAGE.
+*********************************************************************/
+#include <cstring>
+
+#include <gtest/gtest.h>
+#include <opencv2/core/core.hpp>
+#include <opencv2/imgproc/imgproc.hpp>
+
+#include "../src/nodelets/decimate.h"
+
+// Image of the given type with random content, a view into a wider one when padded so rows aren't continuous
+static cv::Mat randomImage(int rows, int cols, int type, bool padded)
+{
+  cv::Mat image(rows, cols + (padded ? 5 : 0), type);
+  cv::randu(image, cv::Scalar::all(0), cv::Scalar::all(CV_MAT_DEPTH(type) == CV_16U ? 65536 : 256));
+  return image.colRange(0, cols);
+}
+
+static const int SIZES[][2] = {{1, 1}, {7, 5}, {33, 17}, {64, 32}, {127, 63}, {641, 481}};
+
+TEST(Decimate, nearestKeepsTopLeftPixel)
+{
+  const int types[] = {CV_8UC1, CV_8UC2, CV_8UC3, CV_8UC4, CV_16UC3, CV_16UC4, CV_32FC3, CV_32FC4};
+  const int decimations[] = {1, 2, 3, 4, 8, 16};
+  for (size_t s = 0; s < sizeof(SIZES) / sizeof(SIZES[0]); ++s)
+    for (size_t t = 0; t < sizeof(types) / sizeof(types[0]); ++t)
+      for (size_t d = 0; d < sizeof(decimations) / sizeof(decimations[0]); ++d)
+      {
+        int dx = decimations[d], dy = decimations[(d + 1) % 3];
+        cv::Mat src = randomImage(SIZES[s][1], SIZES[s][0], types[t], s % 2), dst;
+        ASSERT_TRUE(image_proc::decimateNearest(src, dst, dx, dy));
+        ASSERT_EQ(src.cols / dx, dst.cols);
+        ASSERT_EQ(src.rows / dy, dst.rows);
+        for (int y = 0; y < dst.rows; ++y)
+          for (int x = 0; x < dst.cols; ++x)
+            ASSERT_EQ(0, memcmp(dst.ptr(y, x), src.ptr(y * dy, x * dx), src.elemSize()))
+              << src.cols << "x" << src.rows << " type " << types[t] << " decimation " << dx << "x" << dy;
+      }
+}
+
+TEST(Decimate, areaMatchesResize)
+{
+  const int types[] = {CV_8UC1, CV_8UC3, CV_8UC4, CV_16UC1, CV_16UC3, CV_32FC1, CV_32FC3};
+  const int decimations[] = {2, 3, 4, 8};
+  for (size_t t = 0; t < sizeof(types) / sizeof(types[0]); ++t)
+    for (size_t d = 0; d < sizeof(decimations) / sizeof(decimations[0]); ++d)
+    {
+      int dx = decimations[d], dy = decimations[(d + 1) % 4];
+      cv::Mat src = randomImage(480, 640 + dx, types[t], d % 2), dst, expected;
+      ASSERT_TRUE(image_proc::decimateArea(src, dst, dx, dy));
+
+      // Same blocks as resize, which rounds half to even where we round half up
+      cv::Mat whole = src(cv::Rect(0, 0, dst.cols * dx, dst.rows * dy));
+      cv::resize(whole, expected, dst.size(), 0.0, 0.0, cv::INTER_AREA);
+      double tolerance = CV_MAT_DEPTH(types[t]) == CV_32F ? 1e-3 : 1.0;
+      EXPECT_LE(cv::norm(expected, dst, cv::NORM_INF), tolerance) << "type " << types[t] << " decimation " << dx << "x" << dy;
+    }
+}
+
+// Row and column of R, G1, G2 and B within each 2x2 cell, in the order crop_decimate passes their offsets
+struct BayerPattern
+{
+  const char* name;
+  int cell[4][2];
+};
+
+static const BayerPattern PATTERNS[] = {
+  {"RGGB", {{0, 0}, {0, 1}, {1, 0}, {1, 1}}},
+  {"BGGR", {{1, 1}, {0, 1}, {1, 0}, {0, 0}}},
+  {"GBRG", {{1, 0}, {0, 0}, {1, 1}, {0, 1}}},
+  {"GRBG", {{0, 1}, {0, 0}, {1, 1}, {1, 0}}},
+};
+
+template <typename T>
+static void expectDebayer2x2(int depth)
+{
+  for (size_t p = 0; p < sizeof(PATTERNS) / sizeof(PATTERNS[0]); ++p)
+    for (size_t s = 1; s < sizeof(SIZES) / sizeof(SIZES[0]); ++s)
+    {
+      const int (&cell)[4][2] = PATTERNS[p].cell;
+      cv::Mat src = randomImage(SIZES[s][1] & ~1, SIZES[s][0] & ~1, CV_MAKETYPE(depth, 1), s % 2), dst;
+      int step = src.step1();
+      int offsets[4];
+      for (int c = 0; c < 4; ++c)
+        offsets[c] = cell[c][0] * step + cell[c][1];
+      image_proc::debayer2x2toBGR(src, dst, offsets[0], offsets[1], offsets[2], offsets[3]);
+      ASSERT_EQ(CV_MAKETYPE(depth, 3), dst.type());
+      for (int y = 0; y < dst.rows; ++y)
+        for (int x = 0; x < dst.cols; ++x)
+        {
+          const cv::Vec<T, 3>& bgr = dst.at<cv::Vec<T, 3> >(y, x);
+          ASSERT_EQ(src.at<T>(2 * y + cell[3][0], 2 * x + cell[3][1]), bgr[0]) << PATTERNS[p].name;
+          ASSERT_EQ((src.at<T>(2 * y + cell[1][0], 2 * x + cell[1][1]) + src.at<T>(2 * y + cell[2][0], 2 * x + cell[2][1])) / 2, bgr[1])
+            << PATTERNS[p].name;
+          ASSERT_EQ(src.at<T>(2 * y + cell[0][0], 2 * x + cell[0][1]), bgr[2]) << PATTERNS[p].name;
+        }
+    }
+}
+
+TEST(Decimate, debayer2x2)
+{
+  expectDebayer2x2<uint8_t>(CV_8U);
+  expectDebayer2x2<uint16_t>(CV_16U);
+}
+
+TEST(Decimate, multithreaded)
+{
+  cv::Mat src = randomImage(1080, 1920, CV_8UC3, false), single, multi;
+  cv::setNumThreads(1);
+  image_proc::decimateArea(src, single, 4, 4);
+  cv::setNumThreads(8);
+  image_proc::decimateArea(src, multi, 4, 4);
+  cv::setNumThreads(-1);
+  EXPECT_EQ(0, cv::norm(single, multi, cv::NORM_INF));
+}
+
+int main(int argc, char** argv)
+{
+  testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
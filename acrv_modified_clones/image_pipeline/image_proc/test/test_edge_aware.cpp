@@ -0,0 +1,108 @@
+/*********************************************************************
+* Software License Agreement (BSD License)
+* 
+*  Copyright (c) 2008, Willow Garage, Inc.
+*  All rights reserved.
+* 
+*  Redistribution and use in source and binary forms, with or without
+*  modification, are permitted provided that the following conditions
+*  are met:
+* 
+*   * Redistributions of source code must retain the above copyright
+*     notice, this list of conditions and the following disclaimer.
+*   * Redistributions in binary form must reproduce the above
+*     copyright notice, this list of conditions and the following
+*     disclaimer in the documentation and/or other materials provided
+*     with the distribution.
+*   * Neither the name of the Willow Garage nor the names of its
+*     contributors may be used to endorse or promote products derived
+*     from this software without specific prior written permission.
+* 
+*  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+*  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+*  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+*  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+*  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+*  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+*  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+*  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+*  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+*  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+*  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+*  POSSIBILITY OF SUCH DAMAGE.
+*********************************************************************/
+#include <gtest/gtest.h>
+#include <opencv2/core/core.hpp>
+
+#include "../src/nodelets/edge_aware.h"
+#include "edge_aware_reference.h"
+
+typedef void (*DebayerFunction)(const cv::Mat&, cv::Mat&);
+
+// Runs both implementations on the same frame and expects identical output, including the untouched padding of a
+// non-continuous color image
+void expectBitExact(const cv::Mat& bayer, DebayerFunction reference, DebayerFunction tiled)
+{
+  cv::Mat expected_padded(bayer.rows, bayer.cols + 3, CV_8UC3, cv::Scalar::all(7));
+  cv::Mat actual_padded = expected_padded.clone();
+  cv::Mat expected = expected_padded.colRange(0, bayer.cols);
+  cv::Mat actual = actual_padded.colRange(0, bayer.cols);
+
+  reference(bayer, expected);
+  tiled(bayer, actual);
+  EXPECT_EQ(0, cv::norm(expected_padded, actual_padded, cv::NORM_INF)) << bayer.cols << "x" << bayer.rows;
+}
+
+class EdgeAwareTest : public testing::TestWithParam<int>
+{
+protected:
+  virtual void SetUp()
+  {
+    cv::setNumThreads(GetParam());
+    cv::RNG rng(42);
+
+    const int sizes[][2] = {{4, 4}, {8, 6}, {34, 10}, {36, 8}, {50, 20}, {640, 480}, {642, 482}, {20, 1000}};
+    for (size_t i = 0; i < sizeof(sizes) / sizeof(sizes[0]); ++i)
+    {
+      // Noise exercises every branch, few levels give many ties between the gradients and flat regions zero gradients
+      cv::Mat noise(sizes[i][1], sizes[i][0], CV_8UC1);
+      rng.fill(noise, cv::RNG::UNIFORM, 0, 256);
+      frames_.push_back(noise);
+
+      cv::Mat levels(sizes[i][1], sizes[i][0], CV_8UC1);
+      rng.fill(levels, cv::RNG::UNIFORM, 0, 4);
+      frames_.push_back(levels * 60);
+
+      cv::Mat flat(sizes[i][1], sizes[i][0], CV_8UC1);
+      rng.fill(flat, cv::RNG::UNIFORM, 128, 131);
+      frames_.push_back(flat);
+    }
+  }
+
+  virtual void TearDown()
+  {
+    cv::setNumThreads(-1);
+  }
+
+  std::vector<cv::Mat> frames_;
+};
+
+TEST_P(EdgeAwareTest, matchesReference)
+{
+  for (size_t i = 0; i < frames_.size(); ++i)
+    expectBitExact(frames_[i], image_proc::reference::debayerEdgeAware, image_proc::debayerEdgeAware);
+}
+
+TEST_P(EdgeAwareTest, weightedMatchesReference)
+{
+  for (size_t i = 0; i < frames_.size(); ++i)
+    expectBitExact(frames_[i], image_proc::reference::debayerEdgeAwareWeighted, image_proc::debayerEdgeAwareWeighted);
+}
+
+INSTANTIATE_TEST_CASE_P(Threads, EdgeAwareTest, testing::Values(1, 3, 8));
+
+int main(int argc, char** argv)
+{
+  testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -39,8 +39,12 @@
 #include <cv_bridge/cv_bridge.h>
 #include <image_transport/image_transport.h>
 
+#include <boost/bind.hpp>
 #include <boost/thread.hpp>
 #include <boost/format.hpp>
+#include <boost/scoped_ptr.hpp>
+
+#include "image_writer.h"
 
 class ExtractImages
 {
@@ -56,6 +60,8 @@ private:
   double _time;
   double sec_per_frame_;
 
+  boost::scoped_ptr<image_view::ImageWriter> writer_;
+
 #if defined(_VIDEO)
   CvVideoWriter* video_writer;
 #endif //_VIDEO
@@ -73,6 +79,9 @@ public:
 
     local_nh.param("sec_per_frame", sec_per_frame_, 0.1);
 
+    ros::NodeHandle writer_nh(nh);
+    writer_.reset(new image_view::ImageWriter(writer_nh, local_nh));
+
     image_transport::ImageTransport it(nh);
     sub_ = it.subscribe(topic, 1, &ExtractImages::image_cb, this, transport);
 
@@ -87,6 +96,12 @@ public:
   {
   }
 
+  // Runs on the writer threads
+  static void imageWritten(const std::string& filename)
+  {
+    ROS_INFO("Saved image %s", filename.c_str());
+  }
+
   void image_cb(const sensor_msgs::ImageConstPtr& msg)
   {
     boost::lock_guard<boost::mutex> guard(image_mutex_);
@@ -99,26 +114,43 @@ public:
     if (msg->encoding.find("bayer") != std::string::npos)
       boost::const_pointer_cast<sensor_msgs::Image>(msg)->encoding = "mono8";
 
-    cv::Mat image;
-    try
-    {
-      image = cv_bridge::toCvShare(msg, "bgr8")->image;
-    } catch(cv_bridge::Exception)
-    {
-      ROS_ERROR("Unable to convert %s image to bgr8", msg->encoding.c_str());
-    }
-
     double delay = ros::Time::now().toSec()-_time;
     if(delay >= sec_per_frame_)
     {
       _time = ros::Time::now().toSec();
 
+#if !defined(_VIDEO)
+      cv_bridge::CvImageConstPtr image;
+      try
+      {
+        image = cv_bridge::toCvShare(msg, "bgr8");
+      } catch(cv_bridge::Exception)
+      {
+        ROS_ERROR("Unable to convert %s image to bgr8", msg->encoding.c_str());
+        return;
+      }
+
+      if (!image->image.empty()) {
+        // Compressed and written on the writer threads
+        std::string filename = (filename_format_ % count_).str();
+        if (writer_->write(image, filename, &ExtractImages::imageWritten))
+          count_++;
+      } else {
+        ROS_WARN("Couldn't save image, no data!");
+      }
+#else
+      cv::Mat image;
+      try
+      {
+        image = cv_bridge::toCvShare(msg, "bgr8")->image;
+      } catch(cv_bridge::Exception)
+      {
+        ROS_ERROR("Unable to convert %s image to bgr8", msg->encoding.c_str());
+      }
+
       if (!image.empty()) {
         std::string filename = (filename_format_ % count_).str();
 
-#if !defined(_VIDEO)
-        cv::imwrite(filename, image);
-#else
         if(!video_writer)
         {
             video_writer = cvCreateVideoWriter("video.avi", CV_FOURCC('M','J','P','G'),
@@ -126,13 +158,13 @@ public:
         }
 
         cvWriteFrame(video_writer, image);
-#endif // _VIDEO
 
         ROS_INFO("Saved image %s", filename.c_str());
         count_++;
       } else {
         ROS_WARN("Couldn't save image, no data!");
       }
+#endif // _VIDEO
     }
   }
 };
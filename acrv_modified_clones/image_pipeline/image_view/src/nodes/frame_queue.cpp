@@ -0,0 +1,158 @@
+/*********************************************************************
+* Software License Agreement (BSD License)
+* 
+*  Copyright (c) 2008, Willow Garage, Inc.
+*  All rights reserved.
+* 
+*  Redistribution and use in source and binary forms, with or without
+*  modification, are permitted provided that the following conditions
+*  are met:
+* 
+*   * Redistributions of source code must retain the above copyright
+*     notice, this list of conditions and the following disclaimer.
+*   * Redistributions in binary form must reproduce the above
+*     copyright notice, this list of conditions and the following
+*     disclaimer in the documentation and/or other materials provided
+*     with the distribution.
+*   * Neither the name of the Willow Garage nor the names of its
+*     contributors may be used to endorse or promote products derived
+*     from this software without specific prior written permission.
+* 
+*  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+*  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+*  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+*  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+*  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+*  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+*  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+*  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+*  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+*  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+*  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+*  POSSIBILITY OF SUCH DAMAGE.
+*********************************************************************/
+#include "frame_queue.h"
+
+#include <ros/console.h>
+
+#include <algorithm>
+#include <exception>
+
+namespace image_view {
+
+FrameQueue::Statistics::Statistics()
+  : written(0), dropped(0), failed(0), write_time(0.0), max_write_time(0.0), latency(0.0),
+    max_latency(0.0), queue_depth(0), max_queue_depth(0)
+{
+}
+
+FrameQueue::FrameQueue(const WriteFrame& write_frame, size_t queue_size, DropPolicy drop)
+  : write_frame_(write_frame), queue_size_(std::max<size_t>(queue_size, 1)), drop_(drop), busy_(false),
+    stopping_(false), thread_(&FrameQueue::work, this)
+{
+}
+
+FrameQueue::~FrameQueue()
+{
+  {
+    boost::mutex::scoped_lock lock(mutex_);
+    stopping_ = true;
+  }
+  queued_.notify_all();
+  thread_.join();
+}
+
+bool FrameQueue::push(const sensor_msgs::ImageConstPtr& frame)
+{
+  Entry entry;
+  entry.frame = frame;
+  entry.pushed = ros::WallTime::now();
+  {
+    boost::mutex::scoped_lock lock(mutex_);
+    if (queue_.size() >= queue_size_)
+    {
+      ++statistics_.dropped;
+      if (drop_ == DROP_NEWEST)
+        return false;
+      queue_.pop_front();
+    }
+    queue_.push_back(entry);
+    statistics_.max_queue_depth = std::max(statistics_.max_queue_depth, queue_.size());
+  }
+  queued_.notify_one();
+  return true;
+}
+
+void FrameQueue::flush()
+{
+  boost::mutex::scoped_lock lock(mutex_);
+  while (!queue_.empty() || busy_)
+    idle_.wait(lock);
+}
+
+void FrameQueue::work()
+{
+  for (;;)
+  {
+    Entry entry;
+    {
+      boost::mutex::scoped_lock lock(mutex_);
+      while (queue_.empty() && !stopping_)
+        queued_.wait(lock);
+      if (queue_.empty())
+        return;
+      entry = queue_.front();
+      queue_.pop_front();
+      busy_ = true;
+    }
+
+    ros::WallTime start = ros::WallTime::now();
+    bool ok;
+    try
+    {
+      ok = write_frame_(entry.frame);
+    }
+    catch (const std::exception& e)
+    {
+      ROS_ERROR_THROTTLE(5, "Could not write a %s frame: %s", entry.frame->encoding.c_str(), e.what());
+      ok = false;
+    }
+    ros::WallTime end = ros::WallTime::now();
+
+    {
+      boost::mutex::scoped_lock lock(mutex_);
+      busy_ = false;
+      if (ok)
+      {
+        double seconds = (end - start).toSec(), latency = (end - entry.pushed).toSec();
+        ++statistics_.written;
+        statistics_.write_time += seconds;
+        statistics_.max_write_time = std::max(statistics_.max_write_time, seconds);
+        statistics_.latency += latency;
+        statistics_.max_latency = std::max(statistics_.max_latency, latency);
+      }
+      else
+      {
+        ++statistics_.failed;
+      }
+    }
+    idle_.notify_all();
+  }
+}
+
+FrameQueue::Statistics FrameQueue::statistics() const
+{
+  boost::mutex::scoped_lock lock(mutex_);
+  Statistics statistics = statistics_;
+  statistics.queue_depth = queue_.size();
+  return statistics;
+}
+
+void FrameQueue::resetStatistics()
+{
+  boost::mutex::scoped_lock lock(mutex_);
+  statistics_ = Statistics();
+  statistics_.max_queue_depth = queue_.size();
+}
+
+} // namespace image_view
@@ -0,0 +1,124 @@
+/*********************************************************************
+* Software License Agreement (BSD License)
+* 
+*  Copyright (c) 2008, Willow Garage, Inc.
+*  All rights reserved.
+* 
+*  Redistribution and use in source and binary forms, with or without
+*  modification, are permitted provided that the following conditions
+*  are met:
+* 
+*   * Redistributions of source code must retain the above copyright
+*     notice, this list of conditions and the following disclaimer.
+*   * Redistributions in binary form must reproduce the above
+*     copyright notice, this list of conditions and the following
+*     disclaimer in the documentation and/or other materials provided
+*     with the distribution.
+*   * Neither the name of the Willow Garage nor the names of its
+*     contributors may be used to endorse or promote products derived
+*     from this software without specific prior written permission.
+* 
+*  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+*  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+*  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+*  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+*  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+*  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+*  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+*  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+*  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+*  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+*  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+*  POSSIBILITY OF SUCH DAMAGE.
+*********************************************************************/
+#ifndef IMAGE_VIEW_FRAME_QUEUE_H
+#define IMAGE_VIEW_FRAME_QUEUE_H
+
+#include <ros/time.h>
+#include <sensor_msgs/Image.h>
+#include <boost/function.hpp>
+#include <boost/noncopyable.hpp>
+#include <boost/thread/condition_variable.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/thread.hpp>
+
+#include <deque>
+
+namespace image_view {
+
+// Writes the frames of a video on one thread, in the order they were pushed, so that slow
+// conversion or encoding doesn't hold up the subscriber callback. When the queue is full, the
+// newest frame is refused or the oldest one dropped, as ImageWriter does for images.
+class FrameQueue : boost::noncopyable
+{
+public:
+  // Converts and writes one frame, returns false if it could not. Called on the writer thread.
+  typedef boost::function<bool (const sensor_msgs::ImageConstPtr&)> WriteFrame;
+
+  enum DropPolicy
+  {
+    DROP_OLDEST,  // The frame that has waited longest
+    DROP_NEWEST   // The frame being pushed, push() returns false
+  };
+
+  // Totals since construction or the last resetStatistics()
+  struct Statistics
+  {
+    Statistics();
+
+    uint64_t written;        // Frames written
+    uint64_t dropped;        // Frames dropped from a full queue
+    uint64_t failed;         // Frames that could not be written
+    double write_time;       // Total seconds spent writing
+    double max_write_time;   // Longest write, in seconds
+    double latency;          // Total seconds from push() until written
+    double max_latency;      // Longest time from push() until written
+    size_t queue_depth;      // Frames waiting when the statistics were taken
+    size_t max_queue_depth;  // Most frames waiting at once
+
+    double meanWriteTime() const { return written ? write_time / written : 0.0; }
+    double meanLatency() const { return written ? latency / written : 0.0; }
+  };
+
+  FrameQueue(const WriteFrame& write_frame, size_t queue_size = 16, DropPolicy drop = DROP_NEWEST);
+
+  // Writes the frames still queued, then stops the thread
+  ~FrameQueue();
+
+  // Queues frame to be written. Returns false if it was dropped right away, with DROP_NEWEST.
+  bool push(const sensor_msgs::ImageConstPtr& frame);
+
+  // Waits until every frame pushed so far has been written
+  void flush();
+
+  Statistics statistics() const;
+
+  void resetStatistics();
+
+private:
+  struct Entry
+  {
+    sensor_msgs::ImageConstPtr frame;
+    ros::WallTime pushed;
+  };
+
+  void work();
+
+  WriteFrame write_frame_;
+  size_t queue_size_;
+  DropPolicy drop_;
+
+  mutable boost::mutex mutex_;
+  boost::condition_variable queued_;  // Signalled when a frame is pushed or on stopping
+  boost::condition_variable idle_;    // Signalled when a frame has been written
+  std::deque<Entry> queue_;
+  bool busy_;
+  bool stopping_;
+  Statistics statistics_;
+  // Last, so that it starts once the rest is set up
+  boost::thread thread_;
+};
+
+} // namespace image_view
+
+#endif
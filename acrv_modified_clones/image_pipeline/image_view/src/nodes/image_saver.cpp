@@ -37,11 +37,14 @@
 #include <cv_bridge/cv_bridge.h>
 #include <image_transport/image_transport.h>
 #include <camera_calibration_parsers/parse.h>
+#include <boost/bind.hpp>
 #include <boost/format.hpp>
 
 #include <std_srvs/Empty.h>
 #include <std_srvs/Trigger.h>
 
+#include "image_writer.h"
+
 boost::format g_format;
 bool save_all_image, save_image_service;
 std::string encoding;
@@ -53,11 +56,24 @@ bool service(std_srvs::Empty::Request &req, std_srvs::Empty::Response &res) {
   return true;
 }
 
+// Runs on the writer threads once the image is saved
+void writeCameraInfo(std::string filename, const sensor_msgs::CameraInfoConstPtr& info)
+{
+  ROS_INFO("Saved image %s", filename.c_str());
+
+  // save the CameraInfo
+  if (info) {
+    filename = filename.replace(filename.rfind("."), filename.length(), ".ini");
+    camera_calibration_parsers::writeCalibration(filename, "camera", *info);
+  }
+}
+
 /** Class to deal with which callback to call whether we have CameraInfo or not
  */
 class Callbacks {
 public:
-  Callbacks() : is_first_image_(true), has_camera_info_(false), count_(0) {
+  Callbacks(image_view::ImageWriter& writer)
+    : writer_(writer), is_first_image_(true), has_camera_info_(false), count_(0) {
   }
 
   bool callbackStartSave(std_srvs::Trigger::Request &req,
@@ -107,8 +123,7 @@ public:
     }
 
     // save the image
-    std::string filename;
-    if (!saveImage(image_msg, filename))
+    if (!saveImage(image_msg, sensor_msgs::CameraInfoConstPtr()))
       return;
 
     count_++;
@@ -127,58 +142,51 @@ public:
         return;  // skip message which comes after end_time
     }
 
-    // save the image
-    std::string filename;
-    if (!saveImage(image_msg, filename))
+    // save the image and the CameraInfo
+    if (!saveImage(image_msg, info))
       return;
 
-    // save the CameraInfo
-    if (info) {
-      filename = filename.replace(filename.rfind("."), filename.length(), ".ini");
-      camera_calibration_parsers::writeCalibration(filename, "camera", *info);
-    }
-
     count_++;
   }
 private:
-  bool saveImage(const sensor_msgs::ImageConstPtr& image_msg, std::string &filename) {
-    cv::Mat image;
-    try
-    {
-      image = cv_bridge::toCvShare(image_msg, encoding)->image;
-    } catch(cv_bridge::Exception)
-    {
+  // Compression and writing are left to the writer threads. The image is only counted once it is
+  // queued, so a dropped image doesn't use up a filename or a service request.
+  bool saveImage(const sensor_msgs::ImageConstPtr& image_msg, const sensor_msgs::CameraInfoConstPtr& info) {
+    if (!save_all_image && !save_image_service)
+      return false;
+
+    std::string filename;
+    try {
+      filename = (g_format).str();
+    } catch (...) { g_format.clear(); }
+    try {
+      filename = (g_format % count_).str();
+    } catch (...) { g_format.clear(); }
+    try { 
+      filename = (g_format % count_ % "jpg").str();
+    } catch (...) { g_format.clear(); }
+
+    cv_bridge::CvImageConstPtr image;
+    try {
+      image = cv_bridge::toCvShare(image_msg, encoding);
+    } catch (const cv_bridge::Exception&) {
       ROS_ERROR("Unable to convert %s image to %s", image_msg->encoding.c_str(), encoding.c_str());
       return false;
     }
-
-    if (!image.empty()) {
-      try {
-        filename = (g_format).str();
-      } catch (...) { g_format.clear(); }
-      try {
-        filename = (g_format % count_).str();
-      } catch (...) { g_format.clear(); }
-      try { 
-        filename = (g_format % count_ % "jpg").str();
-      } catch (...) { g_format.clear(); }
-
-      if ( save_all_image || save_image_service ) {
-        cv::imwrite(filename, image);
-        ROS_INFO("Saved image %s", filename.c_str());
-
-        save_image_service = false;
-      } else {
-        return false;
-      }
-    } else {
+    if (image->image.empty()) {
       ROS_WARN("Couldn't save image, no data!");
       return false;
     }
+
+    if (!writer_.write(image, filename, boost::bind(&writeCameraInfo, _1, info)))
+      return false;
+
+    save_image_service = false;
     return true;
   }
 
 private:
+  image_view::ImageWriter& writer_;
   bool is_first_image_;
   bool has_camera_info_;
   size_t count_;
@@ -192,8 +200,11 @@ int main(int argc, char** argv)
   ros::NodeHandle nh;
   image_transport::ImageTransport it(nh);
   std::string topic = nh.resolveName("image");
+  ros::NodeHandle local_nh("~");
 
-  Callbacks callbacks;
+  // Declared first so that it finishes writing after everything else is gone
+  image_view::ImageWriter writer(nh, local_nh);
+  Callbacks callbacks(writer);
   // Useful when CameraInfo is being published
   image_transport::CameraSubscriber sub_image_and_camera = it.subscribeCamera(topic, 1,
                                                                               &Callbacks::callbackWithCameraInfo,
@@ -202,7 +213,6 @@ int main(int argc, char** argv)
   image_transport::Subscriber sub_image = it.subscribe(
       topic, 1, boost::bind(&Callbacks::callbackWithoutCameraInfo, &callbacks, _1));
 
-  ros::NodeHandle local_nh("~");
   std::string format_string;
   local_nh.param("filename_format", format_string, std::string("left%04i.%s"));
   local_nh.param("encoding", encoding, std::string("bgr8"));
@@ -0,0 +1,197 @@
+/*********************************************************************
+* Software License Agreement (BSD License)
+* 
+*  Copyright (c) 2008, Willow Garage, Inc.
+*  All rights reserved.
+* 
+*  Redistribution and use in source and binary forms, with or without
+*  modification, are permitted provided that the following conditions
+*  are met:
+* 
+*   * Redistributions of source code must retain the above copyright
+*     notice, this list of conditions and the following disclaimer.
+*   * Redistributions in binary form must reproduce the above
+*     copyright notice, this list of conditions and the following
+*     disclaimer in the documentation and/or other materials provided
+*     with the distribution.
+*   * Neither the name of the Willow Garage nor the names of its
+*     contributors may be used to endorse or promote products derived
+*     from this software without specific prior written permission.
+* 
+*  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+*  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+*  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+*  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+*  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+*  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+*  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+*  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+*  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+*  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+*  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+*  POSSIBILITY OF SUCH DAMAGE.
+*********************************************************************/
+#include "image_writer.h"
+
+#include <diagnostic_msgs/DiagnosticArray.h>
+#include <boost/algorithm/string/case_conv.hpp>
+#include <boost/bind.hpp>
+
+#include <algorithm>
+#include <fstream>
+#include <sstream>
+
+namespace image_view {
+
+bool formatFromFilename(const std::string& filename, cv_bridge::Format& format)
+{
+  static const struct { const char* extension; cv_bridge::Format format; } formats[] = {
+    { "bmp", cv_bridge::BMP }, { "dib", cv_bridge::DIB }, { "jpg", cv_bridge::JPG },
+    { "jpeg", cv_bridge::JPEG }, { "jpe", cv_bridge::JPE }, { "jp2", cv_bridge::JP2 },
+    { "png", cv_bridge::PNG }, { "pbm", cv_bridge::PBM }, { "pgm", cv_bridge::PGM },
+    { "ppm", cv_bridge::PPM }, { "sr", cv_bridge::SR }, { "ras", cv_bridge::RAS },
+    { "tiff", cv_bridge::TIFF }, { "tif", cv_bridge::TIF }, { "rvl", cv_bridge::RVL } };
+
+  size_t dot = filename.rfind('.');
+  if (dot == std::string::npos || filename.find('/', dot) != std::string::npos)
+    return false;
+  std::string extension = boost::algorithm::to_lower_copy(filename.substr(dot + 1));
+  for (size_t i = 0; i < sizeof(formats) / sizeof(formats[0]); ++i)
+  {
+    if (extension == formats[i].extension)
+    {
+      format = formats[i].format;
+      return true;
+    }
+  }
+  return false;
+}
+
+bool writeFile(const std::string& filename, const std::vector<uint8_t>& data)
+{
+  std::ofstream file(filename.c_str(), std::ios::binary | std::ios::trunc);
+  if (!data.empty())
+    file.write(reinterpret_cast<const char*>(&data[0]), data.size());
+  file.close();
+  return !file.fail();
+}
+
+ImageWriter::ImageWriter(ros::NodeHandle& nh, ros::NodeHandle& private_nh)
+  : format_(cv_bridge::JPG), write_failures_(0), period_start_(ros::WallTime::now())
+{
+  int threads, queue_size;
+  std::string drop_policy;
+  double diagnostics_period;
+  private_nh.param("writer_threads", threads, 2);
+  private_nh.param("writer_queue_size", queue_size, 16);
+  private_nh.param("drop_policy", drop_policy, std::string("newest"));
+  private_nh.param("diagnostics_period", diagnostics_period, 1.0);
+  if (drop_policy != "newest" && drop_policy != "oldest")
+    ROS_WARN("Unknown drop_policy '%s', dropping the newest images", drop_policy.c_str());
+
+  encoder_.reset(new cv_bridge::ImageEncoder(cv_bridge::CompressionOptions(format_),
+                                             cv_bridge::ImageEncoder::Callback(),
+                                             std::max(threads, 1), std::max(queue_size, 1),
+                                             drop_policy == "oldest" ? cv_bridge::ImageEncoder::DROP_OLDEST
+                                                                     : cv_bridge::ImageEncoder::DROP_NEWEST));
+
+  pub_diagnostics_ = nh.advertise<diagnostic_msgs::DiagnosticArray>("diagnostics", 1);
+  if (diagnostics_period > 0.0)
+    diagnostics_timer_ = nh.createWallTimer(ros::WallDuration(diagnostics_period), &ImageWriter::diagnosticsCb, this);
+}
+
+ImageWriter::~ImageWriter()
+{
+  diagnostics_timer_.stop();
+  encoder_.reset();
+}
+
+bool ImageWriter::write(const cv_bridge::CvImageConstPtr& image, const std::string& filename,
+                        const Written& written)
+{
+  cv_bridge::Format format;
+  if (!formatFromFilename(filename, format))
+  {
+    ROS_ERROR_THROTTLE(5, "Can't tell which format to save %s in", filename.c_str());
+    return false;
+  }
+  // The format applies to every queued image, so those queued in another format go first
+  if (format != format_)
+  {
+    encoder_->flush();
+    encoder_->setOptions(cv_bridge::CompressionOptions(format));
+    format_ = format;
+  }
+  return encoder_->encode(image, boost::bind(&ImageWriter::writeCb, this, _1, filename, written));
+}
+
+void ImageWriter::writeCb(const sensor_msgs::CompressedImageConstPtr& msg, const std::string& filename,
+                          const Written& written)
+{
+  if (!writeFile(filename, msg->data))
+  {
+    ROS_ERROR_THROTTLE(5, "Could not write %s", filename.c_str());
+    boost::mutex::scoped_lock lock(mutex_);
+    ++write_failures_;
+    return;
+  }
+  if (!written)
+    return;
+  try
+  {
+    written(filename);
+  }
+  catch (const std::exception& e)
+  {
+    ROS_ERROR_THROTTLE(5, "Could not finish saving %s: %s", filename.c_str(), e.what());
+  }
+}
+
+void ImageWriter::diagnosticsCb(const ros::WallTimerEvent& event)
+{
+  cv_bridge::ImageEncoder::Statistics statistics = encoder_->statistics();
+  encoder_->resetStatistics();
+  uint64_t write_failures;
+  double period;
+  {
+    boost::mutex::scoped_lock lock(mutex_);
+    write_failures = write_failures_;
+    write_failures_ = 0;
+    ros::WallTime now = ros::WallTime::now();
+    period = (now - period_start_).toSec();
+    period_start_ = now;
+  }
+  uint64_t failed = statistics.failed + write_failures;
+
+  diagnostic_msgs::DiagnosticStatus status;
+  status.name = ros::this_node::getName() + ": writer";
+  status.level = statistics.dropped || failed ? diagnostic_msgs::DiagnosticStatus::WARN : diagnostic_msgs::DiagnosticStatus::OK;
+  status.message = statistics.dropped ? "Dropping images" : failed ? "Failing to write images" :
+                   statistics.encoded ? "Writing" : "Idle";
+
+  std::ostringstream values[8];
+  values[0] << (period > 0.0 ? statistics.encoded / period : 0.0);
+  values[1] << statistics.queue_depth;
+  values[2] << statistics.max_queue_depth;
+  values[3] << statistics.dropped;
+  values[4] << failed;
+  values[5] << statistics.meanEncodeTime() * 1000.0;
+  values[6] << statistics.max_encode_time * 1000.0;
+  values[7] << statistics.compressionRatio();
+  static const char* keys[8] = { "encoded rate (Hz)", "queue depth", "max queue depth", "dropped", "failed",
+                                 "encode mean (ms)", "encode max (ms)", "compression ratio" };
+  for (int i = 0; i < 8; ++i)
+  {
+    diagnostic_msgs::KeyValue value;
+    value.key = keys[i];
+    value.value = values[i].str();
+    status.values.push_back(value);
+  }
+
+  diagnostic_msgs::DiagnosticArray diagnostics;
+  diagnostics.header.stamp = ros::Time::now();
+  diagnostics.status.push_back(status);
+  pub_diagnostics_.publish(diagnostics);
+}
+
+} // namespace image_view
@@ -0,0 +1,96 @@
+/*********************************************************************
+* Software License Agreement (BSD License)
+* 
+*  Copyright (c) 2008, Willow Garage, Inc.
+*  All rights reserved.
+* 
+*  Redistribution and use in source and binary forms, with or without
+*  modification, are permitted provided that the following conditions
+*  are met:
+* 
+*   * Redistributions of source code must retain the above copyright
+*     notice, this list of conditions and the following disclaimer.
+*   * Redistributions in binary form must reproduce the above
+*     copyright notice, this list of conditions and the following
+*     disclaimer in the documentation and/or other materials provided
+*     with the distribution.
+*   * Neither the name of the Willow Garage nor the names of its
+*     contributors may be used to endorse or promote products derived
+*     from this software without specific prior written permission.
+* 
+*  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+*  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+*  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+*  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+*  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+*  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+*  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+*  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+*  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+*  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+*  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+*  POSSIBILITY OF SUCH DAMAGE.
+*********************************************************************/
+#ifndef IMAGE_VIEW_IMAGE_WRITER_H
+#define IMAGE_VIEW_IMAGE_WRITER_H
+
+#include <ros/ros.h>
+#include <cv_bridge/image_encoder.h>
+#include <boost/function.hpp>
+#include <boost/scoped_ptr.hpp>
+#include <boost/thread/mutex.hpp>
+
+#include <string>
+#include <vector>
+
+namespace image_view {
+
+// Gets the cv_bridge format for the extension of filename, returns false if there is none
+bool formatFromFilename(const std::string& filename, cv_bridge::Format& format);
+
+// Writes data to filename, returns false if it couldn't
+bool writeFile(const std::string& filename, const std::vector<uint8_t>& data);
+
+// Saves images to files, compressing them with a cv_bridge::ImageEncoder so that slow encoding or
+// disks don't hold up the subscriber callback. The file format follows the filename extension.
+// The encoder's statistics, and how many files could not be written, are published on the
+// "diagnostics" topic.
+//
+// Parameters, read from the private node handle:
+//   writer_threads (int, 2), writer_queue_size (int, 16),
+//   drop_policy ("newest" or "oldest", "newest"), diagnostics_period (double, 1.0 s, 0 disables)
+class ImageWriter
+{
+public:
+  // Called on a writer thread once the file has been written
+  typedef boost::function<void (const std::string&)> Written;
+
+  ImageWriter(ros::NodeHandle& nh, ros::NodeHandle& private_nh);
+
+  // Finishes writing the images still queued
+  ~ImageWriter();
+
+  // Queues image to be saved to filename. The image must not be modified afterwards. Returns false
+  // when it is dropped right away, or the filename has no known extension.
+  bool write(const cv_bridge::CvImageConstPtr& image, const std::string& filename,
+             const Written& written = Written());
+
+private:
+  void writeCb(const sensor_msgs::CompressedImageConstPtr& msg, const std::string& filename,
+               const Written& written);
+  void diagnosticsCb(const ros::WallTimerEvent& event);
+
+  boost::mutex mutex_;
+  cv_bridge::Format format_;
+  uint64_t write_failures_;  // Since diagnostics were last published
+  ros::WallTime period_start_;
+
+  ros::Publisher pub_diagnostics_;
+  ros::WallTimer diagnostics_timer_;
+  // Last, so that it finishes the queued images before the rest is destroyed
+  boost::scoped_ptr<cv_bridge::ImageEncoder> encoder_;
+};
+
+} // namespace image_view
+
+#endif
@@ -23,11 +23,20 @@
 #include <cv_bridge/cv_bridge.h>
 #include <image_transport/image_transport.h>
 #include <camera_calibration_parsers/parse.h>
+#include <diagnostic_msgs/DiagnosticArray.h>
+#include <boost/scoped_ptr.hpp>
 #if CV_MAJOR_VERSION == 3
 #include <opencv2/videoio.hpp>
 #endif
 
+#include <algorithm>
+#include <sstream>
+
+#include "frame_queue.h"
+
+// Opened by the subscriber callback, then only written by the frame queue's thread
 cv::VideoWriter outputVideo;
+bool video_opened = false;
 
 int g_count = 0;
 ros::Time g_last_wrote_time = ros::Time(0);
@@ -40,10 +49,40 @@ double max_depth_range;
 bool use_dynamic_range;
 int colormap;
 
+boost::scoped_ptr<image_view::FrameQueue> frame_queue;
+ros::Publisher pub_diagnostics;
+ros::WallTime period_start;
+
+
+// Converts a frame for display and appends it to the video, on the frame queue's thread
+bool writeFrame(const sensor_msgs::ImageConstPtr& image_msg)
+{
+    try
+    {
+      cv_bridge::CvtColorForDisplayOptions options;
+      options.do_dynamic_scaling = use_dynamic_range;
+      options.min_image_value = min_depth_range;
+      options.max_image_value = max_depth_range;
+      options.colormap = colormap;
+      const cv::Mat image = cv_bridge::cvtColorForDisplay(cv_bridge::toCvShare(image_msg), encoding, options)->image;
+      if (image.empty()) {
+          ROS_WARN("Frame skipped, no data!");
+          return false;
+      }
+      outputVideo << image;
+      ROS_INFO_STREAM("Recording frame " << g_count << "\x1b[1F");
+      g_count++;
+      return true;
+    } catch(cv_bridge::Exception)
+    {
+        ROS_ERROR("Unable to convert %s image to %s", image_msg->encoding.c_str(), encoding.c_str());
+        return false;
+    }
+}
 
 void callback(const sensor_msgs::ImageConstPtr& image_msg)
 {
-    if (!outputVideo.isOpened()) {
+    if (!video_opened) {
 
         cv::Size size(image_msg->width, image_msg->height);
 
@@ -65,6 +104,7 @@ void callback(const sensor_msgs::ImageConstPtr& image_msg)
             ROS_ERROR("Could not create the output video! Check filename and/or support for codec.");
             exit(-1);
         }
+        video_opened = true;
 
         ROS_INFO_STREAM("Starting to record " << codec << " video at " << size << "@" << fps << "fps. Press Ctrl+C to stop recording." );
 
@@ -76,27 +116,48 @@ void callback(const sensor_msgs::ImageConstPtr& image_msg)
       return;
     }
 
-    try
-    {
-      cv_bridge::CvtColorForDisplayOptions options;
-      options.do_dynamic_scaling = use_dynamic_range;
-      options.min_image_value = min_depth_range;
-      options.max_image_value = max_depth_range;
-      options.colormap = colormap;
-      const cv::Mat image = cv_bridge::cvtColorForDisplay(cv_bridge::toCvShare(image_msg), encoding, options)->image;
-      if (!image.empty()) {
-        outputVideo << image;
-        ROS_INFO_STREAM("Recording frame " << g_count << "\x1b[1F");
-        g_count++;
-        g_last_wrote_time = image_msg->header.stamp;
-      } else {
-          ROS_WARN("Frame skipped, no data!");
-      }
-    } catch(cv_bridge::Exception)
+    if (frame_queue->push(image_msg))
+      g_last_wrote_time = image_msg->header.stamp;
+}
+
+void diagnosticsCb(const ros::WallTimerEvent& event)
+{
+    image_view::FrameQueue::Statistics statistics = frame_queue->statistics();
+    frame_queue->resetStatistics();
+    ros::WallTime now = ros::WallTime::now();
+    double period = (now - period_start).toSec();
+    period_start = now;
+
+    diagnostic_msgs::DiagnosticStatus status;
+    status.name = ros::this_node::getName() + ": writer";
+    status.level = statistics.dropped || statistics.failed ? diagnostic_msgs::DiagnosticStatus::WARN : diagnostic_msgs::DiagnosticStatus::OK;
+    status.message = statistics.dropped ? "Dropping frames" : statistics.failed ? "Failing to write frames" :
+                     statistics.written ? "Writing" : "Idle";
+
+    std::ostringstream values[9];
+    values[0] << (period > 0.0 ? statistics.written / period : 0.0);
+    values[1] << statistics.queue_depth;
+    values[2] << statistics.max_queue_depth;
+    values[3] << statistics.dropped;
+    values[4] << statistics.failed;
+    values[5] << statistics.meanWriteTime() * 1000.0;
+    values[6] << statistics.max_write_time * 1000.0;
+    values[7] << statistics.meanLatency() * 1000.0;
+    values[8] << statistics.max_latency * 1000.0;
+    static const char* keys[9] = { "written rate (Hz)", "queue depth", "max queue depth", "dropped", "failed",
+                                   "write mean (ms)", "write max (ms)", "latency mean (ms)", "latency max (ms)" };
+    for (int i = 0; i < 9; ++i)
     {
-        ROS_ERROR("Unable to convert %s image to %s", image_msg->encoding.c_str(), encoding.c_str());
-        return;
+      diagnostic_msgs::KeyValue value;
+      value.key = keys[i];
+      value.value = values[i].str();
+      status.values.push_back(value);
     }
+
+    diagnostic_msgs::DiagnosticArray diagnostics;
+    diagnostics.header.stamp = ros::Time::now();
+    diagnostics.status.push_back(status);
+    pub_diagnostics.publish(diagnostics);
 }
 
 int main(int argc, char** argv)
@@ -115,6 +176,15 @@ int main(int argc, char** argv)
     local_nh.param("max_depth_range", max_depth_range, 0.0);
     local_nh.param("use_dynamic_depth_range", use_dynamic_range, false);
     local_nh.param("colormap", colormap, -1);
+    // Frames are converted and written on a thread of their own, as image_saver does for images
+    int queue_size;
+    std::string drop_policy;
+    double diagnostics_period;
+    local_nh.param("writer_queue_size", queue_size, 16);
+    local_nh.param("drop_policy", drop_policy, std::string("newest"));
+    local_nh.param("diagnostics_period", diagnostics_period, 1.0);
+    if (drop_policy != "newest" && drop_policy != "oldest")
+        ROS_WARN("Unknown drop_policy '%s', dropping the newest frames", drop_policy.c_str());
 
     if (stamped_filename) {
       std::size_t found = filename.find_last_of("/\\");
@@ -131,11 +201,26 @@ int main(int argc, char** argv)
         exit(-1);
     }
 
+    frame_queue.reset(new image_view::FrameQueue(&writeFrame, std::max(queue_size, 1),
+                                                 drop_policy == "oldest" ? image_view::FrameQueue::DROP_OLDEST
+                                                                         : image_view::FrameQueue::DROP_NEWEST));
+    period_start = ros::WallTime::now();
+    pub_diagnostics = nh.advertise<diagnostic_msgs::DiagnosticArray>("diagnostics", 1);
+    ros::WallTimer diagnostics_timer;
+    if (diagnostics_period > 0.0)
+        diagnostics_timer = nh.createWallTimer(ros::WallDuration(diagnostics_period), diagnosticsCb);
+
     image_transport::ImageTransport it(nh);
     std::string topic = nh.resolveName("image");
     image_transport::Subscriber sub_image = it.subscribe(topic, 1, callback);
 
     ROS_INFO_STREAM("Waiting for topic " << topic << "...");
     ros::spin();
+
+    // Write the frames still queued before the video is closed
+    sub_image.shutdown();
+    diagnostics_timer.stop();
+    frame_queue.reset();
+    outputVideo.release();
     std::cout << "\nVideo saved as " << filename << std::endl;
 }
@@ -0,0 +1,152 @@
+/*********************************************************************
+* Software License Agreement (BSD License)
+* 
+*  Copyright (c) 2008, Willow Garage, Inc.
+*  All rights reserved.
+* 
+*  Redistribution and use in source and binary forms, with or without
+*  modification, are permitted provided that the following conditions
+*  are met:
+* 
+*   * Redistributions of source code must retain the above copyright
+*     notice, this list of conditions and the following disclaimer.
+*   * Redistributions in binary form must reproduce the above
+*     copyright notice, this list of conditions and the following
+*     disclaimer in the documentation and/or other materials provided
+*     with the distribution.
+*   * Neither the name of the Willow Garage nor the names of its
+*     contributors may be used to endorse or promote products derived
+*     from this software without specific prior written permission.
+* 
+*  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+*  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+*  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+*  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+*  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+*  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+*  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+*  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+*  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+*  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+*  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+*  POSSIBILITY OF SUCH DAMAGE.
+*********************************************************************/
+#include <gtest/gtest.h>
+#include <boost/bind.hpp>
+#include <boost/thread/thread.hpp>
+
+#include <stdexcept>
+#include <vector>
+
+#include "../src/nodes/frame_queue.h"
+
+namespace {
+
+// Records the sequence numbers of the frames written, after waiting for delay seconds
+struct Recorder
+{
+  Recorder(double delay = 0.0) : delay(delay) {}
+
+  bool write(const sensor_msgs::ImageConstPtr& frame)
+  {
+    if (delay > 0.0)
+      boost::this_thread::sleep(boost::posix_time::microseconds(static_cast<long>(delay * 1e6)));
+    if (frame->encoding == "broken")
+      return false;
+    if (frame->encoding == "throws")
+      throw std::runtime_error("cannot write");
+    written.push_back(frame->header.seq);
+    return true;
+  }
+
+  double delay;
+  std::vector<uint32_t> written;
+};
+
+sensor_msgs::ImageConstPtr makeFrame(uint32_t seq, const std::string& encoding = "bgr8")
+{
+  sensor_msgs::ImagePtr frame(new sensor_msgs::Image);
+  frame->header.seq = seq;
+  frame->encoding = encoding;
+  return frame;
+}
+
+} // namespace
+
+TEST(FrameQueue, writesInOrder)
+{
+  Recorder recorder;
+  {
+    image_view::FrameQueue queue(boost::bind(&Recorder::write, &recorder, _1), 100);
+    for (uint32_t i = 0; i < 50; ++i)
+      ASSERT_TRUE(queue.push(makeFrame(i)));
+    queue.flush();
+    image_view::FrameQueue::Statistics statistics = queue.statistics();
+    EXPECT_EQ(statistics.written, 50u);
+    EXPECT_EQ(statistics.dropped, 0u);
+    EXPECT_EQ(statistics.queue_depth, 0u);
+    EXPECT_GE(statistics.max_latency, statistics.meanLatency());
+  }
+  ASSERT_EQ(recorder.written.size(), 50u);
+  for (uint32_t i = 0; i < 50; ++i)
+    EXPECT_EQ(recorder.written[i], i);
+}
+
+TEST(FrameQueue, dropNewestRefusesFramesWhenFull)
+{
+  Recorder recorder(0.05);
+  size_t accepted = 0;
+  {
+    image_view::FrameQueue queue(boost::bind(&Recorder::write, &recorder, _1), 2,
+                                 image_view::FrameQueue::DROP_NEWEST);
+    for (uint32_t i = 0; i < 10; ++i)
+      accepted += queue.push(makeFrame(i));
+    EXPECT_LT(accepted, 10u);
+    EXPECT_EQ(queue.statistics().dropped, 10u - accepted);
+  }
+  // The first frames are kept and the queued ones are finished on destruction
+  ASSERT_EQ(recorder.written.size(), accepted);
+  for (size_t i = 0; i < recorder.written.size(); ++i)
+    EXPECT_EQ(recorder.written[i], i);
+}
+
+TEST(FrameQueue, dropOldestKeepsTheLatestFrames)
+{
+  Recorder recorder(0.05);
+  {
+    image_view::FrameQueue queue(boost::bind(&Recorder::write, &recorder, _1), 2,
+                                 image_view::FrameQueue::DROP_OLDEST);
+    for (uint32_t i = 0; i < 10; ++i)
+      EXPECT_TRUE(queue.push(makeFrame(i)));
+    queue.flush();
+    image_view::FrameQueue::Statistics statistics = queue.statistics();
+    EXPECT_EQ(statistics.written + statistics.dropped, 10u);
+    EXPECT_EQ(statistics.max_queue_depth, 2u);
+  }
+  ASSERT_GE(recorder.written.size(), 2u);
+  EXPECT_EQ(recorder.written[recorder.written.size() - 2], 8u);
+  EXPECT_EQ(recorder.written.back(), 9u);
+}
+
+TEST(FrameQueue, countsFailures)
+{
+  Recorder recorder;
+  image_view::FrameQueue queue(boost::bind(&Recorder::write, &recorder, _1));
+  queue.push(makeFrame(0, "broken"));
+  queue.push(makeFrame(1, "throws"));
+  queue.push(makeFrame(2));
+  queue.flush();
+  image_view::FrameQueue::Statistics statistics = queue.statistics();
+  EXPECT_EQ(statistics.failed, 2u);
+  EXPECT_EQ(statistics.written, 1u);
+
+  queue.resetStatistics();
+  EXPECT_EQ(queue.statistics().failed, 0u);
+  EXPECT_EQ(queue.statistics().written, 0u);
+}
+
+int main(int argc, char** argv)
+{
+  testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
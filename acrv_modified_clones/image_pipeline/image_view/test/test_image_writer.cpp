@@ -0,0 +1,102 @@
+/*********************************************************************
+* Software License Agreement (BSD License)
+* 
+*  Copyright (c) 2008, Willow Garage, Inc.
+*  All rights reserved.
+* 
+*  Redistribution and use in source and binary forms, with or without
+*  modification, are permitted provided that the following conditions
+*  are met:
+* 
+*   * Redistributions of source code must retain the above copyright
+*     notice, this list of conditions and the following disclaimer.
+*   * Redistributions in binary form must reproduce the above
+*     copyright notice, this list of conditions and the following
+*     disclaimer in the documentation and/or other materials provided
+*     with the distribution.
+*   * Neither the name of the Willow Garage nor the names of its
+*     contributors may be used to endorse or promote products derived
+*     from this software without specific prior written permission.
+* 
+*  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+*  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+*  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+*  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+*  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+*  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+*  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+*  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+*  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+*  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+*  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+*  POSSIBILITY OF SUCH DAMAGE.
+*********************************************************************/
+#include <gtest/gtest.h>
+#include <opencv2/highgui/highgui.hpp>
+#include <sensor_msgs/image_encodings.h>
+
+#include <cstdio>
+#include <fstream>
+#include <iterator>
+
+#include "../src/nodes/image_writer.h"
+
+TEST(ImageWriter, formatFromFilename)
+{
+  cv_bridge::Format format;
+  ASSERT_TRUE(image_view::formatFromFilename("left0001.jpg", format));
+  EXPECT_EQ(format, cv_bridge::JPG);
+  ASSERT_TRUE(image_view::formatFromFilename("/tmp/frames.d/depth0001.PNG", format));
+  EXPECT_EQ(format, cv_bridge::PNG);
+  ASSERT_TRUE(image_view::formatFromFilename("frame.tiff", format));
+  EXPECT_EQ(format, cv_bridge::TIFF);
+  ASSERT_TRUE(image_view::formatFromFilename("frame.rvl", format));
+  EXPECT_EQ(format, cv_bridge::RVL);
+
+  EXPECT_FALSE(image_view::formatFromFilename("frame", format));
+  EXPECT_FALSE(image_view::formatFromFilename("frames.d/frame", format));
+  EXPECT_FALSE(image_view::formatFromFilename("frame.avi", format));
+}
+
+TEST(ImageWriter, writeFileRoundTrip)
+{
+  std::vector<uint8_t> data;
+  for (int i = 0; i < 1000; ++i)
+    data.push_back(i * 7);
+  const std::string filename = "image_view_test_image_writer.bin";
+  ASSERT_TRUE(image_view::writeFile(filename, data));
+
+  std::ifstream file(filename.c_str(), std::ios::binary);
+  std::vector<uint8_t> read((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+  EXPECT_EQ(read, data);
+  std::remove(filename.c_str());
+
+  EXPECT_FALSE(image_view::writeFile("no/such/directory/image.bin", data));
+}
+
+// What ImageWriter does on its threads, compressing as the filename says then writing the bytes
+TEST(ImageWriter, savedImageReadsBack)
+{
+  cv::Mat depth(48, 64, CV_16UC1);
+  for (int i = 0; i < depth.rows * depth.cols; ++i)
+    depth.at<uint16_t>(i) = i * 3;
+  cv_bridge::CvImage image(std_msgs::Header(), sensor_msgs::image_encodings::TYPE_16UC1, depth);
+
+  const std::string filename = "image_view_test_image_writer.png";
+  cv_bridge::Format format;
+  ASSERT_TRUE(image_view::formatFromFilename(filename, format));
+  sensor_msgs::CompressedImage msg;
+  image.toCompressedImageMsg(msg, cv_bridge::CompressionOptions(format));
+  ASSERT_TRUE(image_view::writeFile(filename, msg.data));
+
+  cv::Mat saved = cv::imread(filename, cv::IMREAD_UNCHANGED);
+  std::remove(filename.c_str());
+  ASSERT_EQ(saved.type(), CV_16UC1);
+  EXPECT_EQ(cv::norm(saved, depth, cv::NORM_INF), 0);
+}
+
+int main(int argc, char** argv)
+{
+  testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -145,7 +145,8 @@ public:
   int getDisp12MaxDiff() const;
   void setDisp12MaxDiff(int disp12MaxDiff);
 
-  // Do all the work!
+  // Do all the work! The point clouds are reprojected straight from the block matcher's fixed-point
+  // disparities, so output.disparity is only filled in when DISPARITY or POINT_CLOUD is requested.
   bool process(const sensor_msgs::ImageConstPtr& left_raw,
                const sensor_msgs::ImageConstPtr& right_raw,
                const image_geometry::StereoCameraModel& model,
@@ -155,6 +156,9 @@ public:
                         const image_geometry::StereoCameraModel& model,
                         stereo_msgs::DisparityImage& disparity) const;
 
+  // Points are reprojected with model.reprojectionMatrix(), and are invalid where the disparity is below
+  // disparity.min_disparity, as adjusted for the principal points, or maps to infinity. color is only
+  // read for mono8, rgb8 and bgr8 encodings.
   void processPoints(const stereo_msgs::DisparityImage& disparity,
                      const cv::Mat& color, const std::string& encoding,
                      const image_geometry::StereoCameraModel& model,
@@ -165,6 +169,11 @@ public:
                       sensor_msgs::PointCloud2& points) const;
 
 private:
+  // Block matching into disparity16_
+  void matchDisparity(const cv::Mat& left_rect, const cv::Mat& right_rect) const;
+  void fillDisparityImage(const image_geometry::StereoCameraModel& model,
+                          stereo_msgs::DisparityImage& disparity) const;
+
   image_proc::Processor mono_processor_;
   
   mutable cv::Mat_<int16_t> disparity16_; // scratch buffer for 16-bit signed disparity image
@@ -180,10 +189,15 @@ private:
   mutable cv::Mat_<uint32_t> labels_;
   mutable cv::Mat_<uint32_t> wavefront_;
   mutable cv::Mat_<uint8_t> region_types_;
-  // scratch buffer for dense point cloud
-  mutable cv::Mat_<cv::Vec3f> dense_points_;
 };
 
+// Dense x, y, z, rgb cloud of disparity in one parallel pass, what StereoProcessor::processPoints2() does
+// without needing a processor. Invalid points are all NaN. rgb is zero unless color is a mono8, rgb8 or
+// bgr8 image covering the disparities, so color may be left empty for other encodings.
+void reprojectPoints2(const stereo_msgs::DisparityImage& disparity,
+                      const cv::Mat& color, const std::string& encoding,
+                      const image_geometry::StereoCameraModel& model,
+                      sensor_msgs::PointCloud2& points);
 
 inline int StereoProcessor::getInterpolation() const
 {
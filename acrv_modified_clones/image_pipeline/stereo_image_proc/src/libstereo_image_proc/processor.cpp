@@ -34,11 +34,261 @@
 #include <ros/assert.h>
 #include "stereo_image_proc/processor.h"
 #include <sensor_msgs/image_encodings.h>
-#include <cmath>
+#include <stdint.h>
+#include <algorithm>
+#include <cstring>
 #include <limits>
+#include <vector>
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
 
 namespace stereo_image_proc {
 
+namespace {
+
+// Fixed-point disparity is 16 times the true value: d = d_fp / 16.0 = x_l - x_r.
+const int DPP = 16; // disparities per pixel
+
+// Subtracted from the matcher's disparities, see fillDisparityImage()
+double principalOffset(const image_geometry::StereoCameraModel& model)
+{
+  return model.left().cx() - model.right().cx();
+}
+
+// The reprojection matrix of StereoCameraModel only has these terms, giving the point (X, Y, Z) / W for
+// pixel (u, v) with disparity d:
+//   X = Q00 u + Q03,  Y = Q11 v + Q13,  Z = Q23,  W = Q32 d + Q33
+// Stored disparities are turned into d = scale * stored + offset, and are invalid below min_disparity,
+// where the matchers put their invalid marker, or when W is zero and the point is at infinity.
+struct Reprojection
+{
+  Reprojection(const image_geometry::StereoCameraModel& model, double scale, double offset,
+               double min_disparity)
+    : scale(scale), offset(offset), min_disparity(min_disparity)
+  {
+    const cv::Matx44d& Q = model.reprojectionMatrix();
+    q00 = Q(0,0);
+    q03 = Q(0,3);
+    q11 = Q(1,1);
+    q13 = Q(1,3);
+    q23 = Q(2,3);
+    q32 = Q(3,2);
+    q33 = Q(3,3);
+  }
+
+  float scale, offset, min_disparity;
+  float q00, q03, q11, q13, q23, q32, q33;
+};
+
+enum ColorOrder
+{
+  COLOR_NONE, COLOR_MONO, COLOR_RGB, COLOR_BGR
+};
+
+// How to read color for a disparity image of the given size, which is not read at all unless it is a
+// mono8, rgb8 or bgr8 image covering the disparities
+ColorOrder colorOrder(const cv::Mat& color, const std::string& encoding, int rows, int cols)
+{
+  namespace enc = sensor_msgs::image_encodings;
+  ColorOrder order = COLOR_NONE;
+  if (encoding == enc::MONO8)
+    order = COLOR_MONO;
+  else if (encoding == enc::RGB8)
+    order = COLOR_RGB;
+  else if (encoding == enc::BGR8)
+    order = COLOR_BGR;
+  else
+  {
+    ROS_WARN_THROTTLE(30, "Could not fill color channel of the point cloud, unrecognized encoding '%s'",
+                      encoding.c_str());
+    return COLOR_NONE;
+  }
+
+  if (color.empty() || color.rows < rows || color.cols < cols || color.depth() != CV_8U ||
+      color.channels() != (order == COLOR_MONO ? 1 : 3))
+  {
+    ROS_WARN_THROTTLE(30, "Could not fill color channel of the point cloud, the %s image doesn't match the disparities",
+                      encoding.c_str());
+    return COLOR_NONE;
+  }
+  return order;
+}
+
+// Row v of color as the 0x00RRGGBB words that are punned to float in "rgb" fields
+void packColors(const cv::Mat& color, ColorOrder order, int v, int cols, uint32_t* rgb)
+{
+  const uint8_t* p = order == COLOR_NONE ? NULL : color.ptr<uint8_t>(v);
+  switch (order)
+  {
+    case COLOR_MONO:
+      for (int u = 0; u < cols; ++u)
+        rgb[u] = p[u] * 0x010101u;
+      break;
+    case COLOR_RGB:
+      for (int u = 0; u < cols; ++u, p += 3)
+        rgb[u] = (p[0] << 16) | (p[1] << 8) | p[2];
+      break;
+    case COLOR_BGR:
+      for (int u = 0; u < cols; ++u, p += 3)
+        rgb[u] = (p[2] << 16) | (p[1] << 8) | p[0];
+      break;
+    default:
+      std::fill(rgb, rgb + cols, 0);
+      break;
+  }
+}
+
+#if defined(__SSE2__)
+inline __m128 load4(const float* p)
+{
+  return _mm_loadu_ps(p);
+}
+
+inline __m128 load4(const int16_t* p)
+{
+  __m128i d = _mm_loadl_epi64(reinterpret_cast<const __m128i*>(p));
+  return _mm_cvtepi32_ps(_mm_srai_epi32(_mm_unpacklo_epi16(d, d), 16));
+}
+
+inline __m128 select(__m128 mask, __m128 a, __m128 b)
+{
+  return _mm_or_ps(_mm_and_ps(mask, a), _mm_andnot_ps(mask, b));
+}
+#endif
+
+// Reprojects row v into x, y, z, rgb quadruples at out, all NaN for invalid disparities
+template <typename T>
+void reprojectRow(const T* disparity, const uint32_t* rgb, int cols, int v, const Reprojection& r, float* out)
+{
+  const float y = r.q11 * v + r.q13;
+  const float bad_point = std::numeric_limits<float>::quiet_NaN();
+  int u = 0;
+#if defined(__SSE2__)
+  const __m128 scale = _mm_set1_ps(r.scale), offset = _mm_set1_ps(r.offset);
+  const __m128 min_disparity = _mm_set1_ps(r.min_disparity);
+  const __m128 q00 = _mm_set1_ps(r.q00), q03 = _mm_set1_ps(r.q03), q23 = _mm_set1_ps(r.q23);
+  const __m128 q32 = _mm_set1_ps(r.q32), q33 = _mm_set1_ps(r.q33);
+  const __m128 Y = _mm_set1_ps(y), one = _mm_set1_ps(1.0f), four = _mm_set1_ps(4.0f);
+  const __m128 bad = _mm_set1_ps(bad_point);
+  __m128 column = _mm_setr_ps(0.0f, 1.0f, 2.0f, 3.0f);
+  for (; u <= cols - 4; u += 4, out += 16, column = _mm_add_ps(column, four))
+  {
+    __m128 d = _mm_add_ps(_mm_mul_ps(load4(disparity + u), scale), offset);
+    __m128 w = _mm_add_ps(_mm_mul_ps(d, q32), q33);
+    __m128 valid = _mm_and_ps(_mm_cmpge_ps(d, min_disparity), _mm_cmpneq_ps(w, _mm_setzero_ps()));
+    if (!_mm_movemask_ps(valid))
+    {
+      _mm_storeu_ps(out, bad);
+      _mm_storeu_ps(out + 4, bad);
+      _mm_storeu_ps(out + 8, bad);
+      _mm_storeu_ps(out + 12, bad);
+      continue;
+    }
+
+    __m128 iw = _mm_div_ps(one, w);
+    __m128 px = select(valid, _mm_mul_ps(_mm_add_ps(_mm_mul_ps(column, q00), q03), iw), bad);
+    __m128 py = select(valid, _mm_mul_ps(Y, iw), bad);
+    __m128 pz = select(valid, _mm_mul_ps(q23, iw), bad);
+    __m128 pc = select(valid, _mm_castsi128_ps(_mm_loadu_si128(reinterpret_cast<const __m128i*>(rgb + u))), bad);
+    _MM_TRANSPOSE4_PS(px, py, pz, pc);
+    _mm_storeu_ps(out, px);
+    _mm_storeu_ps(out + 4, py);
+    _mm_storeu_ps(out + 8, pz);
+    _mm_storeu_ps(out + 12, pc);
+  }
+#endif
+  for (; u < cols; ++u, out += 4)
+  {
+    float d = disparity[u] * r.scale + r.offset;
+    float w = d * r.q32 + r.q33;
+    if (d >= r.min_disparity && w != 0.0f)
+    {
+      float iw = 1.0f / w;
+      out[0] = (u * r.q00 + r.q03) * iw;
+      out[1] = y * iw;
+      out[2] = r.q23 * iw;
+      memcpy(&out[3], &rgb[u], sizeof(float));
+    }
+    else
+    {
+      out[0] = out[1] = out[2] = out[3] = bad_point;
+    }
+  }
+}
+
+template <typename T>
+class ReprojectRows : public cv::ParallelLoopBody
+{
+public:
+  ReprojectRows(const cv::Mat_<T>& disparity, const Reprojection& reprojection, const cv::Mat& color,
+                ColorOrder order, sensor_msgs::PointCloud2& points)
+    : disparity_(disparity), reprojection_(reprojection), color_(color), order_(order), points_(points)
+  {
+  }
+
+  void operator()(const cv::Range& range) const
+  {
+    std::vector<uint32_t> rgb(disparity_.cols);
+    for (int v = range.start; v < range.end; ++v)
+    {
+      packColors(color_, order_, v, disparity_.cols, &rgb[0]);
+      reprojectRow(disparity_[v], &rgb[0], disparity_.cols, v, reprojection_,
+                   reinterpret_cast<float*>(&points_.data[v * points_.row_step]));
+    }
+  }
+
+private:
+  const cv::Mat_<T>& disparity_;
+  const Reprojection& reprojection_;
+  const cv::Mat& color_;
+  ColorOrder order_;
+  sensor_msgs::PointCloud2& points_;
+};
+
+// Rows are cheap, so they are handed out in stripes of about this many points
+const double STRIPE_POINTS = 16 * 1024;
+
+// Dense x, y, z, rgb cloud of the disparity image, in one pass over it
+template <typename T>
+void reprojectDense(const cv::Mat_<T>& disparity, const Reprojection& reprojection, const cv::Mat& color,
+                      const std::string& encoding, sensor_msgs::PointCloud2& points)
+{
+  points.height = disparity.rows;
+  points.width  = disparity.cols;
+  points.fields.resize (4);
+  points.fields[0].name = "x";
+  points.fields[0].offset = 0;
+  points.fields[0].count = 1;
+  points.fields[0].datatype = sensor_msgs::PointField::FLOAT32;
+  points.fields[1].name = "y";
+  points.fields[1].offset = 4;
+  points.fields[1].count = 1;
+  points.fields[1].datatype = sensor_msgs::PointField::FLOAT32;
+  points.fields[2].name = "z";
+  points.fields[2].offset = 8;
+  points.fields[2].count = 1;
+  points.fields[2].datatype = sensor_msgs::PointField::FLOAT32;
+  points.fields[3].name = "rgb";
+  points.fields[3].offset = 12;
+  points.fields[3].count = 1;
+  points.fields[3].datatype = sensor_msgs::PointField::FLOAT32;
+  points.is_bigendian = false;
+  points.point_step = 16;
+  points.row_step = points.point_step * points.width;
+  points.data.resize (points.row_step * points.height);
+  points.is_dense = false; // there may be invalid points
+  if (points.data.empty())
+    return;
+
+  cv::parallel_for_(cv::Range(0, disparity.rows),
+                    ReprojectRows<T>(disparity, reprojection, color,
+                                     colorOrder(color, encoding, disparity.rows, disparity.cols), points),
+                    std::max(1.0, disparity.total() / STRIPE_POINTS));
+}
+
+} // namespace
+
 bool StereoProcessor::process(const sensor_msgs::ImageConstPtr& left_raw,
                               const sensor_msgs::ImageConstPtr& right_raw,
                               const image_geometry::StereoCameraModel& model,
@@ -53,7 +303,6 @@ bool StereoProcessor::process(const sensor_msgs::ImageConstPtr& left_raw,
     right_flags |= RIGHT_RECT;
   }
   if (flags & (POINT_CLOUD | POINT_CLOUD2)) {
-    flags |= DISPARITY;
     // Need the color channels for the point cloud
     left_flags |= LEFT_RECT_COLOR;
   }
@@ -63,8 +312,11 @@ bool StereoProcessor::process(const sensor_msgs::ImageConstPtr& left_raw,
     return false;
 
   // Do block matching to produce the disparity image
-  if (flags & DISPARITY) {
-    processDisparity(output.left.rect, output.right.rect, model, output.disparity);
+  if (flags & STEREO_ALL) {
+    matchDisparity(output.left.rect, output.right.rect);
+  }
+  if (flags & (DISPARITY | POINT_CLOUD)) {
+    fillDisparityImage(model, output.disparity);
   }
 
   // Project disparity image to 3d point cloud
@@ -72,9 +324,11 @@ bool StereoProcessor::process(const sensor_msgs::ImageConstPtr& left_raw,
     processPoints(output.disparity, output.left.rect_color, output.left.color_encoding, model, output.points);
   }
 
-  // Project disparity image to 3d point cloud
+  // Project the fixed-point disparities to 3d point cloud, without going through float
   if (flags & POINT_CLOUD2) {
-    processPoints2(output.disparity, output.left.rect_color, output.left.color_encoding, model, output.points2);
+    const double offset = principalOffset(model);
+    reprojectDense(disparity16_, Reprojection(model, 1.0 / DPP, -offset, getMinDisparity() - offset),
+                     output.left.rect_color, output.left.color_encoding, output.points2);
   }
 
   return true;
@@ -84,10 +338,12 @@ void StereoProcessor::processDisparity(const cv::Mat& left_rect, const cv::Mat&
                                        const image_geometry::StereoCameraModel& model,
                                        stereo_msgs::DisparityImage& disparity) const
 {
-  // Fixed-point disparity is 16 times the true value: d = d_fp / 16.0 = x_l - x_r.
-  static const int DPP = 16; // disparities per pixel
-  static const double inv_dpp = 1.0 / DPP;
+  matchDisparity(left_rect, right_rect);
+  fillDisparityImage(model, disparity);
+}
 
+void StereoProcessor::matchDisparity(const cv::Mat& left_rect, const cv::Mat& right_rect) const
+{
   // Block matcher produces 16-bit signed (fixed point) disparity image
   if (current_stereo_algorithm_ == BM)
 #if CV_MAJOR_VERSION == 3
@@ -99,6 +355,12 @@ void StereoProcessor::processDisparity(const cv::Mat& left_rect, const cv::Mat&
   else
     sg_block_matcher_(left_rect, right_rect, disparity16_);
 #endif
+}
+
+void StereoProcessor::fillDisparityImage(const image_geometry::StereoCameraModel& model,
+                                         stereo_msgs::DisparityImage& disparity) const
+{
+  static const double inv_dpp = 1.0 / DPP;
 
   // Fill in DisparityImage image data, converting to 32-bit float
   sensor_msgs::Image& dimage = disparity.image;
@@ -110,7 +372,7 @@ void StereoProcessor::processDisparity(const cv::Mat& left_rect, const cv::Mat&
   cv::Mat_<float> dmat(dimage.height, dimage.width, (float*)&dimage.data[0], dimage.step);
   // We convert from fixed-point to float disparity and also adjust for any x-offset between
   // the principal points: d = d_fp*inv_dpp - (cx_l - cx_r)
-  disparity16_.convertTo(dmat, dmat.type(), inv_dpp, -(model.left().cx() - model.right().cx()));
+  disparity16_.convertTo(dmat, dmat.type(), inv_dpp, -principalOffset(model));
   ROS_ASSERT(dmat.data == &dimage.data[0]);
   /// @todo is_bigendian? :)
 
@@ -126,22 +388,15 @@ void StereoProcessor::processDisparity(const cv::Mat& left_rect, const cv::Mat&
   disparity.delta_d = inv_dpp;
 }
 
-inline bool isValidPoint(const cv::Vec3f& pt)
-{
-  // Check both for disparities explicitly marked as invalid (where OpenCV maps pt.z to MISSING_Z)
-  // and zero disparities (point mapped to infinity).
-  return pt[2] != image_geometry::StereoCameraModel::MISSING_Z && !std::isinf(pt[2]);
-}
-
 void StereoProcessor::processPoints(const stereo_msgs::DisparityImage& disparity,
                                     const cv::Mat& color, const std::string& encoding,
                                     const image_geometry::StereoCameraModel& model,
                                     sensor_msgs::PointCloud& points) const
 {
-  // Calculate dense point cloud
   const sensor_msgs::Image& dimage = disparity.image;
   const cv::Mat_<float> dmat(dimage.height, dimage.width, (float*)&dimage.data[0], dimage.step);
-  model.projectDisparityImageTo3d(dmat, dense_points_, true);
+  const Reprojection reprojection(model, 1.0, 0.0, disparity.min_disparity - principalOffset(model));
+  const ColorOrder order = colorOrder(color, encoding, dmat.rows, dmat.cols);
 
   // Fill in sparse point cloud message
   points.points.resize(0);
@@ -152,62 +407,33 @@ void StereoProcessor::processPoints(const stereo_msgs::DisparityImage& disparity
   points.channels[1].values.resize(0);
   points.channels[2].name = "v";
   points.channels[2].values.resize(0);
-  
-  for (int32_t u = 0; u < dense_points_.rows; ++u) {
-    for (int32_t v = 0; v < dense_points_.cols; ++v) {
-      if (isValidPoint(dense_points_(u,v))) {
+
+  if (dmat.empty())
+    return;
+
+  // One row at a time, reprojected densely and then packed
+  std::vector<uint32_t> rgb(dmat.cols);
+  std::vector<float> row(4 * dmat.cols);
+  for (int32_t u = 0; u < dmat.rows; ++u) {
+    packColors(color, order, u, dmat.cols, &rgb[0]);
+    reprojectRow(dmat[u], &rgb[0], dmat.cols, u, reprojection, &row[0]);
+    for (int32_t v = 0; v < dmat.cols; ++v) {
+      const float* pt = &row[4 * v];
+      if (pt[2] == pt[2]) {
         // x,y,z
-        geometry_msgs::Point32 pt;
-        pt.x = dense_points_(u,v)[0];
-        pt.y = dense_points_(u,v)[1];
-        pt.z = dense_points_(u,v)[2];
-        points.points.push_back(pt);
+        geometry_msgs::Point32 point;
+        point.x = pt[0];
+        point.y = pt[1];
+        point.z = pt[2];
+        points.points.push_back(point);
         // u,v
         points.channels[1].values.push_back(u);
         points.channels[2].values.push_back(v);
+        if (order != COLOR_NONE)
+          points.channels[0].values.push_back(pt[3]);
       }
     }
   }
-
-  // Fill in color
-  namespace enc = sensor_msgs::image_encodings;
-  points.channels[0].values.reserve(points.points.size());
-  if (encoding == enc::MONO8) {
-    for (int32_t u = 0; u < dense_points_.rows; ++u) {
-      for (int32_t v = 0; v < dense_points_.cols; ++v) {
-        if (isValidPoint(dense_points_(u,v))) {
-          uint8_t g = color.at<uint8_t>(u,v);
-          int32_t rgb = (g << 16) | (g << 8) | g;
-          points.channels[0].values.push_back(*(float*)(&rgb));
-        }
-      }
-    }
-  }
-  else if (encoding == enc::RGB8) {
-    for (int32_t u = 0; u < dense_points_.rows; ++u) {
-      for (int32_t v = 0; v < dense_points_.cols; ++v) {
-        if (isValidPoint(dense_points_(u,v))) {
-          const cv::Vec3b& rgb = color.at<cv::Vec3b>(u,v);
-          int32_t rgb_packed = (rgb[0] << 16) | (rgb[1] << 8) | rgb[2];
-          points.channels[0].values.push_back(*(float*)(&rgb_packed));
-        }
-      }
-    }
-  }
-  else if (encoding == enc::BGR8) {
-    for (int32_t u = 0; u < dense_points_.rows; ++u) {
-      for (int32_t v = 0; v < dense_points_.cols; ++v) {
-        if (isValidPoint(dense_points_(u,v))) {
-          const cv::Vec3b& bgr = color.at<cv::Vec3b>(u,v);
-          int32_t rgb_packed = (bgr[2] << 16) | (bgr[1] << 8) | bgr[0];
-          points.channels[0].values.push_back(*(float*)(&rgb_packed));
-        }
-      }
-    }
-  }
-  else {
-    ROS_WARN("Could not fill color channel of the point cloud, unrecognized encoding '%s'", encoding.c_str());
-  }
 }
 
 void StereoProcessor::processPoints2(const stereo_msgs::DisparityImage& disparity,
@@ -215,103 +441,20 @@ void StereoProcessor::processPoints2(const stereo_msgs::DisparityImage& disparit
                                      const image_geometry::StereoCameraModel& model,
                                      sensor_msgs::PointCloud2& points) const
 {
-  // Calculate dense point cloud
-  const sensor_msgs::Image& dimage = disparity.image;
-  const cv::Mat_<float> dmat(dimage.height, dimage.width, (float*)&dimage.data[0], dimage.step);
-  model.projectDisparityImageTo3d(dmat, dense_points_, true);
-
-  // Fill in sparse point cloud message
-  points.height = dense_points_.rows;
-  points.width  = dense_points_.cols;
-  points.fields.resize (4);
-  points.fields[0].name = "x";
-  points.fields[0].offset = 0;
-  points.fields[0].count = 1;
-  points.fields[0].datatype = sensor_msgs::PointField::FLOAT32;
-  points.fields[1].name = "y";
-  points.fields[1].offset = 4;
-  points.fields[1].count = 1;
-  points.fields[1].datatype = sensor_msgs::PointField::FLOAT32;
-  points.fields[2].name = "z";
-  points.fields[2].offset = 8;
-  points.fields[2].count = 1;
-  points.fields[2].datatype = sensor_msgs::PointField::FLOAT32;
-  points.fields[3].name = "rgb";
-  points.fields[3].offset = 12;
-  points.fields[3].count = 1;
-  points.fields[3].datatype = sensor_msgs::PointField::FLOAT32;
-  //points.is_bigendian = false; ???
-  points.point_step = 16;
-  points.row_step = points.point_step * points.width;
-  points.data.resize (points.row_step * points.height);
-  points.is_dense = false; // there may be invalid points
- 
-  float bad_point = std::numeric_limits<float>::quiet_NaN ();
-  int i = 0;
-  for (int32_t u = 0; u < dense_points_.rows; ++u) {
-    for (int32_t v = 0; v < dense_points_.cols; ++v, ++i) {
-      if (isValidPoint(dense_points_(u,v))) {
-        // x,y,z,rgba
-        memcpy (&points.data[i * points.point_step + 0], &dense_points_(u,v)[0], sizeof (float));
-        memcpy (&points.data[i * points.point_step + 4], &dense_points_(u,v)[1], sizeof (float));
-        memcpy (&points.data[i * points.point_step + 8], &dense_points_(u,v)[2], sizeof (float));
-      }
-      else {
-        memcpy (&points.data[i * points.point_step + 0], &bad_point, sizeof (float));
-        memcpy (&points.data[i * points.point_step + 4], &bad_point, sizeof (float));
-        memcpy (&points.data[i * points.point_step + 8], &bad_point, sizeof (float));
-      }
-    }
-  }
+  reprojectPoints2(disparity, color, encoding, model, points);
+}
 
-  // Fill in color
-  namespace enc = sensor_msgs::image_encodings;
-  i = 0;
-  if (encoding == enc::MONO8) {
-    for (int32_t u = 0; u < dense_points_.rows; ++u) {
-      for (int32_t v = 0; v < dense_points_.cols; ++v, ++i) {
-        if (isValidPoint(dense_points_(u,v))) {
-          uint8_t g = color.at<uint8_t>(u,v);
-          int32_t rgb = (g << 16) | (g << 8) | g;
-          memcpy (&points.data[i * points.point_step + 12], &rgb, sizeof (int32_t));
-        }
-        else {
-          memcpy (&points.data[i * points.point_step + 12], &bad_point, sizeof (float));
-        }
-      }
-    }
-  }
-  else if (encoding == enc::RGB8) {
-    for (int32_t u = 0; u < dense_points_.rows; ++u) {
-      for (int32_t v = 0; v < dense_points_.cols; ++v, ++i) {
-        if (isValidPoint(dense_points_(u,v))) {
-          const cv::Vec3b& rgb = color.at<cv::Vec3b>(u,v);
-          int32_t rgb_packed = (rgb[0] << 16) | (rgb[1] << 8) | rgb[2];
-          memcpy (&points.data[i * points.point_step + 12], &rgb_packed, sizeof (int32_t));
-        }
-        else {
-          memcpy (&points.data[i * points.point_step + 12], &bad_point, sizeof (float));
-        }
-      }
-    }
-  }
-  else if (encoding == enc::BGR8) {
-    for (int32_t u = 0; u < dense_points_.rows; ++u) {
-      for (int32_t v = 0; v < dense_points_.cols; ++v, ++i) {
-        if (isValidPoint(dense_points_(u,v))) {
-          const cv::Vec3b& bgr = color.at<cv::Vec3b>(u,v);
-          int32_t rgb_packed = (bgr[2] << 16) | (bgr[1] << 8) | bgr[0];
-          memcpy (&points.data[i * points.point_step + 12], &rgb_packed, sizeof (int32_t));
-        }
-        else {
-          memcpy (&points.data[i * points.point_step + 12], &bad_point, sizeof (float));
-        }
-      }
-    }
-  }
-  else {
-    ROS_WARN("Could not fill color channel of the point cloud, unrecognized encoding '%s'", encoding.c_str());
-  }
+void reprojectPoints2(const stereo_msgs::DisparityImage& disparity,
+                      const cv::Mat& color, const std::string& encoding,
+                      const image_geometry::StereoCameraModel& model,
+                      sensor_msgs::PointCloud2& points)
+{
+  const sensor_msgs::Image& dimage = disparity.image;
+  cv::Mat_<float> dmat;
+  if (!dimage.data.empty())
+    dmat = cv::Mat_<float>(dimage.height, dimage.width, (float*)&dimage.data[0], dimage.step);
+  reprojectDense(dmat, Reprojection(model, 1.0, 0.0, disparity.min_disparity - principalOffset(model)),
+                 color, encoding, points);
 }
 
 } //namespace stereo_image_proc
@@ -0,0 +1,183 @@
+/*********************************************************************
+* Software License Agreement (BSD License)
+* 
+*  Copyright (c) 2008, Willow Garage, Inc.
+*  All rights reserved.
+* 
+*  Redistribution and use in source and binary forms, with or without
+*  modification, are permitted provided that the following conditions
+*  are met:
+* 
+*   * Redistributions of source code must retain the above copyright
+*     notice, this list of conditions and the following disclaimer.
+*   * Redistributions in binary form must reproduce the above
+*     copyright notice, this list of conditions and the following
+*     disclaimer in the documentation and/or other materials provided
+*     with the distribution.
+*   * Neither the name of the Willow Garage nor the names of its
+*     contributors may be used to endorse or promote products derived
+*     from this software without specific prior written permission.
+* 
+*  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+*  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+*  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+*  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+*  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+*  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+*  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+*  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+*  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+*  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+*  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+*  POSSIBILITY OF SUCH DAMAGE.
+*********************************************************************/
+#include <gtest/gtest.h>
+#include <sensor_msgs/image_encodings.h>
+#include <stereo_image_proc/processor.h>
+
+#include <cmath>
+#include <cstring>
+
+namespace enc = sensor_msgs::image_encodings;
+
+// A stereo pair 7 cm apart with the same principal points, so stored disparities need no adjusting
+static image_geometry::StereoCameraModel stereoModel()
+{
+  sensor_msgs::CameraInfo left, right;
+  left.width = right.width = 640;
+  left.height = right.height = 480;
+  const double fx = 500.0, fy = 510.0, cx = 320.0, cy = 240.0, baseline = 0.07;
+  const double P[12] = { fx, 0, cx, 0, 0, fy, cy, 0, 0, 0, 1, 0 };
+  for (int i = 0; i < 12; ++i)
+    left.P[i] = right.P[i] = P[i];
+  right.P[3] = -fx * baseline;
+  image_geometry::StereoCameraModel model;
+  model.fromCameraInfo(left, right);
+  return model;
+}
+
+static stereo_msgs::DisparityImage disparityImage(int rows, int cols, const float* values, float min_disparity)
+{
+  stereo_msgs::DisparityImage disparity;
+  disparity.min_disparity = min_disparity;
+  disparity.max_disparity = min_disparity + 64;
+  sensor_msgs::Image& image = disparity.image;
+  image.height = rows;
+  image.width = cols;
+  image.encoding = enc::TYPE_32FC1;
+  image.step = cols * sizeof(float);
+  image.data.resize(rows * image.step);
+  memcpy(&image.data[0], values, image.data.size());
+  return disparity;
+}
+
+static const float* point(const sensor_msgs::PointCloud2& points, int u, int v)
+{
+  return reinterpret_cast<const float*>(&points.data[v * points.row_step + u * points.point_step]);
+}
+
+static uint32_t rgb(const float* pt)
+{
+  uint32_t packed;
+  memcpy(&packed, &pt[3], sizeof(packed));
+  return packed;
+}
+
+// Each point is NaN below min_disparity or at infinity, and otherwise where the model puts it. Rows are
+// 7 wide so that both the four pixel and the remaining single pixel paths are taken.
+TEST(ReprojectPoints2, invalidDisparities)
+{
+  const image_geometry::StereoCameraModel model = stereoModel();
+  const float values[2 * 7] = { -5.0f, -4.0f, 0.0f, 1.0f, 2.5f, 8.0f, 16.0f,
+                                32.0f, -4.5f, 3.0f, 0.0f, -4.0f, 60.0f, -100.0f };
+  const stereo_msgs::DisparityImage disparity = disparityImage(2, 7, values, -4.0f);
+
+  sensor_msgs::PointCloud2 points;
+  stereo_image_proc::reprojectPoints2(disparity, cv::Mat(), enc::MONO16, model, points);
+  ASSERT_EQ(points.height, 2u);
+  ASSERT_EQ(points.width, 7u);
+  ASSERT_EQ(points.point_step, 16u);
+  EXPECT_FALSE(points.is_dense);
+
+  for (int v = 0; v < 2; ++v)
+  {
+    for (int u = 0; u < 7; ++u)
+    {
+      const float d = values[v * 7 + u];
+      const float* pt = point(points, u, v);
+      SCOPED_TRACE(testing::Message() << "u " << u << " v " << v << " d " << d);
+      if (d < disparity.min_disparity || d == 0.0f)
+      {
+        for (int i = 0; i < 4; ++i)
+          EXPECT_NE(pt[i], pt[i]);
+        continue;
+      }
+      cv::Point3d xyz;
+      model.projectDisparityTo3d(cv::Point2d(u, v), d, xyz);
+      EXPECT_NEAR(pt[0], xyz.x, 1e-4 * std::abs(xyz.z));
+      EXPECT_NEAR(pt[1], xyz.y, 1e-4 * std::abs(xyz.z));
+      EXPECT_NEAR(pt[2], xyz.z, 1e-4 * std::abs(xyz.z));
+      EXPECT_EQ(rgb(pt), 0u);
+    }
+  }
+}
+
+// The old rule dropped every pixel holding the image's smallest disparity, even when that was valid
+TEST(ReprojectPoints2, keepsSmallestValidDisparity)
+{
+  const image_geometry::StereoCameraModel model = stereoModel();
+  const float values[5] = { 3.0f, 5.0f, 3.0f, 9.0f, 3.0f };
+  const stereo_msgs::DisparityImage disparity = disparityImage(1, 5, values, 1.0f);
+
+  sensor_msgs::PointCloud2 points;
+  stereo_image_proc::reprojectPoints2(disparity, cv::Mat(), enc::MONO16, model, points);
+  for (int u = 0; u < 5; ++u)
+  {
+    const float* pt = point(points, u, 0);
+    EXPECT_EQ(pt[2], pt[2]) << "u " << u;
+    EXPECT_NEAR(pt[2], model.getZ(values[u]), 1e-4 * model.getZ(values[u])) << "u " << u;
+  }
+}
+
+// Only mono8, rgb8 and bgr8 images of the disparities' size color the points
+TEST(ReprojectPoints2, colorsFromMatchingImagesOnly)
+{
+  const image_geometry::StereoCameraModel model = stereoModel();
+  const float values[6] = { 4.0f, 4.0f, 4.0f, 4.0f, 4.0f, -1.0f };
+  const stereo_msgs::DisparityImage disparity = disparityImage(1, 6, values, 0.0f);
+
+  cv::Mat bgr(1, 6, CV_8UC3);
+  for (int u = 0; u < 6; ++u)
+    bgr.at<cv::Vec3b>(0, u) = cv::Vec3b(u, 0x10 + u, 0x20 + u);
+
+  sensor_msgs::PointCloud2 points;
+  stereo_image_proc::reprojectPoints2(disparity, bgr, enc::BGR8, model, points);
+  for (int u = 0; u < 5; ++u)
+    EXPECT_EQ(rgb(point(points, u, 0)), (uint32_t)((0x20 + u) << 16 | (0x10 + u) << 8 | u));
+  EXPECT_NE(point(points, 5, 0)[3], point(points, 5, 0)[3]);
+
+  stereo_image_proc::reprojectPoints2(disparity, bgr, enc::RGB8, model, points);
+  EXPECT_EQ(rgb(point(points, 2, 0)), (uint32_t)(2 << 16 | 0x12 << 8 | 0x22));
+
+  // An rgb8 image without data, or too small, leaves the points uncolored
+  stereo_image_proc::reprojectPoints2(disparity, cv::Mat(), enc::RGB8, model, points);
+  EXPECT_EQ(rgb(point(points, 2, 0)), 0u);
+  stereo_image_proc::reprojectPoints2(disparity, bgr.colRange(0, 3), enc::BGR8, model, points);
+  EXPECT_EQ(rgb(point(points, 2, 0)), 0u);
+  EXPECT_EQ(point(points, 2, 0)[2], point(points, 2, 0)[2]);
+}
+
+TEST(ReprojectPoints2, emptyDisparity)
+{
+  stereo_msgs::DisparityImage disparity;
+  sensor_msgs::PointCloud2 points;
+  stereo_image_proc::reprojectPoints2(disparity, cv::Mat(), enc::BGR8, stereoModel(), points);
+  EXPECT_EQ(points.width * points.height, 0u);
+  EXPECT_TRUE(points.data.empty());
+}
+
+int main(int argc, char** argv)
+{
+  testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
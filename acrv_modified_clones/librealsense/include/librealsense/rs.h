@@ -1072,6 +1072,46 @@ void rs_log_to_callback_cpp(rs_log_severity min_severity, rs_log_callback * call
 */
 void rs_log_to_callback(rs_log_severity min_severity, rs_log_callback_ptr on_log, void * user, rs_error ** error);
 
+/**
+* \brief Starts recording per-frame latency traces, discarding any spans recorded before. Each thread keeps only its most recent spans.
+*        Tracing is also started by setting the RS_TRACE_FILE environment variable, and the trace is then written there when the context is destroyed
+* \param[in] records_per_thread Number of spans kept for each thread, rounded up to a power of two
+* \param[out] error  If non-null, receives any error that occurs during this call, otherwise, errors are ignored.
+*/
+void rs_start_tracing(int records_per_thread, rs_error ** error);
+
+/**
+* \brief Stops recording latency traces. Spans recorded so far can still be written with rs_write_trace
+* \param[in] write_path If non-null, the trace is written to this file as with rs_write_trace
+* \param[out] error  If non-null, receives any error that occurs during this call, otherwise, errors are ignored.
+*/
+void rs_stop_tracing(const char * write_path, rs_error ** error);
+
+/**
+* \brief Retrieves the current time on the trace clock, the monotonic clock shared by all processes on the machine
+* \param[out] error  If non-null, receives any error that occurs during this call, otherwise, errors are ignored.
+* \return            Time in microseconds
+*/
+double rs_get_trace_time(rs_error ** error);
+
+/**
+* \brief Records an application span in the trace, e.g. processing or publishing a frame. Nothing is recorded unless tracing was started
+* \param[in] name          Name of the span, truncated to 31 characters
+* \param[in] stream        Stream of the frame the span handled, or RS_STREAM_COUNT for spans not tied to a frame
+* \param[in] frame_number  Number of that frame, as from rs_get_frame_number. Spans with the same stream and frame number, including those recorded by the library, are linked in the trace
+* \param[in] begin_time    Start of the span, from rs_get_trace_time
+* \param[in] end_time      End of the span, from rs_get_trace_time
+* \param[out] error  If non-null, receives any error that occurs during this call, otherwise, errors are ignored.
+*/
+void rs_trace_event(const char * name, rs_stream stream, unsigned long long frame_number, double begin_time, double end_time, rs_error ** error);
+
+/**
+* \brief Writes the recorded spans as Chrome trace event JSON, viewable in chrome://tracing or Perfetto. Traces of several processes can be merged by concatenating their traceEvents arrays
+* \param[in] file_path File to write, overwritten if it exists
+* \param[out] error  If non-null, receives any error that occurs during this call, otherwise, errors are ignored.
+*/
+void rs_write_trace(const char * file_path, rs_error ** error);
+
 #ifdef __cplusplus
 }
 #endif
@@ -1129,6 +1129,64 @@ namespace rs
         error::handle(e);
     }
 
+    inline void start_tracing(int records_per_thread = 16384)
+    {
+        rs_error * e = nullptr;
+        rs_start_tracing(records_per_thread, &e);
+        error::handle(e);
+    }
+
+    inline void stop_tracing(const char * write_path = nullptr)
+    {
+        rs_error * e = nullptr;
+        rs_stop_tracing(write_path, &e);
+        error::handle(e);
+    }
+
+    inline double get_trace_time()
+    {
+        rs_error * e = nullptr;
+        auto r = rs_get_trace_time(&e);
+        error::handle(e);
+        return r;
+    }
+
+    inline void trace_event(const char * name, stream s, unsigned long long frame_number, double begin_time, double end_time)
+    {
+        rs_error * e = nullptr;
+        rs_trace_event(name, (rs_stream)s, frame_number, begin_time, end_time, &e);
+        error::handle(e);
+    }
+
+    inline void trace_event(const char * name, double begin_time, double end_time)
+    {
+        rs_error * e = nullptr;
+        rs_trace_event(name, RS_STREAM_COUNT, 0, begin_time, end_time, &e);
+        error::handle(e);
+    }
+
+    inline void write_trace(const char * file_path)
+    {
+        rs_error * e = nullptr;
+        rs_write_trace(file_path, &e);
+        error::handle(e);
+    }
+
+    // Records a trace span from construction to destruction
+    class trace_scope
+    {
+        const char * name;
+        rs_stream stream;
+        unsigned long long frame_number;
+        double begin_time;
+        trace_scope(const trace_scope &) = delete;
+        trace_scope & operator = (const trace_scope &) = delete;
+    public:
+        trace_scope(const char * name) : name(name), stream(RS_STREAM_COUNT), frame_number(0), begin_time(get_trace_time()) {}
+        trace_scope(const char * name, rs::stream s, unsigned long long frame_number) : name(name), stream((rs_stream)s), frame_number(frame_number), begin_time(get_trace_time()) {}
+        ~trace_scope() { rs_trace_event(name, stream, frame_number, begin_time, rs_get_trace_time(nullptr), nullptr); }
+    };
+
     // Additional utilities
     inline void apply_depth_control_preset(device * device, int preset) { rs_apply_depth_control_preset((rs_device *)device, preset); }
     inline void apply_ivcam_preset(device * device, rs_ivcam_preset preset) { rs_apply_ivcam_preset((rs_device *)device, preset); }
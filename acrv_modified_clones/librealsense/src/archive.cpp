@@ -1,11 +1,135 @@
 
 #include "archive.h"
 #include <algorithm>
+#include <cstdlib>
+
+#ifdef _WIN32
+#include <malloc.h>     // For _aligned_malloc
+#else
+#include <sys/mman.h>   // For madvise
+#endif
 
 using namespace rsimpl;
 
+namespace
+{
+    const size_t page_size = 4096;
+    const size_t huge_page_size = 2 * 1024 * 1024;
+
+    size_t round_up(size_t size, size_t alignment) { return (size + alignment - 1) / alignment * alignment; }
+
+    byte * allocate_aligned(size_t size, size_t alignment)
+    {
+#ifdef _WIN32
+        return static_cast<byte *>(_aligned_malloc(size, alignment));
+#else
+        void * memory = nullptr;
+        return posix_memalign(&memory, alignment, size) == 0 ? static_cast<byte *>(memory) : nullptr;
+#endif
+    }
+
+    void free_aligned(byte * memory)
+    {
+#ifdef _WIN32
+        _aligned_free(memory);
+#else
+        free(memory);
+#endif
+    }
+
+    // Frames the archive itself may hold per stream on top of the ones published to the user: the backbuffer,
+    // the frontbuffer, and the syncronizing_archive queue and backlog
+    const uint32_t archive_frames_per_stream = 10;
+}
+
+frame_buffer_pool::frame_buffer_pool(size_t buffer_size, uint32_t capacity)
+    : buffer_size(buffer_size), stride(round_up(buffer_size, page_size)), capacity(capacity), region(nullptr), free_buffers(capacity),
+      acquired(0), exhausted(0), in_use(0), peak_in_use(0)
+{
+    const bool huge_pages = stride >= huge_page_size;
+    const size_t alignment = huge_pages ? huge_page_size : page_size;
+    const size_t region_size = round_up(stride * capacity, alignment);
+    region = allocate_aligned(region_size, alignment);
+    if (!region) throw std::runtime_error(to_string() << "failed to allocate " << region_size << " bytes of frame buffers");
+#if defined(__linux__) && defined(MADV_HUGEPAGE)
+    if (huge_pages) madvise(region, region_size, MADV_HUGEPAGE); // Only a hint, ignore failure on kernels without transparent huge pages
+#endif
+}
+
+frame_buffer_pool::~frame_buffer_pool()
+{
+    free_aligned(region);
+}
+
+byte * frame_buffer_pool::acquire()
+{
+    uint32_t index;
+    if (!free_buffers.pop(index))
+    {
+        ++exhausted;
+        return nullptr;
+    }
+    ++acquired;
+    auto used = ++in_use, peak = peak_in_use.load();
+    while (used > peak && !peak_in_use.compare_exchange_weak(peak, used));
+    return region + index * stride;
+}
+
+void frame_buffer_pool::release(byte * buffer)
+{
+    --in_use;
+    free_buffers.push(uint32_t((buffer - region) / stride));
+}
+
+frame_buffer_pool::stats frame_buffer_pool::get_stats() const
+{
+    return { capacity, buffer_size, acquired.load(), exhausted.load(), in_use.load(), peak_in_use.load() };
+}
+
+frame_buffer::frame_buffer(std::shared_ptr<frame_buffer_pool> from_pool, size_t size) : buffer(nullptr), length(size)
+{
+    if (from_pool && size <= from_pool->get_buffer_size()) buffer = from_pool->acquire();
+    if (buffer)
+    {
+        pool = std::move(from_pool);
+        return;
+    }
+    buffer = allocate_aligned(round_up(size, page_size), page_size);
+    if (!buffer) throw std::bad_alloc();
+}
+
+frame_buffer & frame_buffer::operator=(frame_buffer && other)
+{
+    if (this != &other)
+    {
+        reset();
+        pool = std::move(other.pool);
+        buffer = other.buffer;
+        length = other.length;
+        other.buffer = nullptr;
+        other.length = 0;
+    }
+    return *this;
+}
+
+void frame_buffer::reset()
+{
+    if (buffer)
+    {
+        if (pool) pool->release(buffer);
+        else free_aligned(buffer);
+    }
+    pool.reset();
+    buffer = nullptr;
+    length = 0;
+}
+
 frame_archive::frame_archive(const std::vector<subdevice_mode_selection>& selection, std::atomic<uint32_t>* in_max_frame_queue_size, std::chrono::high_resolution_clock::time_point capture_started)
-    : max_frame_queue_size(in_max_frame_queue_size), mutex(), capture_started(capture_started)
+    : max_frame_queue_size(in_max_frame_queue_size),
+      published_frames(std::max<int>(*in_max_frame_queue_size, RS_USER_QUEUE_SIZE) * RS_STREAM_COUNT),
+      published_sets(std::max<int>(*in_max_frame_queue_size, RS_USER_QUEUE_SIZE) * RS_STREAM_COUNT),
+      detached_refs(std::max<int>(*in_max_frame_queue_size, RS_USER_QUEUE_SIZE) * RS_STREAM_COUNT),
+      mutex(), capture_started(capture_started)
 {
     // Store the mode selection that pertains to each native stream
     for (auto & mode : selection)
@@ -19,9 +143,18 @@ frame_archive::frame_archive(const std::vector<subdevice_mode_selection>& select
     for(auto s : {RS_STREAM_DEPTH, RS_STREAM_INFRARED, RS_STREAM_INFRARED2, RS_STREAM_COLOR, RS_STREAM_FISHEYE})
     {
         published_frames_per_stream[s] = 0;
+
+        // Size each stream's pool for every frame the user may hold plus the ones in flight inside the archive, so that
+        // capture never has to allocate. Pages are only touched as buffers are first used, and reuse is last in first out
+        if (is_stream_enabled(s)) buffer_pools[s] = std::make_shared<frame_buffer_pool>(modes[s].get_image_size(s), *max_frame_queue_size + archive_frames_per_stream);
     }
 }
 
+frame_buffer_pool::stats frame_archive::get_buffer_pool_stats(rs_stream stream) const
+{
+    return buffer_pools[stream] ? buffer_pools[stream]->get_stats() : frame_buffer_pool::stats();
+}
+
 frame_archive::frameset* frame_archive::clone_frameset(frameset* frameset)
 {
     auto new_set = published_sets.allocate();
@@ -37,14 +170,11 @@ void frame_archive::unpublish_frame(frame* frame)
     if (frame)
     {
         log_frame_callback_end(frame);
-        std::lock_guard<std::recursive_mutex> lock(mutex);
 
         if (is_valid(frame->get_stream_type()))
             --published_frames_per_stream[frame->get_stream_type()];
 
-        freelist.push_back(std::move(*frame));
-        published_frames.deallocate(frame);
-       
+        published_frames.deallocate(frame); // Resetting the slot returns the frame's buffer to its pool
     }
 }
 
@@ -84,38 +214,16 @@ frame_archive::frame_ref* frame_archive::clone_frame(frame_ref* frameset)
     return new_ref;
 }
 
-// Allocate a new frame in the backbuffer, potentially recycling a buffer from the freelist
+// Allocate a new frame in the backbuffer, taking its buffer from the stream's pool
 byte * frame_archive::alloc_frame(rs_stream stream, const frame_additional_data& additional_data, bool requires_memory)
 {
-    const size_t size = modes[stream].get_image_size(stream);
+    if (requires_memory)
     {
-        std::lock_guard<std::recursive_mutex> guard(mutex);
-
-        if (requires_memory)
-        {
-            // Attempt to obtain a buffer of the appropriate size from the freelist
-            for (auto it = begin(freelist); it != end(freelist); ++it)
-            {
-                if (it->data.size() == size)
-                {
-                    backbuffer[stream] = std::move(*it);
-                    freelist.erase(it);
-                    break;
-                }
-            }
-        }
-
-        // Discard buffers that have been in the freelist for longer than 1s
-        for (auto it = begin(freelist); it != end(freelist);)
-        {
-            if (additional_data.timestamp > it->additional_data.timestamp + 1000) it = freelist.erase(it);
-            else ++it;
-        }
+        backbuffer[stream].data = frame_buffer(buffer_pools[stream], modes[stream].get_image_size(stream));
     }
-    
-    if (requires_memory)
+    else
     {
-        backbuffer[stream].data.resize(size); // TODO: Allow users to provide a custom allocator for frame buffers
+        backbuffer[stream].data.reset(); // The frame will point into the driver's buffer through its continuation
     }
     backbuffer[stream].update_owner(this);
     backbuffer[stream].additional_data = additional_data;
@@ -143,6 +251,14 @@ frame_archive::frame_ref* frame_archive::track_frame(rs_stream stream)
 
 void frame_archive::flush()
 {
+    for (int s = 0; s < RS_STREAM_NATIVE_COUNT; ++s)
+    {
+        if (!buffer_pools[s]) continue;
+        auto stats = buffer_pools[s]->get_stats();
+        LOG_INFO("Frame pool of " << rsimpl::get_string((rs_stream)s) << ": " << stats.capacity << " x " << stats.buffer_size << " bytes, peak " << stats.peak_in_use
+                 << " in use, " << stats.acquired << " allocations, " << stats.exhausted << " fell back to the heap");
+    }
+
     published_frames.stop_allocation();
     published_sets.stop_allocation();
     detached_refs.stop_allocation();
@@ -314,13 +430,21 @@ const byte* frame_archive::frame::get_frame_data() const
     return frame_data;
 }
 
+// A frame published before its timestamp event arrived reports the event timestamp as soon as it is there. Its own timestamp is left
+// alone as other threads may be reading the frame, the syncronizing archive writes it once the frame is back on the application thread
 rs_timestamp_domain frame_archive::frame::get_frame_timestamp_domain() const
 {
+    double timestamp;
+    if (additional_data.pending_correction && additional_data.pending_correction->find_timestamp(additional_data.stream_type, additional_data.frame_number, timestamp))
+        return RS_TIMESTAMP_DOMAIN_MICROCONTROLLER;
     return additional_data.timestamp_domain;
 }
 
 double frame_archive::frame::get_frame_timestamp() const
 {
+    double timestamp;
+    if (additional_data.pending_correction && additional_data.pending_correction->find_timestamp(additional_data.stream_type, additional_data.frame_number, timestamp))
+        return timestamp;
     return additional_data.timestamp;
 }
 
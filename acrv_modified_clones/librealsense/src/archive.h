@@ -11,6 +11,64 @@
 
 namespace rsimpl
 {
+    // A fixed number of page aligned buffers of one size, allocated once when streaming starts and handed out and returned in O(1)
+    // without locks. Buffers of 2MB or more are backed by transparent huge pages where the platform supports it.
+    class frame_buffer_pool
+    {
+    public:
+        struct stats
+        {
+            uint32_t capacity;
+            size_t buffer_size;
+            unsigned long long acquired;  // Buffers handed out by the pool
+            unsigned long long exhausted; // Allocations the pool could not serve, which fell back to the heap
+            uint32_t in_use;
+            uint32_t peak_in_use;
+        };
+
+        frame_buffer_pool(size_t buffer_size, uint32_t capacity);
+        ~frame_buffer_pool();
+        frame_buffer_pool(const frame_buffer_pool &) = delete;
+        frame_buffer_pool & operator=(const frame_buffer_pool &) = delete;
+
+        byte * acquire(); // Returns nullptr and counts an exhaustion if every buffer is in use
+        void release(byte * buffer);
+        bool owns(const byte * buffer) const { return buffer >= region && buffer < region + stride * capacity; }
+        size_t get_buffer_size() const { return buffer_size; }
+        stats get_stats() const;
+
+    private:
+        size_t buffer_size, stride;
+        uint32_t capacity;
+        byte * region;
+        index_stack free_buffers;
+        std::atomic<unsigned long long> acquired, exhausted;
+        std::atomic<uint32_t> in_use, peak_in_use;
+    };
+
+    // Storage for the pixels of one frame, taken from a frame_buffer_pool or from the heap when the pool has run dry.
+    // Movable but not copyable, the buffer goes back where it came from when the frame_buffer is reset or destroyed.
+    class frame_buffer
+    {
+        std::shared_ptr<frame_buffer_pool> pool;
+        byte * buffer;
+        size_t length;
+
+    public:
+        frame_buffer() : buffer(nullptr), length(0) {}
+        frame_buffer(std::shared_ptr<frame_buffer_pool> pool, size_t size);
+        frame_buffer(frame_buffer && other) : pool(std::move(other.pool)), buffer(other.buffer), length(other.length) { other.buffer = nullptr; other.length = 0; }
+        frame_buffer & operator=(frame_buffer && other);
+        frame_buffer(const frame_buffer &) = delete;
+        frame_buffer & operator=(const frame_buffer &) = delete;
+        ~frame_buffer() { reset(); }
+
+        byte * data() { return buffer; }
+        const byte * data() const { return buffer; }
+        size_t size() const { return length; }
+        void reset();
+    };
+
     // Defines general frames storage model
     class frame_archive
     {
@@ -31,9 +89,11 @@ namespace rsimpl
             rs_format format = RS_FORMAT_ANY;
             rs_stream stream_type = RS_STREAM_COUNT;
             rs_timestamp_domain timestamp_domain = RS_TIMESTAMP_DOMAIN_CAMERA;
+            const timestamp_corrector * pending_correction = nullptr; // Set while the timestamp event of the frame has not arrived
             int pad = 0;
             std::shared_ptr<std::vector<rs_frame_metadata>> supported_metadata_vector;
             std::chrono::high_resolution_clock::time_point frame_callback_started {};
+            std::chrono::high_resolution_clock::time_point frame_committed {};
 
             frame_additional_data(){};
 
@@ -68,7 +128,7 @@ namespace rsimpl
             frame_continuation on_release;
 
         public:
-            std::vector<byte> data;
+            frame_buffer data;
             frame_additional_data additional_data;
 
             explicit frame() : ref_count(0), owner(nullptr), on_release(){}
@@ -83,7 +143,7 @@ namespace rsimpl
             frame & operator=(const frame & r) = delete;
             frame& operator=(frame&& r)
             {
-                data = move(r.data);
+                data = std::move(r.data);
                 owner = r.owner;
                 ref_count = r.ref_count.exchange(0);
                 on_release = std::move(r.on_release);
@@ -119,6 +179,8 @@ namespace rsimpl
             void update_owner(frame_archive * new_owner) { owner = new_owner; }
             void attach_continuation(frame_continuation&& continuation) { on_release = std::move(continuation); }
             void disable_continuation() { on_release.reset(); }
+            // Give back everything a dropped frame holds: the driver buffer it borrowed and its own buffer
+            void recycle() { on_release(); data.reset(); }
         };
 
         class frame_ref : public rs_frame_ref // esentially an intrusive shared_ptr<frame>
@@ -214,14 +276,14 @@ namespace rsimpl
         
         std::atomic<uint32_t>* max_frame_queue_size;
         std::atomic<uint32_t> published_frames_per_stream[RS_STREAM_COUNT];
-        small_heap<frame, RS_USER_QUEUE_SIZE*RS_STREAM_COUNT> published_frames;
-        small_heap<frameset, RS_USER_QUEUE_SIZE*RS_STREAM_COUNT> published_sets;
-        small_heap<frame_ref, RS_USER_QUEUE_SIZE*RS_STREAM_COUNT> detached_refs;
+        std::shared_ptr<frame_buffer_pool> buffer_pools[RS_STREAM_NATIVE_COUNT];
+        small_heap<frame> published_frames;
+        small_heap<frameset> published_sets;
+        small_heap<frame_ref> detached_refs;
         
 
     protected:
         frame backbuffer[RS_STREAM_NATIVE_COUNT]; // receive frame here
-        std::vector<frame> freelist; // return frames here
         std::recursive_mutex mutex;
         std::chrono::high_resolution_clock::time_point capture_started;
 
@@ -230,6 +292,7 @@ namespace rsimpl
 
         // Safe to call from any thread
         bool is_stream_enabled(rs_stream stream) const { return modes[stream].mode.pf.fourcc != 0; }
+        frame_buffer_pool::stats get_buffer_pool_stats(rs_stream stream) const;
         const subdevice_mode_selection & get_mode(rs_stream stream) const { return modes[stream]; }
         
         void release_frameset(frameset * frameset)
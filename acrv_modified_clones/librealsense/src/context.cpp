@@ -10,7 +10,9 @@
 #include "f200.h"
 #include "sr300.h"
 #include "zr300.h"
+#include "synthetic.h"
 #include "uvc.h"
+#include "trace.h"
 #include "context.h"
 
 
@@ -54,6 +56,7 @@ bool is_compatible(std::shared_ptr<rs_device> device)
 
 rs_context_base::rs_context_base()
 {
+    rsimpl::trace::start_from_environment();
     context = rsimpl::uvc::create_context();
 
     for(auto device : query_devices(context))
@@ -72,6 +75,7 @@ rs_context_base::rs_context_base()
             case ZR300_PRODUCT_ID: rs_dev = rsimpl::make_zr300_device(device); break;
             case F200_PRODUCT_ID:  rs_dev = rsimpl::make_f200_device(device); break;
             case SR300_PRODUCT_ID: rs_dev = rsimpl::make_sr300_device(device); break;
+            case SYNTHETIC_PRODUCT_ID: rs_dev = rsimpl::make_synthetic_device(device); break;
         }
 
         if (rs_dev && is_compatible(rs_dev))
@@ -87,6 +91,7 @@ rs_context_base::rs_context_base()
 
 rs_context_base::rs_context_base(const std::string &serial_number)
 {
+    rsimpl::trace::start_from_environment();
     context = rsimpl::uvc::create_context();
 
     for(auto device : query_devices(context))
@@ -162,6 +167,7 @@ void rs_context_base::release_instance()
 rs_context_base::~rs_context_base()
 {
     assert(ref_count == 0);
+    rsimpl::trace::write_to_environment_file();
 }
 
 size_t rs_context_base::get_device_count() const
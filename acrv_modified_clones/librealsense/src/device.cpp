@@ -6,22 +6,39 @@
 #include "motion-module.h"
 #include "hw-monitor.h"
 #include "image.h"
+#include "trace.h"
 
 #include <array>
 #include <algorithm>
 #include <sstream>
 #include <iostream>
 #include <functional>
+#include <cstdlib> // For getenv
 
 using namespace rsimpl;
 using namespace rsimpl::motion_module;
 
 const int NUMBER_OF_FRAMES_TO_SAMPLE = 5;
 
+// Frame buffers each subdevice keeps queued with the driver. RS_CAPTURE_BUFFERS overrides the camera's default, e.g. to ride out
+// longer stalls of the consumer at the cost of latency and memory. The driver may still grant a different number.
+static int get_capture_buffer_count(int default_count)
+{
+    auto value = std::getenv("RS_CAPTURE_BUFFERS");
+    if(!value) return default_count;
+    const int count = std::atoi(value);
+    if(count < 2)
+    {
+        LOG_WARNING("Ignoring RS_CAPTURE_BUFFERS=" << value << ", at least 2 buffers are needed. Using " << default_count);
+        return default_count;
+    }
+    return count;
+}
+
 rs_device_base::rs_device_base(std::shared_ptr<rsimpl::uvc::device> device, const rsimpl::static_device_info & info, calibration_validator validator) : device(device), config(info),
     depth(config, RS_STREAM_DEPTH, validator), color(config, RS_STREAM_COLOR, validator), infrared(config, RS_STREAM_INFRARED, validator), infrared2(config, RS_STREAM_INFRARED2, validator), fisheye(config, RS_STREAM_FISHEYE, validator),
     points(depth), rect_color(color), color_to_depth(color, depth), depth_to_color(depth, color), depth_to_rect_color(depth, rect_color), infrared2_to_depth(infrared2,depth), depth_to_infrared2(depth,infrared2),
-    capturing(false), data_acquisition_active(false), max_publish_list_size(RS_USER_QUEUE_SIZE), event_queue_size(RS_MAX_EVENT_QUEUE_SIZE), events_timeout(RS_MAX_EVENT_TIME_OUT),
+    capturing(false), data_acquisition_active(false), max_publish_list_size(RS_USER_QUEUE_SIZE),
     usb_port_id(""), motion_module_ready(false), keep_fw_logger_alive(false), frames_drops_counter(0)
 {
     streams[RS_STREAM_DEPTH    ] = native_streams[RS_STREAM_DEPTH]     = &depth;
@@ -329,7 +346,7 @@ void rs_device_base::start_video_streaming()
 
     auto capture_start_time = std::chrono::high_resolution_clock::now();
     auto selected_modes = config.select_modes();
-    auto archive = std::make_shared<syncronizing_archive>(selected_modes, select_key_stream(selected_modes), &max_publish_list_size, &event_queue_size, &events_timeout, capture_start_time);
+    auto archive = std::make_shared<syncronizing_archive>(selected_modes, select_key_stream(selected_modes), &max_publish_list_size, capture_start_time);
 
     for(auto & s : native_streams) s->archive.reset(); // Starting capture invalidates the current stream info, if any exists from previous capture
 
@@ -364,6 +381,7 @@ void rs_device_base::start_video_streaming()
         set_subdevice_mode(*device, mode_selection.mode.subdevice, mode_selection.mode.native_dims.x, mode_selection.mode.native_dims.y, mode_selection.mode.pf.fourcc, mode_selection.mode.fps, 
             [this, mode_selection, archive, timestamp_reader, streams, capture_start_time, frame_drops_status, actual_fps_calc, supported_metadata_vector](const void * frame, std::function<void()> continuation) mutable
         {
+            trace::scope capture_span("capture", streams[0]);
             auto now = std::chrono::system_clock::now();
             auto sys_time = std::chrono::duration_cast<std::chrono::milliseconds>(now.time_since_epoch()).count();
 
@@ -378,6 +396,7 @@ void rs_device_base::start_video_streaming()
             auto timestamp = timestamp_reader->get_frame_timestamp(mode_selection.mode, frame, actual_fps);
             auto frame_counter = timestamp_reader->get_frame_counter(mode_selection.mode, frame);
             auto recieved_time = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::high_resolution_clock::now() - capture_start_time).count();
+            capture_span.set_frame_number(frame_counter);
 
             auto requires_processing = mode_selection.requires_processing();
 
@@ -449,6 +468,7 @@ void rs_device_base::start_video_streaming()
             // Unpack the frame
             if (requires_processing)
             {
+                trace::scope unpack_span("unpack", streams[0], frame_counter);
                 mode_selection.unpack(dest.data(), reinterpret_cast<const byte *>(frame));
             }
 
@@ -468,6 +488,7 @@ void rs_device_base::start_video_streaming()
                         frame_ref->update_frame_callback_start_ts(std::chrono::high_resolution_clock::now());
                         frame_ref->log_callback_start(capture_start_time);
                         on_before_callback(streams[i], frame_ref, archive);
+                        trace::scope callback_span("frame callback", streams[i], frame_counter);
                         (*config.callbacks[streams[i]])->on_frame(this, frame_ref);
                     }
                 }
@@ -482,6 +503,7 @@ void rs_device_base::start_video_streaming()
     
     this->archive = archive;
     on_before_start(selected_modes);
+    set_capture_buffer_count(*device, get_capture_buffer_count(config.info.num_capture_buffers));
     start_streaming(*device, config.info.num_libuvc_transfer_buffers);
     capture_started = std::chrono::high_resolution_clock::now();
     capturing = true;
@@ -524,7 +546,7 @@ rs_frame_ref* ::rs_device_base::clone_frame(rs_frame_ref* frame)
 
 void rs_device_base::update_device_info(rsimpl::static_device_info& info)
 {
-    info.options.push_back({ RS_OPTION_FRAMES_QUEUE_SIZE,     1, RS_USER_QUEUE_SIZE,      1, RS_USER_QUEUE_SIZE });
+    info.options.push_back({ RS_OPTION_FRAMES_QUEUE_SIZE,     1, RS_MAX_USER_QUEUE_SIZE,  1, RS_USER_QUEUE_SIZE });
 }
 
 const char * rs_device_base::get_option_description(rs_option option) const
@@ -591,7 +613,7 @@ const char * rs_device_base::get_option_description(rs_option option) const
     case RS_OPTION_FISHEYE_GAIN                                    : return "Fisheye image gain";
     case RS_OPTION_FISHEYE_STROBE                                  : return "Enables / disables fisheye strobe. When enabled this will align timestamps to common clock-domain with the motion events";
     case RS_OPTION_FISHEYE_EXTERNAL_TRIGGER                        : return "Enables / disables fisheye external trigger mode. When enabled fisheye image will be acquired in-sync with the depth image";
-    case RS_OPTION_FRAMES_QUEUE_SIZE                               : return "Number of frames the user is allowed to keep per stream. Trying to hold-on to more frames will cause frame-drops.";
+    case RS_OPTION_FRAMES_QUEUE_SIZE                               : return "Number of frames the user is allowed to keep per stream. Trying to hold-on to more frames will cause frame-drops. Frame buffers are preallocated for this many frames when streaming starts.";
     case RS_OPTION_FISHEYE_ENABLE_AUTO_EXPOSURE                    : return "Enable / disable fisheye auto-exposure";
     case RS_OPTION_FISHEYE_AUTO_EXPOSURE_MODE                      : return "0 - static auto-exposure, 1 - anti-flicker auto-exposure, 2 - hybrid";
     case RS_OPTION_FISHEYE_AUTO_EXPOSURE_ANTIFLICKER_RATE          : return "Fisheye auto-exposure anti-flicker rate, can be 50 or 60 Hz";
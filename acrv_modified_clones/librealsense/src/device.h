@@ -89,8 +89,6 @@ private:
     bool                                        data_acquisition_active;
     std::chrono::high_resolution_clock::time_point capture_started;
     std::atomic<uint32_t>                       max_publish_list_size;
-    std::atomic<uint32_t>                       event_queue_size;
-    std::atomic<uint32_t>                       events_timeout;
     std::shared_ptr<rsimpl::syncronizing_archive> archive;
 
     mutable std::string                         usb_port_id;
@@ -6,11 +6,38 @@
 
 #include <cstring> // For memcpy
 #include <cmath>
+#include <cstdio>  // For rename, remove
+#include <fstream>
 #include <algorithm>
+#include <limits>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <thread>
+
+#ifdef _WIN32
+#include <process.h>
+#define getpid _getpid
+#else
+#include <unistd.h>
+#endif
+
 #ifdef __SSSE3__
 #include <tmmintrin.h> // For SSE3 intrinsic used in unpack_yuy2_sse
 #endif
 
+// On x86 with GCC or Clang the AVX2 unpackers are built for the AVX2 target regardless of the compiler flags, and are only called
+// once the CPU has been checked for support, so the library keeps running on older CPUs
+#if (defined(__GNUC__) || defined(__clang__)) && (defined(__x86_64__) || defined(__i386__))
+#define RS_RUNTIME_AVX2
+#define RS_TARGET_AVX2 __attribute__((target("avx2")))
+#endif
+#if defined(__AVX2__) || defined(RS_RUNTIME_AVX2)
+#include <immintrin.h> // For AVX2 intrinsics used in deproject_row and the AVX2 unpackers
+#endif
+
 #pragma pack(push, 1) // All structs in this file are assumed to be byte-packed
 namespace rsimpl
 {
@@ -46,6 +73,219 @@ namespace rsimpl
         default: assert(false); return 0;
         }
     }
+    //////////////////////////
+    // Runtime CPU dispatch //
+    //////////////////////////
+
+    bool is_avx2_supported()
+    {
+#ifdef RS_RUNTIME_AVX2
+        static const bool supported = __builtin_cpu_supports("avx2");
+        return supported;
+#else
+        return false;
+#endif
+    }
+
+    static std::atomic<bool> & avx2_unpacking()
+    {
+        static std::atomic<bool> enabled(is_avx2_supported());
+        return enabled;
+    }
+
+    void set_avx2_unpacking(bool enable)
+    {
+        avx2_unpacking() = enable && is_avx2_supported();
+    }
+
+    static std::atomic<bool> & avx2_deprojection()
+    {
+        static std::atomic<bool> enabled(is_avx2_supported());
+        return enabled;
+    }
+
+    void set_avx2_deprojection(bool enable)
+    {
+        avx2_deprojection() = enable && is_avx2_supported();
+    }
+
+#ifdef RS_RUNTIME_AVX2
+    /////////////////////////////
+    // AVX2 unpacking routines //
+    /////////////////////////////
+
+    // Each routine unpacks as many whole blocks of pixels as it can and returns how many pixels it unpacked, leaving the rest to the
+    // SSSE3/generic routine. Byte shuffles in AVX2 stay within each 128-bit lane, so the YUY2 and INZI routines run the SSSE3 algorithm
+    // on two blocks at once, one per lane, and write each lane back to its own block.
+
+    RS_TARGET_AVX2 static inline __m256i both_lanes(__m128i x) { return _mm256_broadcastsi128_si256(x); }
+
+    RS_TARGET_AVX2 static inline __m256i load_lanes(const byte * lo, const byte * hi)
+    {
+        return _mm256_inserti128_si256(_mm256_castsi128_si256(_mm_loadu_si128(reinterpret_cast<const __m128i *>(lo))), _mm_loadu_si128(reinterpret_cast<const __m128i *>(hi)), 1);
+    }
+
+    RS_TARGET_AVX2 static inline void store_lanes(byte *& lo, byte *& hi, __m256i x)
+    {
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(lo), _mm256_castsi256_si128(x));
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(hi), _mm256_extracti128_si256(x, 1));
+        lo += 16;
+        hi += 16;
+    }
+
+    // Computes 8 R, G, B values per lane from 16-bit Y, U and V, exactly as in the SSSE3 path of unpack_yuy2
+    RS_TARGET_AVX2 static inline void yuv16_to_rgb16(__m256i y16, __m256i u16, __m256i v16, __m256i & r16, __m256i & g16, __m256i & b16)
+    {
+        const __m256i zero = _mm256_setzero_si256(), max = _mm256_set1_epi16(255);
+        const __m256i n100 = _mm256_set1_epi16(100 << 4), n208 = _mm256_set1_epi16(208 << 4), n298 = _mm256_set1_epi16(298 << 4), n409 = _mm256_set1_epi16(409 << 4), n516 = _mm256_set1_epi16(516 << 4);
+        const __m256i c16 = _mm256_slli_epi16(_mm256_subs_epi16(y16, _mm256_set1_epi16(16)), 4);
+        const __m256i d16 = _mm256_slli_epi16(_mm256_subs_epi16(u16, _mm256_set1_epi16(128)), 4);
+        const __m256i e16 = _mm256_slli_epi16(_mm256_subs_epi16(v16, _mm256_set1_epi16(128)), 4);
+        const __m256i y298 = _mm256_mulhi_epi16(c16, n298);
+        r16 = _mm256_min_epi16(max, _mm256_max_epi16(zero, _mm256_add_epi16(y298, _mm256_mulhi_epi16(e16, n409))));
+        g16 = _mm256_min_epi16(max, _mm256_max_epi16(zero, _mm256_sub_epi16(_mm256_sub_epi16(y298, _mm256_mulhi_epi16(d16, n100)), _mm256_mulhi_epi16(e16, n208))));
+        b16 = _mm256_min_epi16(max, _mm256_max_epi16(zero, _mm256_add_epi16(y298, _mm256_mulhi_epi16(d16, n516))));
+    }
+
+    // Interleaves 16 pixels per lane of three 16-bit channels into four registers of four (first, second, third, 255) pixels each
+    RS_TARGET_AVX2 static inline void interleave_rgba(const __m256i (&first)[2], const __m256i (&second)[2], const __m256i (&third)[2], __m256i (&quads)[4])
+    {
+        const __m256i evens_odds = both_lanes(_mm_setr_epi8(0, 2, 4, 6, 8, 10, 12, 14, 1, 3, 5, 7, 9, 11, 13, 15));
+        for(int i=0; i<2; ++i)
+        {
+            __m256i xy8 = _mm256_unpacklo_epi8(_mm256_shuffle_epi8(first[i], evens_odds), _mm256_shuffle_epi8(second[i], evens_odds));
+            __m256i za8 = _mm256_unpacklo_epi8(_mm256_shuffle_epi8(third[i], evens_odds), _mm256_set1_epi8(-1));
+            quads[i*2] = _mm256_unpacklo_epi16(xy8, za8);
+            quads[i*2+1] = _mm256_unpackhi_epi16(xy8, za8);
+        }
+    }
+
+    template<rs_format FORMAT> RS_TARGET_AVX2 int unpack_yuy2_avx2(byte * dst, const byte * src, int n)
+    {
+        const int out_block = get_image_bpp(FORMAT) * 2; // Bytes written for each block of 16 pixels
+        const __m256i zero = _mm256_setzero_si256();
+        int count = 0;
+        for(; count + 32 <= n; count += 32, src += 64, dst += out_block * 2)
+        {
+            // Load 16 YUY2 pixels into each lane of two registers
+            __m256i s0 = load_lanes(src, src + 32);
+            __m256i s1 = load_lanes(src + 16, src + 48);
+            byte * lo = dst, * hi = dst + out_block;
+
+            if(FORMAT == RS_FORMAT_Y8)
+            {
+                __m256i y0 = _mm256_shuffle_epi8(s0, both_lanes(_mm_setr_epi8(1, 3, 5, 7, 9, 11, 13, 15,   0, 2, 4, 6, 8, 10, 12, 14)));
+                __m256i y1 = _mm256_shuffle_epi8(s1, both_lanes(_mm_setr_epi8(0, 2, 4, 6, 8, 10, 12, 14,   1, 3, 5, 7, 9, 11, 13, 15)));
+                store_lanes(lo, hi, _mm256_alignr_epi8(y0, y1, 8));
+                continue;
+            }
+
+            // Shuffle all Y components to the low order bytes of each lane, and all U/V components to the high order bytes
+            const __m256i evens_odd1s_odd3s = both_lanes(_mm_setr_epi8(0, 2, 4, 6, 8, 10, 12, 14, 1, 5, 9, 13, 3, 7, 11, 15)); // to get yyyyyyyyuuuuvvvv
+            __m256i yyyyyyyyuuuuvvvv0 = _mm256_shuffle_epi8(s0, evens_odd1s_odd3s);
+            __m256i yyyyyyyyuuuuvvvv8 = _mm256_shuffle_epi8(s1, evens_odd1s_odd3s);
+
+            __m256i y16[2] = { _mm256_unpacklo_epi8(yyyyyyyyuuuuvvvv0, zero), _mm256_unpacklo_epi8(yyyyyyyyuuuuvvvv8, zero) };
+
+            if(FORMAT == RS_FORMAT_Y16)
+            {
+                store_lanes(lo, hi, _mm256_slli_epi16(y16[0], 8));
+                store_lanes(lo, hi, _mm256_slli_epi16(y16[1], 8));
+                continue;
+            }
+
+            // Duplicate each U and V component across the two pixels it covers
+            __m256i uv = _mm256_unpackhi_epi32(yyyyyyyyuuuuvvvv0, yyyyyyyyuuuuvvvv8);
+            __m256i u = _mm256_unpacklo_epi8(uv, uv), v = _mm256_unpackhi_epi8(uv, uv);
+            __m256i r16[2], g16[2], b16[2];
+            yuv16_to_rgb16(y16[0], _mm256_unpacklo_epi8(u, zero), _mm256_unpacklo_epi8(v, zero), r16[0], g16[0], b16[0]);
+            yuv16_to_rgb16(y16[1], _mm256_unpackhi_epi8(u, zero), _mm256_unpackhi_epi8(v, zero), r16[1], g16[1], b16[1]);
+
+            __m256i quads[4];
+            if(FORMAT == RS_FORMAT_RGB8 || FORMAT == RS_FORMAT_RGBA8) interleave_rgba(r16, g16, b16, quads);
+            if(FORMAT == RS_FORMAT_BGR8 || FORMAT == RS_FORMAT_BGRA8) interleave_rgba(b16, g16, r16, quads);
+
+            if(FORMAT == RS_FORMAT_RGBA8 || FORMAT == RS_FORMAT_BGRA8)
+            {
+                for(auto & quad : quads) store_lanes(lo, hi, quad);
+            }
+
+            if(FORMAT == RS_FORMAT_RGB8 || FORMAT == RS_FORMAT_BGR8)
+            {
+                // Shuffle triples to the start and end of each register, then align registers to store 16 pixels (48 bytes) per lane
+                __m256i t0 = _mm256_shuffle_epi8(quads[0], both_lanes(_mm_setr_epi8(  3, 7, 11, 15,   0, 1, 2, 4, 5, 6, 8, 9, 10, 12, 13, 14)));
+                __m256i t1 = _mm256_shuffle_epi8(quads[1], both_lanes(_mm_setr_epi8(0, 1, 2, 4,   3, 7, 11, 15,   5, 6, 8, 9, 10, 12, 13, 14)));
+                __m256i t2 = _mm256_shuffle_epi8(quads[2], both_lanes(_mm_setr_epi8(0, 1, 2, 4, 5, 6, 8, 9,   3, 7, 11, 15,   10, 12, 13, 14)));
+                __m256i t3 = _mm256_shuffle_epi8(quads[3], both_lanes(_mm_setr_epi8(0, 1, 2, 4, 5, 6, 8, 9, 10, 12, 13, 14,   3, 7, 11, 15  )));
+                store_lanes(lo, hi, _mm256_alignr_epi8(t1, t0, 4));
+                store_lanes(lo, hi, _mm256_alignr_epi8(t2, t1, 8));
+                store_lanes(lo, hi, _mm256_alignr_epi8(t3, t2, 12));
+            }
+        }
+        return count;
+    }
+
+    // 10 bit luminance in 16 bits to 16 bit luminance
+    RS_TARGET_AVX2 static int unpack_y16_from_y16_10_avx2(byte * dst, const byte * src, int n)
+    {
+        int count = 0;
+        for(; count + 16 <= n; count += 16, src += 32, dst += 32)
+        {
+            _mm256_storeu_si256(reinterpret_cast<__m256i *>(dst), _mm256_slli_epi16(_mm256_loadu_si256(reinterpret_cast<const __m256i *>(src)), 6));
+        }
+        return count;
+    }
+
+    // 10 bit luminance in 16 bits to 8 bit luminance, keeping the low byte like the scalar cast rather than saturating
+    RS_TARGET_AVX2 static int unpack_y8_from_y16_10_avx2(byte * dst, const byte * src, int n)
+    {
+        const __m256i low_bytes = _mm256_set1_epi16(0xff);
+        int count = 0;
+        for(; count + 32 <= n; count += 32, src += 64, dst += 32)
+        {
+            __m256i a = _mm256_and_si256(_mm256_srli_epi16(_mm256_loadu_si256(reinterpret_cast<const __m256i *>(src)), 2), low_bytes);
+            __m256i b = _mm256_and_si256(_mm256_srli_epi16(_mm256_loadu_si256(reinterpret_cast<const __m256i *>(src + 32)), 2), low_bytes);
+            // Packing works per lane, so put the four 64-bit quarters back in order
+            _mm256_storeu_si256(reinterpret_cast<__m256i *>(dst), _mm256_permute4x64_epi64(_mm256_packus_epi16(a, b), _MM_SHUFFLE(3, 1, 2, 0)));
+        }
+        return count;
+    }
+
+    // Splits 3 byte F200 INZI pixels into 16 bit Z and 8 or 16 bit IR, 16 pixels (48 bytes) per lane
+    template<class IR> RS_TARGET_AVX2 int unpack_z16_ir_from_f200_inzi_avx2(byte * z_dst, byte * ir_dst, const byte * src, int n)
+    {
+        // Byte indices of each output within a 48 byte block, split across its three 16 byte loads. -1 zeroes the byte
+        const __m256i z0_from_a = both_lanes(_mm_setr_epi8(0, 1, 3, 4, 6, 7, 9, 10, 12, 13, 15, -1, -1, -1, -1, -1));
+        const __m256i z0_from_b = both_lanes(_mm_setr_epi8(-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, 0, 2, 3, 5, 6));
+        const __m256i z1_from_b = both_lanes(_mm_setr_epi8(8, 9, 11, 12, 14, 15, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1));
+        const __m256i z1_from_c = both_lanes(_mm_setr_epi8(-1, -1, -1, -1, -1, -1, 1, 2, 4, 5, 7, 8, 10, 11, 13, 14));
+        const __m256i ir_from_a = both_lanes(_mm_setr_epi8(2, 5, 8, 11, 14, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1));
+        const __m256i ir_from_b = both_lanes(_mm_setr_epi8(-1, -1, -1, -1, -1, 1, 4, 7, 10, 13, -1, -1, -1, -1, -1, -1));
+        const __m256i ir_from_c = both_lanes(_mm_setr_epi8(-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, 0, 3, 6, 9, 12, 15));
+
+        int count = 0;
+        for(; count + 32 <= n; count += 32, src += 96, z_dst += 64, ir_dst += 32 * sizeof(IR))
+        {
+            __m256i a = load_lanes(src, src + 48), b = load_lanes(src + 16, src + 64), c = load_lanes(src + 32, src + 80);
+
+            byte * z_lo = z_dst, * z_hi = z_dst + 32;
+            store_lanes(z_lo, z_hi, _mm256_or_si256(_mm256_shuffle_epi8(a, z0_from_a), _mm256_shuffle_epi8(b, z0_from_b)));
+            store_lanes(z_lo, z_hi, _mm256_or_si256(_mm256_shuffle_epi8(b, z1_from_b), _mm256_shuffle_epi8(c, z1_from_c)));
+
+            __m256i ir = _mm256_or_si256(_mm256_or_si256(_mm256_shuffle_epi8(a, ir_from_a), _mm256_shuffle_epi8(b, ir_from_b)), _mm256_shuffle_epi8(c, ir_from_c));
+            byte * ir_lo = ir_dst, * ir_hi = ir_dst + 16 * sizeof(IR);
+            if(sizeof(IR) == 1) store_lanes(ir_lo, ir_hi, ir);
+            else
+            {
+                // Duplicating the byte gives y8 | y8 << 8
+                store_lanes(ir_lo, ir_hi, _mm256_unpacklo_epi8(ir, ir));
+                store_lanes(ir_lo, ir_hi, _mm256_unpackhi_epi8(ir, ir));
+            }
+        }
+        return count;
+    }
+#endif
+
     //////////////////////////////
     // Naive unpacking routines //
     //////////////////////////////
@@ -67,8 +307,26 @@ namespace rsimpl
     }
 
     void unpack_y16_from_y8    (byte * const d[], const byte * s, int n) { unpack_pixels(d, n, reinterpret_cast<const uint8_t  *>(s), [](uint8_t  pixel) -> uint16_t { return pixel | pixel << 8; }); }
-    void unpack_y16_from_y16_10(byte * const d[], const byte * s, int n) { unpack_pixels(d, n, reinterpret_cast<const uint16_t *>(s), [](uint16_t pixel) -> uint16_t { return pixel << 6; }); }
-    void unpack_y8_from_y16_10 (byte * const d[], const byte * s, int n) { unpack_pixels(d, n, reinterpret_cast<const uint16_t *>(s), [](uint16_t pixel) -> uint8_t  { return pixel >> 2; }); }
+    void unpack_y16_from_y16_10(byte * const d[], const byte * s, int n)
+    {
+        int done = 0;
+#ifdef RS_RUNTIME_AVX2
+        if(avx2_unpacking()) done = unpack_y16_from_y16_10_avx2(d[0], s, n);
+#endif
+        byte * const rest[] = { d[0] + done * 2 };
+        unpack_pixels(rest, n - done, reinterpret_cast<const uint16_t *>(s) + done, [](uint16_t pixel) -> uint16_t { return pixel << 6; });
+    }
+
+    void unpack_y8_from_y16_10(byte * const d[], const byte * s, int n)
+    {
+        int done = 0;
+#ifdef RS_RUNTIME_AVX2
+        if(avx2_unpacking()) done = unpack_y8_from_y16_10_avx2(d[0], s, n);
+#endif
+        byte * const rest[] = { d[0] + done };
+        unpack_pixels(rest, n - done, reinterpret_cast<const uint16_t *>(s) + done, [](uint16_t pixel) -> uint8_t { return pixel >> 2; });
+    }
+
     void unpack_rw10_from_rw8 (byte *  const d[], const byte * s, int n)
     {
 #ifdef __SSSE3__
@@ -109,6 +367,16 @@ namespace rsimpl
     template<rs_format FORMAT> void unpack_yuy2(byte * const d [], const byte * s, int n)
     {
         assert(n % 16 == 0); // All currently supported color resolutions are multiples of 16 pixels. Could easily extend support to other resolutions by copying final n<16 pixels into a zero-padded buffer and recursively calling self for final iteration.
+#ifdef RS_RUNTIME_AVX2
+        if(n >= 32 && avx2_unpacking())
+        {
+            // AVX2 handles 32 pixels at a time, a final block of 16 is left to the code below
+            const int done = unpack_yuy2_avx2<FORMAT>(d[0], s, n);
+            if(done == n) return;
+            byte * const rest[] = { d[0] + done * get_image_bpp(FORMAT) / 8 };
+            return unpack_yuy2<FORMAT>(rest, s + done * 2, n - done);
+        }
+#endif
 #ifdef __SSSE3__
         auto src = reinterpret_cast<const __m128i *>(s);
         auto dst = reinterpret_cast<__m128i *>(d[0]);
@@ -420,32 +688,40 @@ namespace rsimpl
     struct f200_inzi_pixel { uint16_t z16; uint8_t y8; };
     void unpack_z16_y8_from_f200_inzi(byte * const dest[], const byte * source, int count)
     {
-        split_frame(dest, count, reinterpret_cast<const f200_inzi_pixel *>(source),
+        int done = 0;
+#ifdef RS_RUNTIME_AVX2
+        if(avx2_unpacking()) done = unpack_z16_ir_from_f200_inzi_avx2<uint8_t>(dest[0], dest[1], source, count);
+#endif
+        byte * const rest[] = { dest[0] + done * 2, dest[1] + done };
+        split_frame(rest, count - done, reinterpret_cast<const f200_inzi_pixel *>(source) + done,
             [](const f200_inzi_pixel & p) -> uint16_t { return p.z16; },
             [](const f200_inzi_pixel & p) -> uint8_t { return p.y8; });
     }
 
     void unpack_z16_y16_from_f200_inzi(byte * const dest[], const byte * source, int count)
     {
-        split_frame(dest, count, reinterpret_cast<const f200_inzi_pixel *>(source),
+        int done = 0;
+#ifdef RS_RUNTIME_AVX2
+        if(avx2_unpacking()) done = unpack_z16_ir_from_f200_inzi_avx2<uint16_t>(dest[0], dest[1], source, count);
+#endif
+        byte * const rest[] = { dest[0] + done * 2, dest[1] + done * 2 };
+        split_frame(rest, count - done, reinterpret_cast<const f200_inzi_pixel *>(source) + done,
             [](const f200_inzi_pixel & p) -> uint16_t { return p.z16; },
             [](const f200_inzi_pixel & p) -> uint16_t { return p.y8 | p.y8 << 8; });
     }
 
     void unpack_z16_y8_from_sr300_inzi(byte * const dest[], const byte * source, int count)
     {
-        auto in = reinterpret_cast<const uint16_t *>(source);
-        auto out_ir = reinterpret_cast<uint8_t *>(dest[1]);            
-        for(int i=0; i<count; ++i) *out_ir++ = *in++ >> 2;
-        memcpy(dest[0], in, count*2);
+        byte * const ir[] = { dest[1] };
+        unpack_y8_from_y16_10(ir, source, count);
+        memcpy(dest[0], source + count*2, count*2);
     }
 
     void unpack_z16_y16_from_sr300_inzi (byte * const dest[], const byte * source, int count)
     {
-        auto in = reinterpret_cast<const uint16_t *>(source);
-        auto out_ir = reinterpret_cast<uint16_t *>(dest[1]);
-        for(int i=0; i<count; ++i) *out_ir++ = *in++ << 6;
-        memcpy(dest[0], in, count*2);
+        byte * const ir[] = { dest[1] };
+        unpack_y16_from_y16_10(ir, source, count);
+        memcpy(dest[0], source + count*2, count*2);
     }
 
 #pragma GCC diagnostic push
@@ -508,6 +784,96 @@ namespace rsimpl
         deproject_depth(points, disparity_intrin, disparity_pixels, [disparity_scale](uint16_t disparity) { return disparity_scale / disparity; });
     }
 
+    std::vector<float> compute_deprojection_table(const rs_intrinsics & intrin)
+    {
+        // Deprojecting at unit depth gives the ray {x, y, 1} through each pixel, so that the point at depth d is exactly d * ray
+        std::vector<float> table(intrin.width * intrin.height * 3);
+        auto ray = table.data();
+        for(int y=0; y<intrin.height; ++y)
+        {
+            for(int x=0; x<intrin.width; ++x)
+            {
+                const float pixel[] = { (float) x, (float) y};
+                rs_deproject_pixel_to_point(ray, &intrin, pixel, 1.0f);
+                ray += 3;
+            }
+        }
+        return table;
+    }
+
+#ifdef RS_RUNTIME_AVX2
+    // Scales blocks of 8 rays, returns the number of rays done
+    RS_TARGET_AVX2 static int deproject_row_avx2(float * points, const float * rays, const float * depth, int count)
+    {
+        const __m256i lo = _mm256_setr_epi32(0,0,0,1,1,1,2,2), mid = _mm256_setr_epi32(2,3,3,3,4,4,4,5), hi = _mm256_setr_epi32(5,5,6,6,6,7,7,7);
+        int i = 0;
+        for(; i + 8 <= count; i += 8, points += 24, rays += 24)
+        {
+            const __m256 d = _mm256_loadu_ps(depth + i);
+            _mm256_storeu_ps(points,      _mm256_mul_ps(_mm256_loadu_ps(rays),      _mm256_permutevar8x32_ps(d, lo)));
+            _mm256_storeu_ps(points + 8,  _mm256_mul_ps(_mm256_loadu_ps(rays + 8),  _mm256_permutevar8x32_ps(d, mid)));
+            _mm256_storeu_ps(points + 16, _mm256_mul_ps(_mm256_loadu_ps(rays + 16), _mm256_permutevar8x32_ps(d, hi)));
+        }
+        return i;
+    }
+#endif
+
+    // Scales count rays of three floats by one depth each
+    static void deproject_row(float * points, const float * rays, const float * depth, int count)
+    {
+        int i = 0;
+#ifdef RS_RUNTIME_AVX2
+        if(avx2_deprojection())
+        {
+            i = deproject_row_avx2(points, rays, depth, count);
+            points += i * 3;
+            rays += i * 3;
+        }
+#endif
+#if defined(__SSE2__)
+        for(; i + 4 <= count; i += 4, points += 12, rays += 12)
+        {
+            const __m128 d = _mm_loadu_ps(depth + i);
+            _mm_storeu_ps(points,     _mm_mul_ps(_mm_loadu_ps(rays),     _mm_shuffle_ps(d, d, _MM_SHUFFLE(1,0,0,0))));
+            _mm_storeu_ps(points + 4, _mm_mul_ps(_mm_loadu_ps(rays + 4), _mm_shuffle_ps(d, d, _MM_SHUFFLE(2,2,1,1))));
+            _mm_storeu_ps(points + 8, _mm_mul_ps(_mm_loadu_ps(rays + 8), _mm_shuffle_ps(d, d, _MM_SHUFFLE(3,3,3,2))));
+        }
+#endif
+        for(; i < count; ++i, points += 3, rays += 3)
+        {
+            points[0] = depth[i] * rays[0];
+            points[1] = depth[i] * rays[1];
+            points[2] = depth[i] * rays[2];
+        }
+    }
+
+    template<class MAP_DEPTH> void deproject_depth(float * points, const std::vector<float> & deprojection_table, const rs_intrinsics & intrin, const uint16_t * depth, MAP_DEPTH map_depth)
+    {
+        assert(deprojection_table.size() == size_t(intrin.width * intrin.height * 3));
+        const int width = intrin.width;
+        const float * rays = deprojection_table.data();
+        for_each_row_parallel(intrin.height, [=](int first_row, int last_row)
+        {
+            std::vector<float> row_depth(width);
+            for(int y=first_row; y<last_row; ++y)
+            {
+                const uint16_t * row = depth + y * width;
+                for(int x=0; x<width; ++x) row_depth[x] = map_depth(row[x]);
+                deproject_row(points + y * width * 3, rays + y * width * 3, row_depth.data(), width);
+            }
+        });
+    }
+
+    void deproject_z(float * points, const std::vector<float> & deprojection_table, const rs_intrinsics & z_intrin, const uint16_t * z_pixels, float z_scale)
+    {
+        deproject_depth(points, deprojection_table, z_intrin, z_pixels, [z_scale](uint16_t z) { return z_scale * z; });
+    }
+
+    void deproject_disparity(float * points, const std::vector<float> & deprojection_table, const rs_intrinsics & disparity_intrin, const uint16_t * disparity_pixels, float disparity_scale)
+    {
+        deproject_depth(points, deprojection_table, disparity_intrin, disparity_pixels, [disparity_scale](uint16_t disparity) { return disparity_scale / disparity; });
+    }
+
     /////////////////////
     // Image alignment //
     /////////////////////
@@ -601,40 +967,444 @@ namespace rsimpl
         align_other_to_depth(other_aligned_to_disparity, [disparity_pixels, disparity_scale](int disparity_pixel_index) { return disparity_scale / disparity_pixels[disparity_pixel_index]; }, disparity_intrin, disparity_to_other, other_intrin, other_pixels, other_format);
     }
 
+    //////////////////////////////////
+    // Table driven image alignment //
+    //////////////////////////////////
+
+    bool alignment_table::matches(const rs_intrinsics & depth, const rs_extrinsics & to_other, const rs_intrinsics & other) const
+    {
+        return !rays.empty() && depth == depth_intrin && other == other_intrin && memcmp(&to_other, &depth_to_other, sizeof(to_other)) == 0;
+    }
+
+    alignment_table compute_alignment_table(const rs_intrinsics & depth_intrin, const rs_extrinsics & depth_to_other, const rs_intrinsics & other_intrin)
+    {
+        alignment_table table;
+        table.depth_intrin = depth_intrin;
+        table.depth_to_other = depth_to_other;
+        table.other_intrin = other_intrin;
+
+        // Depth pixel corners sit half a pixel either side of the pixel centres, so there is one more corner than pixels in each direction
+        table.rays.resize((depth_intrin.width + 1) * (depth_intrin.height + 1) * 3);
+        auto ray = table.rays.data();
+        auto r = depth_to_other.rotation;
+        for(int y=0; y<=depth_intrin.height; ++y)
+        {
+            for(int x=0; x<=depth_intrin.width; ++x)
+            {
+                const float pixel[] = { x-0.5f, y-0.5f };
+                float p[3];
+                rs_deproject_pixel_to_point(p, &depth_intrin, pixel, 1.0f);
+                ray[0] = r[0] * p[0] + r[3] * p[1] + r[6] * p[2];
+                ray[1] = r[1] * p[0] + r[4] * p[1] + r[7] * p[2];
+                ray[2] = r[2] * p[0] + r[5] * p[1] + r[8] * p[2];
+                ray += 3;
+            }
+        }
+        return table;
+    }
+
+    // The point at depth d along a rotated corner ray is d * ray + translation in the other camera, so only the projection is left per frame
+    static void project_corner(float other_pixel[2], const alignment_table & table, const float * ray, float depth)
+    {
+        const float * t = table.depth_to_other.translation;
+        const float other_point[] = { depth * ray[0] + t[0], depth * ray[1] + t[1], depth * ray[2] + t[2] };
+        rs_project_point_to_pixel(other_pixel, &table.other_intrin, other_point);
+    }
+
+    // Calls visit(depth_pixel_index, x0, y0, x1, y1) with the rectangle of other pixels covered by each valid depth pixel in [first_row, last_row)
+    template<class GET_DEPTH, class VISIT> void for_each_aligned_rect(const alignment_table & table, int first_row, int last_row, GET_DEPTH get_depth, VISIT visit)
+    {
+        const int width = table.depth_intrin.width, corner_stride = (width + 1) * 3;
+        for(int depth_y = first_row; depth_y < last_row; ++depth_y)
+        {
+            int depth_pixel_index = depth_y * width;
+            const float * top = table.rays.data() + depth_y * corner_stride, * bottom = top + corner_stride;
+            for(int depth_x = 0; depth_x < width; ++depth_x, ++depth_pixel_index, top += 3, bottom += 3)
+            {
+                // Skip over depth pixels with no depth data, we will not write anything into our aligned images
+                const float depth = get_depth(depth_pixel_index);
+                if(!(depth > 0)) continue;
+
+                float other_pixel[2];
+                project_corner(other_pixel, table, top, depth);
+                const int other_x0 = static_cast<int>(other_pixel[0] + 0.5f);
+                const int other_y0 = static_cast<int>(other_pixel[1] + 0.5f);
+                project_corner(other_pixel, table, bottom + 3, depth);
+                const int other_x1 = static_cast<int>(other_pixel[0] + 0.5f);
+                const int other_y1 = static_cast<int>(other_pixel[1] + 0.5f);
+
+                if(other_x0 < 0 || other_y0 < 0 || other_x1 >= table.other_intrin.width || other_y1 >= table.other_intrin.height) continue;
+                visit(depth_pixel_index, other_x0, other_y0, other_x1, other_y1);
+            }
+        }
+    }
+
+    // Writes into the other image. Each thread owns a band of other rows, so transfer_pixel never races on an output pixel
+    template<class GET_DEPTH, class TRANSFER_PIXEL> void scatter_to_other(alignment_table & table, GET_DEPTH get_depth, TRANSFER_PIXEL transfer_pixel)
+    {
+        const int depth_width = table.depth_intrin.width, depth_height = table.depth_intrin.height, other_width = table.other_intrin.width;
+        table.rects.assign(depth_width * depth_height, alignment_table::rect{ 1, 1, 0, 0 });
+        table.row_extents.resize(depth_height * 2);
+
+        for_each_row_parallel(depth_height, [&table, get_depth](int first_row, int last_row)
+        {
+            for(int y = first_row; y < last_row; ++y)
+            {
+                int min_y = std::numeric_limits<int>::max(), max_y = -1;
+                for_each_aligned_rect(table, y, y + 1, get_depth, [&table, &min_y, &max_y](int depth_pixel_index, int x0, int y0, int x1, int y1)
+                {
+                    table.rects[depth_pixel_index] = { int16_t(x0), int16_t(y0), int16_t(x1), int16_t(y1) };
+                    min_y = std::min(min_y, y0);
+                    max_y = std::max(max_y, y1);
+                });
+                table.row_extents[y * 2] = min_y;
+                table.row_extents[y * 2 + 1] = max_y;
+            }
+        });
+
+        for_each_row_parallel(table.other_intrin.height, [&table, transfer_pixel, depth_width, depth_height, other_width](int first_row, int last_row)
+        {
+            for(int depth_y = 0; depth_y < depth_height; ++depth_y)
+            {
+                if(table.row_extents[depth_y * 2 + 1] < first_row || table.row_extents[depth_y * 2] >= last_row) continue;
+                for(int depth_pixel_index = depth_y * depth_width; depth_pixel_index < (depth_y + 1) * depth_width; ++depth_pixel_index)
+                {
+                    const auto & rect = table.rects[depth_pixel_index];
+                    const int y0 = std::max<int>(rect.y0, first_row), y1 = std::min<int>(rect.y1, last_row - 1);
+                    for(int y=y0; y<=y1; ++y) for(int x=rect.x0; x<=rect.x1; ++x) transfer_pixel(depth_pixel_index, y * other_width + x);
+                }
+            }
+        });
+    }
+
+    void align_z_to_other(byte * z_aligned_to_other, const uint16_t * z_pixels, float z_scale, alignment_table & table)
+    {
+        auto out_z = (uint16_t *)(z_aligned_to_other);
+        scatter_to_other(table,
+            [z_pixels, z_scale](int z_pixel_index) { return z_scale * z_pixels[z_pixel_index]; },
+            [out_z, z_pixels](int z_pixel_index, int other_pixel_index) { out_z[other_pixel_index] = out_z[other_pixel_index] ? std::min(out_z[other_pixel_index],z_pixels[z_pixel_index]) : z_pixels[z_pixel_index]; });
+    }
+
+    void align_disparity_to_other(byte * disparity_aligned_to_other, const uint16_t * disparity_pixels, float disparity_scale, alignment_table & table)
+    {
+        // Unlike the per-pixel path this keeps the nearest (largest) disparity rather than whichever pixel was written last. 0xFFFF marks no data
+        auto out_disparity = (uint16_t *)(disparity_aligned_to_other);
+        scatter_to_other(table,
+            [disparity_pixels, disparity_scale](int disparity_pixel_index) { return disparity_pixels[disparity_pixel_index] ? disparity_scale / disparity_pixels[disparity_pixel_index] : 0.0f; },
+            [out_disparity, disparity_pixels](int disparity_pixel_index, int other_pixel_index) { out_disparity[other_pixel_index] = out_disparity[other_pixel_index] != 0xFFFF ? std::max(out_disparity[other_pixel_index], disparity_pixels[disparity_pixel_index]) : disparity_pixels[disparity_pixel_index]; });
+    }
+
+    template<int N, class GET_DEPTH> void gather_other_to_depth_bytes(byte * other_aligned_to_depth, GET_DEPTH get_depth, const alignment_table & table, const byte * other_pixels)
+    {
+        // The per-pixel path copies every pixel of the rectangle in turn, which leaves the bottom right one, so copy only that.
+        // A rectangle flipped by the extrinsics is empty there and copies nothing, and its x1 or y1 may be off the image.
+        auto in_other = (const bytes<N> *)(other_pixels);
+        auto out_other = (bytes<N> *)(other_aligned_to_depth);
+        const int other_width = table.other_intrin.width;
+        for_each_row_parallel(table.depth_intrin.height, [&table, get_depth, in_other, out_other, other_width](int first_row, int last_row)
+        {
+            for_each_aligned_rect(table, first_row, last_row, get_depth, [in_other, out_other, other_width](int depth_pixel_index, int x0, int y0, int x1, int y1)
+            {
+                if(x0 <= x1 && y0 <= y1) out_other[depth_pixel_index] = in_other[y1 * other_width + x1];
+            });
+        });
+    }
+
+    template<class GET_DEPTH> void gather_other_to_depth(byte * other_aligned_to_depth, GET_DEPTH get_depth, const alignment_table & table, const byte * other_pixels, rs_format other_format)
+    {
+        switch(other_format)
+        {
+        case RS_FORMAT_Y8:
+            gather_other_to_depth_bytes<1>(other_aligned_to_depth, get_depth, table, other_pixels); break;
+        case RS_FORMAT_Y16: case RS_FORMAT_Z16:
+            gather_other_to_depth_bytes<2>(other_aligned_to_depth, get_depth, table, other_pixels); break;
+        case RS_FORMAT_RGB8: case RS_FORMAT_BGR8:
+            gather_other_to_depth_bytes<3>(other_aligned_to_depth, get_depth, table, other_pixels); break;
+        case RS_FORMAT_RGBA8: case RS_FORMAT_BGRA8:
+            gather_other_to_depth_bytes<4>(other_aligned_to_depth, get_depth, table, other_pixels); break;
+        default:
+            assert(false); // See align_other_to_depth
+        }
+    }
+
+    void align_other_to_z(byte * other_aligned_to_z, const uint16_t * z_pixels, float z_scale, const alignment_table & table, const byte * other_pixels, rs_format other_format)
+    {
+        gather_other_to_depth(other_aligned_to_z, [z_pixels, z_scale](int z_pixel_index) { return z_scale * z_pixels[z_pixel_index]; }, table, other_pixels, other_format);
+    }
+
+    void align_other_to_disparity(byte * other_aligned_to_disparity, const uint16_t * disparity_pixels, float disparity_scale, const alignment_table & table, const byte * other_pixels, rs_format other_format)
+    {
+        gather_other_to_depth(other_aligned_to_disparity, [disparity_pixels, disparity_scale](int disparity_pixel_index) { return disparity_pixels[disparity_pixel_index] ? disparity_scale / disparity_pixels[disparity_pixel_index] : 0.0f; }, table, other_pixels, other_format);
+    }
+
     /////////////////////////
     // Image rectification //
     /////////////////////////
 
-    std::vector<int> compute_rectification_table(const rs_intrinsics & rect_intrin, const rs_extrinsics & rect_to_unrect, const rs_intrinsics & unrect_intrin)
-    {   
-        std::vector<int> rectification_table;
-        rectification_table.resize(rect_intrin.width * rect_intrin.height);
-        align_images(rect_intrin, rect_to_unrect, unrect_intrin, [](int) { return 1.0f; },
-            [&rectification_table](int rect_pixel_index, int unrect_pixel_index) { rectification_table[rect_pixel_index] = unrect_pixel_index; });
-        return rectification_table;
+    bool rectification_table::matches(const rs_intrinsics & rect, const rs_extrinsics & to_unrect, const rs_intrinsics & unrect) const
+    {
+        return !indices.empty() && rect == rect_intrin && unrect == unrect_intrin && memcmp(&to_unrect, &rect_to_unrect, sizeof(to_unrect)) == 0;
     }
 
-    template<class T> void rectify_image_pixels(T * rect_pixels, const std::vector<int> & rectification_table, const T * unrect_pixels)
+    rectification_table compute_rectification_table(const rs_intrinsics & rect_intrin, const rs_extrinsics & rect_to_unrect, const rs_intrinsics & unrect_intrin)
     {
-        for(auto entry : rectification_table) *rect_pixels++ = unrect_pixels[entry];
+        rectification_table table;
+        table.rect_intrin = rect_intrin;
+        table.rect_to_unrect = rect_to_unrect;
+        table.unrect_intrin = unrect_intrin;
+        table.indices.assign(rect_intrin.width * rect_intrin.height, 0);
+
+        // The same mapping as aligning the rectified image at a depth of one, where the last pixel written for each rectified pixel is the
+        // bottom right one of its rectangle. Neighbouring pixels share corner rays, and rows are built in parallel
+        const auto corners = compute_alignment_table(rect_intrin, rect_to_unrect, unrect_intrin);
+        for_each_row_parallel(rect_intrin.height, [&table, &corners, &unrect_intrin](int first_row, int last_row)
+        {
+            for_each_aligned_rect(corners, first_row, last_row, [](int) { return 1.0f; }, [&table, &unrect_intrin](int rect_pixel_index, int x0, int y0, int x1, int y1)
+            {
+                if(x0 <= x1 && y0 <= y1) table.indices[rect_pixel_index] = y1 * unrect_intrin.width + x1;
+            });
+        });
+        return table;
     }
 
-    void rectify_image(uint8_t * rect_pixels, const std::vector<int> & rectification_table, const uint8_t * unrect_pixels, rs_format format)
+#ifdef RS_RUNTIME_AVX2
+    // Gathers eight N byte pixels at a time, returning the number of pixels written. Each gather loads four bytes, so blocks which would
+    // read past the end of the unrectified image are copied one pixel at a time
+    template<int N> RS_TARGET_AVX2 int rectify_pixels_avx2(byte * rect_pixels, const int * indices, int count, const byte * unrect_pixels, int unrect_pixel_count)
+    {
+        // Moves the low N bytes of each 32 bit word to the front of its 128 bit lane
+        int8_t order[16];
+        for(auto & o : order) o = -1;
+        for(int word = 0, o = 0; word < 4; ++word) for(int b = 0; b < N; ++b) order[o++] = int8_t(word * 4 + b);
+        const __m256i pack = both_lanes(_mm_loadu_si128((const __m128i *)order));
+        const __m256i last_safe_index = _mm256_set1_epi32((unrect_pixel_count * N - 4) / N);
+
+        int i = 0;
+        for(; i + 8 <= count; i += 8)
+        {
+            const __m256i index = _mm256_loadu_si256((const __m256i *)(indices + i));
+            if(_mm256_movemask_epi8(_mm256_cmpgt_epi32(index, last_safe_index)))
+            {
+                for(int j = i; j < i + 8; ++j) memcpy(rect_pixels + j * N, unrect_pixels + indices[j] * N, N);
+                continue;
+            }
+
+            const __m256i offset = N == 1 ? index : N == 2 ? _mm256_add_epi32(index, index) : N == 3 ? _mm256_add_epi32(index, _mm256_add_epi32(index, index)) : _mm256_slli_epi32(index, 2);
+            const __m256i pixels = _mm256_i32gather_epi32((const int *)unrect_pixels, offset, 1);
+            if(N == 4) _mm256_storeu_si256((__m256i *)(rect_pixels + i * 4), pixels);
+            else
+            {
+                byte lanes[32];
+                _mm256_storeu_si256((__m256i *)lanes, _mm256_shuffle_epi8(pixels, pack));
+                memcpy(rect_pixels + i * N, lanes, 4 * N);
+                memcpy(rect_pixels + (i + 4) * N, lanes + 16, 4 * N);
+            }
+        }
+        return i;
+    }
+#endif
+
+    template<int N> void rectify_image_pixels(byte * rect_pixels, const rectification_table & table, const byte * unrect_pixels)
+    {
+        const int width = table.rect_intrin.width, unrect_pixel_count = table.unrect_intrin.width * table.unrect_intrin.height;
+        for_each_row_parallel(table.rect_intrin.height, [rect_pixels, &table, unrect_pixels, width, unrect_pixel_count](int first_row, int last_row)
+        {
+            const int * indices = table.indices.data() + first_row * width;
+            const int count = (last_row - first_row) * width;
+            byte * out = rect_pixels + first_row * width * N;
+            int done = 0;
+#ifdef RS_RUNTIME_AVX2
+            if(avx2_unpacking()) done = rectify_pixels_avx2<N>(out, indices, count, unrect_pixels, unrect_pixel_count);
+#endif
+            auto out_pixels = (bytes<N> *)out;
+            auto in_pixels = (const bytes<N> *)unrect_pixels;
+            for(int i = done; i < count; ++i) out_pixels[i] = in_pixels[indices[i]];
+        });
+    }
+
+    void rectify_image(uint8_t * rect_pixels, const rectification_table & table, const uint8_t * unrect_pixels, rs_format format)
     {
         switch(format)
         {
         case RS_FORMAT_Y8: 
-            return rectify_image_pixels((bytes<1> *)rect_pixels, rectification_table, (const bytes<1> *)unrect_pixels);
+            return rectify_image_pixels<1>(rect_pixels, table, unrect_pixels);
         case RS_FORMAT_Y16: case RS_FORMAT_Z16: 
-            return rectify_image_pixels((bytes<2> *)rect_pixels, rectification_table, (const bytes<2> *)unrect_pixels);
+            return rectify_image_pixels<2>(rect_pixels, table, unrect_pixels);
         case RS_FORMAT_RGB8: case RS_FORMAT_BGR8: 
-            return rectify_image_pixels((bytes<3> *)rect_pixels, rectification_table, (const bytes<3> *)unrect_pixels);
+            return rectify_image_pixels<3>(rect_pixels, table, unrect_pixels);
         case RS_FORMAT_RGBA8: case RS_FORMAT_BGRA8: 
-            return rectify_image_pixels((bytes<4> *)rect_pixels, rectification_table, (const bytes<4> *)unrect_pixels);
+            return rectify_image_pixels<4>(rect_pixels, table, unrect_pixels);
         default: 
             assert(false); // NOTE: rectify_image_pixels(...) is not appropriate for RS_FORMAT_YUYV images, no logic prevents U/V channels from being written to one another
         }
     }
+
+    // Rectification table files hold a header, the calibration the table was built from and the indices, in native byte order
+    static const char rectification_file_magic[4] = {'R','S','R','T'};
+    static const uint32_t rectification_file_version = 1;
+
+    bool load_rectification_table(const std::string & file_path, const rs_intrinsics & rect_intrin, const rs_extrinsics & rect_to_unrect, const rs_intrinsics & unrect_intrin, rectification_table & table)
+    {
+        std::ifstream file(file_path, std::ios::binary);
+        if(!file) return false;
+
+        char magic[4];
+        uint32_t version = 0;
+        rectification_table loaded;
+        file.read(magic, sizeof(magic));
+        file.read((char *)&version, sizeof(version));
+        file.read((char *)&loaded.rect_intrin, sizeof(loaded.rect_intrin));
+        file.read((char *)&loaded.rect_to_unrect, sizeof(loaded.rect_to_unrect));
+        file.read((char *)&loaded.unrect_intrin, sizeof(loaded.unrect_intrin));
+        if(!file || memcmp(magic, rectification_file_magic, sizeof(magic)) || version != rectification_file_version) return false;
+
+        // A table built from any other calibration or mode is stale, and gets rebuilt by the caller
+        if(!(loaded.rect_intrin == rect_intrin && loaded.unrect_intrin == unrect_intrin && memcmp(&loaded.rect_to_unrect, &rect_to_unrect, sizeof(rect_to_unrect)) == 0)) return false;
+        loaded.indices.resize(rect_intrin.width * rect_intrin.height);
+        file.read((char *)loaded.indices.data(), loaded.indices.size() * sizeof(int));
+        if(!file) return false;
+
+        const int unrect_pixel_count = unrect_intrin.width * unrect_intrin.height;
+        for(auto index : loaded.indices) if(index < 0 || index >= unrect_pixel_count) return false;
+
+        table = std::move(loaded);
+        return true;
+    }
+
+    bool save_rectification_table(const std::string & file_path, const rectification_table & table)
+    {
+        // Write a temporary file and move it into place, so that a concurrent reader never sees half a table. The temporary file is named
+        // after this process, so that two processes saving the same table don't write into each other's file
+        const std::string temp_path = to_string() << file_path << ".tmp." << getpid();
+        {
+            std::ofstream file(temp_path, std::ios::binary | std::ios::trunc);
+            file.write(rectification_file_magic, sizeof(rectification_file_magic));
+            file.write((const char *)&rectification_file_version, sizeof(rectification_file_version));
+            file.write((const char *)&table.rect_intrin, sizeof(table.rect_intrin));
+            file.write((const char *)&table.rect_to_unrect, sizeof(table.rect_to_unrect));
+            file.write((const char *)&table.unrect_intrin, sizeof(table.unrect_intrin));
+            file.write((const char *)table.indices.data(), table.indices.size() * sizeof(int));
+            if(!file) return false;
+        }
+#ifdef _WIN32
+        std::remove(file_path.c_str()); // rename does not replace existing files on Windows
+#endif
+        return std::rename(temp_path.c_str(), file_path.c_str()) == 0;
+    }
 }
 
 #pragma pack(pop)
+
+namespace rsimpl
+{
+    //////////////////////
+    // Row worker pool  //
+    //////////////////////
+
+    // Workers that live as long as the library, so that striping an image costs a wakeup rather than a thread start and join
+    class row_worker_pool
+    {
+        // One call to run_row_stripes. Whichever thread gets to it first claims the next stripe, so a caller that finds the workers
+        // busy with another image runs its own stripes rather than waiting for them
+        struct job
+        {
+            const std::function<void(int, int)> * row_func;
+            int height, stripe_count;
+            std::atomic<int> next_stripe, stripes_done;
+            std::mutex mutex;
+            std::condition_variable done;
+
+            job(const std::function<void(int, int)> & row_func, int height, int stripe_count) : row_func(&row_func), height(height), stripe_count(stripe_count), next_stripe(0), stripes_done(0) {}
+
+            // Runs stripes until none are left unclaimed
+            void run_stripes()
+            {
+                for(int stripe = next_stripe++; stripe < stripe_count; stripe = next_stripe++)
+                {
+                    (*row_func)(stripe * height / stripe_count, (stripe + 1) * height / stripe_count);
+                    if(++stripes_done == stripe_count)
+                    {
+                        std::lock_guard<std::mutex> lock(mutex);
+                        done.notify_all();
+                    }
+                }
+            }
+        };
+
+        std::vector<std::thread> workers;
+        std::deque<std::shared_ptr<job>> jobs;
+        std::mutex mutex;
+        std::condition_variable job_queued;
+        bool stopping;
+
+        void work()
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            while(true)
+            {
+                job_queued.wait(lock, [this]() { return stopping || !jobs.empty(); });
+                if(jobs.empty()) return;
+                auto next = jobs.front();
+                jobs.pop_front();
+                lock.unlock();
+                next->run_stripes();
+                lock.lock();
+            }
+        }
+    public:
+        row_worker_pool() : stopping(false)
+        {
+            const int worker_count = std::max(1, (int)std::thread::hardware_concurrency()) - 1;
+            for(int i=0; i<worker_count; ++i) workers.emplace_back(&row_worker_pool::work, this);
+        }
+
+        ~row_worker_pool()
+        {
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                stopping = true;
+            }
+            job_queued.notify_all();
+            for(auto & worker : workers) worker.join();
+        }
+
+        int thread_count() const { return (int)workers.size() + 1; }
+
+        void run(int height, int stripe_count, const std::function<void(int, int)> & row_func)
+        {
+            // Each worker that picks the job up runs stripes until none are left, so one entry per helping worker is enough. An entry
+            // left in the queue after its stripes are done finds none to claim, and never touches row_func again
+            auto stripes = std::make_shared<job>(row_func, height, stripe_count);
+            const int helpers = std::min(stripe_count - 1, (int)workers.size());
+            if(helpers > 0)
+            {
+                {
+                    std::lock_guard<std::mutex> lock(mutex);
+                    for(int i=0; i<helpers; ++i) jobs.push_back(stripes);
+                }
+                if(helpers > 1) job_queued.notify_all();
+                else job_queued.notify_one();
+            }
+
+            stripes->run_stripes();
+            std::unique_lock<std::mutex> lock(stripes->mutex);
+            stripes->done.wait(lock, [&stripes]() { return stripes->stripes_done == stripes->stripe_count; });
+        }
+    };
+
+    static row_worker_pool & row_workers()
+    {
+        static row_worker_pool pool;
+        return pool;
+    }
+
+    int row_thread_count()
+    {
+        return row_workers().thread_count();
+    }
+
+    void run_row_stripes(int height, int stripe_count, const std::function<void(int, int)> & row_func)
+    {
+        row_workers().run(height, stripe_count, row_func);
+    }
+}
@@ -7,6 +7,9 @@
 
 #include "types.h"
 
+#include <algorithm>
+#include <functional>
+
 namespace rsimpl
 {
 
@@ -15,6 +18,11 @@ namespace rsimpl
     void             deproject_z                    (float * points, const rs_intrinsics & z_intrin, const uint16_t * z_pixels, float z_scale);
     void             deproject_disparity            (float * points, const rs_intrinsics & disparity_intrin, const uint16_t * disparity_pixels, float disparity_scale);
 
+    // Table driven deprojection, the same as the functions above up to float rounding, but without redoing the distortion model every frame
+    std::vector<float> compute_deprojection_table   (const rs_intrinsics & intrin);
+    void             deproject_z                    (float * points, const std::vector<float> & deprojection_table, const rs_intrinsics & z_intrin, const uint16_t * z_pixels, float z_scale);
+    void             deproject_disparity            (float * points, const std::vector<float> & deprojection_table, const rs_intrinsics & disparity_intrin, const uint16_t * disparity_pixels, float disparity_scale);
+
     void             align_z_to_other               (byte * z_aligned_to_other, const uint16_t * z_pixels, float z_scale, const rs_intrinsics & z_intrin, 
                                                      const rs_extrinsics & z_to_other, const rs_intrinsics & other_intrin);
     void             align_disparity_to_other       (byte * disparity_aligned_to_other, const uint16_t * disparity_pixels, float disparity_scale, const rs_intrinsics & disparity_intrin, 
@@ -24,8 +32,66 @@ namespace rsimpl
     void             align_other_to_disparity       (byte * other_aligned_to_disparity, const uint16_t * disparity_pixels, float disparity_scale, const rs_intrinsics & disparity_intrin, 
                                                      const rs_extrinsics & disparity_to_other, const rs_intrinsics & other_intrin, const byte * other_pixels, rs_format other_format);
 
-    std::vector<int> compute_rectification_table    (const rs_intrinsics & rect_intrin, const rs_extrinsics & rect_to_unrect, const rs_intrinsics & unrect_intrin);
-    void             rectify_image                  (uint8_t * rect_pixels, const std::vector<int> & rectification_table, const uint8_t * unrect_pixels, rs_format format);
+    // Precomputed alignment of a depth image onto another camera. rays holds the depth pixel corner rays rotated into the other camera,
+    // so each corner only needs scaling by depth, translating and projecting per frame. rects and row_extents are per-frame scratch space.
+    struct alignment_table
+    {
+        struct rect { int16_t x0, y0, x1, y1; };
+
+        rs_intrinsics                   depth_intrin;
+        rs_extrinsics                   depth_to_other;
+        rs_intrinsics                   other_intrin;
+        std::vector<float>              rays;
+        std::vector<rect>               rects;
+        std::vector<int>                row_extents;
+
+        bool                            matches(const rs_intrinsics & depth_intrin, const rs_extrinsics & depth_to_other, const rs_intrinsics & other_intrin) const;
+    };
+
+    alignment_table  compute_alignment_table        (const rs_intrinsics & depth_intrin, const rs_extrinsics & depth_to_other, const rs_intrinsics & other_intrin);
+    void             align_z_to_other               (byte * z_aligned_to_other, const uint16_t * z_pixels, float z_scale, alignment_table & table);
+    void             align_disparity_to_other       (byte * disparity_aligned_to_other, const uint16_t * disparity_pixels, float disparity_scale, alignment_table & table);
+    void             align_other_to_z               (byte * other_aligned_to_z, const uint16_t * z_pixels, float z_scale, const alignment_table & table, const byte * other_pixels, rs_format other_format);
+    void             align_other_to_disparity       (byte * other_aligned_to_disparity, const uint16_t * disparity_pixels, float disparity_scale, const alignment_table & table, const byte * other_pixels, rs_format other_format);
+
+    // Index of the unrectified pixel copied into each rectified pixel, along with the calibration the table was built from
+    struct rectification_table
+    {
+        rs_intrinsics                   rect_intrin;
+        rs_extrinsics                   rect_to_unrect;
+        rs_intrinsics                   unrect_intrin;
+        std::vector<int>                indices;
+
+        bool                            matches(const rs_intrinsics & rect_intrin, const rs_extrinsics & rect_to_unrect, const rs_intrinsics & unrect_intrin) const;
+    };
+
+    rectification_table compute_rectification_table(const rs_intrinsics & rect_intrin, const rs_extrinsics & rect_to_unrect, const rs_intrinsics & unrect_intrin);
+    void             rectify_image                  (uint8_t * rect_pixels, const rectification_table & table, const uint8_t * unrect_pixels, rs_format format);
+
+    // Rectification tables stored on disk. Loading fails unless the file was built from exactly the given calibration
+    bool             load_rectification_table       (const std::string & file_path, const rs_intrinsics & rect_intrin, const rs_extrinsics & rect_to_unrect,
+                                                     const rs_intrinsics & unrect_intrin, rectification_table & table);
+    bool             save_rectification_table       (const std::string & file_path, const rectification_table & table);
+
+    // Runtime CPU dispatch of the unpackers and rectify_image, and separately of the table driven deprojection. AVX2 versions are used when the CPU supports them, and can be switched off to compare against the SSSE3/generic ones
+    bool             is_avx2_supported              ();
+    void             set_avx2_unpacking             (bool enable);
+    void             set_avx2_deprojection          (bool enable);
+
+    // Number of threads that stripes of an image are spread over, the calling thread and the row workers started with the library
+    int              row_thread_count               ();
+
+    // Runs row_func(first_row, last_row) for stripe_count equal stripes of height rows, on the calling thread and the row workers
+    void             run_row_stripes                (int height, int stripe_count, const std::function<void(int, int)> & row_func);
+
+    // Calls row_func(first_row, last_row) for horizontal stripes of an image on several threads
+    template<class ROW_FUNC> void for_each_row_parallel(int height, ROW_FUNC row_func)
+    {
+        // Keep at least 64 rows per stripe, smaller images are not worth handing over to another thread
+        const int stripe_count = std::min(row_thread_count(), std::max(1, height / 64));
+        if(stripe_count == 1) row_func(0, height);
+        else run_row_stripes(height, stripe_count, row_func);
+    }
 
     extern const native_pixel_format pf_raw8;       // Four 8 bit luminance
     extern const native_pixel_format pf_rw10;       // Four 10 bit luminance values in one 40 bit macropixel
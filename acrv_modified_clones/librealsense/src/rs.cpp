@@ -8,6 +8,7 @@
 #include "device.h"
 #include "sync.h"
 #include "archive.h"
+#include "trace.h"
 
 ////////////////////////
 // API implementation //
@@ -808,3 +809,37 @@ void rs_log_to_file(rs_log_severity min_severity, const char * file_path, rs_err
     rsimpl::log_to_file(min_severity, file_path);
 }
 HANDLE_EXCEPTIONS_AND_RETURN(, min_severity, file_path)
+
+void rs_start_tracing(int records_per_thread, rs_error ** error) try
+{
+    VALIDATE_RANGE(records_per_thread, 1, 1 << 24);
+    rsimpl::trace::start(records_per_thread);
+}
+HANDLE_EXCEPTIONS_AND_RETURN(, records_per_thread)
+
+void rs_stop_tracing(const char * write_path, rs_error ** error) try
+{
+    rsimpl::trace::stop();
+    if (write_path) rsimpl::trace::write_chrome_trace(std::string(write_path));
+}
+HANDLE_EXCEPTIONS_AND_RETURN(, write_path)
+
+double rs_get_trace_time(rs_error ** /*error*/)
+{
+    return rsimpl::trace::now() / 1000.0;
+}
+
+void rs_trace_event(const char * name, rs_stream stream, unsigned long long frame_number, double begin_time, double end_time, rs_error ** error) try
+{
+    VALIDATE_NOT_NULL(name);
+    VALIDATE_RANGE(stream, 0, RS_STREAM_COUNT);
+    if (rsimpl::trace::is_enabled()) rsimpl::trace::record_span(name, stream, frame_number, (int64_t)(begin_time * 1000), (int64_t)(end_time * 1000));
+}
+HANDLE_EXCEPTIONS_AND_RETURN(, name, stream, frame_number, begin_time, end_time)
+
+void rs_write_trace(const char * file_path, rs_error ** error) try
+{
+    VALIDATE_NOT_NULL(file_path);
+    rsimpl::trace::write_chrome_trace(std::string(file_path));
+}
+HANDLE_EXCEPTIONS_AND_RETURN(, file_path)
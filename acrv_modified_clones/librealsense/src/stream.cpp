@@ -6,6 +6,14 @@
 #include "image.h"      // For image alignment, rectification, and deprojection routines
 #include <algorithm>    // For sort
 #include <tuple>        // For make_tuple
+#include <cstdlib>      // For getenv
+#include <cctype>       // For isalnum
+#include <cerrno>
+#ifdef _WIN32
+#include <direct.h>     // For _mkdir
+#else
+#include <sys/stat.h>   // For mkdir
+#endif
 
 using namespace rsimpl;
 
@@ -75,7 +83,7 @@ subdevice_mode_selection native_stream::get_mode() const
         }   
         throw std::logic_error("no mode found"); // Should never happen, select_modes should throw if no mode can be found
     }
-    throw std::runtime_error(to_string() << "stream not enabled: " << stream);
+    throw std::runtime_error(to_string() << "stream not enabled: " << get_string(stream));
 }
 
 rs_intrinsics native_stream::get_intrinsics() const 
@@ -101,56 +109,56 @@ rs_intrinsics native_stream::get_rectified_intrinsics() const
 
 double native_stream::get_frame_metadata(rs_frame_metadata frame_metadata) const
 {
-    if (!is_enabled()) throw std::runtime_error(to_string() << "stream not enabled: " << stream);
+    if (!is_enabled()) throw std::runtime_error(to_string() << "stream not enabled: " << get_string(stream));
     if (!archive) throw  std::runtime_error(to_string() << "streaming not started!");
     return archive->get_frame_metadata(stream, frame_metadata);
 }
 
 bool native_stream::supports_frame_metadata(rs_frame_metadata frame_metadata) const
 {
-    if (!is_enabled()) throw std::runtime_error(to_string() << "stream not enabled: " << stream);
+    if (!is_enabled()) throw std::runtime_error(to_string() << "stream not enabled: " << get_string(stream));
     if (!archive) throw  std::runtime_error(to_string() << "streaming not started!");
     return archive->supports_frame_metadata(stream, frame_metadata);
 }
 
 unsigned long long native_stream::get_frame_number() const
 { 
-    if (!is_enabled()) throw std::runtime_error(to_string() << "stream not enabled: " << stream);
+    if (!is_enabled()) throw std::runtime_error(to_string() << "stream not enabled: " << get_string(stream));
     if (!archive) throw  std::runtime_error(to_string() << "streaming not started!");
     return archive->get_frame_number(stream);
 }
 
 double native_stream::get_frame_timestamp() const
 {
-    if (!is_enabled()) throw std::runtime_error(to_string() << "stream not enabled: " << stream);
+    if (!is_enabled()) throw std::runtime_error(to_string() << "stream not enabled: " << get_string(stream));
     if (!archive) throw  std::runtime_error(to_string() << "streaming not started!");
     return archive->get_frame_timestamp(stream);
 }
 
 long long native_stream::get_frame_system_time() const
 {
-    if (!is_enabled()) throw std::runtime_error(to_string() << "stream not enabled: " << stream);
+    if (!is_enabled()) throw std::runtime_error(to_string() << "stream not enabled: " << get_string(stream));
     if (!archive) throw  std::runtime_error(to_string() << "streaming not started!");
     return archive->get_frame_system_time(stream);
 }
 
 const uint8_t * native_stream::get_frame_data() const
 {
-    if(!is_enabled()) throw std::runtime_error(to_string() << "stream not enabled: " << stream);
+    if(!is_enabled()) throw std::runtime_error(to_string() << "stream not enabled: " << get_string(stream));
     if (!archive) throw  std::runtime_error(to_string() << "streaming not started!");
     return (const uint8_t *) archive->get_frame_data(stream);
 }
 
 int native_stream::get_frame_stride() const
 {
-    if (!is_enabled()) throw std::runtime_error(to_string() << "stream not enabled: " << stream);
+    if (!is_enabled()) throw std::runtime_error(to_string() << "stream not enabled: " << get_string(stream));
     if (!archive) throw  std::runtime_error(to_string() << "streaming not started!");
     return archive->get_frame_stride(stream);
 }
 
 int native_stream::get_frame_bpp() const
 {
-    if (!is_enabled()) throw std::runtime_error(to_string() << "stream not enabled: " << stream);
+    if (!is_enabled()) throw std::runtime_error(to_string() << "stream not enabled: " << get_string(stream));
     if (!archive) throw  std::runtime_error(to_string() << "streaming not started!");
     return archive->get_frame_bpp(stream);
 }
@@ -159,15 +167,21 @@ const uint8_t * point_stream::get_frame_data() const
 {
     if(image.empty() || number != get_frame_number())
     {
-        image.resize(get_image_size(get_intrinsics().width, get_intrinsics().height, get_format()));
+        const auto intrin = get_intrinsics();
+        image.resize(get_image_size(intrin.width, intrin.height, get_format()));
+        if(table.empty() || !(table_intrin == intrin))
+        {
+            table = compute_deprojection_table(intrin);
+            table_intrin = intrin;
+        }
 
         if(source.get_format() == RS_FORMAT_Z16)
         {
-            deproject_z(reinterpret_cast<float *>(image.data()), get_intrinsics(), reinterpret_cast<const uint16_t *>(source.get_frame_data()), get_depth_scale());
+            deproject_z(reinterpret_cast<float *>(image.data()), table, intrin, reinterpret_cast<const uint16_t *>(source.get_frame_data()), get_depth_scale());
         }
         else if(source.get_format() == RS_FORMAT_DISPARITY16)
         {
-            deproject_disparity(reinterpret_cast<float *>(image.data()), get_intrinsics(), reinterpret_cast<const uint16_t *>(source.get_frame_data()), get_depth_scale());
+            deproject_disparity(reinterpret_cast<float *>(image.data()), table, intrin, reinterpret_cast<const uint16_t *>(source.get_frame_data()), get_depth_scale());
         }
         else assert(false && "Cannot deproject image from a non-depth format");
 
@@ -176,17 +190,82 @@ const uint8_t * point_stream::get_frame_data() const
     return image.data();
 }
 
+// Rectification tables are kept in RS_CACHE_DIR, or in the user's cache directory by default. Setting RS_CACHE_DIR to nothing disables the cache
+static std::string get_cache_directory()
+{
+    if(auto dir = std::getenv("RS_CACHE_DIR")) return dir;
+#ifdef _WIN32
+    if(auto dir = std::getenv("LOCALAPPDATA")) return std::string(dir) + "\\librealsense";
+#else
+    auto xdg_dir = std::getenv("XDG_CACHE_HOME");
+    if(xdg_dir && *xdg_dir) return std::string(xdg_dir) + "/librealsense";
+    if(auto home_dir = std::getenv("HOME")) return std::string(home_dir) + "/.cache/librealsense";
+#endif
+    return "";
+}
+
+static bool make_directories(const std::string & path)
+{
+    for(size_t i = 1; i <= path.size(); ++i)
+    {
+        if(i < path.size() && path[i] != '/' && path[i] != '\\') continue;
+#ifdef _WIN32
+        if(_mkdir(path.substr(0, i).c_str()) != 0 && errno != EEXIST) return false;
+#else
+        if(mkdir(path.substr(0, i).c_str(), 0755) != 0 && errno != EEXIST) return false;
+#endif
+    }
+    return true;
+}
+
+// Building the table for a large color mode takes long enough to delay the first frame, so tables are kept on disk per device and mode.
+// The file records the calibration the table was built from, and is rebuilt when the camera is recalibrated
+static rectification_table get_rectification_table(const std::string & serial, const rs_intrinsics & rect_intrin, const rs_extrinsics & rect_to_unrect, const rs_intrinsics & unrect_intrin)
+{
+    const auto dir = get_cache_directory();
+    std::string file_path;
+    if(!dir.empty() && !serial.empty())
+    {
+        std::string file_name = "rectification-";
+        for(auto c : serial) file_name += isalnum((unsigned char)c) ? c : '_';
+        file_name += std::string(to_string() << "-" << unrect_intrin.width << "x" << unrect_intrin.height << "-" << rect_intrin.width << "x" << rect_intrin.height << ".bin");
+        file_path = dir + "/" + file_name;
+
+        rectification_table table;
+        if(load_rectification_table(file_path, rect_intrin, rect_to_unrect, unrect_intrin, table))
+        {
+            LOG_DEBUG("Loaded rectification table from " << file_path);
+            return table;
+        }
+    }
+
+    auto table = compute_rectification_table(rect_intrin, rect_to_unrect, unrect_intrin);
+    if(!file_path.empty())
+    {
+        if(make_directories(dir) && save_rectification_table(file_path, table)) LOG_INFO("Cached rectification table in " << file_path);
+        else LOG_WARNING("Cannot cache rectification table in " << file_path);
+    }
+    return table;
+}
+
 const uint8_t * rectified_stream::get_frame_data() const
 {
     // If source image is already rectified, just return it without doing any work
     if(get_pose() == source.get_pose() && get_intrinsics() == source.get_intrinsics()) return source.get_frame_data();
 
-    if(image.empty() || number != get_frame_number())
+    std::lock_guard<std::mutex> lock(mutex);
+    const auto frame_number = get_frame_number();
+    if(image.empty() || number != frame_number)
     {
-        if(table.empty()) table = compute_rectification_table(get_intrinsics(), get_extrinsics_to(source), source.get_intrinsics());
-        image.resize(get_image_size(get_intrinsics().width, get_intrinsics().height, get_format()));
+        // The table only depends on calibration and mode, rebuild it if either changes
+        const auto rect_intrin = get_intrinsics(), unrect_intrin = source.get_intrinsics();
+        const auto rect_to_unrect = get_extrinsics_to(source);
+        if(!table.matches(rect_intrin, rect_to_unrect, unrect_intrin)) table = get_rectification_table(source.config.info.serial, rect_intrin, rect_to_unrect, unrect_intrin);
+
+        const auto image_size = get_image_size(rect_intrin.width, rect_intrin.height, get_format());
+        if(image.size() != image_size) image.resize(image_size);
         rectify_image(image.data(), table, source.get_frame_data(), get_format());
-        number = get_frame_number();
+        number = frame_number;
     }
     return image.data();
 }
@@ -197,21 +276,29 @@ const uint8_t * aligned_stream::get_frame_data() const
     {
         image.resize(get_image_size(get_intrinsics().width, get_intrinsics().height, get_format()));
         memset(image.data(), from.get_format() == RS_FORMAT_DISPARITY16 ? 0xFF : 0x00, image.size());
+
+        // The table only depends on calibration, rebuild it if that changes (e.g. on a mode switch)
+        const bool from_depth = from.get_format() == RS_FORMAT_Z16 || from.get_format() == RS_FORMAT_DISPARITY16;
+        const stream_interface & depth = from_depth ? from : to, & other = from_depth ? to : from;
+        const auto depth_intrin = depth.get_intrinsics(), other_intrin = other.get_intrinsics();
+        const auto depth_to_other = depth.get_extrinsics_to(other);
+        if(!table.matches(depth_intrin, depth_to_other, other_intrin)) table = compute_alignment_table(depth_intrin, depth_to_other, other_intrin);
+
         if(from.get_format() == RS_FORMAT_Z16)
         {
-            align_z_to_other(image.data(), (const uint16_t *)from.get_frame_data(), from.get_depth_scale(), from.get_intrinsics(), from.get_extrinsics_to(to), to.get_intrinsics());
+            align_z_to_other(image.data(), (const uint16_t *)from.get_frame_data(), from.get_depth_scale(), table);
         }
         else if(from.get_format() == RS_FORMAT_DISPARITY16)
         {
-            align_disparity_to_other(image.data(), (const uint16_t *)from.get_frame_data(), from.get_depth_scale(), from.get_intrinsics(), from.get_extrinsics_to(to), to.get_intrinsics());
+            align_disparity_to_other(image.data(), (const uint16_t *)from.get_frame_data(), from.get_depth_scale(), table);
         }
         else if(to.get_format() == RS_FORMAT_Z16)
         {
-            align_other_to_z(image.data(), (const uint16_t *)to.get_frame_data(), to.get_depth_scale(), to.get_intrinsics(), to.get_extrinsics_to(from), from.get_intrinsics(), from.get_frame_data(), from.get_format());
+            align_other_to_z(image.data(), (const uint16_t *)to.get_frame_data(), to.get_depth_scale(), table, from.get_frame_data(), from.get_format());
         }
         else if(to.get_format() == RS_FORMAT_DISPARITY16)
         {
-            align_other_to_disparity(image.data(), (const uint16_t *)to.get_frame_data(), to.get_depth_scale(), to.get_intrinsics(), to.get_extrinsics_to(from), from.get_intrinsics(), from.get_frame_data(), from.get_format());
+            align_other_to_disparity(image.data(), (const uint16_t *)to.get_frame_data(), to.get_depth_scale(), table, from.get_frame_data(), from.get_format());
         }
         else assert(false && "Cannot align two images if neither have depth data");
         number = get_frame_number();
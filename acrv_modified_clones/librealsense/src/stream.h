@@ -6,6 +6,7 @@
 #define LIBREALSENSE_STREAM_H
 
 #include "types.h"
+#include "image.h" // For alignment_table
 
 #include <memory> // For shared_ptr
 
@@ -65,10 +66,12 @@ namespace rsimpl
     class point_stream final : public stream_interface
     {
         const stream_interface &                source;
+        mutable std::vector<float>              table;
+        mutable rs_intrinsics                   table_intrin;
         mutable std::vector<uint8_t>            image;
         mutable unsigned long long              number;
     public:
-        point_stream(const stream_interface & source) :stream_interface(calibration_validator(), RS_STREAM_POINTS), source(source), number() {}
+        point_stream(const stream_interface & source) :stream_interface(calibration_validator(), RS_STREAM_POINTS), source(source), table_intrin(), number() {}
 
         pose                                    get_pose() const override { return {{{1,0,0},{0,1,0},{0,0,1}}, source.get_pose().position}; }
         float                                   get_depth_scale() const override { return source.get_depth_scale(); }
@@ -92,12 +95,13 @@ namespace rsimpl
 
     class rectified_stream final : public stream_interface
     {
-        const stream_interface &                source;
-        mutable std::vector<int>                table;
+        const native_stream &                   source;
+        mutable rectification_table             table;
         mutable std::vector<uint8_t>            image;
         mutable unsigned long long              number;
+        mutable std::mutex                      mutex; // Consumers on several threads share the image, which is rectified once per frame
     public:
-        rectified_stream(const stream_interface & source) : stream_interface(calibration_validator(), RS_STREAM_RECTIFIED_COLOR), source(source), number() {}
+        rectified_stream(const native_stream & source) : stream_interface(calibration_validator(), RS_STREAM_RECTIFIED_COLOR), source(source), table(), number() {}
 
         pose                                    get_pose() const override { return {{{1,0,0},{0,1,0},{0,0,1}}, source.get_pose().position}; }
         float                                   get_depth_scale() const override { return source.get_depth_scale(); }
@@ -122,6 +126,7 @@ namespace rsimpl
     class aligned_stream final : public stream_interface
     {
         const stream_interface &                from, & to;
+        mutable alignment_table                 table;
         mutable std::vector<uint8_t>            image;
         mutable unsigned long long              number;
     public:
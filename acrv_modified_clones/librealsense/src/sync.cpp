@@ -1,16 +1,14 @@
 #include <cmath>
 #include "sync.h"
+#include "trace.h"
 
 using namespace rsimpl;
 
 syncronizing_archive::syncronizing_archive(const std::vector<subdevice_mode_selection> & selection,
     rs_stream key_stream,
     std::atomic<uint32_t>* max_size,
-    std::atomic<uint32_t>* event_queue_size,
-    std::atomic<uint32_t>* events_timeout,
     std::chrono::high_resolution_clock::time_point capture_started)
-    : frame_archive(selection, max_size, capture_started), key_stream(key_stream),
-    ts_corrector(event_queue_size, events_timeout)
+    : frame_archive(selection, max_size, capture_started), key_stream(key_stream)
 {
     // Enumerate all streams we need to keep synchronized with the key stream
     for(auto s : {RS_STREAM_DEPTH, RS_STREAM_INFRARED, RS_STREAM_INFRARED2, RS_STREAM_COLOR, RS_STREAM_FISHEYE})
@@ -69,12 +67,19 @@ long long syncronizing_archive::get_frame_system_time(rs_stream stream) const
     return frontbuffer.get_frame_system_time(stream);
 }
 
+// Wait until the key stream has a frame queued. Only called from the application thread
+bool syncronizing_archive::wait_for_key_frame(std::chrono::milliseconds timeout)
+{
+    if(key_frame_ready()) return true;
+    std::unique_lock<std::mutex> lock(wait_mutex);
+    return cv.wait_for(lock, timeout, [this]() { return key_frame_ready(); });
+}
+
 // Block until the next coherent frameset is available
 void syncronizing_archive::wait_for_frames()
 {
-    std::unique_lock<std::recursive_mutex> lock(mutex);
-    const auto ready = [this]() { return !frames[key_stream].empty(); };
-    if(!ready() && !cv.wait_for(lock, std::chrono::seconds(5), ready)) throw std::runtime_error("Timeout waiting for frames.");
+    std::lock_guard<std::mutex> lock(application_mutex);
+    if(!wait_for_key_frame(std::chrono::seconds(5))) throw std::runtime_error("Timeout waiting for frames.");
     get_next_frames();
 }
 
@@ -82,8 +87,8 @@ void syncronizing_archive::wait_for_frames()
 bool syncronizing_archive::poll_for_frames()
 {
     // TODO: Implement a user-specifiable timeout for how long to wait before returning false?
-    std::unique_lock<std::recursive_mutex> lock(mutex);
-    if(frames[key_stream].empty()) return false;
+    std::lock_guard<std::mutex> lock(application_mutex);
+    if(!key_frame_ready()) return false;
     get_next_frames();
     return true;
 }
@@ -93,9 +98,8 @@ frame_archive::frameset* syncronizing_archive::wait_for_frames_safe()
     frameset * result = nullptr;
     do
     {
-        std::unique_lock<std::recursive_mutex> lock(mutex);
-        const auto ready = [this]() { return !frames[key_stream].empty(); };
-        if (!ready() && !cv.wait_for(lock, std::chrono::seconds(5), ready)) throw std::runtime_error("Timeout waiting for frames.");
+        std::lock_guard<std::mutex> lock(application_mutex);
+        if (!wait_for_key_frame(std::chrono::seconds(5))) throw std::runtime_error("Timeout waiting for frames.");
         get_next_frames();
         result = clone_frontbuffer();
     } 
@@ -106,8 +110,8 @@ frame_archive::frameset* syncronizing_archive::wait_for_frames_safe()
 bool syncronizing_archive::poll_for_frames_safe(frameset** frameset)
 {
     // TODO: Implement a user-specifiable timeout for how long to wait before returning false?
-    std::unique_lock<std::recursive_mutex> lock(mutex);
-    if (frames[key_stream].empty()) return false;
+    std::lock_guard<std::mutex> lock(application_mutex);
+    if (!key_frame_ready()) return false;
     get_next_frames();
     auto result = clone_frontbuffer();
     if (result)
@@ -118,9 +122,32 @@ bool syncronizing_archive::poll_for_frames_safe(frameset** frameset)
     return false;
 }
 
+// Take everything the callback threads have committed so far, without blocking them
+void syncronizing_archive::drain_queues()
+{
+    frame f;
+    for(int s = 0; s < RS_STREAM_NATIVE_COUNT; ++s)
+    {
+        while(queues[s].try_pop(f)) frames[s].push_back(std::move(f));
+
+        // Queued frames belong to the application thread alone, so late timestamp events can be written into them for matching
+        for(auto & queued : frames[s]) apply_pending_correction(queued);
+    }
+}
+
+void syncronizing_archive::apply_pending_correction(frame & f)
+{
+    if(f.additional_data.pending_correction && ts_corrector.correct_timestamp(f, f.get_stream_type()))
+        f.additional_data.pending_correction = nullptr;
+}
+
 // Move frames from the queues to the frontbuffers to form the next coherent frameset
 void syncronizing_archive::get_next_frames()
 {
+    // Timestamp matching is done here on the application thread, the callback threads only ever push to their queue
+    drain_queues();
+    cull_frames();
+
     // Always dequeue a frame from the key stream
     dequeue_frame(key_stream);
 
@@ -144,25 +171,39 @@ void syncronizing_archive::get_next_frames()
 // Move a frame from the backbuffer to the back of the queue
 void syncronizing_archive::commit_frame(rs_stream stream)
 {
-    std::unique_lock<std::recursive_mutex> lock(mutex);
-    frames[stream].push_back(std::move(backbuffer[stream]));
-    cull_frames();
-    lock.unlock();
-    if(!frames[key_stream].empty()) cv.notify_one();
+    backbuffer[stream].additional_data.frame_committed = std::chrono::high_resolution_clock::now();
+    while(!queues[stream].try_push(std::move(backbuffer[stream])))
+    {
+        // The application has fallen behind, drop the oldest queued frame so it still gets the most recent ones
+        frame oldest;
+        if(queues[stream].try_pop(oldest)) recycle_frame(std::move(oldest));
+    }
+
+    // Only a key stream frame can complete a frameset, so only those need to wake the application
+    if(stream == key_stream)
+    {
+        // Taking the lock orders this push against a waiter checking its predicate, so the notification cannot be lost
+        { std::lock_guard<std::mutex> lock(wait_mutex); }
+        cv.notify_one();
+    }
 }
 
 void syncronizing_archive::flush()
 {
+    for(int s = 0; s < RS_STREAM_NATIVE_COUNT; ++s)
+    {
+        if(dispatch_latency[s].get_total()) LOG_INFO("Commit to dispatch latency of " << rsimpl::get_string((rs_stream)s) << ": " << dispatch_latency[s].to_string());
+    }
     frontbuffer.cleanup(); // frontbuffer also holds frame references, since its content is publicly available through get_frame_data
     frame_archive::flush();
 }
 
+// Called from the frame callback thread before the frame is committed. If its event has not arrived yet, the frame goes out with the
+// camera timestamp rather than waiting, and is corrected once the event arrives
 void syncronizing_archive::correct_timestamp(rs_stream stream)
 {
-    if (is_stream_enabled(stream))
-        {
-            ts_corrector.correct_timestamp(backbuffer[stream], stream);
-        }
+    if (is_stream_enabled(stream) && !ts_corrector.correct_timestamp(backbuffer[stream], stream))
+        backbuffer[stream].additional_data.pending_correction = &ts_corrector;
 }
 
 void syncronizing_archive::on_timestamp(rs_timestamp_data data)
@@ -175,7 +216,7 @@ int syncronizing_archive::get_frame_stride(rs_stream stream) const
     return frontbuffer.get_frame_stride(stream);
 }
 
-// Discard all frames which are older than the most recent coherent frameset
+// Discard all frames which are older than the most recent coherent frameset. Only called from the application thread
 void syncronizing_archive::cull_frames()
 {
     // Never keep more than four frames around in any given stream, regardless of timestamps
@@ -225,7 +266,7 @@ void syncronizing_archive::cull_frames()
     }
 }
 
-// Move a single frame from the head of the queue to the front buffer, while recycling the front buffer into the freelist
+// Move a single frame from the head of the queue to the front buffer, releasing the frame it replaces
 void syncronizing_archive::dequeue_frame(rs_stream stream)
 {
     auto & frame = frames[stream].front();
@@ -235,15 +276,69 @@ void syncronizing_archive::dequeue_frame(rs_stream stream)
     frame.update_frame_callback_start_ts(callback_start_time);
     auto ts = std::chrono::duration_cast<std::chrono::milliseconds>(callback_start_time - capture_started).count();
     LOG_DEBUG("CallbackStarted," << rsimpl::get_string(frame.get_stream_type()) << "," << frame.get_frame_number() << ",DispatchedAt," << ts);
+    if(frame.additional_data.frame_committed != std::chrono::high_resolution_clock::time_point())
+    {
+        dispatch_latency[stream].record(callback_start_time - frame.additional_data.frame_committed);
+
+        // The span from commit to dispatch, moved onto the trace clock
+        if(trace::is_enabled())
+        {
+            auto end = trace::now();
+            auto begin = end - std::chrono::duration_cast<std::chrono::nanoseconds>(callback_start_time - frame.additional_data.frame_committed).count();
+            trace::record_span("sync dispatch", stream, frame.get_frame_number(), begin, end);
+        }
+    }
 
     frontbuffer.place_frame(stream, std::move(frames[stream].front())); // the frame will move to free list once there are no external references to it
-    frames[stream].erase(begin(frames[stream]));
+    frames[stream].pop_front();
 }
 
-// Move a single frame from the head of the queue directly to the freelist
+// Drop a single frame from the head of the queue
 void syncronizing_archive::discard_frame(rs_stream stream)
 {
-    std::lock_guard<std::recursive_mutex> guard(mutex);
-    freelist.push_back(std::move(frames[stream].front()));
-    frames[stream].erase(begin(frames[stream]));
+    recycle_frame(std::move(frames[stream].front()));
+    frames[stream].pop_front();
+}
+
+void syncronizing_archive::recycle_frame(frame && frame)
+{
+    frame.recycle();
+}
+
+void latency_histogram::record(std::chrono::high_resolution_clock::duration latency)
+{
+    // Bucket 0 holds latencies under 1us, bucket i holds [2^(i-1), 2^i)us
+    auto us = std::chrono::duration_cast<std::chrono::microseconds>(latency).count();
+    int bucket = 0;
+    while(us > 0 && bucket < bucket_count - 1)
+    {
+        us >>= 1;
+        ++bucket;
+    }
+    buckets[bucket].fetch_add(1, std::memory_order_relaxed);
+}
+
+unsigned long long latency_histogram::get_total() const
+{
+    unsigned long long total = 0;
+    for(auto & bucket : buckets) total += bucket.load(std::memory_order_relaxed);
+    return total;
+}
+
+double latency_histogram::get_percentile(double fraction) const
+{
+    const auto total = get_total();
+    unsigned long long seen = 0;
+    for(int i = 0; i < bucket_count; ++i)
+    {
+        seen += get_count(i);
+        if(seen > 0 && seen >= fraction * total) return std::ldexp(1.0, i);
+    }
+    return 0;
+}
+
+std::string latency_histogram::to_string() const
+{
+    return rsimpl::to_string() << get_total() << " frames, 50% under " << get_percentile(0.5) << "us, 90% under " << get_percentile(0.9)
+                               << "us, 99% under " << get_percentile(0.99) << "us";
 }
@@ -9,6 +9,7 @@
 #include <atomic>
 #include "timestamps.h"
 #include <chrono>
+#include <deque>
 
 namespace rsimpl
 {
@@ -48,9 +49,30 @@ namespace rsimpl
         std::vector<std::chrono::time_point<std::chrono::system_clock>> _time_samples;
     };
 
+    // Power of two histogram of latencies in microseconds, safe to record from one thread while others read it
+    class latency_histogram
+    {
+    public:
+        static const int bucket_count = 24; // The last bucket collects everything from 2^23us (~8s) up
+
+        latency_histogram() { for (auto & bucket : buckets) bucket = 0; }
+
+        void record(std::chrono::high_resolution_clock::duration latency);
+        unsigned long long get_count(int bucket) const { return buckets[bucket].load(std::memory_order_relaxed); }
+        unsigned long long get_total() const;
+        double get_percentile(double fraction) const; // Upper edge of the bucket holding the given fraction of samples, in microseconds
+        std::string to_string() const;
+
+    private:
+        std::atomic<unsigned long long> buckets[bucket_count];
+    };
+
     class syncronizing_archive : public frame_archive
     {
     private:
+        // Frames committed but not yet seen by the application. Must be a power of two
+        static const int frame_queue_capacity = 4;
+
         // This data will be left constant after creation, and accessed from all threads
         subdevice_mode_selection modes[RS_STREAM_NATIVE_COUNT];
         rs_stream key_stream;
@@ -58,14 +80,24 @@ namespace rsimpl
 
         // This data will be read and written exclusively from the application thread
         frameset frontbuffer;
+        std::deque<frame> frames[RS_STREAM_NATIVE_COUNT];
+        std::mutex application_mutex;
 
-        // This data will be read and written by all threads, and synchronized with a mutex
-        std::vector<frame> frames[RS_STREAM_NATIVE_COUNT];
-        std::condition_variable_any cv;
-        
+        // Each queue is pushed by the single callback thread producing that stream and drained by the application thread
+        bounded_queue<frame, frame_queue_capacity> queues[RS_STREAM_NATIVE_COUNT];
+        std::mutex wait_mutex;
+        std::condition_variable cv;
+
+        latency_histogram dispatch_latency[RS_STREAM_NATIVE_COUNT];
+
+        bool key_frame_ready() const { return !frames[key_stream].empty() || !queues[key_stream].empty(); }
+        bool wait_for_key_frame(std::chrono::milliseconds timeout);
+        void drain_queues();
+        void apply_pending_correction(frame & f);
         void get_next_frames();
         void dequeue_frame(rs_stream stream);
         void discard_frame(rs_stream stream);
+        void recycle_frame(frame && frame);
         void cull_frames();
 
         timestamp_corrector            ts_corrector;
@@ -73,8 +105,6 @@ namespace rsimpl
         syncronizing_archive(const std::vector<subdevice_mode_selection> & selection, 
             rs_stream key_stream, 
             std::atomic<uint32_t>* max_size,
-            std::atomic<uint32_t>* event_queue_size,
-            std::atomic<uint32_t>* events_timeout,
             std::chrono::high_resolution_clock::time_point capture_started = std::chrono::high_resolution_clock::now());
         
         // Application thread API
@@ -103,6 +133,9 @@ namespace rsimpl
         void correct_timestamp(rs_stream stream);
         void on_timestamp(rs_timestamp_data data);
 
+        // Time from commit_frame to the frame reaching the frontbuffer, safe to call from any thread
+        const latency_histogram & get_dispatch_latency(rs_stream stream) const { return dispatch_latency[stream]; }
+
     };
 }
 
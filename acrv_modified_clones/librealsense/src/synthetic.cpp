@@ -0,0 +1,198 @@
+// License: Apache 2.0. See LICENSE file in root directory.
+
+#define _USE_MATH_DEFINES
+#include <math.h>
+#include <algorithm>
+#include <limits>
+
+#include "image.h"
+#include "synthetic.h"
+
+namespace rsimpl
+{
+    struct synthetic_mode { int2 dims; std::vector<int> fps; };
+
+    static const synthetic_mode synthetic_color_modes[] = {
+        {{1920, 1080}, {30}},
+        {{1280,  720}, {30,60}},
+        {{ 640,  480}, {30,60}},
+        {{ 320,  240}, {30,60}}
+    };
+    static const synthetic_mode synthetic_depth_modes[] = {
+        {{640, 480}, {30,60,90}},
+        {{320, 240}, {30,60,90}}
+    };
+
+    // Distortion free pinhole intrinsics with the given horizontal field of view
+    static rs_intrinsics make_synthetic_intrinsics(const int2 & dims, float hfov_degrees)
+    {
+        const float focal = dims.x / (2 * std::tan(hfov_degrees * (float)M_PI / 360));
+        return {dims.x, dims.y, (dims.x - 1) / 2.0f, (dims.y - 1) / 2.0f, focal, focal, RS_DISTORTION_NONE, {0,0,0,0,0}};
+    }
+
+    static static_device_info get_synthetic_info()
+    {
+        static_device_info info;
+        info.name = "Synthetic Camera";
+
+        // Color modes on subdevice 0
+        info.stream_subdevices[RS_STREAM_COLOR] = 0;
+        for(auto & m : synthetic_color_modes)
+        {
+            for(auto fps : m.fps)
+            {
+                info.subdevice_modes.push_back({0, m.dims, pf_yuy2, fps, make_synthetic_intrinsics(m.dims, 70), {}, {0}});
+            }
+        }
+
+        // Depth modes on subdevice 1, IR modes on subdevice 2
+        info.stream_subdevices[RS_STREAM_DEPTH] = 1;
+        info.stream_subdevices[RS_STREAM_INFRARED] = 2;
+        for(auto & m : synthetic_depth_modes)
+        {
+            for(auto fps : m.fps)
+            {
+                info.subdevice_modes.push_back({1, m.dims, pf_z16, fps, make_synthetic_intrinsics(m.dims, 60), {}, {0}});
+                info.subdevice_modes.push_back({2, m.dims, pf_y8, fps, make_synthetic_intrinsics(m.dims, 60), {}, {0}});
+                info.subdevice_modes.push_back({2, m.dims, pf_y16, fps, make_synthetic_intrinsics(m.dims, 60), {}, {0}});
+            }
+        }
+
+        for(int i = 0; i < RS_PRESET_COUNT; i++)
+        {
+            info.presets[RS_STREAM_COLOR   ][i] = {true, 640, 480, RS_FORMAT_RGB8, 30, RS_OUTPUT_BUFFER_FORMAT_CONTINUOUS};
+            info.presets[RS_STREAM_DEPTH   ][i] = {true, 640, 480, RS_FORMAT_Z16,  30, RS_OUTPUT_BUFFER_FORMAT_CONTINUOUS};
+            info.presets[RS_STREAM_INFRARED][i] = {true, 640, 480, RS_FORMAT_Y8,   30, RS_OUTPUT_BUFFER_FORMAT_CONTINUOUS};
+        }
+        info.presets[RS_STREAM_COLOR   ][RS_PRESET_LARGEST_IMAGE] = {true, 1920, 1080, RS_FORMAT_RGB8, 30, RS_OUTPUT_BUFFER_FORMAT_CONTINUOUS};
+        info.presets[RS_STREAM_DEPTH   ][RS_PRESET_HIGHEST_FRAMERATE] = {true, 640, 480, RS_FORMAT_Z16, 90, RS_OUTPUT_BUFFER_FORMAT_CONTINUOUS};
+        info.presets[RS_STREAM_INFRARED][RS_PRESET_HIGHEST_FRAMERATE] = {true, 640, 480, RS_FORMAT_Y8,  90, RS_OUTPUT_BUFFER_FORMAT_CONTINUOUS};
+
+        // Depth and IR share an imager, 25mm to the side of the color imager
+        info.stream_poses[RS_STREAM_DEPTH] = info.stream_poses[RS_STREAM_INFRARED] = {{{1,0,0},{0,1,0},{0,0,1}}, {0.025f,0,0}};
+        info.stream_poses[RS_STREAM_COLOR] = {{{1,0,0},{0,1,0},{0,0,1}}, {0,0,0}};
+
+        info.nominal_depth_scale = 0.001f;
+        rs_device_base::update_device_info(info);
+        return info;
+    }
+
+    synthetic_camera::synthetic_camera(std::shared_ptr<uvc::device> device, const static_device_info & info) :
+        rs_device_base(device, info)
+    {
+    }
+
+    void synthetic_camera::set_options(const rs_option options[], size_t count, const double values[])
+    {
+        std::vector<rs_option>  base_opt;
+        std::vector<double>     base_opt_val;
+
+        for (size_t i = 0; i < count; ++i)
+        {
+            if (uvc::is_pu_control(options[i]))
+            {
+                // Disabling auto-setting controls, if needed
+                switch (options[i])
+                {
+                case RS_OPTION_COLOR_WHITE_BALANCE:     disable_auto_option(0, RS_OPTION_COLOR_ENABLE_AUTO_WHITE_BALANCE); break;
+                case RS_OPTION_COLOR_EXPOSURE:          disable_auto_option(0, RS_OPTION_COLOR_ENABLE_AUTO_EXPOSURE); break;
+                default:  break;
+                }
+
+                uvc::set_pu_control_with_retry(get_device(), 0, options[i], static_cast<int>(values[i]));
+                continue;
+            }
+
+            base_opt.push_back(options[i]);
+            base_opt_val.push_back(values[i]);
+        }
+
+        if (!base_opt.empty())
+            rs_device_base::set_options(base_opt.data(), base_opt.size(), base_opt_val.data());
+    }
+
+    void synthetic_camera::get_options(const rs_option options[], size_t count, double values[])
+    {
+        for (size_t i = 0; i < count; ++i)
+        {
+            if (uvc::is_pu_control(options[i]))
+                values[i] = uvc::get_pu_control_with_retry(get_device(), 0, options[i]);
+            else
+                rs_device_base::get_options(&options[i], 1, &values[i]);
+        }
+    }
+
+    void synthetic_camera::on_before_start(const std::vector<subdevice_mode_selection> & /*selected_modes*/)
+    {
+    }
+
+    rs_stream synthetic_camera::select_key_stream(const std::vector<subdevice_mode_selection> & selected_modes)
+    {
+        int fps[RS_STREAM_NATIVE_COUNT] = {}, max_fps = 0;
+        for (const auto & m : selected_modes)
+        {
+            for (const auto & output : m.get_outputs())
+            {
+                fps[output.first] = m.mode.fps;
+                max_fps = std::max(max_fps, m.mode.fps);
+            }
+        }
+
+        // Prefer to sync on depth or infrared, but select the stream running at the fastest framerate
+        for (auto s : { RS_STREAM_DEPTH, RS_STREAM_INFRARED, RS_STREAM_COLOR })
+        {
+            if (fps[s] == max_fps) return s;
+        }
+        return RS_STREAM_DEPTH;
+    }
+
+    // Reads the frame counter stamped by the synthetic backend. Timestamps are nominal, counter / fps, so streams running at
+    // the same rate line up exactly in the syncronizing archive regardless of how fast the backend is actually replaying.
+    class synthetic_timestamp_reader : public frame_timestamp_reader
+    {
+        wraparound_mechanism<unsigned long long> counter;
+    public:
+        synthetic_timestamp_reader() : counter(0, std::numeric_limits<uint32_t>::max()) {}
+
+        bool validate_frame(const subdevice_mode & /*mode*/, const void * /*frame*/) override
+        {
+            return true;
+        }
+
+        double get_frame_timestamp(const subdevice_mode & mode, const void * frame, double /*actual_fps*/) override
+        {
+            return get_frame_counter(mode, frame) * 1000.0 / mode.fps;
+        }
+
+        unsigned long long get_frame_counter(const subdevice_mode & /*mode*/, const void * frame) override
+        {
+            auto bytes = reinterpret_cast<const uint8_t *>(frame);
+            return counter.fix(bytes[0] | bytes[1] << 8 | bytes[2] << 16 | (unsigned long long)bytes[3] << 24);
+        }
+    };
+
+    std::vector<std::shared_ptr<frame_timestamp_reader>> synthetic_camera::create_frame_timestamp_readers() const
+    {
+        return {std::make_shared<synthetic_timestamp_reader>(), std::make_shared<synthetic_timestamp_reader>(), std::make_shared<synthetic_timestamp_reader>()};
+    }
+
+    std::shared_ptr<rs_device> make_synthetic_device(std::shared_ptr<uvc::device> device)
+    {
+        LOG_INFO("Connecting to synthetic camera");
+
+        auto info = get_synthetic_info();
+        info.serial = uvc::get_usb_port_id(*device);
+        info.firmware_version = "1.0.0.0";
+
+        info.camera_info[RS_CAMERA_INFO_CAMERA_FIRMWARE_VERSION] = info.firmware_version;
+        info.camera_info[RS_CAMERA_INFO_DEVICE_SERIAL_NUMBER] = info.serial;
+        info.camera_info[RS_CAMERA_INFO_DEVICE_NAME] = info.name;
+
+        info.capabilities_vector.push_back(RS_CAPABILITIES_ENUMERATION);
+        info.capabilities_vector.push_back(RS_CAPABILITIES_COLOR);
+        info.capabilities_vector.push_back(RS_CAPABILITIES_DEPTH);
+        info.capabilities_vector.push_back(RS_CAPABILITIES_INFRARED);
+
+        return std::make_shared<synthetic_camera>(device, info);
+    }
+} // namespace rsimpl
@@ -0,0 +1,33 @@
+// License: Apache 2.0. See LICENSE file in root directory.
+
+#pragma once
+#ifndef LIBREALSENSE_SYNTHETIC_H
+#define LIBREALSENSE_SYNTHETIC_H
+
+#include "device.h"
+
+// Product ID reported by the synthetic UVC backend (uvc-synthetic.cpp), which is never enumerated by real hardware
+#define SYNTHETIC_PRODUCT_ID 0xffff
+
+namespace rsimpl
+{
+    // A camera with no firmware, served by the synthetic backend: color YUY2 on subdevice 0, Z16 depth on subdevice 1 and
+    // Y8/Y16 infrared on subdevice 2. The backend stamps a little endian 32 bit frame counter into the first four bytes of
+    // every payload, which is where timestamps and frame numbers are read from.
+    class synthetic_camera final : public rs_device_base
+    {
+    public:
+        synthetic_camera(std::shared_ptr<uvc::device> device, const static_device_info & info);
+        ~synthetic_camera() {}
+
+        void set_options(const rs_option options[], size_t count, const double values[]) override;
+        void get_options(const rs_option options[], size_t count, double values[]) override;
+        void on_before_start(const std::vector<subdevice_mode_selection> & selected_modes) override;
+        rs_stream select_key_stream(const std::vector<subdevice_mode_selection> & selected_modes) override;
+        std::vector<std::shared_ptr<frame_timestamp_reader>> create_frame_timestamp_readers() const override;
+    };
+
+    std::shared_ptr<rs_device> make_synthetic_device(std::shared_ptr<uvc::device> device);
+}
+
+#endif
@@ -1,95 +1,44 @@
 #include "timestamps.h"
-#include "sync.h"
-#include <algorithm>
 
 using namespace rsimpl;
-using namespace std;
 
+static_assert((RS_MAX_EVENT_QUEUE_SIZE & (RS_MAX_EVENT_QUEUE_SIZE - 1)) == 0, "RS_MAX_EVENT_QUEUE_SIZE must be a power of two");
 
+static const unsigned long long empty_slot = ~0ULL;
 
-void concurrent_queue::push_back_data(rs_timestamp_data data)
+timestamp_event_ring::timestamp_event_ring()
 {
-    lock_guard<mutex> lock(mtx);
-
-    data_queue.push_back(data);
-}
-
-bool concurrent_queue::pop_front_data()
-{
-    lock_guard<mutex> lock(mtx);
-
-    if (!data_queue.size())
-        return false;
-
-    data_queue.pop_front();
-
-    return true;
-}
-
-bool concurrent_queue::erase(rs_timestamp_data data)
-{
-    lock_guard<mutex> lock(mtx);
-
-    auto it = find_if(data_queue.begin(), data_queue.end(),
-                      [&](const rs_timestamp_data& element) {
-        return (data.frame_number == element.frame_number);
-    });
-
-    if (it != data_queue.end())
-    {
-        data_queue.erase(it);
-        return true;
-    }
-
-    return false;
-}
-
-size_t concurrent_queue::size()
-{
-    lock_guard<mutex> lock(mtx);
-
-    return data_queue.size();
-}
-
-bool concurrent_queue::correct( frame_interface& frame)
-{
-    lock_guard<mutex> lock(mtx);
-    
-    auto it = find_if(data_queue.begin(), data_queue.end(),
-                      [&](const rs_timestamp_data& element) {
-        return ((frame.get_frame_number() == element.frame_number));
-    });
-
-    if (it != data_queue.end())
+    for (auto & s : slots)
     {
-        frame.set_timestamp(it->timestamp);
-        return true;
+        s.frame_number = empty_slot;
+        s.timestamp = 0;
     }
-    return false;
 }
 
-timestamp_corrector::timestamp_corrector(std::atomic<uint32_t>* queue_size, std::atomic<uint32_t>* timeout)
-    :event_queue_size(queue_size), events_timeout(timeout)
+void timestamp_event_ring::push(const rs_timestamp_data & data)
 {
+    auto & s = slots[data.frame_number & (RS_MAX_EVENT_QUEUE_SIZE - 1)];
+    s.frame_number.store(empty_slot, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    s.timestamp.store(data.timestamp, std::memory_order_relaxed);
+    s.frame_number.store(data.frame_number, std::memory_order_release);
 }
 
-timestamp_corrector::~timestamp_corrector()
+bool timestamp_event_ring::find(unsigned long long frame_number, double & timestamp) const
 {
-}
+    auto & s = slots[frame_number & (RS_MAX_EVENT_QUEUE_SIZE - 1)];
+    if (s.frame_number.load(std::memory_order_acquire) != frame_number) return false;
+    auto ts = s.timestamp.load(std::memory_order_relaxed);
 
-void timestamp_corrector::on_timestamp(rs_timestamp_data data)
-{
-    lock_guard<mutex> lock(mtx);
-
-    if (data_queue[data.source_id].size() <= *event_queue_size)
-        data_queue[data.source_id].push_back_data(data);
-    if (data_queue[data.source_id].size() > *event_queue_size)
-        data_queue[data.source_id].pop_front_data();
+    // If the slot was rewritten while the timestamp was read, the tag no longer matches
+    std::atomic_thread_fence(std::memory_order_acquire);
+    if (s.frame_number.load(std::memory_order_relaxed) != frame_number) return false;
 
-    cv.notify_one();
+    timestamp = ts;
+    return true;
 }
 
-void timestamp_corrector::update_source_id(rs_event_source& source_id, const rs_stream stream)
+static bool get_source_id(rs_stream stream, rs_event_source & source_id)
 {
     switch(stream)
     {
@@ -98,31 +47,34 @@ void timestamp_corrector::update_source_id(rs_event_source& source_id, const rs_
     case RS_STREAM_INFRARED:
     case RS_STREAM_INFRARED2:
         source_id = RS_EVENT_IMU_DEPTH_CAM;
-        break;
+        return true;
     case RS_STREAM_FISHEYE:
         source_id = RS_EVENT_IMU_MOTION_CAM;
-        break;
+        return true;
     default:
-        throw std::runtime_error(to_string() << "Unsupported source stream requested " << rs_stream_to_string(stream));
+        return false;
     }
 }
 
-void timestamp_corrector::correct_timestamp(frame_interface& frame, rs_stream stream)
+void timestamp_corrector::on_timestamp(const rs_timestamp_data & data)
 {
-    unique_lock<mutex> lock(mtx);
+    if (data.source_id < 0 || data.source_id >= RS_EVENT_SOURCE_COUNT) return;
+    events[data.source_id].push(data);
+}
 
-    bool res;
+bool timestamp_corrector::find_timestamp(rs_stream stream, unsigned long long frame_number, double & timestamp) const
+{
     rs_event_source source_id;
-    update_source_id(source_id, stream);
-    if (!(res = data_queue[source_id].correct(frame)))
-    {
-        const auto ready = [&]() { return data_queue[source_id].correct(frame); };
-        res = cv.wait_for(lock, std::chrono::milliseconds(*events_timeout), ready);
-    }
+    if (!get_source_id(stream, source_id)) throw std::runtime_error(to_string() << "Unsupported source stream requested " << rs_stream_to_string(stream));
+    return events[source_id].find(frame_number, timestamp);
+}
 
-    if (res)
-    {
-        frame.set_timestamp_domain(RS_TIMESTAMP_DOMAIN_MICROCONTROLLER);
-    }
-    lock.unlock();
+bool timestamp_corrector::correct_timestamp(frame_interface& frame, rs_stream stream) const
+{
+    double timestamp;
+    if (!find_timestamp(stream, frame.get_frame_number(), timestamp)) return false;
+
+    frame.set_timestamp(timestamp);
+    frame.set_timestamp_domain(RS_TIMESTAMP_DOMAIN_MICROCONTROLLER);
+    return true;
 }
@@ -2,10 +2,7 @@
 #ifndef LIBREALSENSE_TIMESTAMPS_H
 #define LIBREALSENSE_TIMESTAMPS_H
 
-#include "../include/librealsense/rs.h"     // Inherit all type definitions in the public API
-#include <deque>
-#include <condition_variable>
-#include <mutex>
+#include "types.h"
 #include <atomic>
 
 
@@ -23,49 +20,38 @@ namespace rsimpl
     };
 
 
-    class concurrent_queue{
+    // The most recent timestamp events of one source, in slots indexed by frame number so that a frame finds its event in O(1).
+    // Written only by the motion module thread and read from any thread without locking. Each slot is tagged with its frame
+    // number, which is cleared while the slot is rewritten, so a reader never takes the timestamp of another frame.
+    class timestamp_event_ring
+    {
     public:
-        void    push_back_data(rs_timestamp_data data);
-        bool    pop_front_data();
-        bool    erase(rs_timestamp_data data);
-        bool    correct(frame_interface& frame);
-        size_t  size();
+        timestamp_event_ring();
 
-        private:
-        std::deque<rs_timestamp_data> data_queue;
-        std::mutex mtx;
+        void push(const rs_timestamp_data & data);
+        bool find(unsigned long long frame_number, double & timestamp) const;
 
+    private:
+        struct slot
+        {
+            std::atomic<unsigned long long> frame_number;
+            std::atomic<double> timestamp;
+        };
+        slot slots[RS_MAX_EVENT_QUEUE_SIZE];
     };
 
-    class timestamp_corrector_interface{
-    public:
-        virtual ~timestamp_corrector_interface() {}
-        virtual void on_timestamp(rs_timestamp_data data) = 0;
-        virtual void correct_timestamp(frame_interface& frame, rs_stream stream) = 0;
-        virtual void release() = 0;
-    };
-
-
-    class timestamp_corrector : public timestamp_corrector_interface{
+    // Replaces the camera timestamps of frames with those of the motion module events sent for the same frames. Frames are never
+    // held back waiting for their event: one whose event has not arrived yet is published with its camera timestamp, and reads
+    // the event timestamp from here once it has arrived (see frame_archive::frame::get_frame_timestamp).
+    class timestamp_corrector
+    {
     public:
-        timestamp_corrector(std::atomic<uint32_t>* event_queue_size, std::atomic<uint32_t>* events_timeout);
-        ~timestamp_corrector() override;
-        void on_timestamp(rs_timestamp_data data) override;
-        void correct_timestamp(frame_interface& frame, rs_stream stream) override;
-        void release() override  {delete this;}
+        void on_timestamp(const rs_timestamp_data & data);
+        bool find_timestamp(rs_stream stream, unsigned long long frame_number, double & timestamp) const;
+        bool correct_timestamp(frame_interface & frame, rs_stream stream) const; // Returns false if the event has not arrived yet
 
     private:
-        void update_source_id(rs_event_source& source_id, const rs_stream stream);
-
-        std::mutex mtx;
-        concurrent_queue data_queue[RS_EVENT_SOURCE_COUNT];
-        std::condition_variable cv;
-        std::atomic<uint32_t>* event_queue_size;
-        std::atomic<uint32_t>* events_timeout;
-
+        timestamp_event_ring events[RS_EVENT_SOURCE_COUNT];
     };
-
-
-
 } // namespace rsimpl
 #endif // LIBREALSENSE_TIMESTAMPS_H
@@ -0,0 +1,215 @@
+// License: Apache 2.0. See LICENSE file in root directory.
+
+#include "trace.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#ifdef _WIN32
+#include <process.h>
+#define getpid _getpid
+#else
+#include <unistd.h>
+#endif
+
+namespace rsimpl
+{
+    namespace trace
+    {
+        std::atomic<bool> enabled(false);
+
+        // Spans recorded by one thread. Only the owning thread writes, publishing each record by advancing head, so readers can
+        // copy the ring at any time and discard whatever the writer may have overwritten meanwhile
+        struct ring
+        {
+            std::vector<record> records;
+            std::atomic<uint64_t> head;     // Number of records ever written
+            int generation;
+            int thread_id;
+
+            ring(size_t capacity, int generation, int thread_id) : records(capacity), head(0), generation(generation), thread_id(thread_id) {}
+        };
+
+        static std::mutex registry_mutex;
+        static std::vector<std::shared_ptr<ring>> rings;
+        static size_t ring_capacity = 16384;
+        static std::atomic<int> generation(0);
+        static int next_thread_id = 0;
+
+        // Starting a new trace bumps the generation, each thread replaces its ring on its next record
+        static ring & get_thread_ring()
+        {
+            thread_local std::shared_ptr<ring> local;
+            thread_local int thread_id = -1;
+            if (!local || local->generation != generation.load(std::memory_order_relaxed))
+            {
+                std::lock_guard<std::mutex> lock(registry_mutex);
+                if (thread_id < 0) thread_id = next_thread_id++;
+                local = std::make_shared<ring>(ring_capacity, generation.load(), thread_id);
+                rings.push_back(local);
+            }
+            return *local;
+        }
+
+        int64_t now()
+        {
+            return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+        }
+
+        void start(int records_per_thread)
+        {
+            std::lock_guard<std::mutex> lock(registry_mutex);
+            ring_capacity = 1;
+            while (ring_capacity < (size_t)std::max(records_per_thread, 1)) ring_capacity *= 2;
+            rings.clear();
+            ++generation;
+            enabled = true;
+        }
+
+        void stop()
+        {
+            enabled = false;
+        }
+
+        void record_span(const char * name, rs_stream stream, unsigned long long frame_number, int64_t begin_ns, int64_t end_ns)
+        {
+            if (!is_enabled()) return;
+            auto & r = get_thread_ring();
+            auto index = r.head.load(std::memory_order_relaxed);
+            auto & rec = r.records[index & (r.records.size() - 1)];
+            strncpy(rec.name, name, sizeof(rec.name) - 1);
+            rec.name[sizeof(rec.name) - 1] = 0;
+            rec.begin_ns = begin_ns;
+            rec.end_ns = end_ns;
+            rec.stream = stream;
+            rec.frame_number = frame_number;
+            r.head.store(index + 1, std::memory_order_release);
+        }
+
+        struct thread_record { record rec; int thread_id; };
+
+        static std::vector<thread_record> collect_records()
+        {
+            std::vector<std::shared_ptr<ring>> snapshot;
+            {
+                std::lock_guard<std::mutex> lock(registry_mutex);
+                snapshot = rings;
+            }
+
+            std::vector<thread_record> records;
+            for (auto & r : snapshot)
+            {
+                const uint64_t capacity = r->records.size();
+                const auto head = r->head.load(std::memory_order_acquire);
+                std::vector<record> copy;
+                for (auto i = head > capacity ? head - capacity : 0; i < head; ++i) copy.push_back(r->records[i & (capacity - 1)]);
+                std::atomic_thread_fence(std::memory_order_acquire);
+
+                // The writer may be overwriting the slot of record (current head - capacity) right now, drop it and anything older
+                const auto head_after = r->head.load(std::memory_order_relaxed);
+                const auto first_valid = head_after + 1 > capacity ? head_after + 1 - capacity : 0;
+                auto first_copied = head > capacity ? head - capacity : 0;
+                for (size_t i = 0; i < copy.size(); ++i)
+                {
+                    if (first_copied + i >= first_valid) records.push_back({copy[i], r->thread_id});
+                }
+            }
+            std::sort(records.begin(), records.end(), [](const thread_record & a, const thread_record & b) { return a.rec.begin_ns < b.rec.begin_ns; });
+            return records;
+        }
+
+        static void write_json_string(std::ostream & out, const char * s)
+        {
+            out << '"';
+            for (; *s; ++s)
+            {
+                if (*s == '"' || *s == '\\') out << '\\' << *s;
+                else if ((unsigned char)*s < 0x20) out << ' ';
+                else out << *s;
+            }
+            out << '"';
+        }
+
+        static bool is_frame_span(const record & rec)
+        {
+            return rec.stream >= 0 && rec.stream < RS_STREAM_COUNT && rec.frame_number;
+        }
+
+        void write_chrome_trace(std::ostream & out)
+        {
+            const auto records = collect_records();
+            const auto pid = getpid();
+            out.precision(3);
+            out << std::fixed << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[";
+
+            bool first = true;
+            std::map<std::pair<int, unsigned long long>, std::vector<const thread_record *>> flows;
+            for (auto & r : records)
+            {
+                out << (first ? "\n" : ",\n") << "{\"ph\":\"X\",\"cat\":\"rs\",\"name\":";
+                write_json_string(out, r.rec.name);
+                out << ",\"pid\":" << pid << ",\"tid\":" << r.thread_id << ",\"ts\":" << r.rec.begin_ns / 1000.0 << ",\"dur\":" << (r.rec.end_ns - r.rec.begin_ns) / 1000.0;
+                if (is_frame_span(r.rec))
+                {
+                    out << ",\"args\":{\"stream\":\"" << rs_stream_to_string((rs_stream)r.rec.stream) << "\",\"frame\":" << r.rec.frame_number << "}";
+                    flows[std::make_pair(r.rec.stream, (unsigned long long)r.rec.frame_number)].push_back(&r);
+                }
+                out << "}";
+                first = false;
+            }
+
+            // Link the spans of each frame, in time order, with flow arrows
+            for (auto & flow : flows)
+            {
+                if (flow.second.size() < 2) continue;
+                for (size_t i = 0; i < flow.second.size(); ++i)
+                {
+                    auto & r = *flow.second[i];
+                    const char * phase = i == 0 ? "s" : i + 1 == flow.second.size() ? "f" : "t";
+                    out << ",\n{\"ph\":\"" << phase << "\",\"cat\":\"frame\",\"name\":\"" << rs_stream_to_string((rs_stream)flow.first.first) << " frame\"";
+                    out << ",\"id\":\"" << flow.first.first << ":" << flow.first.second << "\",\"bp\":\"e\"";
+                    out << ",\"pid\":" << pid << ",\"tid\":" << r.thread_id << ",\"ts\":" << r.rec.begin_ns / 1000.0 << "}";
+                }
+            }
+            out << "\n]}\n";
+        }
+
+        void write_chrome_trace(const std::string & file_path)
+        {
+            std::ofstream out(file_path);
+            if (!out) throw std::runtime_error(to_string() << "cannot open trace file " << file_path);
+            write_chrome_trace(out);
+        }
+
+        static const char * get_environment_file()
+        {
+            auto file = std::getenv("RS_TRACE_FILE");
+            return file && *file ? file : nullptr;
+        }
+
+        void start_from_environment()
+        {
+            if (get_environment_file() && !is_enabled()) start(16384);
+        }
+
+        void write_to_environment_file()
+        {
+            if (auto file = get_environment_file())
+            {
+                try
+                {
+                    write_chrome_trace(std::string(file));
+                    LOG_INFO("Wrote latency trace to " << file);
+                }
+                catch (const std::exception & e) { LOG_ERROR(e.what()); }
+            }
+        }
+    }
+}
@@ -0,0 +1,60 @@
+// License: Apache 2.0. See LICENSE file in root directory.
+
+#pragma once
+#ifndef LIBREALSENSE_TRACE_H
+#define LIBREALSENSE_TRACE_H
+
+#include "types.h"
+
+#include <atomic>
+#include <ostream>
+
+namespace rsimpl
+{
+    // Per-frame latency tracing. Every thread records fixed-size spans into its own ring without taking locks, so a span costs
+    // two clock reads and a few stores, and only the most recent spans of each thread are kept. Spans tagged with the same
+    // stream and frame number are linked into one flow in the Chrome trace JSON export, which shows where a frame spends its
+    // time from the backend to the application. Applications record into the same trace through rs_trace_event.
+    namespace trace
+    {
+        struct record
+        {
+            char name[32];
+            int64_t begin_ns, end_ns;       // On the trace clock
+            int32_t stream;                 // RS_STREAM_COUNT for spans not tied to a frame
+            uint32_t reserved;
+            uint64_t frame_number;
+        };
+
+        extern std::atomic<bool> enabled;
+        inline bool is_enabled() { return enabled.load(std::memory_order_relaxed); }
+
+        int64_t now(); // Nanoseconds on the trace clock, the monotonic clock shared by all processes on the machine
+
+        void start(int records_per_thread); // Discards previously recorded spans
+        void stop();
+        void record_span(const char * name, rs_stream stream, unsigned long long frame_number, int64_t begin_ns, int64_t end_ns);
+        void write_chrome_trace(std::ostream & out);
+        void write_chrome_trace(const std::string & file_path);
+
+        // Tracing can also be enabled by setting RS_TRACE_FILE, in which case the trace is written there when the context is destroyed
+        void start_from_environment();
+        void write_to_environment_file();
+
+        // Records the span from construction to destruction, if tracing was enabled at construction
+        class scope
+        {
+            const char * name;
+            rs_stream stream;
+            unsigned long long frame_number;
+            int64_t begin_ns;
+        public:
+            scope(const char * name, rs_stream stream, unsigned long long frame_number = 0) : name(name), stream(stream), frame_number(frame_number), begin_ns(is_enabled() ? now() : 0) {}
+            ~scope() { if (begin_ns) record_span(name, stream, frame_number, begin_ns, now()); }
+
+            void set_frame_number(unsigned long long number) { frame_number = number; }
+        };
+    }
+}
+
+#endif
@@ -294,6 +294,9 @@ namespace rsimpl
         output_format = in_output_format;
     }
 
+    // Frames with at least this many pixels are unpacked on several threads
+    static const int parallel_unpack_min_pixels = 1280 * 720;
+
     void subdevice_mode_selection::unpack(byte * const dest[], const byte * source) const
     {
         const int MAX_OUTPUTS = 2;
@@ -316,23 +319,43 @@ namespace rsimpl
         }
 
         // Unpack (potentially a subrect of) the source image into (potentially a subrect of) the destination buffers
+        const auto & unpacker = mode.pf.unpackers[unpacker_index];
         const int unpack_width = get_unpacked_width(), unpack_height = get_unpacked_height();
+
+        // Large frames are unpacked in horizontal stripes on several threads. Planar formats are left whole, as the offset of each
+        // plane depends on the size of the frame, and plain copies are not worth the threads
+        const bool parallel = unpacker.requires_processing && mode.pf.plane_count == 1 && unpack_width * unpack_height >= parallel_unpack_min_pixels;
+
         if(mode.native_dims.x == get_width())
         {
             // If not strided, unpack as though it were a single long row
-            mode.pf.unpackers[unpacker_index].unpack(out, in, unpack_width * unpack_height);
+            if(!parallel) unpacker.unpack(out, in, unpack_width * unpack_height);
+            else for_each_row_parallel(unpack_height, [&](int first_row, int last_row)
+            {
+                byte * stripe_out[MAX_OUTPUTS];
+                for(size_t i=0; i<outputs.size(); ++i) stripe_out[i] = out[i] + rsimpl::get_image_size(unpack_width * first_row, 1, outputs[i].second);
+                unpacker.unpack(stripe_out, in + mode.pf.get_image_size(unpack_width * first_row, 1), unpack_width * (last_row - first_row));
+            });
         }
         else
         {
             
             // Otherwise unpack one row at a time
             assert(mode.pf.plane_count == 1); // Can't unpack planar formats row-by-row (at least not with the current architecture, would need to pass multiple source ptrs to unpack)
-            for(int i=0; i<unpack_height; ++i)
+            const auto unpack_rows = [&](int first_row, int last_row)
             {
-                mode.pf.unpackers[unpacker_index].unpack(out, in, unpack_width);
-                for(size_t i=0; i<outputs.size(); ++i) out[i] += out_stride[i];
-                in += in_stride;
-            }
+                byte * row_out[MAX_OUTPUTS];
+                for(size_t i=0; i<outputs.size(); ++i) row_out[i] = out[i] + out_stride[i] * first_row;
+                const byte * row_in = in + in_stride * first_row;
+                for(int y=first_row; y<last_row; ++y)
+                {
+                    unpacker.unpack(row_out, row_in, unpack_width);
+                    for(size_t i=0; i<outputs.size(); ++i) row_out[i] += out_stride[i];
+                    row_in += in_stride;
+                }
+            };
+            if(parallel) for_each_row_parallel(unpack_height, unpack_rows);
+            else unpack_rows(0, unpack_height);
         }
     }
 
@@ -366,7 +389,7 @@ namespace rsimpl
         return width != 0 && height != 0 && format != RS_FORMAT_ANY && fps != 0;
     }
 
-    static_device_info::static_device_info() : num_libuvc_transfer_buffers(1), nominal_depth_scale(0.001f)
+    static_device_info::static_device_info() : num_libuvc_transfer_buffers(1), num_capture_buffers(4), nominal_depth_scale(0.001f)
     {
         for(auto & s : stream_subdevices) s = -1;
         for(auto & s : data_subdevices) s = -1;
@@ -25,13 +25,13 @@
 #include <functional>
 
 const uint8_t RS_STREAM_NATIVE_COUNT    = 5;
-const int RS_USER_QUEUE_SIZE = 20;
+const int RS_USER_QUEUE_SIZE = 20;      // Default number of frames the user may hold per stream
+const int RS_MAX_USER_QUEUE_SIZE = 128; // Upper bound for RS_OPTION_FRAMES_QUEUE_SIZE, frame pools are sized from it when streaming starts
 
 // Timestamp syncronization settings:
-const int RS_MAX_EVENT_QUEUE_SIZE = 500;  // Max number of timestamp events to keep for all streams
-const int RS_MAX_EVENT_TIME_OUT = 20;     // Max timeout in milliseconds that a frame can wait for its corresponding timestamp event
+const int RS_MAX_EVENT_QUEUE_SIZE = 512;  // Number of timestamp events to keep for each event source, must be a power of two
 // Usually timestamp events arrive much faster then frames, but due to USB arbitration the QoS isn't guaranteed.
-// RS_MAX_EVENT_TIME_OUT controls how much time the user is willing to wait before "giving-up" on a particular frame
+// Frames are not held back for late events, they pick up the event timestamp when it arrives (see timestamp_corrector)
 
 namespace rsimpl
 {
@@ -276,6 +276,7 @@ namespace rsimpl
         std::vector<supported_option> options;
         pose stream_poses[RS_STREAM_NATIVE_COUNT];                          // Static pose of each camera on the device
         int num_libuvc_transfer_buffers;                                    // Number of transfer buffers to use in LibUVC backend
+        int num_capture_buffers;                                            // Number of frame buffers per subdevice to keep queued with the V4L2 driver
         std::string firmware_version;                                       // Firmware version string
         std::string serial;                                                 // Serial number of the camera (from USB or from SPI memory)
         float nominal_depth_scale;                                          // Default scale
@@ -492,69 +493,100 @@ namespace rsimpl
         return (c0 << 24) | (c1 << 16) | (c2 << 8) | c3;
     }
 
-    template<class T, int C>
+    // Lock-free stack of the indices [0, capacity), used to hand out the slots of fixed pools in O(1). The head carries a tag which
+    // changes on every update, so a pop cannot be fooled by the same index being popped and pushed back in the meantime (ABA)
+    class index_stack
+    {
+        std::unique_ptr<std::atomic<uint32_t>[]> next; // next[i] is the entry below index i, stored as index + 1 with 0 for none
+        std::atomic<uint64_t> head;                     // tag << 32 | (top index + 1)
+
+    public:
+        explicit index_stack(uint32_t capacity) : next(new std::atomic<uint32_t>[capacity]), head(0)
+        {
+            for (auto i = capacity; i-- > 0;) push(i); // Hand out low indices first
+        }
+
+        bool pop(uint32_t & index)
+        {
+            auto h = head.load(std::memory_order_acquire);
+            while (true)
+            {
+                const auto top = uint32_t(h);
+                if (top == 0) return false;
+                const uint64_t below = next[top - 1].load(std::memory_order_relaxed);
+                if (head.compare_exchange_weak(h, ((h >> 32) + 1) << 32 | below, std::memory_order_acquire, std::memory_order_acquire))
+                {
+                    index = top - 1;
+                    return true;
+                }
+            }
+        }
+
+        void push(uint32_t index)
+        {
+            auto h = head.load(std::memory_order_relaxed);
+            do next[index].store(uint32_t(h), std::memory_order_relaxed);
+            while (!head.compare_exchange_weak(h, ((h >> 32) + 1) << 32 | (index + 1), std::memory_order_release, std::memory_order_relaxed));
+        }
+    };
+
+    template<class T>
     class small_heap
     {
-        T buffer[C];
-        bool is_free[C];
-        std::mutex mutex;
-        bool keep_allocating = true;
+        std::unique_ptr<T[]> buffer;
+        int capacity;
+        index_stack free_slots;
+        std::atomic<int> size;
+        std::atomic<bool> keep_allocating;
+        std::mutex mutex; // Only used to wait for the heap to empty
         std::condition_variable cv;
-        int size = 0;
 
-    public:
-        small_heap()
+        void release_count()
         {
-            for (auto i = 0; i < C; i++)
+            if (--size == 0)
             {
-                is_free[i] = true;
-                buffer[i] = std::move(T());
+                { std::lock_guard<std::mutex> lock(mutex); }
+                cv.notify_one();
             }
         }
 
+    public:
+        explicit small_heap(int capacity) : buffer(new T[capacity]()), capacity(capacity), free_slots(capacity), size(0), keep_allocating(true) {}
+
         T * allocate()
         {
-            std::unique_lock<std::mutex> lock(mutex);
-            if (!keep_allocating) return nullptr;
+            // Count the allocation before checking the flag. Both are sequentially consistent, so either stop_allocation() comes
+            // first and this allocation is rolled back, or wait_until_empty() sees it and waits for its deallocation.
+            ++size;
+            if (!keep_allocating)
+            {
+                release_count();
+                return nullptr;
+            }
 
-            for (auto i = 0; i < C; i++)
+            uint32_t i;
+            if (!free_slots.pop(i))
             {
-                if (is_free[i])
-                {
-                    is_free[i] = false;
-                    size++;
-                    return &buffer[i];
-                }
+                release_count();
+                return nullptr;
             }
-            return nullptr;
+            return &buffer[i];
         }
 
         void deallocate(T * item)
         {
-             if (item < buffer || item >= buffer + C)
+            if (item < buffer.get() || item >= buffer.get() + capacity)
             {
                 throw std::runtime_error("Trying to return item to a heap that didn't allocate it!");
             }
-            auto i = item - buffer;
+            auto i = item - buffer.get();
             buffer[i] = std::move(T());
-            
-            {
-                std::unique_lock<std::mutex> lock(mutex);
-
-                is_free[i] = true;
-                size--;
-
-                if (size == 0)
-                {
-                    lock.unlock();
-                    cv.notify_one();
-                }
-            }
+            free_slots.push(uint32_t(i));
+            release_count();
         }
 
         void stop_allocation()
         {
-            std::unique_lock<std::mutex> lock(mutex);
             keep_allocating = false;
         }
 
@@ -573,6 +605,71 @@ namespace rsimpl
         }
     };
 
+    // Fixed capacity lock-free queue (D. Vyukov's bounded queue). Each slot carries a sequence number telling pushers and poppers
+    // whose turn it is, so neither side ever blocks. Used with one producer and one consumer per queue, but try_pop is also safe from
+    // the producer, which lets a producer evict the oldest entry when the consumer falls behind. C must be a power of two.
+    template<class T, int C>
+    class bounded_queue
+    {
+        static_assert(C > 0 && (C & (C - 1)) == 0, "bounded_queue capacity must be a power of two");
+
+        struct cell
+        {
+            std::atomic<size_t> sequence;
+            T data;
+        };
+        cell buffer[C];
+        std::atomic<size_t> push_pos, pop_pos;
+
+    public:
+        bounded_queue() : push_pos(0), pop_pos(0)
+        {
+            for (size_t i = 0; i < C; i++) buffer[i].sequence.store(i, std::memory_order_relaxed);
+        }
+
+        // Moves from item only on success, returns false if the queue is full
+        bool try_push(T && item)
+        {
+            auto pos = push_pos.load(std::memory_order_relaxed);
+            cell * c;
+            while (true)
+            {
+                c = &buffer[pos & (C - 1)];
+                auto diff = (intptr_t)c->sequence.load(std::memory_order_acquire) - (intptr_t)pos;
+                if (diff == 0 && push_pos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) break;
+                if (diff < 0) return false;
+                if (diff > 0) pos = push_pos.load(std::memory_order_relaxed);
+            }
+            c->data = std::move(item);
+            c->sequence.store(pos + 1, std::memory_order_release);
+            return true;
+        }
+
+        // Returns false if the queue is empty
+        bool try_pop(T & item)
+        {
+            auto pos = pop_pos.load(std::memory_order_relaxed);
+            cell * c;
+            while (true)
+            {
+                c = &buffer[pos & (C - 1)];
+                auto diff = (intptr_t)c->sequence.load(std::memory_order_acquire) - (intptr_t)(pos + 1);
+                if (diff == 0 && pop_pos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) break;
+                if (diff < 0) return false;
+                if (diff > 0) pos = pop_pos.load(std::memory_order_relaxed);
+            }
+            item = std::move(c->data);
+            c->sequence.store(pos + C, std::memory_order_release);
+            return true;
+        }
+
+        bool empty() const
+        {
+            auto pos = pop_pos.load(std::memory_order_relaxed);
+            return (intptr_t)buffer[pos & (C - 1)].sequence.load(std::memory_order_acquire) - (intptr_t)(pos + 1) < 0;
+        }
+    };
+
     class frame_continuation
     {
         std::function<void()> continuation;
@@ -248,6 +248,11 @@ namespace rsimpl
             device.subdevices[subdevice_index].set_data_channel_cfg(callback);
         }
 
+        void set_capture_buffer_count(device & /*device*/, int /*count*/)
+        {
+            // libuvc sizes its transfers from num_transfer_bufs instead
+        }
+
         void start_streaming(device & device, int num_transfer_bufs)
         {
             for(auto i = 0; i < device.subdevices.size(); i++)
@@ -0,0 +1,479 @@
+// License: Apache 2.0. See LICENSE file in root directory.
+
+#ifdef RS_USE_SYNTHETIC_BACKEND
+
+// A UVC backend with no hardware behind it. It enumerates synthetic cameras (synthetic.h) which stream either recorded raw
+// payloads or generated test content, so everything above the backend (unpacking, alignment, the syncronizing archive,
+// wrappers) can be exercised and profiled without a camera. It is configured through the environment:
+//
+//   RS_SYNTHETIC_DEVICES      Number of cameras to enumerate (default 1)
+//   RS_SYNTHETIC_RATE         Multiplier applied to the frame rate of every mode (default 1). At 0 frames are produced as fast as
+//                             the consumer releases them, which measures the throughput of the pipeline above the backend
+//   RS_SYNTHETIC_REPLAY_DIR   Directory of recorded payloads, named <width>x<height>_<fourcc>.raw (e.g. 640x480_Z16.raw), each
+//                             holding raw frames back to back. The frames are replayed in a loop. Modes without a recording
+//                             stream generated content. For pass-through formats (Z16, YUYV, Y8) the frame data returned by
+//                             rs_get_frame_data is the UVC payload, so recordings can be captured through the normal API
+//
+// Like a driver, a throttled stream drops frames when the consumer holds all of its capture buffers, and the dropped frames
+// show up as gaps in the frame counter stamped into the first four bytes of each payload.
+
+#include "uvc.h"
+#include "image.h"
+#include "synthetic.h"
+
+#include <cstdlib>
+#include <cstring>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <fstream>
+#include <map>
+#include <mutex>
+#include <thread>
+#include <tuple>
+
+namespace rsimpl
+{
+    namespace uvc
+    {
+        static const int synthetic_subdevice_count = 3;
+        static const int synthetic_frame_cycle = 8; // Distinct frames generated for each stream, played in a loop
+
+        static std::string get_environment(const char * name, const char * def)
+        {
+            auto value = std::getenv(name);
+            return value ? value : def;
+        }
+
+        struct context
+        {
+            std::string replay_dir;
+            double rate;
+            int device_count;
+
+            context() :
+                replay_dir(get_environment("RS_SYNTHETIC_REPLAY_DIR", "")),
+                rate(std::max(0.0, std::atof(get_environment("RS_SYNTHETIC_RATE", "1").c_str()))),
+                device_count(std::atoi(get_environment("RS_SYNTHETIC_DEVICES", "1").c_str()))
+            {
+                LOG_INFO("Synthetic UVC backend: " << device_count << " device(s), rate x" << rate << (replay_dir.empty() ? "" : ", replaying from " + replay_dir));
+            }
+        };
+
+        // Capture buffers of one stream. A buffer is held from the moment it is filled until the continuation passed with the frame
+        // releases it. Continuations keep the pool alive, since a frame may be released after streaming stopped.
+        struct buffer_pool
+        {
+            std::vector<std::vector<uint8_t>> buffers;
+            std::vector<int> free;
+            std::mutex mutex;
+            std::condition_variable cv;
+
+            buffer_pool(int count, size_t size) : buffers(count, std::vector<uint8_t>(size))
+            {
+                for(int i=0; i<count; ++i) free.push_back(i);
+            }
+
+            int try_acquire()
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                if(free.empty()) return -1;
+                auto index = free.back();
+                free.pop_back();
+                return index;
+            }
+
+            // Waits for a free buffer, returns -1 if stop was raised first
+            int acquire(const std::atomic<bool> & stop)
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                cv.wait(lock, [&]() { return stop || !free.empty(); });
+                if(stop) return -1;
+                auto index = free.back();
+                free.pop_back();
+                return index;
+            }
+
+            // Sleeps until the given time, returns false if stop was raised first
+            bool sleep_until(std::chrono::steady_clock::time_point time, const std::atomic<bool> & stop)
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                return !cv.wait_until(lock, time, [&]() { return stop.load(); });
+            }
+
+            void release(int index)
+            {
+                {
+                    std::lock_guard<std::mutex> lock(mutex);
+                    free.push_back(index);
+                }
+                cv.notify_all();
+            }
+
+            void wake()
+            {
+                { std::lock_guard<std::mutex> lock(mutex); }
+                cv.notify_all();
+            }
+        };
+
+        struct subdevice
+        {
+            int width = 0, height = 0, fps = 0;
+            uint32_t fourcc = 0;
+            size_t frame_size = 0;
+            video_channel_callback callback = nullptr;
+            std::map<rs_option, int> pu_values;
+
+            std::shared_ptr<buffer_pool> pool;
+            std::ifstream replay;                               // Open while replaying a recording
+            std::vector<std::vector<uint8_t>> generated;        // Otherwise, the generated frames
+            uint32_t frame_number = 0;
+            unsigned long long frames_dropped = 0;
+            std::thread thread;
+        };
+
+        struct device
+        {
+            const std::shared_ptr<context> parent;
+            const int index;
+            subdevice subdevices[synthetic_subdevice_count];
+            std::map<std::tuple<int, int, uint8_t>, std::vector<uint8_t>> xu_values;
+            int buffer_count = 4;
+            std::atomic<bool> stop;
+
+            device(std::shared_ptr<context> parent, int index) : parent(parent), index(index), stop(true) {}
+            ~device() { stop_streaming(*this); }
+
+            subdevice & get_subdevice(int subdevice_index)
+            {
+                if(subdevice_index < 0 || subdevice_index >= synthetic_subdevice_count) throw std::runtime_error(to_string() << "synthetic device has no subdevice " << subdevice_index);
+                return subdevices[subdevice_index];
+            }
+        };
+
+        static std::string fourcc_to_string(uint32_t fourcc)
+        {
+            std::string s;
+            for(int shift = 24; shift >= 0; shift -= 8) if(char c = (char)(fourcc >> shift)) if(c != ' ') s += c;
+            return s;
+        }
+
+        static size_t get_payload_size(uint32_t fourcc, int width, int height)
+        {
+            for(auto pf : {&pf_yuy2, &pf_z16, &pf_y8, &pf_y16, &pf_y8i, &pf_y12i, &pf_raw8, &pf_rw16})
+            {
+                if(pf->fourcc == fourcc) return pf->get_image_size(width, height);
+            }
+            throw std::runtime_error(to_string() << "synthetic backend does not support fourcc " << fourcc_to_string(fourcc));
+        }
+
+        // Test content: a sloped floor with a box moving across it, and a column of holes along the left edge of the depth image
+        static void generate_frame(uint32_t fourcc, int width, int height, int n, std::vector<uint8_t> & frame)
+        {
+            const int box_x = n * width / synthetic_frame_cycle, box_width = width / 4;
+            auto in_box = [=](int x, int y) { return (x - box_x + width) % width < box_width && y >= height / 4 && y < height * 3 / 4; };
+
+            switch(fourcc)
+            {
+            case 'Z16 ':
+            {
+                auto depth = reinterpret_cast<uint16_t *>(frame.data());
+                for(int y=0; y<height; ++y) for(int x=0; x<width; ++x) *depth++ = x < 8 ? 0 : in_box(x, y) ? 600 : 3000 - y * 2000 / height;
+                break;
+            }
+            case 'YUY2':
+            {
+                auto yuy2 = frame.data();
+                for(int y=0; y<height; ++y) for(int x=0; x<width; x+=2, yuy2+=4)
+                {
+                    const bool box = in_box(x, y);
+                    yuy2[0] = yuy2[2] = box ? 200 : (uint8_t)(32 + (x + y) % 160);
+                    yuy2[1] = box ? 90 : 128;
+                    yuy2[3] = box ? 240 : 128;
+                }
+                break;
+            }
+            case 'GREY':
+            {
+                auto ir = frame.data();
+                for(int y=0; y<height; ++y) for(int x=0; x<width; ++x) *ir++ = in_box(x, y) ? 220 : (uint8_t)(40 + ((x ^ y) & 63));
+                break;
+            }
+            case 'Y16 ':
+            {
+                auto ir = reinterpret_cast<uint16_t *>(frame.data());
+                for(int y=0; y<height; ++y) for(int x=0; x<width; ++x) *ir++ = in_box(x, y) ? 880 : 160 + ((x ^ y) & 255);
+                break;
+            }
+            default:
+                for(size_t i=0; i<frame.size(); ++i) frame[i] = (uint8_t)(i * 7 + n);
+                break;
+            }
+        }
+
+        static void prepare_source(const context & ctx, int subdevice_index, subdevice & sub)
+        {
+            sub.replay.close();
+            sub.generated.clear();
+
+            if(!ctx.replay_dir.empty())
+            {
+                std::string path = to_string() << ctx.replay_dir << "/" << sub.width << "x" << sub.height << "_" << fourcc_to_string(sub.fourcc) << ".raw";
+                sub.replay.open(path, std::ios::binary);
+                if(sub.replay.is_open())
+                {
+                    sub.replay.seekg(0, std::ios::end);
+                    if(sub.replay.tellg() < (std::streamoff)sub.frame_size) throw std::runtime_error(to_string() << "recording " << path << " is shorter than one frame");
+                    sub.replay.seekg(0);
+                    LOG_INFO("Synthetic subdevice " << subdevice_index << " replaying " << path);
+                    return;
+                }
+            }
+
+            for(int n=0; n<synthetic_frame_cycle; ++n)
+            {
+                sub.generated.emplace_back(sub.frame_size);
+                generate_frame(sub.fourcc, sub.width, sub.height, n, sub.generated.back());
+            }
+        }
+
+        static void fill_payload(subdevice & sub, uint8_t * payload)
+        {
+            if(sub.replay.is_open())
+            {
+                // Loop back to the first frame at the end of the recording, dropping any partial frame at the end
+                if(!sub.replay.read(reinterpret_cast<char *>(payload), sub.frame_size))
+                {
+                    sub.replay.clear();
+                    sub.replay.seekg(0);
+                    sub.replay.read(reinterpret_cast<char *>(payload), sub.frame_size);
+                }
+            }
+            else memcpy(payload, sub.generated[sub.frame_number % synthetic_frame_cycle].data(), sub.frame_size);
+
+            payload[0] = (uint8_t)(sub.frame_number);
+            payload[1] = (uint8_t)(sub.frame_number >> 8);
+            payload[2] = (uint8_t)(sub.frame_number >> 16);
+            payload[3] = (uint8_t)(sub.frame_number >> 24);
+        }
+
+        static void stream_subdevice(device & dev, subdevice & sub)
+        {
+            const auto rate = dev.parent->rate;
+            const auto period = std::chrono::duration_cast<std::chrono::steady_clock::duration>(std::chrono::duration<double>(rate > 0 ? 1 / (sub.fps * rate) : 0));
+            auto next_frame = std::chrono::steady_clock::now();
+            while(!dev.stop)
+            {
+                int index;
+                if(rate > 0)
+                {
+                    if(!sub.pool->sleep_until(next_frame, dev.stop)) break;
+
+                    // Keep to the schedule like a sensor would, rather than bursting to catch up after a stall
+                    next_frame = std::max(next_frame + period, std::chrono::steady_clock::now());
+
+                    ++sub.frame_number;
+                    index = sub.pool->try_acquire();
+                    if(index < 0)
+                    {
+                        ++sub.frames_dropped;
+                        continue;
+                    }
+                }
+                else
+                {
+                    index = sub.pool->acquire(dev.stop);
+                    if(index < 0) break;
+                    ++sub.frame_number;
+                }
+
+                auto pool = sub.pool;
+                auto payload = pool->buffers[index].data();
+                fill_payload(sub, payload);
+                try
+                {
+                    sub.callback(payload, [pool, index]() { pool->release(index); });
+                }
+                catch(const std::exception & e)
+                {
+                    LOG_ERROR("Synthetic subdevice frame callback failed: " << e.what());
+                }
+            }
+        }
+
+        ////////////
+        // device //
+        ////////////
+
+        std::shared_ptr<context> create_context()
+        {
+            return std::make_shared<context>();
+        }
+
+        std::vector<std::shared_ptr<device>> query_devices(std::shared_ptr<context> context)
+        {
+            std::vector<std::shared_ptr<device>> devices;
+            for(int i=0; i<context->device_count; ++i) devices.push_back(std::make_shared<device>(context, i));
+            return devices;
+        }
+
+        bool is_device_connected(device & /*device*/, int vid, int pid)
+        {
+            return vid == VID_INTEL_CAMERA && pid == SYNTHETIC_PRODUCT_ID;
+        }
+
+        int get_vendor_id(const device & /*device*/) { return VID_INTEL_CAMERA; }
+        int get_product_id(const device & /*device*/) { return SYNTHETIC_PRODUCT_ID; }
+
+        std::string get_usb_port_id(const device & device)
+        {
+            return to_string() << "synthetic-" << device.index;
+        }
+
+        void claim_interface(device & /*device*/, const guid & /*interface_guid*/, int /*interface_number*/) {}
+        void claim_aux_interface(device & /*device*/, const guid & /*interface_guid*/, int /*interface_number*/) {}
+
+        void bulk_transfer(device & /*device*/, unsigned char /*endpoint*/, void * /*data*/, int /*length*/, int * /*actual_length*/, unsigned int /*timeout*/)
+        {
+            throw std::runtime_error("bulk transfers are not supported by the synthetic backend");
+        }
+
+        //////////////
+        // controls //
+        //////////////
+
+        struct pu_range { rs_option option; int min, max, step, def; };
+        static const pu_range synthetic_pu_ranges[] = {
+            //  option                                          min     max     step    def
+            {RS_OPTION_COLOR_BACKLIGHT_COMPENSATION,            0,      4,      1,      1},
+            {RS_OPTION_COLOR_BRIGHTNESS,                        -64,    64,     1,      0},
+            {RS_OPTION_COLOR_CONTRAST,                          0,      100,    1,      50},
+            {RS_OPTION_COLOR_EXPOSURE,                          39,     10000,  1,      156},
+            {RS_OPTION_COLOR_GAIN,                              0,      128,    1,      64},
+            {RS_OPTION_COLOR_GAMMA,                             100,    500,    1,      300},
+            {RS_OPTION_COLOR_HUE,                               -180,   180,    1,      0},
+            {RS_OPTION_COLOR_SATURATION,                        0,      100,    1,      64},
+            {RS_OPTION_COLOR_SHARPNESS,                         0,      100,    1,      50},
+            {RS_OPTION_COLOR_WHITE_BALANCE,                     2800,   6500,   10,     4600},
+            {RS_OPTION_COLOR_ENABLE_AUTO_EXPOSURE,              0,      1,      1,      1},
+            {RS_OPTION_COLOR_ENABLE_AUTO_WHITE_BALANCE,         0,      1,      1,      1}
+        };
+
+        static const pu_range & get_pu_range(rs_option option)
+        {
+            for(auto & range : synthetic_pu_ranges) if(range.option == option) return range;
+            throw std::logic_error(to_string() << "unsupported PU control " << option);
+        }
+
+        void get_pu_control_range(const device & /*device*/, int /*subdevice*/, rs_option option, int * min, int * max, int * step, int * def)
+        {
+            auto & range = get_pu_range(option);
+            if(min)  *min  = range.min;
+            if(max)  *max  = range.max;
+            if(step) *step = range.step;
+            if(def)  *def  = range.def;
+        }
+
+        void get_extension_control_range(const device & /*device*/, const extension_unit & /*xu*/, char /*control*/, int * /*min*/, int * /*max*/, int * /*step*/, int * /*def*/)
+        {
+            throw std::logic_error("extension unit ranges are not supported by the synthetic backend");
+        }
+
+        void set_pu_control(device & device, int subdevice, rs_option option, int value)
+        {
+            auto & range = get_pu_range(option);
+            if(value < range.min || value > range.max) throw std::runtime_error(to_string() << "value " << value << " out of range for " << option);
+            device.get_subdevice(subdevice).pu_values[option] = value;
+        }
+
+        int get_pu_control(const device & device, int subdevice, rs_option option)
+        {
+            auto & values = const_cast<uvc::device &>(device).get_subdevice(subdevice).pu_values;
+            auto it = values.find(option);
+            return it != values.end() ? it->second : get_pu_range(option).def;
+        }
+
+        // XU controls are remembered and read back, controls never written read as zero
+        void set_control(device & device, const extension_unit & xu, uint8_t ctrl, void * data, int len)
+        {
+            auto bytes = reinterpret_cast<const uint8_t *>(data);
+            device.xu_values[std::make_tuple(xu.subdevice, xu.unit, ctrl)].assign(bytes, bytes + len);
+        }
+
+        void get_control(const device & device, const extension_unit & xu, uint8_t ctrl, void * data, int len)
+        {
+            memset(data, 0, len);
+            auto it = device.xu_values.find(std::make_tuple(xu.subdevice, xu.unit, ctrl));
+            if(it != device.xu_values.end()) memcpy(data, it->second.data(), std::min((size_t)len, it->second.size()));
+        }
+
+        ///////////////
+        // streaming //
+        ///////////////
+
+        void set_subdevice_data_channel_handler(device & /*device*/, int /*subdevice_index*/, data_channel_callback /*callback*/) {}
+        void start_data_acquisition(device & /*device*/) {}
+        void stop_data_acquisition(device & /*device*/) {}
+
+        void set_subdevice_mode(device & device, int subdevice_index, int width, int height, uint32_t fourcc, int fps, video_channel_callback callback)
+        {
+            auto & sub = device.get_subdevice(subdevice_index);
+            sub.width = width;
+            sub.height = height;
+            sub.fourcc = fourcc;
+            sub.fps = fps;
+            sub.frame_size = get_payload_size(fourcc, width, height);
+            sub.callback = callback;
+        }
+
+        void set_capture_buffer_count(device & device, int count)
+        {
+            device.buffer_count = std::max(count, 1);
+        }
+
+        void start_streaming(device & device, int /*num_transfer_bufs*/)
+        {
+            if(!device.stop) throw std::runtime_error("synthetic device is already streaming");
+
+            for(int i=0; i<synthetic_subdevice_count; ++i)
+            {
+                auto & sub = device.subdevices[i];
+                if(!sub.callback) continue;
+                prepare_source(*device.parent, i, sub);
+                sub.pool = std::make_shared<buffer_pool>(device.buffer_count, sub.frame_size);
+                sub.frame_number = 0;
+                sub.frames_dropped = 0;
+            }
+
+            device.stop = false;
+            for(auto & sub : device.subdevices)
+            {
+                if(sub.callback) sub.thread = std::thread(stream_subdevice, std::ref(device), std::ref(sub));
+            }
+        }
+
+        void stop_streaming(device & device)
+        {
+            device.stop = true;
+            for(int i=0; i<synthetic_subdevice_count; ++i)
+            {
+                auto & sub = device.subdevices[i];
+                if(!sub.thread.joinable()) continue;
+                sub.pool->wake();
+                sub.thread.join();
+                LOG_INFO("Synthetic subdevice " << i << " delivered " << sub.frame_number - sub.frames_dropped << " frames, dropped " << sub.frames_dropped);
+            }
+
+            for(auto & sub : device.subdevices)
+            {
+                sub.callback = nullptr;
+                sub.pool.reset();
+                sub.replay.close();
+                sub.generated.clear();
+            }
+        }
+    }
+}
+
+#endif
@@ -21,6 +21,10 @@
 #include <utility> // for pair
 #include <chrono>
 #include <thread>
+#include <deque>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
 
 #include <dirent.h>
 #include <fcntl.h>
@@ -30,6 +34,8 @@
 #include <sys/stat.h>
 #include <sys/mman.h>
 #include <sys/ioctl.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
 #include <linux/usb/video.h>
 #include <linux/uvcvideo.h>
 #include <linux/videodev2.h>
@@ -89,13 +95,23 @@ namespace rsimpl
             int vid, pid, mi;       // Vendor ID, product ID, and multiple interface index
             int fd;                 // File descriptor for this device
             std::vector<buffer> buffers;
+            int buffer_count = 4;   // Number of buffers requested from the driver
 
             int width, height, format, fps;
             video_channel_callback callback = nullptr;
             data_channel_callback  channel_data_callback = nullptr;    // handle non-uvc data produced by device
             bool is_capturing;
+            std::atomic<bool> is_streaming; // Buffers are only re-queued while streaming, a frame may be released after stop_capture
 
-            subdevice(const std::string & name) : dev_name("/dev/" + name), vid(), pid(), fd(), width(), height(), format(), callback(nullptr), channel_data_callback(nullptr), is_capturing()
+            // Buffers dequeued by the capture thread, waiting for this subdevice's consumer thread to run the callback. A buffer goes
+            // back to the driver only when the consumer releases the frame, so a slow callback holds buffers rather than the capture thread
+            std::deque<v4l2_buffer> ready;
+            std::mutex ready_mutex;
+            std::condition_variable ready_cv;
+            bool stop_consumer = false;
+            std::thread consumer;
+
+            subdevice(const std::string & name) : dev_name("/dev/" + name), vid(), pid(), fd(), width(), height(), format(), callback(nullptr), channel_data_callback(nullptr), is_capturing(), is_streaming(false)
             {
                 struct stat st;
                 if(stat(dev_name.c_str(), &st) < 0)
@@ -230,7 +246,7 @@ namespace rsimpl
 
                     // Init memory mapped IO
                     v4l2_requestbuffers req = {};
-                    req.count = 4;
+                    req.count = buffer_count;
                     req.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
                     req.memory = V4L2_MEMORY_MMAP;
                     if(xioctl(fd, VIDIOC_REQBUFS, &req) < 0)
@@ -242,6 +258,10 @@ namespace rsimpl
                     {
                         throw std::runtime_error("Insufficient buffer memory on " + dev_name);
                     }
+                    if((int)req.count != buffer_count)
+                    {
+                        LOG_WARNING(dev_name << " granted " << req.count << " of the " << buffer_count << " capture buffers requested");
+                    }
 
                     buffers.resize(req.count);
                     for(size_t i = 0; i < buffers.size(); ++i)
@@ -278,6 +298,7 @@ namespace rsimpl
                     if(xioctl(fd, VIDIOC_STREAMON, &type) < 0) throw_error("VIDIOC_STREAMON");
 
                     is_capturing = true;
+                    is_streaming = true;
                 }
             }
 
@@ -285,6 +306,8 @@ namespace rsimpl
             {
                 if(is_capturing)
                 {
+                    is_streaming = false;
+
                     // Stop streamining
                     v4l2_buf_type type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
                     if(xioctl(fd, VIDIOC_STREAMOFF, &type) < 0) warn_error("VIDIOC_STREAMOFF");
@@ -310,44 +333,72 @@ namespace rsimpl
                 }
             }
 
-            static void poll(const std::vector<subdevice *> & subdevices)
+            // Called on the capture thread when the fd is readable. Takes every filled buffer off the driver and hands them to the consumer.
+            void dequeue_all()
             {
-                int max_fd = 0;
-                fd_set fds;
-                FD_ZERO(&fds);
-                for(auto * sub : subdevices)
+                while(true)
                 {
-                    FD_SET(sub->fd, &fds);
-                    max_fd = std::max(max_fd, sub->fd);
-                }
+                    v4l2_buffer buf = {};
+                    buf.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+                    buf.memory = V4L2_MEMORY_MMAP;
+                    if(xioctl(fd, VIDIOC_DQBUF, &buf) < 0)
+                    {
+                        if(errno == EAGAIN) return;
+                        throw_error("VIDIOC_DQBUF");
+                    }
 
-                struct timeval tv = {0,10000};
-                if(select(max_fd + 1, &fds, NULL, NULL, &tv) < 0)
-                {
-                    if (errno == EINTR) return;
-                    throw_error("select");
+                    {
+                        std::lock_guard<std::mutex> lock(ready_mutex);
+                        ready.push_back(buf);
+                    }
+                    ready_cv.notify_one();
                 }
+            }
 
-                for(auto * sub : subdevices)
+            void requeue(v4l2_buffer buf)
+            {
+                if(is_streaming && xioctl(fd, VIDIOC_QBUF, &buf) < 0) throw_error("VIDIOC_QBUF");
+            }
+
+            void start_consumer()
+            {
+                stop_consumer = false;
+                consumer = std::thread([this]()
                 {
-                    if(FD_ISSET(sub->fd, &fds))
+                    std::unique_lock<std::mutex> lock(ready_mutex);
+                    while(true)
                     {
-                        v4l2_buffer buf = {};
-                        buf.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
-                        buf.memory = V4L2_MEMORY_MMAP;
-                        if(xioctl(sub->fd, VIDIOC_DQBUF, &buf) < 0)
+                        ready_cv.wait(lock, [this]() { return stop_consumer || !ready.empty(); });
+                        if(stop_consumer) break;
+
+                        auto buf = ready.front();
+                        ready.pop_front();
+                        lock.unlock();
+                        try
                         {
-                            if(errno == EAGAIN) return;
-                            throw_error("VIDIOC_DQBUF");
+                            callback(buffers[buf.index].start, [this, buf]() { requeue(buf); });
                         }
-
-                        sub->callback(sub->buffers[buf.index].start,
-                                [sub, buf]() mutable {
-                                    if(xioctl(sub->fd, VIDIOC_QBUF, &buf) < 0) throw_error("VIDIOC_QBUF");
-                                });
+                        catch(const std::exception & e)
+                        {
+                            LOG_ERROR("Frame callback on " << dev_name << " failed: " << e.what());
+                        }
+                        lock.lock();
                     }
+                    // Frames that were never delivered are simply dropped, STREAMOFF takes their buffers back
+                    ready.clear();
+                });
+            }
+
+            void stop_consumer_thread()
+            {
+                if(!consumer.joinable()) return;
+                {
+                    std::lock_guard<std::mutex> lock(ready_mutex);
+                    stop_consumer = true;
                 }
-            }            
+                ready_cv.notify_one();
+                consumer.join();
+            }
 
             static void poll_interrupts(libusb_device_handle *handle, const std::vector<subdevice *> & subdevices, uint16_t timeout)
             {
@@ -385,14 +436,15 @@ namespace rsimpl
             std::vector<std::unique_ptr<subdevice>> subdevices;
             std::thread thread;
             std::thread data_channel_thread;
-            volatile bool stop;
+            int epoll_fd;           // Watches the fds of all streaming subdevices and stop_fd
+            int stop_fd;            // eventfd written to wake the capture thread up to exit
             volatile bool data_stop;
 
             libusb_device * usb_device;
             libusb_device_handle * usb_handle;
             std::vector<int> claimed_interfaces;
 
-            device(std::shared_ptr<context> parent) : parent(parent), stop(), data_stop(), usb_device(), usb_handle() {}
+            device(std::shared_ptr<context> parent) : parent(parent), epoll_fd(-1), stop_fd(-1), data_stop(), usb_device(), usb_handle() {}
             ~device()
             {
                 stop_streaming();
@@ -429,9 +481,41 @@ namespace rsimpl
                     }                
                 }
 
-                thread = std::thread([this, subs]()
+                epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+                if(epoll_fd < 0) throw_error("epoll_create1");
+                stop_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+                if(stop_fd < 0) throw_error("eventfd");
+
+                epoll_event event = {};
+                event.events = EPOLLIN;
+                event.data.ptr = nullptr;
+                if(epoll_ctl(epoll_fd, EPOLL_CTL_ADD, stop_fd, &event) < 0) throw_error("epoll_ctl");
+                for(auto * sub : subs)
+                {
+                    event.data.ptr = sub;
+                    if(epoll_ctl(epoll_fd, EPOLL_CTL_ADD, sub->fd, &event) < 0) throw_error("epoll_ctl");
+                    sub->start_consumer();
+                }
+
+                // The capture thread only moves buffers from the driver to the consumers, so it never waits on a frame callback
+                thread = std::thread([this]()
                 {
-                    while(!stop) subdevice::poll(subs);
+                    const int max_events = 16;
+                    epoll_event events[max_events];
+                    while(true)
+                    {
+                        int count = epoll_wait(epoll_fd, events, max_events, -1);
+                        if(count < 0)
+                        {
+                            if(errno == EINTR) continue;
+                            throw_error("epoll_wait");
+                        }
+                        for(int i=0; i<count; ++i)
+                        {
+                            if(!events[i].data.ptr) return;
+                            static_cast<subdevice *>(events[i].data.ptr)->dequeue_all();
+                        }
+                    }
                 });
             }
 
@@ -439,10 +523,14 @@ namespace rsimpl
             {
                 if(thread.joinable())
                 {
-                    stop = true;
+                    uint64_t one = 1;
+                    if(write(stop_fd, &one, sizeof(one)) < 0) warn_error("write");
                     thread.join();
-                    stop = false;
+                    close(epoll_fd);
+                    close(stop_fd);
+                    epoll_fd = stop_fd = -1;
 
+                    for(auto & sub : subdevices) sub->stop_consumer_thread();
                     for(auto & sub : subdevices) sub->stop_capture();
                 }                
             }
@@ -558,6 +646,11 @@ namespace rsimpl
             device.subdevices[subdevice_index]->set_data_channel_cfg(callback);
         }
 
+        void set_capture_buffer_count(device & device, int count)
+        {
+            for(auto & sub : device.subdevices) sub->buffer_count = count;
+        }
+
         void start_streaming(device & device, int /*num_transfer_bufs*/)
         {
             device.start_streaming();
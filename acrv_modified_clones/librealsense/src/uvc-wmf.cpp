@@ -829,6 +829,7 @@ namespace rsimpl
             device.subdevices[subdevice_index].set_data_channel_cfg(callback);
         }
 
+        void set_capture_buffer_count(device & device, int count) {} // Media Foundation manages its own buffers
         void start_streaming(device & device, int num_transfer_bufs) { device.start_streaming(); }
         void stop_streaming(device & device) { device.stop_streaming(); }
 
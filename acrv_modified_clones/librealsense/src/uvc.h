@@ -64,6 +64,7 @@ namespace rsimpl
         typedef std::function<void(const void * frame, std::function<void()> continuation)> video_channel_callback;
 
         void set_subdevice_mode(device & device, int subdevice_index, int width, int height, uint32_t fourcc, int fps, video_channel_callback callback);
+        void set_capture_buffer_count(device & device, int count); // Frame buffers each subdevice keeps in flight with the driver, used by the V4L2 backend
         void start_streaming(device & device, int num_transfer_bufs);
         void stop_streaming(device & device);
         
@@ -0,0 +1,162 @@
+// License: Apache 2.0. See LICENSE file in root directory.
+
+// Offline benchmarks of the image processing paths, run with "offline-benchmark [benchmark]" or a single one, e.g. "offline-benchmark [unpack]".
+// Recorded depth can be supplied as raw little-endian Z16 frames laid back to back:
+//   RS_BENCHMARK_DEPTH_FILE=frames.z16 RS_BENCHMARK_DEPTH_WIDTH=640 RS_BENCHMARK_DEPTH_HEIGHT=480
+// otherwise a synthetic frame is used.
+
+#define CATCH_CONFIG_MAIN
+#include "catch/catch.hpp"
+
+#include "../src/image.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <vector>
+
+struct recorded_depth
+{
+    rs_intrinsics intrin;
+    std::vector<std::vector<uint16_t>> frames;
+};
+
+static int env_int(const char * name, int fallback)
+{
+    const char * value = std::getenv(name);
+    return value ? std::atoi(value) : fallback;
+}
+
+static recorded_depth load_recorded_depth()
+{
+    recorded_depth depth;
+    depth.intrin = { env_int("RS_BENCHMARK_DEPTH_WIDTH", 640), env_int("RS_BENCHMARK_DEPTH_HEIGHT", 480), 310.2f, 245.7f, 475.1f, 475.3f,
+                     RS_DISTORTION_INVERSE_BROWN_CONRADY, { 0.14f, 0.06f, 0.004f, 0.005f, 0.07f } };
+    const size_t pixels = depth.intrin.width * depth.intrin.height;
+
+    if (const char * path = std::getenv("RS_BENCHMARK_DEPTH_FILE"))
+    {
+        std::ifstream file(path, std::ios::binary);
+        std::vector<uint16_t> frame(pixels);
+        while (file.read(reinterpret_cast<char *>(frame.data()), pixels * sizeof(uint16_t))) depth.frames.push_back(frame);
+        std::cout << "Loaded " << depth.frames.size() << " recorded frames from " << path << std::endl;
+    }
+    if (depth.frames.empty())
+    {
+        std::vector<uint16_t> frame(pixels);
+        for (size_t i = 0; i < pixels; ++i) frame[i] = (i % 97) ? uint16_t(200 + (i * 7919) % 4000) : 0;
+        depth.frames.push_back(frame);
+    }
+    return depth;
+}
+
+template<class FUNC> double milliseconds_per_frame(const recorded_depth & depth, int repeats, FUNC func)
+{
+    auto start = std::chrono::high_resolution_clock::now();
+    for (int r = 0; r < repeats; ++r) for (auto & frame : depth.frames) func(frame.data());
+    std::chrono::duration<double, std::milli> elapsed = std::chrono::high_resolution_clock::now() - start;
+    return elapsed.count() / (repeats * depth.frames.size());
+}
+
+TEST_CASE("deprojection of Z16 frames", "[benchmark] [deprojection]")
+{
+    const auto depth = load_recorded_depth();
+    const int repeats = env_int("RS_BENCHMARK_REPEATS", 50);
+    std::vector<float> points(depth.intrin.width * depth.intrin.height * 3);
+
+    const double per_pixel = milliseconds_per_frame(depth, repeats, [&](const uint16_t * frame) { rsimpl::deproject_z(points.data(), depth.intrin, frame, 0.001f); });
+
+    const auto table = rsimpl::compute_deprojection_table(depth.intrin);
+    const double table_driven = milliseconds_per_frame(depth, repeats, [&](const uint16_t * frame) { rsimpl::deproject_z(points.data(), table, depth.intrin, frame, 0.001f); });
+
+    std::cout << "deproject_z " << depth.intrin.width << "x" << depth.intrin.height << ": per-pixel " << per_pixel << " ms/frame, table driven " << table_driven
+              << " ms/frame (" << per_pixel / table_driven << "x)" << std::endl;
+    REQUIRE(table_driven > 0);
+}
+
+TEST_CASE("alignment of Z16 frames to colour", "[benchmark] [alignment]")
+{
+    const auto depth = load_recorded_depth();
+    const int repeats = env_int("RS_BENCHMARK_REPEATS", 50);
+    const rs_intrinsics color_intrin = { 1920, 1080, 958.2f, 541.7f, 1386.0f, 1386.9f, RS_DISTORTION_MODIFIED_BROWN_CONRADY, { 0.02f, -0.01f, 0.001f, 0.001f, 0 } };
+    const rs_extrinsics depth_to_color = { { 0.9999f, -0.0100f, 0.0050f, 0.0100f, 0.9999f, 0.0020f, -0.0050f, -0.0021f, 0.9999f }, { 0.025f, 0.001f, 0.004f } };
+    std::vector<uint16_t> aligned_z(color_intrin.width * color_intrin.height);
+    std::vector<rsimpl::byte> color(color_intrin.width * color_intrin.height * 3), aligned_color(depth.intrin.width * depth.intrin.height * 3);
+
+    const double per_pixel = milliseconds_per_frame(depth, repeats, [&](const uint16_t * frame) { rsimpl::align_z_to_other((rsimpl::byte *)aligned_z.data(), frame, 0.001f, depth.intrin, depth_to_color, color_intrin); });
+    const double per_pixel_color = milliseconds_per_frame(depth, repeats, [&](const uint16_t * frame) { rsimpl::align_other_to_z(aligned_color.data(), frame, 0.001f, depth.intrin, depth_to_color, color_intrin, color.data(), RS_FORMAT_RGB8); });
+
+    auto table = rsimpl::compute_alignment_table(depth.intrin, depth_to_color, color_intrin);
+    const double table_driven = milliseconds_per_frame(depth, repeats, [&](const uint16_t * frame) { rsimpl::align_z_to_other((rsimpl::byte *)aligned_z.data(), frame, 0.001f, table); });
+    const double table_driven_color = milliseconds_per_frame(depth, repeats, [&](const uint16_t * frame) { rsimpl::align_other_to_z(aligned_color.data(), frame, 0.001f, table, color.data(), RS_FORMAT_RGB8); });
+
+    std::cout << "align_z_to_other: per-pixel " << per_pixel << " ms/frame, table driven " << table_driven << " ms/frame (" << per_pixel / table_driven << "x)" << std::endl;
+    std::cout << "align_other_to_z: per-pixel " << per_pixel_color << " ms/frame, table driven " << table_driven_color << " ms/frame (" << per_pixel_color / table_driven_color << "x)" << std::endl;
+    REQUIRE(table_driven > 0);
+}
+
+static double milliseconds_per_unpack(int repeats, std::function<void()> unpack)
+{
+    auto start = std::chrono::high_resolution_clock::now();
+    for (int r = 0; r < repeats; ++r) unpack();
+    std::chrono::duration<double, std::milli> elapsed = std::chrono::high_resolution_clock::now() - start;
+    return elapsed.count() / repeats;
+}
+
+TEST_CASE("unpacking of each native pixel format", "[benchmark] [unpack]")
+{
+    struct benchmark_format { const char * name; const rsimpl::native_pixel_format & format; int width, height; };
+    const benchmark_format formats[] = {
+        { "RAW8",       rsimpl::pf_raw8,       640,  480 },
+        { "RW10",       rsimpl::pf_rw10,       1920, 1080 },
+        { "RW16",       rsimpl::pf_rw16,       1920, 1080 },
+        { "YUY2",       rsimpl::pf_yuy2,       1920, 1080 },
+        { "Y8",         rsimpl::pf_y8,         640,  480 },
+        { "Y8I",        rsimpl::pf_y8i,        640,  480 },
+        { "Y16",        rsimpl::pf_y16,        640,  480 },
+        { "Y12I",       rsimpl::pf_y12i,       640,  480 },
+        { "Z16",        rsimpl::pf_z16,        640,  480 },
+        { "INVZ",       rsimpl::pf_invz,       640,  480 },
+        { "F200 INVI",  rsimpl::pf_f200_invi,  640,  480 },
+        { "F200 INZI",  rsimpl::pf_f200_inzi,  640,  480 },
+        { "SR300 INVI", rsimpl::pf_sr300_invi, 640,  480 },
+        { "SR300 INZI", rsimpl::pf_sr300_inzi, 640,  480 },
+    };
+    const int repeats = env_int("RS_BENCHMARK_REPEATS", 50);
+    std::cout << "AVX2 " << (rsimpl::is_avx2_supported() ? "supported" : "not supported") << std::endl;
+
+    for (auto & f : formats)
+    {
+        const int count = f.width * f.height;
+        // RW10 packs 4 pixels in 5 bytes but advertises 1 byte per pixel, leave room for it
+        std::vector<rsimpl::byte> source(std::max(f.format.get_image_size(f.width, f.height), size_t(count * 2)));
+        for (size_t i = 0; i < source.size(); ++i) source[i] = rsimpl::byte(i * 7919 >> 3);
+
+        const rs_intrinsics intrin = { f.width, f.height, f.width / 2.0f, f.height / 2.0f, 600.0f, 600.0f, RS_DISTORTION_NONE, { 0, 0, 0, 0, 0 } };
+        const rsimpl::subdevice_mode mode = { 0, { f.width, f.height }, f.format, 30, intrin, {}, { 0 } };
+
+        for (size_t u = 0; u < f.format.unpackers.size(); ++u)
+        {
+            const auto & unpacker = f.format.unpackers[u];
+            std::vector<std::vector<rsimpl::byte>> outputs;
+            rsimpl::byte * dest[2] = {};
+            for (auto & output : unpacker.outputs) outputs.emplace_back(rsimpl::get_image_size(count, 1, output.second));
+            for (size_t i = 0; i < outputs.size(); ++i) dest[i] = outputs[i].data();
+            const rsimpl::subdevice_mode_selection selection(mode, 0, int(u));
+
+            rsimpl::set_avx2_unpacking(false);
+            const double baseline = milliseconds_per_unpack(repeats, [&]() { unpacker.unpack(dest, source.data(), count); });
+            rsimpl::set_avx2_unpacking(true);
+            const double avx2 = milliseconds_per_unpack(repeats, [&]() { unpacker.unpack(dest, source.data(), count); });
+            const double striped = milliseconds_per_unpack(repeats, [&]() { selection.unpack(dest, source.data()); });
+
+            std::cout << f.name << " " << f.width << "x" << f.height << " to";
+            for (auto & output : unpacker.outputs) std::cout << " " << rs_stream_to_string(output.first) << "/" << rs_format_to_string(output.second);
+            std::cout << ": SSSE3/generic " << baseline << " ms, AVX2 " << avx2 << " ms, striped " << striped << " ms" << std::endl;
+            REQUIRE(avx2 > 0);
+        }
+    }
+}
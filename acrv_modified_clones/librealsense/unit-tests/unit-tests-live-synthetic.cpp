@@ -0,0 +1,120 @@
+// License: Apache 2.0. See LICENSE file in root directory.
+
+/////////////////////////////////////////////////////////////////////////////////////////
+// This set of tests is valid only for the synthetic camera (RS_SYNTHETIC_BACKEND=ON) //
+/////////////////////////////////////////////////////////////////////////////////////////
+
+#if !defined(MAKEFILE) || ( defined(LIVE_TEST) && defined(SYNTHETIC_TEST) )
+
+#define CATCH_CONFIG_MAIN
+#include "catch/catch.hpp"
+
+#include "unit-tests-common.h"
+
+#include <chrono>
+#include <cstdlib>
+
+TEST_CASE( "Synthetic camera metadata enumerates correctly", "[live] [synthetic]" )
+{
+    safe_context ctx;
+    const int device_count = rs_get_device_count(ctx, require_no_error());
+    REQUIRE(device_count > 0);
+
+    for(int i=0; i<device_count; ++i)
+    {
+        rs_device * dev = rs_get_device(ctx, i, require_no_error());
+        REQUIRE(dev != nullptr);
+
+        SECTION( "device name is Synthetic Camera" )
+        {
+            REQUIRE(rs_get_device_name(dev, require_no_error()) == std::string("Synthetic Camera"));
+        }
+
+        SECTION( "depth scale is one millimetre" )
+        {
+            REQUIRE(rs_get_device_depth_scale(dev, require_no_error()) == Approx(0.001f));
+        }
+
+        SECTION( "color options read back what was written" )
+        {
+            rs_set_device_option(dev, RS_OPTION_COLOR_GAIN, 100, require_no_error());
+            REQUIRE(rs_get_device_option(dev, RS_OPTION_COLOR_GAIN, require_no_error()) == 100);
+        }
+    }
+}
+
+TEST_CASE( "Synthetic camera streams depth, color and infrared", "[live] [synthetic]" )
+{
+    safe_context ctx;
+    REQUIRE(rs_get_device_count(ctx, require_no_error()) > 0);
+    rs_device * dev = rs_get_device(ctx, 0, require_no_error());
+    REQUIRE(dev != nullptr);
+
+    SECTION( "streaming DEPTH 640x480 at 60 FPS" ) test_streaming(dev, {{RS_STREAM_DEPTH, 640, 480, RS_FORMAT_Z16, 60}});
+    SECTION( "streaming COLOR 1920x1080 RGB8 at 30 FPS" ) test_streaming(dev, {{RS_STREAM_COLOR, 1920, 1080, RS_FORMAT_RGB8, 30}});
+    SECTION( "streaming INFRARED 320x240 Y16 at 90 FPS" ) test_streaming(dev, {{RS_STREAM_INFRARED, 320, 240, RS_FORMAT_Y16, 90}});
+    SECTION( "streaming DEPTH, COLOR and INFRARED 640x480 at 30 FPS" )
+    {
+        test_streaming(dev, {{RS_STREAM_DEPTH, 640, 480, RS_FORMAT_Z16, 30},
+                             {RS_STREAM_COLOR, 640, 480, RS_FORMAT_RGB8, 30},
+                             {RS_STREAM_INFRARED, 640, 480, RS_FORMAT_Y8, 30}});
+    }
+}
+
+TEST_CASE( "Synthetic camera frames carry the generated content", "[live] [synthetic]" )
+{
+    safe_context ctx;
+    REQUIRE(rs_get_device_count(ctx, require_no_error()) > 0);
+    rs_device * dev = rs_get_device(ctx, 0, require_no_error());
+    REQUIRE(dev != nullptr);
+
+    rs_enable_stream(dev, RS_STREAM_DEPTH, 640, 480, RS_FORMAT_Z16, 60, require_no_error());
+    rs_enable_stream(dev, RS_STREAM_COLOR, 640, 480, RS_FORMAT_RGB8, 60, require_no_error());
+    rs_start_device(dev, require_no_error());
+    for(int i=0; i<10; ++i) rs_wait_for_frames(dev, require_no_error());
+
+    // A column of holes on the left, then a floor which is 3m away at the top and gets closer towards the bottom
+    auto depth = reinterpret_cast<const uint16_t *>(rs_get_frame_data(dev, RS_STREAM_DEPTH, require_no_error()));
+    REQUIRE(depth[640 * 10 + 4] == 0);
+    REQUIRE(depth[640 * 10 + 320] == 3000 - 10 * 2000 / 480);
+    REQUIRE(depth[640 * 470 + 320] == 3000 - 470 * 2000 / 480);
+
+    // The color image is gray outside the box, so every pixel of the top row has R == G == B
+    auto rgb = reinterpret_cast<const uint8_t *>(rs_get_frame_data(dev, RS_STREAM_COLOR, require_no_error()));
+    for(int x=2; x<640; ++x)
+    {
+        REQUIRE(rgb[x * 3] == rgb[x * 3 + 1]);
+        REQUIRE(rgb[x * 3] == rgb[x * 3 + 2]);
+    }
+
+    // Frames are stamped by the backend with consecutive counters, and timestamps follow the nominal frame rate
+    auto number = rs_get_frame_number(dev, RS_STREAM_DEPTH, require_no_error());
+    auto timestamp = rs_get_frame_timestamp(dev, RS_STREAM_DEPTH, require_no_error());
+    REQUIRE(number > 0);
+    REQUIRE(timestamp == Approx(number * 1000.0 / 60));
+
+    rs_stop_device(dev, require_no_error());
+}
+
+TEST_CASE( "Unthrottled synthetic camera streams faster than its nominal frame rate", "[live] [synthetic]" )
+{
+    setenv("RS_SYNTHETIC_RATE", "0", 1);
+    safe_context ctx;
+    unsetenv("RS_SYNTHETIC_RATE");
+    REQUIRE(rs_get_device_count(ctx, require_no_error()) > 0);
+    rs_device * dev = rs_get_device(ctx, 0, require_no_error());
+    REQUIRE(dev != nullptr);
+
+    rs_enable_stream(dev, RS_STREAM_DEPTH, 320, 240, RS_FORMAT_Z16, 30, require_no_error());
+    rs_start_device(dev, require_no_error());
+    rs_wait_for_frames(dev, require_no_error());
+
+    // 60 frames at 30 FPS would take two seconds
+    auto start = std::chrono::steady_clock::now();
+    for(int i=0; i<60; ++i) rs_wait_for_frames(dev, require_no_error());
+    REQUIRE(std::chrono::steady_clock::now() - start < std::chrono::seconds(1));
+
+    rs_stop_device(dev, require_no_error());
+}
+
+#endif /* !defined(MAKEFILE) || ( defined(LIVE_TEST) && defined(SYNTHETIC_TEST) ) */
@@ -8,8 +8,14 @@
 
 #include "unit-tests-common.h"
 #include "../src/device.h"
+#include "../src/image.h"
+#include "../src/sync.h"
+#include "../src/trace.h"
+#include "../include/librealsense/rsutil.h"
 
 #include <sstream>
+#include <algorithm>
+#include <cstdlib>
 
 static std::string unknown = "UNKNOWN"; 
 
@@ -404,4 +410,500 @@ TEST_CASE("rs API version verification", "[offline] [validation]")
     REQUIRE(api_ver_str.size() <= 8);
 }
 
+static void require_table_deprojection_matches_reference(const rs_intrinsics & intrin, float scale, bool disparity)
+{
+    std::vector<uint16_t> depth(intrin.width * intrin.height);
+    for (size_t i = 0; i < depth.size(); ++i) depth[i] = (i % 97) ? uint16_t(200 + (i * 7919) % 4000) : 0;
+
+    std::vector<float> reference(depth.size() * 3), points(depth.size() * 3);
+    const auto table = rsimpl::compute_deprojection_table(intrin);
+    if (disparity)
+    {
+        rsimpl::deproject_disparity(reference.data(), intrin, depth.data(), scale);
+        rsimpl::deproject_disparity(points.data(), table, intrin, depth.data(), scale);
+    }
+    else
+    {
+        rsimpl::deproject_z(reference.data(), intrin, depth.data(), scale);
+        rsimpl::deproject_z(points.data(), table, intrin, depth.data(), scale);
+    }
+
+    // Both paths do the same float operations, but -Ofast may reassociate them differently in each loop
+    for (size_t i = 0; i < reference.size(); ++i)
+    {
+        // Zero disparity divides by zero. -Ofast assumes finite math, so neither the result nor an isfinite test on it can be
+        // relied on, and those pixels are skipped by their input.
+        if (disparity && depth[i / 3] == 0) continue;
+        REQUIRE(std::fabs(points[i] - reference[i]) <= 1e-5f * std::max(1.0f, std::fabs(reference[i])));
+    }
+}
+
+TEST_CASE("table driven deprojection matches per-pixel deprojection", "[offline] [deprojection]")
+{
+    // Odd width exercises the scalar tail after the SIMD loop
+    rs_intrinsics intrin = { 333, 250, 160.5f, 123.25f, 311.0f, 309.5f, RS_DISTORTION_NONE, { 0, 0, 0, 0, 0 } };
+    require_table_deprojection_matches_reference(intrin, 0.001f, false);
+    require_table_deprojection_matches_reference(intrin, 32.0f, true);
+
+    rs_intrinsics distorted = { 640, 480, 310.2f, 245.7f, 475.1f, 475.3f, RS_DISTORTION_INVERSE_BROWN_CONRADY, { 0.14f, 0.06f, 0.004f, 0.005f, 0.07f } };
+    require_table_deprojection_matches_reference(distorted, 0.000125f, false);
+
+    // Again without the AVX2 rows, on CPUs that have them
+    rsimpl::set_avx2_deprojection(false);
+    require_table_deprojection_matches_reference(intrin, 0.001f, false);
+    require_table_deprojection_matches_reference(intrin, 32.0f, true);
+    rsimpl::set_avx2_deprojection(true);
+}
+
+TEST_CASE("table driven alignment matches per-pixel alignment", "[offline] [alignment]")
+{
+    const rs_intrinsics depth_intrin = { 320, 240, 160.5f, 121.3f, 240.2f, 240.9f, RS_DISTORTION_NONE, { 0, 0, 0, 0, 0 } };
+    const rs_intrinsics color_intrin = { 640, 480, 318.4f, 242.1f, 617.5f, 617.9f, RS_DISTORTION_MODIFIED_BROWN_CONRADY, { 0.02f, -0.01f, 0.001f, 0.001f, 0 } };
+    const rs_extrinsics depth_to_color = { { 0.9999f, -0.0100f, 0.0050f, 0.0100f, 0.9999f, 0.0020f, -0.0050f, -0.0021f, 0.9999f }, { 0.025f, 0.001f, 0.004f } };
+    const float z_scale = 0.001f;
+
+    // A slanted plane with a step in front of it and some holes, so both occlusion and missing data are exercised
+    std::vector<uint16_t> z(depth_intrin.width * depth_intrin.height);
+    for (int y = 0; y < depth_intrin.height; ++y) for (int x = 0; x < depth_intrin.width; ++x)
+    {
+        uint16_t & pixel = z[y * depth_intrin.width + x];
+        pixel = uint16_t(800 + 2 * x + y);
+        if (x > 100 && x < 180 && y > 60 && y < 160) pixel = 500;
+        if ((x * 31 + y * 17) % 53 == 0) pixel = 0;
+    }
+    std::vector<rsimpl::byte> color(color_intrin.width * color_intrin.height * 3);
+    for (size_t i = 0; i < color.size(); ++i) color[i] = rsimpl::byte(i * 13);
+
+    auto table = rsimpl::compute_alignment_table(depth_intrin, depth_to_color, color_intrin);
+    REQUIRE(table.matches(depth_intrin, depth_to_color, color_intrin));
+
+    // Scaling the rotated ray rounds differently from rotating the scaled point, allow the odd pixel to land one over
+    std::vector<uint16_t> reference_z(color_intrin.width * color_intrin.height), aligned_z(reference_z.size());
+    rsimpl::align_z_to_other((rsimpl::byte *)reference_z.data(), z.data(), z_scale, depth_intrin, depth_to_color, color_intrin);
+    rsimpl::align_z_to_other((rsimpl::byte *)aligned_z.data(), z.data(), z_scale, table);
+    size_t mismatched = 0;
+    for (size_t i = 0; i < reference_z.size(); ++i) mismatched += reference_z[i] != aligned_z[i];
+    REQUIRE(mismatched <= reference_z.size() / 200);
+
+    std::vector<rsimpl::byte> reference_color(z.size() * 3), aligned_color(z.size() * 3);
+    rsimpl::align_other_to_z(reference_color.data(), z.data(), z_scale, depth_intrin, depth_to_color, color_intrin, color.data(), RS_FORMAT_RGB8);
+    rsimpl::align_other_to_z(aligned_color.data(), z.data(), z_scale, table, color.data(), RS_FORMAT_RGB8);
+    mismatched = 0;
+    for (size_t i = 0; i < z.size(); ++i) mismatched += memcmp(&reference_color[i * 3], &aligned_color[i * 3], 3) != 0;
+    REQUIRE(mismatched <= z.size() / 200);
+}
+
+TEST_CASE("table driven alignment copies nothing through rectangles flipped by the extrinsics", "[offline] [alignment]")
+{
+    // Rotating half a turn about the optical axis maps every depth pixel onto a rectangle with x0 > x1 and y0 > y1
+    const rs_intrinsics depth_intrin = { 320, 240, 160.5f, 121.3f, 240.2f, 240.9f, RS_DISTORTION_NONE, { 0, 0, 0, 0, 0 } };
+    const rs_intrinsics color_intrin = { 640, 480, 318.4f, 242.1f, 617.5f, 617.9f, RS_DISTORTION_NONE, { 0, 0, 0, 0, 0 } };
+    const rs_extrinsics flipped = { { -1, 0, 0, 0, -1, 0, 0, 0, 1 }, { 0.025f, 0.001f, 0.004f } };
+    const float z_scale = 0.001f;
+
+    std::vector<uint16_t> z(depth_intrin.width * depth_intrin.height, 1000);
+    std::vector<rsimpl::byte> color(color_intrin.width * color_intrin.height * 3);
+    for (size_t i = 0; i < color.size(); ++i) color[i] = rsimpl::byte(i * 13 + 1);
+
+    auto table = rsimpl::compute_alignment_table(depth_intrin, flipped, color_intrin);
+    std::vector<rsimpl::byte> reference_color(z.size() * 3), aligned_color(z.size() * 3);
+    rsimpl::align_other_to_z(reference_color.data(), z.data(), z_scale, depth_intrin, flipped, color_intrin, color.data(), RS_FORMAT_RGB8);
+    rsimpl::align_other_to_z(aligned_color.data(), z.data(), z_scale, table, color.data(), RS_FORMAT_RGB8);
+    REQUIRE(std::count(reference_color.begin(), reference_color.end(), 0) == (int)reference_color.size());
+    REQUIRE(aligned_color == reference_color);
+}
+
+TEST_CASE("rectification tables match the per-pixel mapping", "[offline] [rectification]")
+{
+    // Odd rectified width exercises the scalar tail after the AVX2 blocks
+    const rs_intrinsics unrect_intrin = { 640, 480, 318.4f, 242.1f, 617.5f, 617.9f, RS_DISTORTION_MODIFIED_BROWN_CONRADY, { 0.12f, -0.21f, 0.001f, 0.002f, 0.05f } };
+    const rs_intrinsics rect_intrin = { 637, 478, 317.9f, 240.6f, 615.0f, 615.0f, RS_DISTORTION_NONE, { 0, 0, 0, 0, 0 } };
+    const rs_extrinsics rect_to_unrect = { { 0.9999f, -0.0100f, 0.0050f, 0.0100f, 0.9999f, 0.0020f, -0.0050f, -0.0021f, 0.9999f }, { 0, 0, 0 } };
+
+    // Each rectified pixel takes the unrectified pixel under the bottom right corner of its footprint, or pixel 0 if it falls outside
+    std::vector<int> reference(rect_intrin.width * rect_intrin.height);
+    for (int y = 0; y < rect_intrin.height; ++y) for (int x = 0; x < rect_intrin.width; ++x)
+    {
+        int corners[2][2];
+        for (int c = 0; c < 2; ++c)
+        {
+            float pixel[] = { x + c - 0.5f, y + c - 0.5f }, point[3], unrect_point[3], unrect_pixel[2];
+            rs_deproject_pixel_to_point(point, &rect_intrin, pixel, 1.0f);
+            rs_transform_point_to_point(unrect_point, &rect_to_unrect, point);
+            rs_project_point_to_pixel(unrect_pixel, &unrect_intrin, unrect_point);
+            corners[c][0] = static_cast<int>(unrect_pixel[0] + 0.5f);
+            corners[c][1] = static_cast<int>(unrect_pixel[1] + 0.5f);
+        }
+        const bool inside = corners[0][0] >= 0 && corners[0][1] >= 0 && corners[1][0] < unrect_intrin.width && corners[1][1] < unrect_intrin.height;
+        const bool covered = corners[0][0] <= corners[1][0] && corners[0][1] <= corners[1][1];
+        reference[y * rect_intrin.width + x] = inside && covered ? corners[1][1] * unrect_intrin.width + corners[1][0] : 0;
+    }
+
+    auto table = rsimpl::compute_rectification_table(rect_intrin, rect_to_unrect, unrect_intrin);
+    REQUIRE(table.matches(rect_intrin, rect_to_unrect, unrect_intrin));
+    // The table is built from the shared corner rays with -Ofast's reassociated float math, so a corner that lands on a pixel boundary
+    // may round to the neighbouring pixel. Allow one pixel either way, and a rare flip between covered and uncovered at the edges
+    size_t uncovered_flips = 0, far = 0;
+    for (size_t i = 0; i < reference.size(); ++i)
+    {
+        const int index = table.indices[i], expected = reference[i];
+        if ((index == 0) != (expected == 0)) ++uncovered_flips;
+        else far += std::abs(index % unrect_intrin.width - expected % unrect_intrin.width) > 1 || std::abs(index / unrect_intrin.width - expected / unrect_intrin.width) > 1;
+    }
+    REQUIRE(far == 0);
+    REQUIRE(uncovered_flips <= reference.size() / 200);
+
+    // Make the gathers hit the very last unrectified pixel, which the AVX2 path must not read past
+    table.indices[5] = unrect_intrin.width * unrect_intrin.height - 1;
+    for (auto format : { RS_FORMAT_Y8, RS_FORMAT_Z16, RS_FORMAT_RGB8, RS_FORMAT_BGRA8 })
+    {
+        const int bpp = rsimpl::get_image_bpp(format) / 8;
+        std::vector<rsimpl::byte> unrect(unrect_intrin.width * unrect_intrin.height * bpp);
+        for (size_t i = 0; i < unrect.size(); ++i) unrect[i] = rsimpl::byte(i * 7919 >> 3);
+
+        std::vector<rsimpl::byte> expected(table.indices.size() * bpp), rect_generic(expected.size()), rect_avx2(expected.size());
+        for (size_t i = 0; i < table.indices.size(); ++i) memcpy(&expected[i * bpp], &unrect[table.indices[i] * bpp], bpp);
+        rsimpl::set_avx2_unpacking(false);
+        rsimpl::rectify_image(rect_generic.data(), table, unrect.data(), format);
+        rsimpl::set_avx2_unpacking(true);
+        rsimpl::rectify_image(rect_avx2.data(), table, unrect.data(), format);
+        REQUIRE(rect_generic == expected);
+        REQUIRE(rect_avx2 == expected);
+    }
+}
+
+TEST_CASE("rectification tables are only loaded back for the calibration they were built from", "[offline] [rectification]")
+{
+    const rs_intrinsics unrect_intrin = { 320, 240, 160.2f, 119.7f, 308.0f, 308.4f, RS_DISTORTION_MODIFIED_BROWN_CONRADY, { 0.1f, -0.2f, 0, 0, 0.04f } };
+    const rs_intrinsics rect_intrin = { 320, 240, 160.0f, 120.0f, 307.0f, 307.0f, RS_DISTORTION_NONE, { 0, 0, 0, 0, 0 } };
+    const rs_extrinsics rect_to_unrect = { { 1, 0, 0, 0, 1, 0, 0, 0, 1 }, { 0, 0, 0 } };
+    const auto table = rsimpl::compute_rectification_table(rect_intrin, rect_to_unrect, unrect_intrin);
+
+    const std::string file_path = "rectification-offline-test.bin";
+    REQUIRE(rsimpl::save_rectification_table(file_path, table));
+
+    rsimpl::rectification_table loaded;
+    REQUIRE(rsimpl::load_rectification_table(file_path, rect_intrin, rect_to_unrect, unrect_intrin, loaded));
+    REQUIRE(loaded.matches(rect_intrin, rect_to_unrect, unrect_intrin));
+    REQUIRE(loaded.indices == table.indices);
+
+    auto recalibrated = unrect_intrin;
+    recalibrated.fx += 0.5f;
+    REQUIRE(!rsimpl::load_rectification_table(file_path, rect_intrin, rect_to_unrect, recalibrated, loaded));
+    REQUIRE(!rsimpl::load_rectification_table("no-such-file.bin", rect_intrin, rect_to_unrect, unrect_intrin, loaded));
+    std::remove(file_path.c_str());
+}
+
+static std::vector<std::vector<rsimpl::byte>> unpack_with(const rsimpl::pixel_format_unpacker & unpacker, const std::vector<rsimpl::byte> & source, int count)
+{
+    std::vector<std::vector<rsimpl::byte>> outputs;
+    rsimpl::byte * dest[2] = {};
+    for (auto & output : unpacker.outputs) outputs.emplace_back(rsimpl::get_image_size(count, 1, output.second));
+    for (size_t i = 0; i < outputs.size(); ++i) dest[i] = outputs[i].data();
+    unpacker.unpack(dest, source.data(), count);
+    return outputs;
+}
+
+TEST_CASE("AVX2 unpackers match the SSSE3 and generic unpackers", "[offline] [unpack]")
+{
+    const rsimpl::native_pixel_format * formats[] = { &rsimpl::pf_yuy2, &rsimpl::pf_y16, &rsimpl::pf_sr300_invi, &rsimpl::pf_f200_inzi, &rsimpl::pf_sr300_inzi };
+
+    // 1008 pixels is not a whole number of AVX2 blocks, so the tails are exercised too
+    const int count = 1008;
+    for (auto format : formats)
+    {
+        std::vector<rsimpl::byte> source(format->get_image_size(count, 1));
+        for (size_t i = 0; i < source.size(); ++i) source[i] = rsimpl::byte(i * 7919 >> 3);
+
+        for (auto & unpacker : format->unpackers)
+        {
+            rsimpl::set_avx2_unpacking(false);
+            const auto reference = unpack_with(unpacker, source, count);
+            rsimpl::set_avx2_unpacking(true);
+            REQUIRE(unpack_with(unpacker, source, count) == reference);
+        }
+    }
+}
+
+TEST_CASE("unpacking large frames in stripes matches unpacking them whole", "[offline] [unpack]")
+{
+    const rs_intrinsics intrin = { 1920, 1080, 958.2f, 541.7f, 1386.0f, 1386.9f, RS_DISTORTION_NONE, { 0, 0, 0, 0, 0 } };
+    const rsimpl::subdevice_mode mode = { 0, { intrin.width, intrin.height }, rsimpl::pf_yuy2, 30, intrin, {}, { 0 } };
+    const int count = intrin.width * intrin.height;
+
+    std::vector<rsimpl::byte> source(rsimpl::pf_yuy2.get_image_size(intrin.width, intrin.height));
+    for (size_t i = 0; i < source.size(); ++i) source[i] = rsimpl::byte(i * 7919 >> 3);
+
+    for (size_t i = 0; i < rsimpl::pf_yuy2.unpackers.size(); ++i)
+    {
+        const rsimpl::subdevice_mode_selection selection(mode, 0, int(i));
+        const auto reference = unpack_with(rsimpl::pf_yuy2.unpackers[i], source, count);
+        std::vector<rsimpl::byte> striped(reference[0].size());
+        rsimpl::byte * dest[] = { striped.data() };
+        selection.unpack(dest, source.data());
+        REQUIRE(striped == reference[0]);
+    }
+}
+
+TEST_CASE("row workers run every stripe once while several images are striped at once", "[offline] [unpack]")
+{
+    // More stripes than threads, and more callers than workers, so stripes are claimed by callers and workers alike
+    const int height = 1000, stripe_count = rsimpl::row_thread_count() + 3;
+    std::vector<std::vector<int>> visits(4, std::vector<int>(height));
+    std::vector<std::thread> callers;
+    for (auto & rows : visits) callers.emplace_back([&rows, stripe_count]()
+    {
+        for (int repeat = 0; repeat < 50; ++repeat)
+        {
+            rsimpl::run_row_stripes(height, stripe_count, [&rows](int first_row, int last_row)
+            {
+                for (int y = first_row; y < last_row; ++y) ++rows[y];
+            });
+        }
+    });
+    for (auto & caller : callers) caller.join();
+    for (auto & rows : visits) REQUIRE(std::count(rows.begin(), rows.end(), 50) == height);
+}
+
+TEST_CASE("bounded_queue keeps order while the producer evicts the oldest entries", "[offline] [sync]")
+{
+    rsimpl::bounded_queue<int, 4> queue;
+    int item = -1;
+    REQUIRE(queue.empty());
+    REQUIRE(!queue.try_pop(item));
+    for (int i = 0; i < 4; ++i) REQUIRE(queue.try_push(int(i)));
+    REQUIRE(!queue.try_push(4));
+    REQUIRE(queue.try_pop(item));
+    REQUIRE(item == 0);
+
+    // Same pattern as syncronizing_archive::commit_frame, racing against a consumer
+    const int count = 200000;
+    std::atomic<int> evicted(0);
+    std::thread producer([&]()
+    {
+        for (int i = 1; i <= count; ++i)
+        {
+            int next = i + 3;
+            while (!queue.try_push(std::move(next)))
+            {
+                int oldest;
+                if (queue.try_pop(oldest)) ++evicted;
+            }
+        }
+    });
+    int consumed = 1, last = 0;
+    bool ordered = true;
+    while (last != count + 3)
+    {
+        if (!queue.try_pop(item)) continue;
+        ordered &= item > last;
+        last = item;
+        ++consumed;
+    }
+    producer.join();
+    REQUIRE(ordered);
+    REQUIRE(queue.empty());
+    REQUIRE(consumed + evicted == count + 4);
+}
+
+TEST_CASE("latency_histogram reports percentiles", "[offline] [sync]")
+{
+    rsimpl::latency_histogram histogram;
+    for (int i = 0; i < 90; ++i) histogram.record(std::chrono::microseconds(100));
+    for (int i = 0; i < 10; ++i) histogram.record(std::chrono::milliseconds(20));
+    REQUIRE(histogram.get_total() == 100);
+    REQUIRE(histogram.get_percentile(0.5) == 128);
+    REQUIRE(histogram.get_percentile(0.9) == 128);
+    REQUIRE(histogram.get_percentile(0.99) == 32768);
+}
+
+TEST_CASE("frame_buffer_pool hands out aligned buffers and counts exhaustion", "[offline] [archive]")
+{
+    auto pool = std::make_shared<rsimpl::frame_buffer_pool>(640 * 480 * 2 + 1, 3);
+    {
+        rsimpl::frame_buffer a(pool, 640 * 480 * 2), b(pool, 640 * 480 * 2), c(pool, 640 * 480 * 2);
+        REQUIRE(pool->owns(a.data()));
+        REQUIRE(pool->owns(c.data()));
+        REQUIRE(((uintptr_t)b.data() % 4096) == 0);
+        REQUIRE(a.data() != b.data());
+        REQUIRE(pool->get_stats().in_use == 3);
+
+        // The pool is empty, so the next buffer comes from the heap
+        rsimpl::frame_buffer d(pool, 640 * 480 * 2);
+        REQUIRE(d.data() != nullptr);
+        REQUIRE(!pool->owns(d.data()));
+        REQUIRE(pool->get_stats().exhausted == 1);
+
+        // Moving a buffer over another gives the overwritten one back
+        a = std::move(b);
+        REQUIRE(b.data() == nullptr);
+        REQUIRE(pool->get_stats().in_use == 2);
+    }
+    auto stats = pool->get_stats();
+    REQUIRE(stats.in_use == 0);
+    REQUIRE(stats.peak_in_use == 3);
+    REQUIRE(stats.acquired == 3);
+}
+
+TEST_CASE("small_heap allocates every slot once across threads", "[offline] [archive]")
+{
+    rsimpl::small_heap<int> heap(8);
+    std::vector<std::thread> threads;
+    std::atomic<bool> shared_slot(false);
+    for (int t = 1; t <= 4; ++t) threads.emplace_back([&heap, &shared_slot, t]()
+    {
+        for (int i = 0; i < 20000; ++i)
+        {
+            auto item = heap.allocate();
+            if (!item) continue;
+            // A slot handed to two threads at once would see the other thread's mark
+            if (*item != 0) shared_slot = true;
+            *item = t;
+            std::this_thread::yield();
+            if (*item != t) shared_slot = true;
+            heap.deallocate(item); // Resets the slot to 0
+        }
+    });
+    for (auto & thread : threads) thread.join();
+    REQUIRE(!shared_slot);
+    heap.stop_allocation();
+    heap.wait_until_empty();
+    REQUIRE(heap.allocate() == nullptr);
+}
+
+TEST_CASE("small_heap allocations never outlive wait_until_empty", "[offline] [archive]")
+{
+    for (int round = 0; round < 50; ++round)
+    {
+        rsimpl::small_heap<int> heap(4);
+        std::atomic<bool> emptied(false), late_allocation(false);
+        std::vector<std::thread> threads;
+        for (int t = 0; t < 4; ++t) threads.emplace_back([&heap, &emptied, &late_allocation]()
+        {
+            while (!emptied)
+            {
+                auto item = heap.allocate();
+                if (!item) continue;
+                // Holding an item means wait_until_empty must not have returned yet
+                if (emptied) late_allocation = true;
+                heap.deallocate(item);
+            }
+        });
+        std::this_thread::sleep_for(std::chrono::microseconds(200));
+        heap.stop_allocation();
+        heap.wait_until_empty();
+        emptied = true;
+        for (auto & thread : threads) thread.join();
+        REQUIRE(!late_allocation);
+    }
+}
+
+TEST_CASE("trace links the spans of each frame across threads", "[offline] [trace]")
+{
+    rsimpl::trace::start(4);
+    std::thread capture([]()
+    {
+        for (unsigned long long i = 1; i <= 10; ++i) rsimpl::trace::record_span("capture", RS_STREAM_DEPTH, i, i * 1000, i * 1000 + 100);
+    });
+    capture.join();
+    rsimpl::trace::record_span("publish", RS_STREAM_DEPTH, 10, 10200, 10300);
+    rsimpl::trace::record_span("idle", RS_STREAM_COUNT, 0, 10400, 10500);
+    {
+        rsimpl::trace::scope span("scoped \"span\"", RS_STREAM_COLOR, 3);
+    }
+    rsimpl::trace::stop();
+    rsimpl::trace::record_span("after stop", RS_STREAM_COUNT, 0, 0, 1);
+
+    std::ostringstream ss;
+    rsimpl::trace::write_chrome_trace(ss);
+    auto json = ss.str();
+    auto count = [&json](const std::string & s) { size_t n = 0; for (auto p = json.find(s); p != std::string::npos; p = json.find(s, p + 1)) ++n; return n; };
+
+    // Each thread keeps only its four most recent spans, and the oldest slot of a full ring is skipped as the thread may be
+    // overwriting it while the trace is written
+    REQUIRE(count("\"name\":\"capture\"") == 3);
+    REQUIRE(count("\"frame\":7}") == 0);
+    REQUIRE(count("\"frame\":8}") == 1);
+    REQUIRE(count("\"ts\":10.200,\"dur\":0.100") == 1);
+    REQUIRE(count("\"name\":\"scoped \\\"span\\\"\"") == 1);
+    REQUIRE(count("\"name\":\"after stop\"") == 0);
+
+    // Frame 10 of depth was captured on one thread and published on another, which links the two spans
+    REQUIRE(count("\"id\":\"0:10\"") == 2);
+    REQUIRE(count("\"ph\":\"s\"") == 1);
+    REQUIRE(count("\"ph\":\"f\"") == 1);
+}
+
+TEST_CASE("timestamp_corrector matches events to frames without waiting", "[offline] [timestamps]")
+{
+    rsimpl::timestamp_corrector corrector;
+    rsimpl::frame_archive::frame frame;
+    frame.additional_data.stream_type = RS_STREAM_DEPTH;
+    frame.additional_data.timestamp = 1.0;
+
+    // An event which arrived before its frame is applied directly
+    corrector.on_timestamp({123.0, RS_EVENT_IMU_DEPTH_CAM, 5});
+    corrector.on_timestamp({789.0, RS_EVENT_IMU_MOTION_CAM, 6});
+    frame.additional_data.frame_number = 5;
+    REQUIRE(corrector.correct_timestamp(frame, RS_STREAM_DEPTH));
+    REQUIRE(frame.get_frame_timestamp() == 123.0);
+    REQUIRE(frame.get_frame_timestamp_domain() == RS_TIMESTAMP_DOMAIN_MICROCONTROLLER);
+
+    // A frame whose event is late keeps its camera timestamp until the event arrives. Events of other sources do not count
+    frame.additional_data.frame_number = 6;
+    frame.additional_data.timestamp = 2.0;
+    frame.additional_data.timestamp_domain = RS_TIMESTAMP_DOMAIN_CAMERA;
+    REQUIRE(!corrector.correct_timestamp(frame, RS_STREAM_DEPTH));
+    frame.additional_data.pending_correction = &corrector;
+    REQUIRE(frame.get_frame_timestamp() == 2.0);
+    REQUIRE(frame.get_frame_timestamp_domain() == RS_TIMESTAMP_DOMAIN_CAMERA);
+    corrector.on_timestamp({456.0, RS_EVENT_IMU_DEPTH_CAM, 6});
+    REQUIRE(frame.get_frame_timestamp() == 456.0);
+    REQUIRE(frame.get_frame_timestamp_domain() == RS_TIMESTAMP_DOMAIN_MICROCONTROLLER);
+
+    // An event for a frame sharing the slot never matches
+    double timestamp;
+    corrector.on_timestamp({999.0, RS_EVENT_IMU_DEPTH_CAM, 6 + RS_MAX_EVENT_QUEUE_SIZE});
+    REQUIRE(!corrector.find_timestamp(RS_STREAM_DEPTH, 6, timestamp));
+    REQUIRE(corrector.find_timestamp(RS_STREAM_COLOR, 6 + RS_MAX_EVENT_QUEUE_SIZE, timestamp));
+    REQUIRE(timestamp == 999.0);
+}
+
+TEST_CASE("timestamp_event_ring never returns a torn event", "[offline] [timestamps]")
+{
+    rsimpl::timestamp_event_ring ring;
+    std::atomic<bool> done(false);
+    std::atomic<unsigned long long> latest(0);
+    std::thread writer([&]()
+    {
+        for (unsigned long long n = 1; n <= 200000; ++n)
+        {
+            ring.push({n * 10.0, RS_EVENT_IMU_DEPTH_CAM, n});
+            latest.store(n, std::memory_order_relaxed);
+        }
+        done = true;
+    });
+
+    bool torn = false;
+    unsigned long long found = 0;
+    bool writing;
+    do
+    {
+        writing = !done; // Always make one pass after the writer is done, in case it finished before the reader started
+        auto n = latest.load(std::memory_order_relaxed);
+        for (unsigned long long i = n; i > 0 && i + RS_MAX_EVENT_QUEUE_SIZE > n + 8; --i)
+        {
+            double timestamp;
+            if (ring.find(i, timestamp))
+            {
+                ++found;
+                if (timestamp != i * 10.0) torn = true;
+            }
+        }
+    } while (writing);
+    writer.join();
+    REQUIRE(!torn);
+    REQUIRE(found > 0);
+}
+
 #endif /* !defined(MAKEFILE) || ( defined(OFFLINE_TEST) ) */
@@ -43,6 +43,9 @@
 #include <opencv2/core/core.hpp>
 #include <opencv2/imgproc/imgproc.hpp>
 #include <opencv2/imgproc/types_c.h>
+#include <boost/make_shared.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/weak_ptr.hpp>
 #include <stdexcept>
 
 namespace cv_bridge {
@@ -53,6 +56,99 @@ public:
   Exception(const std::string& description) : std::runtime_error(description) {}
 };
 
+/**
+ * \brief Recycles messages, so that converting into them reuses their data.
+ *
+ * Messages from acquire() return to the pool when their last reference is dropped, including
+ * references held by subscribers in the same process, and keep their data vector. A publisher
+ * converting into them with CvImage::toImageMsg(ImagePool&) stops allocating once the pool has
+ * warmed up. The pool may be destroyed before the messages it handed out.
+ */
+template <class M>
+class MessagePool
+{
+public:
+  /**
+   * \param capacity Most idle messages kept, beyond which returned messages are freed.
+   */
+  explicit MessagePool(size_t capacity = 4)
+    : impl_(boost::make_shared<Impl>())
+  {
+    impl_->capacity = capacity;
+  }
+
+  /**
+   * \brief A message, recycled if one is idle. Its fields hold whatever they held last.
+   */
+  boost::shared_ptr<M> acquire()
+  {
+    M* msg = NULL;
+    {
+      boost::mutex::scoped_lock lock(impl_->mutex);
+      if (!impl_->idle.empty())
+      {
+        msg = impl_->idle.back();
+        impl_->idle.pop_back();
+      }
+    }
+    if (!msg)
+      msg = new M();
+
+    Recycle recycle;
+    recycle.pool = impl_;
+    return boost::shared_ptr<M>(msg, recycle);
+  }
+
+  /**
+   * \brief Number of idle messages.
+   */
+  size_t idle() const
+  {
+    boost::mutex::scoped_lock lock(impl_->mutex);
+    return impl_->idle.size();
+  }
+
+private:
+  struct Impl
+  {
+    boost::mutex mutex;
+    std::vector<M*> idle;
+    size_t capacity;
+
+    ~Impl()
+    {
+      for (size_t i = 0; i < idle.size(); ++i)
+        delete idle[i];
+    }
+  };
+
+  // Deleter of the messages handed out, returning them to the pool unless it is full or gone
+  struct Recycle
+  {
+    boost::weak_ptr<Impl> pool;
+
+    void operator()(M* msg) const
+    {
+      boost::shared_ptr<Impl> impl = pool.lock();
+      if (impl)
+      {
+        boost::mutex::scoped_lock lock(impl->mutex);
+        if (impl->idle.size() < impl->capacity)
+        {
+          impl->idle.push_back(msg);
+          return;
+        }
+      }
+      delete msg;
+    }
+  };
+
+  boost::shared_ptr<Impl> impl_;
+};
+
+typedef MessagePool<sensor_msgs::Image> ImagePool;
+typedef MessagePool<sensor_msgs::CompressedImage> CompressedImagePool;
+
 class CvImage;
 
 typedef boost::shared_ptr<CvImage> CvImagePtr;
@@ -67,8 +163,36 @@ typedef enum {
 	PBM, PGM, PPM,
 	SR, RAS,
 	TIFF, TIF,
+	RVL, //!< Lossless 16 bit depth, see CompressionOptions
 } Format;
 
+/**
+ * \brief Settings for CvImage::toCompressedImageMsg(). The defaults are those of cv::imencode.
+ *
+ * For low latency JPEG leave optimize and progressive off, as both take a second pass over the
+ * image, and trade quality for speed. PNG level 1 compresses several times faster than the
+ * default of 3 for a slightly bigger image.
+ *
+ * RVL compresses 16 bit single channel images, typically depth in millimetres, losslessly:
+ * runs of zeros are counted and valid pixels stored as the zigzagged difference to the previous
+ * one in 3 bit groups, which encodes a VGA frame in about a millisecond. Its data is the width
+ * and height as 32 bit words followed by the code words, all little endian.
+ */
+struct CompressionOptions
+{
+  CompressionOptions(Format format = JPG)
+    : format(format), jpeg_quality(95), jpeg_optimize(false), jpeg_progressive(false),
+      png_level(-1)
+  {
+  }
+
+  Format format;
+  int jpeg_quality;      //!< 0 to 100
+  bool jpeg_optimize;    //!< Optimize the Huffman tables, a little smaller and slower
+  bool jpeg_progressive;
+  int png_level;         //!< zlib level from 0 to 9, negative for OpenCV's default
+};
+
 /**
  * \brief Image message class that is interoperable with sensor_msgs/Image but uses a
  * more convenient cv::Mat representation for the image data.
@@ -87,6 +211,9 @@ public:
 
   /**
    * \brief Constructor.
+   *
+   * \a image is shared, not copied. Publishing the resulting CvImage serializes straight from
+   * that data, so it is a view of an existing cv::Mat with no sensor_msgs::Image in between.
    */
   CvImage(const std_msgs::Header& header, const std::string& encoding,
           const cv::Mat& image = cv::Mat())
@@ -101,6 +228,14 @@ public:
    */
   sensor_msgs::ImagePtr toImageMsg() const;
 
+  /**
+   * \brief Convert this message to a ROS sensor_msgs::Image message from \a pool.
+   *
+   * The image data is copied into the recycled message's buffer, which is only reallocated
+   * when the image grows.
+   */
+  sensor_msgs::ImagePtr toImageMsg(ImagePool& pool) const;
+
   /**
    * dst_format is compress the image to desire format.
    * Default value is empty string that will convert to jpg format.
@@ -114,7 +249,8 @@ public:
    * \brief Copy the message data to a ROS sensor_msgs::Image message.
    *
    * This overload is intended mainly for aggregate messages such as stereo_msgs::DisparityImage,
-   * which contains a sensor_msgs::Image as a data member.
+   * which contains a sensor_msgs::Image as a data member. The data vector of \a ros_image is
+   * only reallocated when the image grows.
    */
   void toImageMsg(sensor_msgs::Image& ros_image) const;
 
@@ -127,6 +263,17 @@ public:
    */
   void toCompressedImageMsg(sensor_msgs::CompressedImage& ros_image, const Format dst_format = JPG) const;
 
+  /**
+   * \brief Compress the image into \a ros_image as set by \a options.
+   *
+   * bgr8 and single channel 8 bit images are compressed as they are, as are single channel 16
+   * bit images for PNG, TIFF and JPEG 2000, others are converted to bgr8 first, unless the
+   * format is RVL. The data vector of \a ros_image is only reallocated when the
+   * compressed image grows.
+   */
+  void toCompressedImageMsg(sensor_msgs::CompressedImage& ros_image,
+                            const CompressionOptions& options) const;
+
 
   typedef boost::shared_ptr<CvImage> Ptr;
   typedef boost::shared_ptr<CvImage const> ConstPtr;
@@ -143,6 +290,8 @@ protected:
 };
 
 
+
+
 /**
  * \brief Convert a sensor_msgs::Image message to an OpenCV-compatible CvImage, copying the
  * image data.
@@ -187,9 +336,26 @@ CvImagePtr toCvCopy(const sensor_msgs::CompressedImageConstPtr& source,
 CvImagePtr toCvCopy(const sensor_msgs::Image& source,
                     const std::string& encoding = std::string());
 
+/**
+ * \brief Decompress a sensor_msgs::CompressedImage message to a CvImage.
+ *
+ * The source encoding is taken to be mono8, bgr8 or bgra8 after the number of channels decoded,
+ * or 16UC1 for RVL.
+ */
 CvImagePtr toCvCopy(const sensor_msgs::CompressedImage& source,
                     const std::string& encoding = std::string());
 
+/**
+ * \brief Convert a sensor_msgs::Image message into an existing CvImage, copying the image data.
+ *
+ * As toCvCopy(), but the image buffer of \a destination is reused when it already has the size
+ * and type of the result, so converting a stream of same-sized images doesn't allocate. Its data
+ * is overwritten in place, so it must not be shared with anything still reading it.
+ */
+void toCvCopy(const sensor_msgs::Image& source,
+              CvImage& destination,
+              const std::string& encoding = std::string());
+
 /**
  * \brief Convert an immutable sensor_msgs::Image message to an OpenCV-compatible CvImage, sharing
  * the image data if possible.
@@ -313,7 +479,8 @@ int getCvType(const std::string& encoding);
 // a first-class message type you can publish and subscribe to directly.
 // Unfortunately this doesn't yet work with image_transport, so don't rewrite all
 // your callbacks to use CvImage! It might be useful for specific tasks, like
-// processing bag files.
+// processing bag files, or publishing a cv::Mat without copying it into a
+// sensor_msgs::Image first.
 
 /// @cond DOXYGEN_IGNORE
 namespace ros {
@@ -364,11 +531,21 @@ template<> struct Serializer<cv_bridge::CvImage>
     stream.next(m.encoding);
     uint8_t is_bigendian = 0;
     stream.next(is_bigendian);
-    stream.next((uint32_t)m.image.step);
-    size_t data_size = m.image.step*m.image.rows;
+    // Rows are written packed, so any view into a larger cv::Mat can be published
+    size_t row_size = m.image.cols*m.image.elemSize();
+    stream.next((uint32_t)row_size); // step
+    size_t data_size = row_size*m.image.rows;
     stream.next((uint32_t)data_size);
     if (data_size > 0)
-      memcpy(stream.advance(data_size), m.image.data, data_size);
+    {
+      if (m.image.isContinuous())
+        memcpy(stream.advance(data_size), m.image.data, data_size);
+      else
+      {
+        for (int i = 0; i < m.image.rows; ++i)
+          memcpy(stream.advance(row_size), m.image.ptr(i), row_size);
+      }
+    }
   }
 
   template<typename Stream>
@@ -392,7 +569,7 @@ template<> struct Serializer<cv_bridge::CvImage>
 
   inline static uint32_t serializedLength(const cv_bridge::CvImage& m)
   {
-    size_t data_size = m.image.step*m.image.rows;
+    size_t data_size = m.image.cols*m.image.elemSize()*m.image.rows;
     return serializationLength(m.header) + serializationLength(m.encoding) + 17 + data_size;
   }
 };
@@ -0,0 +1,139 @@
+/*********************************************************************
+* Software License Agreement (BSD License)
+*
+*  Copyright (c) 2011, Willow Garage, Inc,
+*  All rights reserved.
+*
+*  Redistribution and use in source and binary forms, with or without
+*  modification, are permitted provided that the following conditions
+*  are met:
+*
+*   * Redistributions of source code must retain the above copyright
+*     notice, this list of conditions and the following disclaimer.
+*   * Redistributions in binary form must reproduce the above
+*     copyright notice, this list of conditions and the following
+*     disclaimer in the documentation and/or other materials provided
+*     with the distribution.
+*   * Neither the name of the Willow Garage nor the names of its
+*     contributors may be used to endorse or promote products derived
+*     from this software without specific prior written permission.
+*
+*  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+*  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+*  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+*  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+*  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+*  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+*  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+*  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+*  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+*  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+*  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+*  POSSIBILITY OF SUCH DAMAGE.
+*********************************************************************/
+
+#ifndef CV_BRIDGE_IMAGE_ENCODER_H
+#define CV_BRIDGE_IMAGE_ENCODER_H
+
+#include <cv_bridge/cv_bridge.h>
+#include <boost/function.hpp>
+#include <boost/noncopyable.hpp>
+
+namespace cv_bridge {
+
+/**
+ * \brief Compresses images on worker threads, keeping the caller's thread free.
+ *
+ * Images are compressed with CvImage::toCompressedImageMsg() into messages from a
+ * CompressedImagePool, so the output buffers are reused once each worker has produced a few, and
+ * handed to the callback in the order they were queued. When every worker is busy and the queue
+ * is full, the oldest queued image is dropped, so a slow encoder adds latency of at most the queue
+ * length rather than falling further behind. With DROP_NEWEST the new image is refused instead,
+ * which suits callers that must know whether an image will be delivered.
+ */
+class ImageEncoder : boost::noncopyable
+{
+public:
+  /**
+   * \brief Receives each compressed image. Called from the worker threads, one call at a time.
+   * It must not throw, nor destroy the encoder.
+   */
+  typedef boost::function<void (const sensor_msgs::CompressedImageConstPtr&)> Callback;
+
+  /**
+   * \brief Which image to drop when the queue is full.
+   */
+  enum DropPolicy
+  {
+    DROP_OLDEST,  //!< The image that has waited longest
+    DROP_NEWEST   //!< The image being queued, encode() returns false
+  };
+
+  /**
+   * \brief Totals since construction or the last resetStatistics().
+   */
+  struct Statistics
+  {
+    Statistics();
+
+    uint64_t encoded;          //!< Images compressed
+    uint64_t dropped;          //!< Images dropped from a full queue
+    uint64_t failed;           //!< Images that could not be compressed
+    double encode_time;        //!< Total seconds spent compressing
+    double max_encode_time;    //!< Longest compression, in seconds
+    uint64_t raw_bytes;        //!< Size of the images compressed
+    uint64_t compressed_bytes; //!< Size of their compressed data
+    size_t queue_depth;        //!< Images waiting for a worker when the statistics were taken
+    size_t max_queue_depth;    //!< Most images waiting for a worker at once
+
+    double meanEncodeTime() const { return encoded ? encode_time / encoded : 0.0; }
+    double compressionRatio() const { return compressed_bytes ? (double)raw_bytes / compressed_bytes : 0.0; }
+  };
+
+  /**
+   * \param options    How to compress, see CompressionOptions.
+   * \param callback   Receives the compressed images, unless encode() is given its own callback.
+   * \param threads    Number of worker threads.
+   * \param queue_size Most images waiting for a worker.
+   * \param drop       Which image to drop when the queue is full.
+   */
+  ImageEncoder(const CompressionOptions& options, const Callback& callback,
+               int threads = 2, size_t queue_size = 2, DropPolicy drop = DROP_OLDEST);
+
+  /**
+   * \brief Compresses the images still queued, then stops the workers.
+   */
+  ~ImageEncoder();
+
+  /**
+   * \brief Queue \a image for compression. It is shared with the workers, so it must not be
+   * modified afterwards.
+   *
+   * \param callback Receives this image once compressed, instead of the encoder's callback. It is
+   * not called if the image is dropped or can't be compressed.
+   * \return false if the image was dropped right away, with DROP_NEWEST.
+   */
+  bool encode(const CvImageConstPtr& image, const Callback& callback = Callback());
+
+  /**
+   * \brief Wait until every image queued so far has been compressed and delivered.
+   */
+  void flush();
+
+  /**
+   * \brief Change the settings, which applies to images not yet taken by a worker.
+   */
+  void setOptions(const CompressionOptions& options);
+
+  Statistics statistics() const;
+
+  void resetStatistics();
+
+private:
+  struct Impl;
+  boost::shared_ptr<Impl> impl_;
+};
+
+} // namespace cv_bridge
+
+#endif
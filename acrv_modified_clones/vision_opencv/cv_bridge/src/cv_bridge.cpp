@@ -35,8 +35,6 @@
 
 #include "boost/endian/conversion.hpp"
 
-#include <map>
-
 #include <boost/make_shared.hpp>
 #include <boost/regex.hpp>
 
@@ -44,6 +42,8 @@
 
 #include <opencv2/highgui/highgui.hpp>
 
+#include <algorithm>
+
 #include <sensor_msgs/image_encodings.h>
 
 #include <cv_bridge/cv_bridge.h>
@@ -98,15 +98,15 @@ int getCvType(const std::string& encoding)
   if (encoding == enc::YUV422) return CV_8UC2;
 
   // Check all the generic content encodings
+  static const boost::regex generic_type("(8U|8S|16U|16S|32S|32F|64F)C([0-9]+)");
+  static const boost::regex generic_depth("(8U|8S|16U|16S|32S|32F|64F)");
   boost::cmatch m;
 
-  if (boost::regex_match(encoding.c_str(), m,
-        boost::regex("(8U|8S|16U|16S|32S|32F|64F)C([0-9]+)"))) {
+  if (boost::regex_match(encoding.c_str(), m, generic_type)) {
     return CV_MAKETYPE(depthStrToInt(m[1].str()), atoi(m[2].str().c_str()));
   }
 
-  if (boost::regex_match(encoding.c_str(), m,
-        boost::regex("(8U|8S|16U|16S|32S|32F|64F)"))) {
+  if (boost::regex_match(encoding.c_str(), m, generic_depth)) {
     return CV_MAKETYPE(depthStrToInt(m[1].str()), 1);
   }
 
@@ -137,67 +137,91 @@ Encoding getEncoding(const std::string& encoding)
 
 static const int SAME_FORMAT = -1;
 
-/** Return a lit of OpenCV conversion codes to get from one Format to the other
- * The key is a pair: <FromFormat, ToFormat> and the value a succession of OpenCV code conversion
- * It's not efficient code but it is only called once and the structure is small enough
- */
-std::map<std::pair<Encoding, Encoding>, std::vector<int> > getConversionCodes() {
-  std::map<std::pair<Encoding, Encoding>, std::vector<int> > res;
-  for(int i=0; i<=5; ++i)
-    res[std::pair<Encoding, Encoding>(Encoding(i),Encoding(i))].push_back(SAME_FORMAT);
-
-  res[std::make_pair(GRAY, RGB)].push_back(cv::COLOR_GRAY2RGB);
-  res[std::make_pair(GRAY, BGR)].push_back(cv::COLOR_GRAY2BGR);
-  res[std::make_pair(GRAY, RGBA)].push_back(cv::COLOR_GRAY2RGBA);
-  res[std::make_pair(GRAY, BGRA)].push_back(cv::COLOR_GRAY2BGRA);
-
-  res[std::make_pair(RGB, GRAY)].push_back(cv::COLOR_RGB2GRAY);
-  res[std::make_pair(RGB, BGR)].push_back(cv::COLOR_RGB2BGR);
-  res[std::make_pair(RGB, RGBA)].push_back(cv::COLOR_RGB2RGBA);
-  res[std::make_pair(RGB, BGRA)].push_back(cv::COLOR_RGB2BGRA);
-
-  res[std::make_pair(BGR, GRAY)].push_back(cv::COLOR_BGR2GRAY);
-  res[std::make_pair(BGR, RGB)].push_back(cv::COLOR_BGR2RGB);
-  res[std::make_pair(BGR, RGBA)].push_back(cv::COLOR_BGR2RGBA);
-  res[std::make_pair(BGR, BGRA)].push_back(cv::COLOR_BGR2BGRA);
-
-  res[std::make_pair(RGBA, GRAY)].push_back(cv::COLOR_RGBA2GRAY);
-  res[std::make_pair(RGBA, RGB)].push_back(cv::COLOR_RGBA2RGB);
-  res[std::make_pair(RGBA, BGR)].push_back(cv::COLOR_RGBA2BGR);
-  res[std::make_pair(RGBA, BGRA)].push_back(cv::COLOR_RGBA2BGRA);
-
-  res[std::make_pair(BGRA, GRAY)].push_back(cv::COLOR_BGRA2GRAY);
-  res[std::make_pair(BGRA, RGB)].push_back(cv::COLOR_BGRA2RGB);
-  res[std::make_pair(BGRA, BGR)].push_back(cv::COLOR_BGRA2BGR);
-  res[std::make_pair(BGRA, RGBA)].push_back(cv::COLOR_BGRA2RGBA);
-
-  res[std::make_pair(YUV422, GRAY)].push_back(cv::COLOR_YUV2GRAY_UYVY);
-  res[std::make_pair(YUV422, RGB)].push_back(cv::COLOR_YUV2RGB_UYVY);
-  res[std::make_pair(YUV422, BGR)].push_back(cv::COLOR_YUV2BGR_UYVY);
-  res[std::make_pair(YUV422, RGBA)].push_back(cv::COLOR_YUV2RGBA_UYVY);
-  res[std::make_pair(YUV422, BGRA)].push_back(cv::COLOR_YUV2BGRA_UYVY);
-
-  // Deal with Bayer
-  res[std::make_pair(BAYER_RGGB, GRAY)].push_back(cv::COLOR_BayerBG2GRAY);
-  res[std::make_pair(BAYER_RGGB, RGB)].push_back(cv::COLOR_BayerBG2RGB);
-  res[std::make_pair(BAYER_RGGB, BGR)].push_back(cv::COLOR_BayerBG2BGR);
-
-  res[std::make_pair(BAYER_BGGR, GRAY)].push_back(cv::COLOR_BayerRG2GRAY);
-  res[std::make_pair(BAYER_BGGR, RGB)].push_back(cv::COLOR_BayerRG2RGB);
-  res[std::make_pair(BAYER_BGGR, BGR)].push_back(cv::COLOR_BayerRG2BGR);
-
-  res[std::make_pair(BAYER_GBRG, GRAY)].push_back(cv::COLOR_BayerGR2GRAY);
-  res[std::make_pair(BAYER_GBRG, RGB)].push_back(cv::COLOR_BayerGR2RGB);
-  res[std::make_pair(BAYER_GBRG, BGR)].push_back(cv::COLOR_BayerGR2BGR);
-
-  res[std::make_pair(BAYER_GRBG, GRAY)].push_back(cv::COLOR_BayerGB2GRAY);
-  res[std::make_pair(BAYER_GRBG, RGB)].push_back(cv::COLOR_BayerGB2RGB);
-  res[std::make_pair(BAYER_GRBG, BGR)].push_back(cv::COLOR_BayerGB2BGR);
+static const int NO_CONVERSION = -2;
 
-  return res;
+#define CONVERSION(from, to) ((from) << 4 | (to))
+
+/** Return the OpenCV conversion code to get from one color Encoding to the other, SAME_FORMAT
+ * if they only differ in depth, or NO_CONVERSION. A switch over both encodings, so the table is
+ * resolved at compile time rather than looked up at run time
+ */
+static int getColorConversionCode(Encoding src, Encoding dst)
+{
+  if (src == INVALID || dst == INVALID)
+    return NO_CONVERSION;
+
+  switch (CONVERSION(src, dst)) {
+    case CONVERSION(GRAY, GRAY):
+    case CONVERSION(RGB, RGB):
+    case CONVERSION(BGR, BGR):
+    case CONVERSION(RGBA, RGBA):
+    case CONVERSION(BGRA, BGRA):
+    case CONVERSION(YUV422, YUV422): return SAME_FORMAT;
+
+    case CONVERSION(GRAY, RGB):  return cv::COLOR_GRAY2RGB;
+    case CONVERSION(GRAY, BGR):  return cv::COLOR_GRAY2BGR;
+    case CONVERSION(GRAY, RGBA): return cv::COLOR_GRAY2RGBA;
+    case CONVERSION(GRAY, BGRA): return cv::COLOR_GRAY2BGRA;
+
+    case CONVERSION(RGB, GRAY):  return cv::COLOR_RGB2GRAY;
+    case CONVERSION(RGB, BGR):   return cv::COLOR_RGB2BGR;
+    case CONVERSION(RGB, RGBA):  return cv::COLOR_RGB2RGBA;
+    case CONVERSION(RGB, BGRA):  return cv::COLOR_RGB2BGRA;
+
+    case CONVERSION(BGR, GRAY):  return cv::COLOR_BGR2GRAY;
+    case CONVERSION(BGR, RGB):   return cv::COLOR_BGR2RGB;
+    case CONVERSION(BGR, RGBA):  return cv::COLOR_BGR2RGBA;
+    case CONVERSION(BGR, BGRA):  return cv::COLOR_BGR2BGRA;
+
+    case CONVERSION(RGBA, GRAY): return cv::COLOR_RGBA2GRAY;
+    case CONVERSION(RGBA, RGB):  return cv::COLOR_RGBA2RGB;
+    case CONVERSION(RGBA, BGR):  return cv::COLOR_RGBA2BGR;
+    case CONVERSION(RGBA, BGRA): return cv::COLOR_RGBA2BGRA;
+
+    case CONVERSION(BGRA, GRAY): return cv::COLOR_BGRA2GRAY;
+    case CONVERSION(BGRA, RGB):  return cv::COLOR_BGRA2RGB;
+    case CONVERSION(BGRA, BGR):  return cv::COLOR_BGRA2BGR;
+    case CONVERSION(BGRA, RGBA): return cv::COLOR_BGRA2RGBA;
+
+    case CONVERSION(YUV422, GRAY): return cv::COLOR_YUV2GRAY_UYVY;
+    case CONVERSION(YUV422, RGB):  return cv::COLOR_YUV2RGB_UYVY;
+    case CONVERSION(YUV422, BGR):  return cv::COLOR_YUV2BGR_UYVY;
+    case CONVERSION(YUV422, RGBA): return cv::COLOR_YUV2RGBA_UYVY;
+    case CONVERSION(YUV422, BGRA): return cv::COLOR_YUV2BGRA_UYVY;
+
+    // Deal with Bayer
+    case CONVERSION(BAYER_RGGB, GRAY): return cv::COLOR_BayerBG2GRAY;
+    case CONVERSION(BAYER_RGGB, RGB):  return cv::COLOR_BayerBG2RGB;
+    case CONVERSION(BAYER_RGGB, BGR):  return cv::COLOR_BayerBG2BGR;
+
+    case CONVERSION(BAYER_BGGR, GRAY): return cv::COLOR_BayerRG2GRAY;
+    case CONVERSION(BAYER_BGGR, RGB):  return cv::COLOR_BayerRG2RGB;
+    case CONVERSION(BAYER_BGGR, BGR):  return cv::COLOR_BayerRG2BGR;
+
+    case CONVERSION(BAYER_GBRG, GRAY): return cv::COLOR_BayerGR2GRAY;
+    case CONVERSION(BAYER_GBRG, RGB):  return cv::COLOR_BayerGR2RGB;
+    case CONVERSION(BAYER_GBRG, BGR):  return cv::COLOR_BayerGR2BGR;
+
+    case CONVERSION(BAYER_GRBG, GRAY): return cv::COLOR_BayerGB2GRAY;
+    case CONVERSION(BAYER_GRBG, RGB):  return cv::COLOR_BayerGB2RGB;
+    case CONVERSION(BAYER_GRBG, BGR):  return cv::COLOR_BayerGB2BGR;
+  }
+  return NO_CONVERSION;
 }
 
-const std::vector<int> getConversionCode(std::string src_encoding, std::string dst_encoding)
+#undef CONVERSION
+
+// The OpenCV conversion codes to apply in order, at most a color conversion and a change of depth
+struct ConversionCodes
+{
+  int codes[2];
+  int size;
+
+  explicit ConversionCodes(int code) : size(1) { codes[0] = code; }
+  void push_back(int code) { codes[size++] = code; }
+};
+
+ConversionCodes getConversionCode(const std::string& src_encoding, const std::string& dst_encoding)
 {
   Encoding src_encod = getEncoding(src_encoding);
   Encoding dst_encod = getEncoding(dst_encoding);
@@ -215,7 +239,7 @@ const std::vector<int> getConversionCode(std::string src_encoding, std::string d
                       "] is. The conversion does not make sense");
     if (!is_num_channels_the_same)
       throw Exception("[" + src_encoding + "] and [" + dst_encoding + "] do not have the same number of channel");
-    return std::vector<int>(1, SAME_FORMAT);
+    return ConversionCodes(SAME_FORMAT);
   }
 
   // If we are converting from a color type to a non color type, we can only do so if we stick
@@ -224,21 +248,18 @@ const std::vector<int> getConversionCode(std::string src_encoding, std::string d
     if (!is_num_channels_the_same)
       throw Exception("[" + src_encoding + "] is a color format but [" + dst_encoding + "] " +
                       "is not so they must have the same OpenCV type, CV_8UC3, CV16UC1 ....");
-    return std::vector<int>(1, SAME_FORMAT);
+    return ConversionCodes(SAME_FORMAT);
   }
 
   // If we are converting from a color type to another type, then everything is fine
-  static const std::map<std::pair<Encoding, Encoding>, std::vector<int> > CONVERSION_CODES = getConversionCodes();
-
-  std::pair<Encoding, Encoding> key(src_encod, dst_encod);
-  std::map<std::pair<Encoding, Encoding>, std::vector<int> >::const_iterator val = CONVERSION_CODES.find(key);
-  if (val == CONVERSION_CODES.end())
+  int code = getColorConversionCode(src_encod, dst_encod);
+  if (code == NO_CONVERSION)
     throw Exception("Unsupported conversion from [" + src_encoding +
                       "] to [" + dst_encoding + "]");
 
   // And deal with depth differences if the colors are different
-  std::vector<int> res = val->second;
-  if ((enc::bitDepth(src_encoding) != enc::bitDepth(dst_encoding)) && (getEncoding(src_encoding) != getEncoding(dst_encoding)))
+  ConversionCodes res(code);
+  if ((enc::bitDepth(src_encoding) != enc::bitDepth(dst_encoding)) && (src_encod != dst_encod))
     res.push_back(SAME_FORMAT);
 
   return res;
@@ -297,30 +318,32 @@ cv::Mat matFromImage(const sensor_msgs::Image& source)
   return mat_swap;
 }
 
-// Internal, used by toCvCopy and cvtColor
-CvImagePtr toCvCopyImpl(const cv::Mat& source,
-                        const std_msgs::Header& src_header,
-                        const std::string& src_encoding,
-                        const std::string& dst_encoding)
+// Internal, used by toCvCopy and cvtColor. Writes into destination, whose image buffer is
+// reused if it has the size and type of the result
+void toCvCopyImpl(const cv::Mat& source,
+                  const std_msgs::Header& src_header,
+                  const std::string& src_encoding,
+                  const std::string& dst_encoding,
+                  CvImage& destination)
 {
   // Copy metadata
-  CvImagePtr ptr = boost::make_shared<CvImage>();
-  ptr->header = src_header;
+  destination.header = src_header;
   
   // Copy to new buffer if same encoding requested
   if (dst_encoding.empty() || dst_encoding == src_encoding)
   {
-    ptr->encoding = src_encoding;
-    source.copyTo(ptr->image);
+    destination.encoding = src_encoding;
+    source.copyTo(destination.image);
   }
   else
   {
-    // Convert the source data to the desired encoding
-    const std::vector<int> conversion_codes = getConversionCode(src_encoding, dst_encoding);
+    // Convert the source data to the desired encoding, the last step straight into destination
+    const ConversionCodes conversion_codes = getConversionCode(src_encoding, dst_encoding);
     cv::Mat image1 = source;
-    cv::Mat image2;
-    for(size_t i=0; i<conversion_codes.size(); ++i) {
-      int conversion_code = conversion_codes[i];
+    cv::Mat temporary;
+    for(int i=0; i<conversion_codes.size; ++i) {
+      int conversion_code = conversion_codes.codes[i];
+      cv::Mat& image2 = (i + 1 == conversion_codes.size) ? destination.image : temporary;
       if (conversion_code == SAME_FORMAT)
       {
         // Same number of channels, but different bit depth
@@ -344,10 +367,17 @@ CvImagePtr toCvCopyImpl(const cv::Mat& source,
       }
       image1 = image2;
     }
-    ptr->image = image2;
-    ptr->encoding = dst_encoding;
+    destination.encoding = dst_encoding;
   }
+}
 
+CvImagePtr toCvCopyImpl(const cv::Mat& source,
+                        const std_msgs::Header& src_header,
+                        const std::string& src_encoding,
+                        const std::string& dst_encoding)
+{
+  CvImagePtr ptr = boost::make_shared<CvImage>();
+  toCvCopyImpl(source, src_header, src_encoding, dst_encoding, *ptr);
   return ptr;
 }
 
@@ -360,6 +390,13 @@ sensor_msgs::ImagePtr CvImage::toImageMsg() const
   return ptr;
 }
 
+sensor_msgs::ImagePtr CvImage::toImageMsg(ImagePool& pool) const
+{
+  sensor_msgs::ImagePtr ptr = pool.acquire();
+  toImageMsg(*ptr);
+  return ptr;
+}
+
 void CvImage::toImageMsg(sensor_msgs::Image& ros_image) const
 {
   ros_image.header = header;
@@ -403,6 +440,13 @@ CvImagePtr toCvCopy(const sensor_msgs::Image& source,
   return toCvCopyImpl(matFromImage(source), source.header, source.encoding, encoding);
 }
 
+void toCvCopy(const sensor_msgs::Image& source,
+              CvImage& destination,
+              const std::string& encoding)
+{
+  toCvCopyImpl(matFromImage(source), source.header, source.encoding, encoding, destination);
+}
+
 // Share const data, returnee is immutable
 CvImageConstPtr toCvShare(const sensor_msgs::ImageConstPtr& source,
                           const std::string& encoding)
@@ -435,8 +479,177 @@ CvImagePtr cvtColor(const CvImageConstPtr& source,
 
 /////////////////////////////////////// CompressedImage ///////////////////////////////////////////
 
+namespace {
+
+// RVL, from A. Wilson, "Fast Lossless Depth Image Compression", 2017. Values are written in
+// groups of 3 bits, least significant first, each in a nibble whose top bit flags that more
+// follow. Nibbles fill 32 bit words from the top.
+class RvlWriter
+{
+public:
+  explicit RvlWriter(uint8_t* out) : out_(out), word_(0), nibbles_(0) {}
+
+  void put(uint32_t value)
+  {
+    do
+    {
+      uint32_t nibble = value & 0x7;
+      value >>= 3;
+      if (value)
+        nibble |= 0x8;
+      word_ = (word_ << 4) | nibble;
+      if (++nibbles_ == 8)
+        flush();
+    } while (value);
+  }
+
+  // Pads and writes the last word, returning the end of the output
+  uint8_t* finish()
+  {
+    if (nibbles_)
+    {
+      word_ <<= 4 * (8 - nibbles_);
+      flush();
+    }
+    return out_;
+  }
+
+private:
+  void flush()
+  {
+    uint32_t word = boost::endian::native_to_little(word_);
+    memcpy(out_, &word, sizeof(word));
+    out_ += sizeof(word);
+    word_ = 0;
+    nibbles_ = 0;
+  }
+
+  uint8_t* out_;
+  uint32_t word_;
+  int nibbles_;
+};
+
+class RvlReader
+{
+public:
+  RvlReader(const uint8_t* begin, const uint8_t* end) : in_(begin), end_(end), word_(0), nibbles_(0) {}
+
+  uint32_t get()
+  {
+    uint32_t value = 0;
+    uint32_t nibble;
+    int shift = 0;
+    do
+    {
+      if (!nibbles_)
+      {
+        if (end_ - in_ < (ptrdiff_t)sizeof(word_))
+          throw Exception("Truncated RVL data");
+        memcpy(&word_, in_, sizeof(word_));
+        boost::endian::little_to_native_inplace(word_);
+        in_ += sizeof(word_);
+        nibbles_ = 8;
+      }
+      if (shift >= 32)
+        throw Exception("Corrupt RVL data");
+      nibble = word_ >> 28;
+      word_ <<= 4;
+      --nibbles_;
+      value |= (nibble & 0x7) << shift;
+      shift += 3;
+    } while (nibble & 0x8);
+    return value;
+  }
+
+private:
+  const uint8_t* in_;
+  const uint8_t* end_;
+  uint32_t word_;
+  int nibbles_;
+};
+
+void compressRvl(const cv::Mat& depth, std::vector<uint8_t>& data)
+{
+  const cv::Mat continuous = depth.isContinuous() ? depth : depth.clone();
+  const size_t pixels = continuous.total();
+
+  // Size words, then at worst 4 bytes a pixel: a lone valid pixel costs a nibble for each run
+  // length and up to 6 for its difference
+  data.resize(8 + 4 * pixels + 4);
+  uint32_t size[2] = {boost::endian::native_to_little((uint32_t)continuous.cols),
+                      boost::endian::native_to_little((uint32_t)continuous.rows)};
+  memcpy(&data[0], size, sizeof(size));
+  RvlWriter writer(&data[8]);
+
+  const uint16_t* p = continuous.ptr<uint16_t>();
+  const uint16_t* end = p + pixels;
+  uint16_t previous = 0;
+  while (p != end)
+  {
+    const uint16_t* run = p;
+    while (p != end && !*p)
+      ++p;
+    writer.put(p - run);
+
+    run = p;
+    while (p != end && *p)
+      ++p;
+    writer.put(p - run);
+
+    for (; run != p; ++run)
+    {
+      int32_t delta = (int32_t)*run - previous;
+      writer.put(((uint32_t)delta << 1) ^ (uint32_t)(delta >> 31));
+      previous = *run;
+    }
+  }
+  data.resize(writer.finish() - &data[0]);
+}
+
+cv::Mat decompressRvl(const std::vector<uint8_t>& data)
+{
+  if (data.size() < 8)
+    throw Exception("Truncated RVL data");
+  uint32_t size[2];
+  memcpy(size, &data[0], sizeof(size));
+  cv::Mat depth(boost::endian::little_to_native(size[1]), boost::endian::little_to_native(size[0]),
+                CV_16UC1);
+  RvlReader reader(&data[0] + 8, &data[0] + data.size());
+
+  uint16_t* p = depth.ptr<uint16_t>();
+  size_t left = depth.total();
+  uint16_t previous = 0;
+  while (left)
+  {
+    uint32_t zeros = reader.get();
+    if (zeros > left)
+      throw Exception("Corrupt RVL data");
+    std::fill(p, p + zeros, 0);
+    p += zeros;
+    left -= zeros;
+
+    uint32_t valid = reader.get();
+    if (valid > left)
+      throw Exception("Corrupt RVL data");
+    left -= valid;
+    for (; valid; --valid)
+    {
+      uint32_t positive = reader.get();
+      int32_t delta = (int32_t)(positive >> 1) ^ -(int32_t)(positive & 1);
+      previous = (uint16_t)(previous + delta);
+      *p++ = previous;
+    }
+  }
+  return depth;
+}
+
+} // namespace
+
 cv::Mat matFromImage(const sensor_msgs::CompressedImage& source)
 {
+    if (source.format == "rvl")
+      return decompressRvl(source.data);
+
     cv::Mat jpegData(1,source.data.size(),CV_8UC1);
     jpegData.data     = const_cast<uchar*>(&source.data[0]);
     cv::InputArray data(jpegData);
@@ -482,32 +695,68 @@ std::string getFormat(Format format) {
 			return "tif";
 		case TIFF:
 			return "tiff";
+		case RVL:
+			return "rvl";
 	}
 
 	throw Exception("Unrecognized image format");
 }
 
 void CvImage::toCompressedImageMsg(sensor_msgs::CompressedImage& ros_image, const Format dst_format) const
+{
+  toCompressedImageMsg(ros_image, CompressionOptions(dst_format));
+}
+
+void CvImage::toCompressedImageMsg(sensor_msgs::CompressedImage& ros_image,
+                                   const CompressionOptions& options) const
 {
   ros_image.header = header;
-  cv::Mat image;
-  if(encoding != enc::BGR8)
+  ros_image.format = getFormat(options.format);
+
+  if (options.format == RVL)
   {
-      CvImagePtr tempThis = boost::make_shared<CvImage>(*this);
-      CvImagePtr temp = cvtColor(tempThis,enc::BGR8);
-      image = temp->image;
+    if (image.type() != CV_16UC1)
+      throw Exception("RVL only compresses 16 bit single channel images, not " + encoding);
+    compressRvl(image, ros_image.data);
+    return;
   }
-  else
+
+  // Single channel images are kept at 16 bits for the formats that store them, such as depth
+  // saved as PNG
+  bool wide = options.format == PNG || options.format == TIFF || options.format == TIF || options.format == JP2;
+  bool plain = image.channels() == 1 && !enc::isBayer(encoding) &&
+               (image.depth() == CV_8U || (image.depth() == CV_16U && wide));
+  cv::Mat image = this->image;
+  if (encoding != enc::BGR8 && !plain)
+    image = toCvCopyImpl(image, header, encoding, enc::BGR8)->image;
+
+  std::vector<int> params;
+  switch (options.format)
   {
-      image = this->image;
+    case JPG:
+    case JPEG:
+    case JPE:
+      params.push_back(cv::IMWRITE_JPEG_QUALITY);
+      params.push_back(options.jpeg_quality);
+      params.push_back(cv::IMWRITE_JPEG_OPTIMIZE);
+      params.push_back(options.jpeg_optimize);
+      params.push_back(cv::IMWRITE_JPEG_PROGRESSIVE);
+      params.push_back(options.jpeg_progressive);
+      break;
+    case PNG:
+      if (options.png_level >= 0)
+      {
+        params.push_back(cv::IMWRITE_PNG_COMPRESSION);
+        params.push_back(options.png_level);
+      }
+      break;
+    default:
+      break;
   }
-  std::vector<uchar> buf;
 
-  std::string format = getFormat(dst_format);
-  ros_image.format = format;
-  cv::imencode("." + format, image, buf);
-
-  ros_image.data = buf;
+  // Straight into the message, whose buffer is kept when it is recycled
+  if (!cv::imencode("." + ros_image.format, image, ros_image.data, params))
+    throw Exception("Could not compress the image as " + ros_image.format);
 }
 
 // Deep copy data, returnee is mutable
@@ -520,8 +769,15 @@ CvImagePtr toCvCopy(const sensor_msgs::CompressedImageConstPtr& source,
 CvImagePtr toCvCopy(const sensor_msgs::CompressedImage& source,
                     const std::string& encoding)
 {
-  // Construct matrix pointing to source data
-  return toCvCopyImpl(matFromImage(source), source.header, enc::BGR8, encoding);
+  const cv::Mat image = matFromImage(source);
+  std::string src_encoding = enc::BGR8;
+  if (image.type() == CV_16UC1)
+    src_encoding = enc::TYPE_16UC1;
+  else if (image.channels() == 1)
+    src_encoding = enc::MONO8;
+  else if (image.channels() == 4)
+    src_encoding = enc::BGRA8;
+  return toCvCopyImpl(image, source.header, src_encoding, encoding);
 }
 
 CvImageConstPtr cvtColorForDisplay(const CvImageConstPtr& source,
@@ -0,0 +1,222 @@
+/*********************************************************************
+* Software License Agreement (BSD License)
+*
+*  Copyright (c) 2011, Willow Garage, Inc,
+*  All rights reserved.
+*
+*  Redistribution and use in source and binary forms, with or without
+*  modification, are permitted provided that the following conditions
+*  are met:
+*
+*   * Redistributions of source code must retain the above copyright
+*     notice, this list of conditions and the following disclaimer.
+*   * Redistributions in binary form must reproduce the above
+*     copyright notice, this list of conditions and the following
+*     disclaimer in the documentation and/or other materials provided
+*     with the distribution.
+*   * Neither the name of the Willow Garage nor the names of its
+*     contributors may be used to endorse or promote products derived
+*     from this software without specific prior written permission.
+*
+*  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+*  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+*  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+*  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+*  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+*  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+*  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+*  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+*  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+*  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+*  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+*  POSSIBILITY OF SUCH DAMAGE.
+*********************************************************************/
+
+#include <cv_bridge/image_encoder.h>
+
+#include <boost/bind.hpp>
+#include <boost/thread/condition_variable.hpp>
+#include <boost/thread/thread.hpp>
+#include <ros/console.h>
+#include <ros/time.h>
+
+#include <algorithm>
+#include <deque>
+
+namespace cv_bridge {
+
+ImageEncoder::Statistics::Statistics()
+  : encoded(0), dropped(0), failed(0), encode_time(0.0), max_encode_time(0.0), raw_bytes(0),
+    compressed_bytes(0), queue_depth(0), max_queue_depth(0)
+{
+}
+
+struct ImageEncoder::Impl
+{
+  struct Job
+  {
+    CvImageConstPtr image;
+    Callback callback;
+  };
+
+  Impl(const CompressionOptions& options, const Callback& callback, int threads, size_t queue_size,
+       DropPolicy drop)
+    : options(options), callback(callback), queue_size(std::max<size_t>(queue_size, 1)), drop(drop),
+      pool(std::max(threads, 1) + queue_size + 1), taken(0), delivered(0), stopping(false)
+  {
+  }
+
+  void work();
+
+  boost::mutex mutex;
+  boost::condition_variable queued;     // Signalled when an image is queued or on stopping
+  boost::condition_variable turn;       // Signalled when a compressed image has been delivered
+
+  CompressionOptions options;
+  Callback callback;
+  size_t queue_size;
+  DropPolicy drop;
+  std::deque<Job> queue;
+  CompressedImagePool pool;
+  // Images are numbered as the workers take them and delivered in that order
+  uint64_t taken;
+  uint64_t delivered;
+  bool stopping;
+  Statistics statistics;
+  boost::thread_group workers;
+};
+
+void ImageEncoder::Impl::work()
+{
+  for (;;)
+  {
+    Job job;
+    CompressionOptions options;
+    uint64_t number;
+    {
+      boost::mutex::scoped_lock lock(mutex);
+      while (queue.empty() && !stopping)
+        queued.wait(lock);
+      if (queue.empty())
+        return;
+      job = queue.front();
+      queue.pop_front();
+      options = this->options;
+      number = taken++;
+    }
+
+    const CvImageConstPtr& image = job.image;
+    sensor_msgs::CompressedImagePtr msg = pool.acquire();
+    bool ok = true;
+    ros::WallTime start = ros::WallTime::now();
+    try
+    {
+      image->toCompressedImageMsg(*msg, options);
+    }
+    catch (const std::exception& e)
+    {
+      // Once only, as it will most likely fail for every image alike. Counted in the statistics.
+      ROS_ERROR_ONCE("cv_bridge could not compress a %s image: %s", image->encoding.c_str(), e.what());
+      ok = false;
+    }
+    double seconds = (ros::WallTime::now() - start).toSec();
+
+    {
+      boost::mutex::scoped_lock lock(mutex);
+      while (delivered != number)
+        turn.wait(lock);
+      if (ok)
+      {
+        ++statistics.encoded;
+        statistics.encode_time += seconds;
+        statistics.max_encode_time = std::max(statistics.max_encode_time, seconds);
+        statistics.raw_bytes += image->image.total() * image->image.elemSize();
+        statistics.compressed_bytes += msg->data.size();
+      }
+      else
+      {
+        ++statistics.failed;
+      }
+    }
+
+    // Later images wait for this one, so the callback runs outside the lock but in order
+    const Callback& deliver = job.callback ? job.callback : callback;
+    if (ok && deliver)
+      deliver(msg);
+
+    {
+      boost::mutex::scoped_lock lock(mutex);
+      ++delivered;
+    }
+    turn.notify_all();
+  }
+}
+
+ImageEncoder::ImageEncoder(const CompressionOptions& options, const Callback& callback,
+                           int threads, size_t queue_size, DropPolicy drop)
+  : impl_(boost::make_shared<Impl>(options, callback, threads, queue_size, drop))
+{
+  for (int i = 0; i < std::max(threads, 1); ++i)
+    impl_->workers.create_thread(boost::bind(&Impl::work, impl_.get()));
+}
+
+ImageEncoder::~ImageEncoder()
+{
+  {
+    boost::mutex::scoped_lock lock(impl_->mutex);
+    impl_->stopping = true;
+  }
+  impl_->queued.notify_all();
+  impl_->workers.join_all();
+}
+
+bool ImageEncoder::encode(const CvImageConstPtr& image, const Callback& callback)
+{
+  Impl::Job job;
+  job.image = image;
+  job.callback = callback;
+  {
+    boost::mutex::scoped_lock lock(impl_->mutex);
+    if (impl_->queue.size() >= impl_->queue_size)
+    {
+      ++impl_->statistics.dropped;
+      if (impl_->drop == DROP_NEWEST)
+        return false;
+      impl_->queue.pop_front();
+    }
+    impl_->queue.push_back(job);
+    impl_->statistics.max_queue_depth = std::max(impl_->statistics.max_queue_depth, impl_->queue.size());
+  }
+  impl_->queued.notify_one();
+  return true;
+}
+
+void ImageEncoder::flush()
+{
+  boost::mutex::scoped_lock lock(impl_->mutex);
+  while (!impl_->queue.empty() || impl_->delivered != impl_->taken)
+    impl_->turn.wait(lock);
+}
+
+void ImageEncoder::setOptions(const CompressionOptions& options)
+{
+  boost::mutex::scoped_lock lock(impl_->mutex);
+  impl_->options = options;
+}
+
+ImageEncoder::Statistics ImageEncoder::statistics() const
+{
+  boost::mutex::scoped_lock lock(impl_->mutex);
+  Statistics statistics = impl_->statistics;
+  statistics.queue_depth = impl_->queue.size();
+  return statistics;
+}
+
+void ImageEncoder::resetStatistics()
+{
+  boost::mutex::scoped_lock lock(impl_->mutex);
+  impl_->statistics = Statistics();
+  impl_->statistics.max_queue_depth = impl_->queue.size();
+}
+
+} // namespace cv_bridge
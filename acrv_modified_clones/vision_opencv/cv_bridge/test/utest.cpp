@@ -1,6 +1,12 @@
 #include "cv_bridge/cv_bridge.h"
+#include "cv_bridge/image_encoder.h"
 #include <sensor_msgs/image_encodings.h>
 #include <gtest/gtest.h>
+#include <boost/bind.hpp>
+#include <boost/ref.hpp>
+#include <boost/thread/condition_variable.hpp>
+#include <boost/thread/mutex.hpp>
+#include <opencv2/highgui/highgui.hpp>
 
 
 // Tests conversion of non-continuous cv::Mat. #5206
@@ -134,6 +140,263 @@ TEST(CvBridgeTest, imageMessageConversion)
   ASSERT_EQ(imgmsg.step, cv_ptr->image.step[0]);
 }
 
+TEST(CvBridgeTest, imagePoolRecycles)
+{
+  cv::Mat mat(120, 160, CV_8UC3, cv::Scalar(1, 2, 3));
+  cv_bridge::CvImage cvi(std_msgs::Header(), sensor_msgs::image_encodings::BGR8, mat);
+
+  const uint8_t* data;
+  sensor_msgs::ImagePtr last;
+  {
+    cv_bridge::ImagePool pool(2);
+    sensor_msgs::ImagePtr msg = cvi.toImageMsg(pool);
+    EXPECT_EQ(msg->step, 480);
+    data = &msg->data[0];
+    msg.reset();
+    EXPECT_EQ(pool.idle(), 1);
+
+    // The same buffer comes back, holding the new image
+    cvi.image.setTo(cv::Scalar(4, 5, 6));
+    msg = cvi.toImageMsg(pool);
+    EXPECT_EQ(pool.idle(), 0);
+    EXPECT_EQ(&msg->data[0], data);
+    EXPECT_EQ(msg->data[0], 4);
+
+    last = pool.acquire();
+    msg.reset();
+    EXPECT_EQ(pool.idle(), 1);
+  }
+  // Outliving the pool is fine
+  EXPECT_EQ(last->data.size(), 0);
+  last.reset();
+}
+
+TEST(CvBridgeTest, toCvCopyReusesDestination)
+{
+  cv::Mat_<cv::Vec<uint16_t, 3> > mat(60, 80);
+  cv::randu(mat, 0, 65535);
+  sensor_msgs::ImagePtr msg = cv_bridge::CvImage(std_msgs::Header(), sensor_msgs::image_encodings::RGB16, mat).toImageMsg();
+
+  // A color conversion and a change of depth, the last into the destination's buffer
+  cv_bridge::CvImage destination;
+  cv_bridge::toCvCopy(*msg, destination, sensor_msgs::image_encodings::MONO8);
+  const uchar* data = destination.image.data;
+  cv_bridge::toCvCopy(*msg, destination, sensor_msgs::image_encodings::MONO8);
+  EXPECT_EQ(destination.image.data, data);
+
+  cv_bridge::CvImagePtr expected = cv_bridge::toCvCopy(msg, sensor_msgs::image_encodings::MONO8);
+  EXPECT_EQ(destination.encoding, expected->encoding);
+  ASSERT_EQ(destination.image.type(), expected->image.type());
+  EXPECT_EQ(cv::norm(destination.image, expected->image, cv::NORM_INF), 0);
+}
+
+// Publishing a CvImage view of part of a cv::Mat serializes only that part
+TEST(CvBridgeTest, serializeNonContinuous)
+{
+  cv::Mat full(8, 8, CV_16U);
+  cv::randu(full, 0, 65535);
+  cv_bridge::CvImage cvi(std_msgs::Header(), sensor_msgs::image_encodings::MONO16, full(cv::Rect(2, 1, 3, 6)));
+
+  uint32_t length = ros::serialization::serializationLength(cvi);
+  std::vector<uint8_t> buffer(length);
+  ros::serialization::OStream out(&buffer[0], length);
+  ros::serialization::serialize(out, cvi);
+
+  sensor_msgs::Image msg;
+  ros::serialization::IStream in(&buffer[0], length);
+  ros::serialization::deserialize(in, msg);
+  EXPECT_EQ(msg.width, 3);
+  EXPECT_EQ(msg.height, 6);
+  EXPECT_EQ(msg.step, 6);
+  EXPECT_EQ(cv::norm(cv_bridge::toCvShare(msg, boost::shared_ptr<void const>())->image, cvi.image, cv::NORM_INF), 0);
+}
+
+TEST(CvBridgeTest, rvlRoundTrip)
+{
+  // Holes, extreme jumps and a view with padded rows
+  cv::Mat full(50, 70, CV_16UC1);
+  cv::randu(full, 0, 65535);
+  full.setTo(0, full < 20000);
+  full.at<uint16_t>(3, 4) = 65535;
+  full.at<uint16_t>(3, 5) = 1;
+  cv_bridge::CvImage cvi(std_msgs::Header(), sensor_msgs::image_encodings::TYPE_16UC1, full(cv::Rect(1, 2, 64, 45)));
+
+  sensor_msgs::CompressedImage msg;
+  cvi.toCompressedImageMsg(msg, cv_bridge::CompressionOptions(cv_bridge::RVL));
+  EXPECT_EQ(msg.format, "rvl");
+  cv_bridge::CvImagePtr decoded = cv_bridge::toCvCopy(msg);
+  EXPECT_EQ(decoded->encoding, sensor_msgs::image_encodings::TYPE_16UC1);
+  ASSERT_EQ(decoded->image.size(), cvi.image.size());
+  EXPECT_EQ(cv::norm(decoded->image, cvi.image, cv::NORM_INF), 0);
+
+  // Smooth depth compresses well
+  cv::Mat ramp(48, 64, CV_16UC1);
+  for (int y = 0; y < ramp.rows; ++y)
+    for (int x = 0; x < ramp.cols; ++x)
+      ramp.at<uint16_t>(y, x) = 1000 + x + y;
+  cv_bridge::CvImage(std_msgs::Header(), sensor_msgs::image_encodings::TYPE_16UC1, ramp).toCompressedImageMsg(msg, cv_bridge::RVL);
+  EXPECT_LT(msg.data.size(), ramp.total() / 2);
+  EXPECT_EQ(cv::norm(cv_bridge::toCvCopy(msg)->image, ramp, cv::NORM_INF), 0);
+
+  msg.data.resize(msg.data.size() / 2);
+  EXPECT_THROW(cv_bridge::toCvCopy(msg), cv_bridge::Exception);
+  EXPECT_THROW(cv_bridge::CvImage(std_msgs::Header(), sensor_msgs::image_encodings::BGR8, cv::Mat(4, 4, CV_8UC3)).toCompressedImageMsg(msg, cv_bridge::RVL),
+               cv_bridge::Exception);
+}
+
+TEST(CvBridgeTest, compressMono)
+{
+  cv::Mat mat(48, 64, CV_8UC1, cv::Scalar(100));
+  cv_bridge::CvImage cvi(std_msgs::Header(), sensor_msgs::image_encodings::MONO8, mat);
+
+  cv_bridge::CompressionOptions options(cv_bridge::PNG);
+  options.png_level = 1;
+  sensor_msgs::CompressedImage msg;
+  cvi.toCompressedImageMsg(msg, options);
+  cv_bridge::CvImagePtr decoded = cv_bridge::toCvCopy(msg);
+  EXPECT_EQ(decoded->encoding, sensor_msgs::image_encodings::MONO8);
+  EXPECT_EQ(cv::norm(decoded->image, mat, cv::NORM_INF), 0);
+
+  options.format = cv_bridge::JPG;
+  options.jpeg_quality = 50;
+  cvi.toCompressedImageMsg(msg, options);
+  EXPECT_EQ(cv_bridge::toCvCopy(msg)->image.channels(), 1);
+}
+
+TEST(CvBridgeTest, compressKeepsSixteenBitPng)
+{
+  cv::Mat ramp(48, 64, CV_16UC1);
+  for (int i = 0; i < ramp.rows * ramp.cols; ++i)
+    ramp.at<uint16_t>(i) = i * 20;
+  sensor_msgs::CompressedImage msg;
+  cv_bridge::CvImage(std_msgs::Header(), sensor_msgs::image_encodings::TYPE_16UC1, ramp).toCompressedImageMsg(msg, cv_bridge::PNG);
+  cv::Mat decoded = cv::imdecode(msg.data, cv::IMREAD_UNCHANGED);
+  ASSERT_EQ(decoded.type(), CV_16UC1);
+  EXPECT_EQ(cv::norm(decoded, ramp, cv::NORM_INF), 0);
+}
+
+static void collect(std::vector<uint32_t>* seqs, const sensor_msgs::CompressedImageConstPtr& msg)
+{
+  seqs->push_back(msg->header.seq);
+}
+
+TEST(CvBridgeTest, imageEncoderKeepsOrder)
+{
+  std::vector<uint32_t> seqs;
+  cv_bridge::ImageEncoder encoder(cv_bridge::CompressionOptions(cv_bridge::RVL), boost::bind(&collect, &seqs, _1), 3, 16);
+  for (uint32_t i = 0; i < 12; ++i)
+  {
+    cv_bridge::CvImagePtr image = boost::make_shared<cv_bridge::CvImage>(std_msgs::Header(), sensor_msgs::image_encodings::TYPE_16UC1,
+                                                                         cv::Mat(48, 64, CV_16UC1, cv::Scalar(i + 1)));
+    image->header.seq = i;
+    encoder.encode(image);
+  }
+  // An image RVL can't compress is counted and skipped
+  encoder.encode(boost::make_shared<cv_bridge::CvImage>(std_msgs::Header(), sensor_msgs::image_encodings::BGR8, cv::Mat(4, 4, CV_8UC3)));
+  encoder.flush();
+
+  ASSERT_EQ(seqs.size(), 12);
+  for (uint32_t i = 0; i < seqs.size(); ++i)
+    EXPECT_EQ(seqs[i], i);
+
+  cv_bridge::ImageEncoder::Statistics statistics = encoder.statistics();
+  EXPECT_EQ(statistics.encoded, 12);
+  EXPECT_EQ(statistics.dropped, 0);
+  EXPECT_EQ(statistics.failed, 1);
+  EXPECT_EQ(statistics.raw_bytes, 12 * 48 * 64 * 2);
+  EXPECT_GT(statistics.compressionRatio(), 3);
+  EXPECT_LE(statistics.meanEncodeTime(), statistics.max_encode_time);
+}
+
+static cv_bridge::CvImagePtr depthImage(uint32_t seq)
+{
+  cv_bridge::CvImagePtr image = boost::make_shared<cv_bridge::CvImage>(std_msgs::Header(), sensor_msgs::image_encodings::TYPE_16UC1,
+                                                                       cv::Mat(48, 64, CV_16UC1, cv::Scalar(seq + 1)));
+  image->header.seq = seq;
+  return image;
+}
+
+// Holds the only worker in the callback of the first image until released
+struct BlockingCallback
+{
+  BlockingCallback() : entered(false), released(false) {}
+
+  void operator()(std::vector<uint32_t>* seqs, const sensor_msgs::CompressedImageConstPtr& msg)
+  {
+    boost::mutex::scoped_lock lock(mutex);
+    entered = true;
+    changed.notify_all();
+    while (!released)
+      changed.wait(lock);
+    seqs->push_back(msg->header.seq);
+  }
+
+  void waitUntilEntered()
+  {
+    boost::mutex::scoped_lock lock(mutex);
+    while (!entered)
+      changed.wait(lock);
+  }
+
+  void release()
+  {
+    boost::mutex::scoped_lock lock(mutex);
+    released = true;
+    changed.notify_all();
+  }
+
+  boost::mutex mutex;
+  boost::condition_variable changed;
+  bool entered, released;
+};
+
+TEST(CvBridgeTest, imageEncoderDropNewestRefusesImages)
+{
+  std::vector<uint32_t> seqs;
+  BlockingCallback blocking;
+  cv_bridge::ImageEncoder encoder(cv_bridge::CompressionOptions(cv_bridge::RVL),
+                                  boost::bind<void>(boost::ref(blocking), &seqs, _1), 1, 1,
+                                  cv_bridge::ImageEncoder::DROP_NEWEST);
+  EXPECT_TRUE(encoder.encode(depthImage(0)));
+  blocking.waitUntilEntered();
+  EXPECT_TRUE(encoder.encode(depthImage(1)));
+  EXPECT_FALSE(encoder.encode(depthImage(2)));
+  EXPECT_EQ(encoder.statistics().queue_depth, 1);
+  blocking.release();
+  encoder.flush();
+
+  ASSERT_EQ(seqs.size(), 2);
+  EXPECT_EQ(seqs[0], 0);
+  EXPECT_EQ(seqs[1], 1);
+  cv_bridge::ImageEncoder::Statistics statistics = encoder.statistics();
+  EXPECT_EQ(statistics.dropped, 1);
+  EXPECT_EQ(statistics.queue_depth, 0);
+  EXPECT_EQ(statistics.max_queue_depth, 1);
+}
+
+TEST(CvBridgeTest, imageEncoderPerImageCallback)
+{
+  std::vector<uint32_t> all, own;
+  cv_bridge::ImageEncoder encoder(cv_bridge::CompressionOptions(cv_bridge::RVL), boost::bind(&collect, &all, _1), 2, 16);
+  for (uint32_t i = 0; i < 6; ++i)
+  {
+    if (i % 2)
+      EXPECT_TRUE(encoder.encode(depthImage(i), boost::bind(&collect, &own, _1)));
+    else
+      EXPECT_TRUE(encoder.encode(depthImage(i)));
+  }
+  encoder.flush();
+
+  // Images given their own callback only go to it, still in queue order
+  ASSERT_EQ(all.size(), 3);
+  ASSERT_EQ(own.size(), 3);
+  for (uint32_t i = 0; i < 3; ++i)
+  {
+    EXPECT_EQ(all[i], 2 * i);
+    EXPECT_EQ(own[i], 2 * i + 1);
+  }
+}
+
 int main(int argc, char** argv)
 {
   testing::InitGoogleTest(&argc, argv);
@@ -107,6 +107,18 @@ public:
    */
   cv::Point3d projectPixelTo3dRay(const cv::Point2d& uv_rect) const;
 
+  /**
+   * \brief Project many 3d points to rectified pixel coordinates, as project3dToPixel() does.
+   *
+   * The points are CV_32FC3 or CV_64FC3, and are projected in that precision. A single
+   * column may have any row step, so a column header over the x,y,z fields of a point cloud
+   * projects it without a copy.
+   *
+   * \param xyz 3d points in the camera coordinate frame
+   * \param uv_rect Rectified pixel coordinates, of the same size and depth with 2 channels
+   */
+  void project3dToPixels(const cv::Mat& xyz, cv::Mat& uv_rect) const;
+
   /**
    * \brief Rectify a raw camera image.
    */
@@ -115,6 +127,9 @@ public:
 
   /**
    * \brief Apply camera distortion to a rectified image.
+   *
+   * The inverse of rectifyImage(), producing an image of the raw resolution. Its maps are
+   * built on first use and cached like the rectification maps.
    */
   void unrectifyImage(const cv::Mat& rectified, cv::Mat& raw,
                       int interpolation = cv::INTER_LINEAR) const;
@@ -129,6 +144,21 @@ public:
    */
   cv::Point2d unrectifyPoint(const cv::Point2d& uv_rect) const;
 
+  /**
+   * \brief Compute the rectified image coordinates of many pixels in the raw image.
+   *
+   * The pixels are CV_32FC2 or CV_64FC2, laid out as for project3dToPixels(), and may be
+   * rectified in place. Matches rectifyPoint() on each pixel, computed in double precision.
+   */
+  void rectifyPoints(const cv::Mat& uv_raw, cv::Mat& uv_rect) const;
+
+  /**
+   * \brief Compute the raw image coordinates of many pixels in the rectified image.
+   *
+   * As rectifyPoints(), matching unrectifyPoint() on each pixel.
+   */
+  void unrectifyPoints(const cv::Mat& uv_rect, cv::Mat& uv_raw) const;
+
   /**
    * \brief Compute the rectified ROI best fitting a raw ROI.
    */
@@ -273,6 +303,7 @@ protected:
   boost::shared_ptr<Cache> cache_; // Holds cached data for internal use
 
   void initRectificationMaps() const;
+  void initUnrectificationMaps() const;
 
   friend class StereoCameraModel;
 };
@@ -1,6 +1,10 @@
 #include "image_geometry/pinhole_camera_model.h"
 #include <sensor_msgs/distortion_models.h>
 #include <boost/make_shared.hpp>
+#include <map>
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
 
 namespace image_geometry {
 
@@ -12,11 +16,24 @@ struct PinholeCameraModel::Cache
 
   cv::Mat_<double> K_binned, P_binned; // Binning applied, but not cropping
   
+  // Full-size maps at one binned resolution. The inverse (raw->rectified) maps
+  // are only built for unrectifyImage.
+  struct FullMaps
+  {
+    cv::Mat map1, map2;
+    cv::Mat inverse_map1, inverse_map2;
+  };
+
+  // Kept for every binning used since the calibration last changed, so that
+  // switching binning back and forth doesn't rebuild them.
   mutable bool full_maps_dirty;
-  mutable cv::Mat full_map1, full_map2;
+  mutable std::map<std::pair<uint32_t, uint32_t>, FullMaps> full_maps;
 
   mutable bool reduced_maps_dirty;
   mutable cv::Mat reduced_map1, reduced_map2;
+
+  mutable bool reduced_inverse_maps_dirty;
+  mutable cv::Mat reduced_inverse_map1, reduced_inverse_map2;
   
   mutable bool rectified_roi_dirty;
   mutable cv::Rect rectified_roi;
@@ -24,9 +41,19 @@ struct PinholeCameraModel::Cache
   Cache()
     : full_maps_dirty(true),
       reduced_maps_dirty(true),
+      reduced_inverse_maps_dirty(true),
       rectified_roi_dirty(true)
   {
   }
+
+  FullMaps& fullMaps(uint32_t binning_x, uint32_t binning_y) const
+  {
+    if (full_maps_dirty) {
+      full_maps.clear();
+      full_maps_dirty = false;
+    }
+    return full_maps[std::make_pair(binning_x, binning_y)];
+  }
 };
 
 PinholeCameraModel::PinholeCameraModel()
@@ -100,29 +127,31 @@ bool PinholeCameraModel::fromCameraInfo(const sensor_msgs::CameraInfo& msg)
   cam_info_.header = msg.header;
   
   // Update any parameters that have changed. The full rectification maps are
-  // invalidated by any change in the calibration parameters OR binning.
-  bool &full_dirty = cache_->full_maps_dirty;
-  full_dirty |= update(msg.height, cam_info_.height);
-  full_dirty |= update(msg.width,  cam_info_.width);
-  full_dirty |= update(msg.distortion_model, cam_info_.distortion_model);
-  full_dirty |= updateMat(msg.D, cam_info_.D, D_, 1, msg.D.size());
-  full_dirty |= updateMat(msg.K, cam_info_.K, K_full_);
-  full_dirty |= updateMat(msg.R, cam_info_.R, R_);
-  full_dirty |= updateMat(msg.P, cam_info_.P, P_full_);
-  full_dirty |= update(binning_x, cam_info_.binning_x);
-  full_dirty |= update(binning_y, cam_info_.binning_y);
+  // invalidated by any change in the calibration parameters, while those
+  // built for other binnings stay valid.
+  bool changed = false;
+  changed |= update(msg.height, cam_info_.height);
+  changed |= update(msg.width,  cam_info_.width);
+  changed |= update(msg.distortion_model, cam_info_.distortion_model);
+  changed |= updateMat(msg.D, cam_info_.D, D_, 1, msg.D.size());
+  changed |= updateMat(msg.K, cam_info_.K, K_full_);
+  changed |= updateMat(msg.R, cam_info_.R, R_);
+  changed |= updateMat(msg.P, cam_info_.P, P_full_);
+  cache_->full_maps_dirty |= changed;
+  changed |= update(binning_x, cam_info_.binning_x);
+  changed |= update(binning_y, cam_info_.binning_y);
 
   // The reduced rectification maps are invalidated by any of the above or a
   // change in ROI.
-  bool &reduced_dirty = cache_->reduced_maps_dirty;
-  reduced_dirty  = full_dirty;
-  reduced_dirty |= update(roi.x_offset,   cam_info_.roi.x_offset);
-  reduced_dirty |= update(roi.y_offset,   cam_info_.roi.y_offset);
-  reduced_dirty |= update(roi.height,     cam_info_.roi.height);
-  reduced_dirty |= update(roi.width,      cam_info_.roi.width);
-  reduced_dirty |= update(roi.do_rectify, cam_info_.roi.do_rectify);
-  // As is the rectified ROI
-  cache_->rectified_roi_dirty = reduced_dirty;
+  changed |= update(roi.x_offset,   cam_info_.roi.x_offset);
+  changed |= update(roi.y_offset,   cam_info_.roi.y_offset);
+  changed |= update(roi.height,     cam_info_.roi.height);
+  changed |= update(roi.width,      cam_info_.roi.width);
+  changed |= update(roi.do_rectify, cam_info_.roi.do_rectify);
+  // As is the rectified ROI. An invalidation not yet acted on stays pending.
+  cache_->reduced_maps_dirty |= changed;
+  cache_->reduced_inverse_maps_dirty |= changed;
+  cache_->rectified_roi_dirty |= changed;
 
   // Figure out how to handle the distortion
   if (cam_info_.distortion_model == sensor_msgs::distortion_models::PLUMB_BOB ||
@@ -182,7 +211,7 @@ bool PinholeCameraModel::fromCameraInfo(const sensor_msgs::CameraInfo& msg)
     }
   }
 
-  return reduced_dirty;
+  return changed;
 }
 
 bool PinholeCameraModel::fromCameraInfo(const sensor_msgs::CameraInfoConstPtr& msg)
@@ -259,6 +288,309 @@ cv::Rect PinholeCameraModel::rectifiedRoi() const
   return cache_->rectified_roi;
 }
 
+namespace {
+
+// The lens model of cv::undistortPoints and cv::projectPoints, for up to 12
+// distortion coefficients (all but the tilted sensor model).
+struct Lens
+{
+  double fx, fy, cx, cy, ifx, ify; // Raw camera matrix K
+  double k[12];
+  cv::Matx33d rectify;             // P*R, taking undistorted rays to rectified pixels
+  cv::Matx33d unrotate;            // R^T, taking rectified rays to raw rays
+  double p_fx, p_fy, p_cx, p_cy, p_Tx, p_Ty;
+
+  Lens(const cv::Matx33d& K, const cv::Mat_<double>& D, const cv::Matx33d& R, const cv::Matx34d& P)
+    : fx(K(0,0)), fy(K(1,1)), cx(K(0,2)), cy(K(1,2)), ifx(1./fx), ify(1./fy),
+      rectify(P.get_minor<3, 3>(0, 0) * R), unrotate(R.t()),
+      p_fx(P(0,0)), p_fy(P(1,1)), p_cx(P(0,2)), p_cy(P(1,2)), p_Tx(P(0,3)), p_Ty(P(1,3))
+  {
+    for (int i = 0; i < 12; ++i)
+      k[i] = i < (int)D.total() ? D(i) : 0.0;
+  }
+
+  static bool supports(const cv::Mat_<double>& D) { return D.total() <= 12; }
+};
+
+// Raw to rectified pixel, as cv::undistortPoints
+struct Rectify
+{
+  const Lens& lens;
+  Rectify(const Lens& lens) : lens(lens) {}
+
+  template<typename V> void operator()(V& u, V& v) const
+  {
+    const double* k = lens.k;
+    V x = (u - lens.cx)*lens.ifx;
+    V y = (v - lens.cy)*lens.ify;
+
+    // Compensate distortion iteratively
+    V x0 = x, y0 = y;
+    for (int j = 0; j < 5; ++j)
+    {
+      V r2 = x*x + y*y;
+      V icdist = (1 + ((k[7]*r2 + k[6])*r2 + k[5])*r2)/(1 + ((k[4]*r2 + k[1])*r2 + k[0])*r2);
+      V deltaX = 2*k[2]*x*y + k[3]*(r2 + 2*x*x) + k[8]*r2 + k[9]*r2*r2;
+      V deltaY = k[2]*(r2 + 2*y*y) + 2*k[3]*x*y + k[10]*r2 + k[11]*r2*r2;
+      x = (x0 - deltaX)*icdist;
+      y = (y0 - deltaY)*icdist;
+    }
+
+    const cv::Matx33d& RR = lens.rectify;
+    V xx = RR(0,0)*x + RR(0,1)*y + RR(0,2);
+    V yy = RR(1,0)*x + RR(1,1)*y + RR(1,2);
+    V ww = 1./(RR(2,0)*x + RR(2,1)*y + RR(2,2));
+    u = xx*ww;
+    v = yy*ww;
+  }
+};
+
+// Rectified to raw pixel: the ray of projectPixelTo3dRay, projected as by
+// cv::projectPoints with rotation R^T
+struct Unrectify
+{
+  const Lens& lens;
+  Unrectify(const Lens& lens) : lens(lens) {}
+
+  template<typename V> void operator()(V& u, V& v) const
+  {
+    const double* k = lens.k;
+    V rx = (u - lens.p_cx - lens.p_Tx) / lens.p_fx;
+    V ry = (v - lens.p_cy - lens.p_Ty) / lens.p_fy;
+
+    const cv::Matx33d& R = lens.unrotate;
+    V X = R(0,0)*rx + R(0,1)*ry + R(0,2);
+    V Y = R(1,0)*rx + R(1,1)*ry + R(1,2);
+    V z = 1./(R(2,0)*rx + R(2,1)*ry + R(2,2));
+    V x = X*z, y = Y*z;
+
+    V r2 = x*x + y*y, r4 = r2*r2, r6 = r4*r2;
+    V a1 = 2*x*y, a2 = r2 + 2*x*x, a3 = r2 + 2*y*y;
+    V cdist = 1 + k[0]*r2 + k[1]*r4 + k[4]*r6;
+    V icdist2 = 1./(1 + k[5]*r2 + k[6]*r4 + k[7]*r6);
+    V xd = x*cdist*icdist2 + k[2]*a1 + k[3]*a2 + k[8]*r2 + k[9]*r4;
+    V yd = y*cdist*icdist2 + k[2]*a3 + k[3]*a1 + k[10]*r2 + k[11]*r4;
+    u = xd*lens.fx + lens.cx;
+    v = yd*lens.fy + lens.cy;
+  }
+};
+
+// As project3dToPixel, in the precision T of the points
+template<typename T>
+struct Project
+{
+  T fx, fy, cx, cy, Tx, Ty;
+  Project(const cv::Matx34d& P)
+    : fx(P(0,0)), fy(P(1,1)), cx(P(0,2)), cy(P(1,2)), Tx(P(0,3)), Ty(P(1,3))
+  {
+  }
+
+  template<typename V> void operator()(const V& x, const V& y, const V& z, V& u, V& v) const
+  {
+    u = (fx*x + Tx) / z + cx;
+    v = (fy*y + Ty) / z + cy;
+  }
+};
+
+#if defined(__SSE2__)
+// Vectors with the arithmetic the functors above need, so the same code runs on
+// two (double) or four (float) points at once
+struct Double2
+{
+  __m128d v;
+  Double2(__m128d v) : v(v) {}
+  Double2(double d) : v(_mm_set1_pd(d)) {}
+};
+
+inline Double2 operator+(const Double2& a, const Double2& b) { return _mm_add_pd(a.v, b.v); }
+inline Double2 operator-(const Double2& a, const Double2& b) { return _mm_sub_pd(a.v, b.v); }
+inline Double2 operator*(const Double2& a, const Double2& b) { return _mm_mul_pd(a.v, b.v); }
+inline Double2 operator/(const Double2& a, const Double2& b) { return _mm_div_pd(a.v, b.v); }
+
+struct Float4
+{
+  __m128 v;
+  Float4(__m128 v) : v(v) {}
+  Float4(float f) : v(_mm_set1_ps(f)) {}
+};
+
+inline Float4 operator+(const Float4& a, const Float4& b) { return _mm_add_ps(a.v, b.v); }
+inline Float4 operator*(const Float4& a, const Float4& b) { return _mm_mul_ps(a.v, b.v); }
+inline Float4 operator/(const Float4& a, const Float4& b) { return _mm_div_ps(a.v, b.v); }
+
+// (x,y) of one point, widened to double
+inline __m128d loadPoint(const double* p) { return _mm_loadu_pd(p); }
+inline __m128d loadPoint(const float* p) { return _mm_cvtps_pd(_mm_castpd_ps(_mm_load_sd((const double*)p))); }
+inline void storePoint(double* p, __m128d uv) { _mm_storeu_pd(p, uv); }
+inline void storePoint(float* p, __m128d uv) { _mm_storel_pi((__m64*)p, _mm_cvtpd_ps(uv)); }
+
+// Projects points [i, count) in fours, returning the index of the first left over
+inline size_t projectSimd(const Project<float>& project, const uchar* src, size_t src_step,
+                          uchar* dst, size_t dst_step, size_t count)
+{
+  size_t i = 0;
+  for (; i + 4 <= count; i += 4)
+  {
+    const float* p0 = (const float*)(src + i*src_step);
+    const float* p1 = (const float*)((const uchar*)p0 + src_step);
+    const float* p2 = (const float*)((const uchar*)p1 + src_step);
+    const float* p3 = (const float*)((const uchar*)p2 + src_step);
+    Float4 u(0.f), v(0.f);
+    project(Float4(_mm_setr_ps(p0[0], p1[0], p2[0], p3[0])),
+            Float4(_mm_setr_ps(p0[1], p1[1], p2[1], p3[1])),
+            Float4(_mm_setr_ps(p0[2], p1[2], p2[2], p3[2])), u, v);
+
+    __m128 uv01 = _mm_unpacklo_ps(u.v, v.v), uv23 = _mm_unpackhi_ps(u.v, v.v);
+    uchar* d = dst + i*dst_step;
+    _mm_storel_pi((__m64*)d, uv01);
+    _mm_storeh_pi((__m64*)(d + dst_step), uv01);
+    _mm_storel_pi((__m64*)(d + 2*dst_step), uv23);
+    _mm_storeh_pi((__m64*)(d + 3*dst_step), uv23);
+  }
+  return i;
+}
+
+inline size_t projectSimd(const Project<double>& project, const uchar* src, size_t src_step,
+                          uchar* dst, size_t dst_step, size_t count)
+{
+  size_t i = 0;
+  for (; i + 2 <= count; i += 2)
+  {
+    const double* p0 = (const double*)(src + i*src_step);
+    const double* p1 = (const double*)((const uchar*)p0 + src_step);
+    Double2 u(0.), v(0.);
+    project(Double2(_mm_setr_pd(p0[0], p1[0])), Double2(_mm_setr_pd(p0[1], p1[1])),
+            Double2(_mm_setr_pd(p0[2], p1[2])), u, v);
+
+    uchar* d = dst + i*dst_step;
+    _mm_storeu_pd((double*)d, _mm_unpacklo_pd(u.v, v.v));
+    _mm_storeu_pd((double*)(d + dst_step), _mm_unpackhi_pd(u.v, v.v));
+  }
+  return i;
+}
+#endif
+
+// Projects 'count' points of T[3], 'src_step' bytes apart, to T[2] 'dst_step' bytes apart
+template<typename T>
+struct ProjectRun
+{
+  Project<T> project;
+  ProjectRun(const cv::Matx34d& P) : project(P) {}
+
+  void operator()(const uchar* src, size_t src_step, uchar* dst, size_t dst_step, size_t count) const
+  {
+    size_t i = 0;
+#if defined(__SSE2__)
+    i = projectSimd(project, src, src_step, dst, dst_step, count);
+#endif
+    for (; i < count; ++i)
+    {
+      const T* p = (const T*)(src + i*src_step);
+      T* uv = (T*)(dst + i*dst_step);
+      project(p[0], p[1], p[2], uv[0], uv[1]);
+    }
+  }
+};
+
+// Applies a functor of (u,v) to 'count' points of T[2], 'src_step' and 'dst_step'
+// bytes apart. Computes in double, in place if src == dst.
+template<typename T, typename F>
+struct TransformRun
+{
+  F f;
+  TransformRun(const F& f) : f(f) {}
+
+  void operator()(const uchar* src, size_t src_step, uchar* dst, size_t dst_step, size_t count) const
+  {
+    size_t i = 0;
+#if defined(__SSE2__)
+    for (; i + 2 <= count; i += 2)
+    {
+      __m128d p0 = loadPoint((const T*)(src + i*src_step));
+      __m128d p1 = loadPoint((const T*)(src + (i + 1)*src_step));
+      Double2 u = _mm_unpacklo_pd(p0, p1), v = _mm_unpackhi_pd(p0, p1);
+      f(u, v);
+      storePoint((T*)(dst + i*dst_step), _mm_unpacklo_pd(u.v, v.v));
+      storePoint((T*)(dst + (i + 1)*dst_step), _mm_unpackhi_pd(u.v, v.v));
+    }
+#endif
+    for (; i < count; ++i)
+    {
+      const T* p = (const T*)(src + i*src_step);
+      double u = p[0], v = p[1];
+      f(u, v);
+      T* uv = (T*)(dst + i*dst_step);
+      uv[0] = (T)u;
+      uv[1] = (T)v;
+    }
+  }
+};
+
+// Calls run(src, src_step, dst, dst_step, count) over the points of two matrices
+// of the same size, in as few runs of evenly spaced points as their layout
+// allows: one for continuous matrices or a single column of any row step.
+template<typename Run>
+void forEachRun(const Run& run, const cv::Mat& src, cv::Mat& dst)
+{
+  if (src.cols == 1)
+    run(src.data, src.step[0], dst.data, dst.step[0], src.rows);
+  else if (src.isContinuous() && dst.isContinuous())
+    run(src.data, src.elemSize(), dst.data, dst.elemSize(), src.total());
+  else {
+    for (int y = 0; y < src.rows; ++y)
+      run(src.ptr(y), src.elemSize(), dst.ptr(y), dst.elemSize(), src.cols);
+  }
+}
+
+template<typename F>
+void transformPoints(const F& f, const cv::Mat& src, cv::Mat& dst)
+{
+  if (src.depth() == CV_32F)
+    forEachRun(TransformRun<float, F>(f), src, dst);
+  else
+    forEachRun(TransformRun<double, F>(f), src, dst);
+}
+
+// dst must already have the size and type of src
+void rectifyPixels(const cv::Matx33d& K, const cv::Mat_<double>& D, const cv::Matx33d& R,
+                   const cv::Matx34d& P, const cv::Mat& src, cv::Mat& dst)
+{
+  if (Lens::supports(D)) {
+    Lens lens(K, D, R, P);
+    transformPoints(Rectify(lens), src, dst);
+    return;
+  }
+
+  // Tilted sensor, left to OpenCV
+  cv::Mat rectified;
+  cv::undistortPoints(src.clone().reshape(0, 1), rectified, K, D, R, P);
+  rectified.reshape(0, src.rows).copyTo(dst);
+}
+
+void unrectifyPixels(const cv::Matx33d& K, const cv::Mat_<double>& D, const cv::Matx33d& R,
+                     const cv::Matx34d& P, const cv::Mat& src, cv::Mat& dst)
+{
+  if (Lens::supports(D)) {
+    Lens lens(K, D, R, P);
+    transformPoints(Unrectify(lens), src, dst);
+    return;
+  }
+
+  cv::Mat_<cv::Point2d> points;
+  src.convertTo(points, CV_64F);
+  std::vector<cv::Point3d> rays;
+  rays.reserve(points.total());
+  for (cv::MatIterator_<cv::Point2d> it = points.begin(); it != points.end(); ++it)
+    rays.push_back(cv::Point3d((it->x - P(0,2) - P(0,3)) / P(0,0), (it->y - P(1,2) - P(1,3)) / P(1,1), 1.0));
+  cv::Mat r_vec, t_vec = cv::Mat_<double>::zeros(3, 1);
+  cv::Rodrigues(R.t(), r_vec);
+  std::vector<cv::Point2d> image_points;
+  cv::projectPoints(rays, r_vec, t_vec, K, D, image_points);
+  cv::Mat(image_points).reshape(0, src.rows).convertTo(dst, dst.type());
+}
+
+} // namespace
+
 cv::Point2d PinholeCameraModel::project3dToPixel(const cv::Point3d& xyz) const
 {
   assert( initialized() );
@@ -284,6 +616,21 @@ cv::Point3d PinholeCameraModel::projectPixelTo3dRay(const cv::Point2d& uv_rect)
   return ray;
 }
 
+void PinholeCameraModel::project3dToPixels(const cv::Mat& xyz, cv::Mat& uv_rect) const
+{
+  assert( initialized() );
+  assert(P_(2, 3) == 0.0); // Calibrated stereo cameras should be in the same plane
+
+  if (xyz.dims > 2 || (xyz.type() != CV_32FC3 && xyz.type() != CV_64FC3))
+    throw Exception("project3dToPixels requires CV_32FC3 or CV_64FC3 points.");
+
+  uv_rect.create(xyz.rows, xyz.cols, CV_MAKETYPE(xyz.depth(), 2));
+  if (xyz.depth() == CV_32F)
+    forEachRun(ProjectRun<float>(P_), xyz, uv_rect);
+  else
+    forEachRun(ProjectRun<double>(P_), xyz, uv_rect);
+}
+
 void PinholeCameraModel::rectifyImage(const cv::Mat& raw, cv::Mat& rectified, int interpolation) const
 {
   assert( initialized() );
@@ -312,14 +659,24 @@ void PinholeCameraModel::unrectifyImage(const cv::Mat& rectified, cv::Mat& raw,
 {
   assert( initialized() );
 
-  throw Exception("PinholeCameraModel::unrectifyImage is unimplemented.");
-  /// @todo Implement unrectifyImage()
-  // Similar to rectifyImage, but need to build separate set of inverse maps (raw->rectified)...
-  // - Build src_pt Mat with all the raw pixel coordinates (or do it one row at a time)
-  // - Do cv::undistortPoints(src_pt, dst_pt, K_, D_, R_, P_)
-  // - Use convertMaps() to convert dst_pt to fast fixed-point maps
-  // - cv::remap(rectified, raw, ...)
-  // Need interpolation argument. Same caching behavior?
+  switch (cache_->distortion_state) {
+    case NONE:
+      rectified.copyTo(raw);
+      break;
+    case CALIBRATED:
+      initUnrectificationMaps();
+      if (rectified.depth() == CV_32F || rectified.depth() == CV_64F)
+      {
+        cv::remap(rectified, raw, cache_->reduced_inverse_map1, cache_->reduced_inverse_map2, interpolation, cv::BORDER_CONSTANT, std::numeric_limits<float>::quiet_NaN());
+      }
+      else {
+        cv::remap(rectified, raw, cache_->reduced_inverse_map1, cache_->reduced_inverse_map2, interpolation);
+      }
+      break;
+    default:
+      assert(cache_->distortion_state == UNKNOWN);
+      throw Exception("Cannot call unrectifyImage when distortion is unknown.");
+  }
 }
 
 cv::Point2d PinholeCameraModel::rectifyPoint(const cv::Point2d& uv_raw) const
@@ -362,6 +719,42 @@ cv::Point2d PinholeCameraModel::unrectifyPoint(const cv::Point2d& uv_rect) const
   return image_point[0];
 }
 
+void PinholeCameraModel::rectifyPoints(const cv::Mat& uv_raw, cv::Mat& uv_rect) const
+{
+  assert( initialized() );
+
+  if (uv_raw.dims > 2 || (uv_raw.type() != CV_32FC2 && uv_raw.type() != CV_64FC2))
+    throw Exception("rectifyPoints requires CV_32FC2 or CV_64FC2 points.");
+  if (cache_->distortion_state == NONE) {
+    uv_raw.copyTo(uv_rect);
+    return;
+  }
+  if (cache_->distortion_state == UNKNOWN)
+    throw Exception("Cannot call rectifyPoints when distortion is unknown.");
+  assert(cache_->distortion_state == CALIBRATED);
+
+  uv_rect.create(uv_raw.rows, uv_raw.cols, uv_raw.type());
+  rectifyPixels(K_, D_, R_, P_, uv_raw, uv_rect);
+}
+
+void PinholeCameraModel::unrectifyPoints(const cv::Mat& uv_rect, cv::Mat& uv_raw) const
+{
+  assert( initialized() );
+
+  if (uv_rect.dims > 2 || (uv_rect.type() != CV_32FC2 && uv_rect.type() != CV_64FC2))
+    throw Exception("unrectifyPoints requires CV_32FC2 or CV_64FC2 points.");
+  if (cache_->distortion_state == NONE) {
+    uv_rect.copyTo(uv_raw);
+    return;
+  }
+  if (cache_->distortion_state == UNKNOWN)
+    throw Exception("Cannot call unrectifyPoints when distortion is unknown.");
+  assert(cache_->distortion_state == CALIBRATED);
+
+  uv_raw.create(uv_rect.rows, uv_rect.cols, uv_rect.type());
+  unrectifyPixels(K_, D_, R_, P_, uv_rect, uv_raw);
+}
+
 cv::Rect PinholeCameraModel::rectifyRoi(const cv::Rect& roi_raw) const
 {
   assert( initialized() );
@@ -404,12 +797,66 @@ cv::Rect PinholeCameraModel::unrectifyRoi(const cv::Rect& roi_rect) const
   return cv::Rect(roi_tl.x, roi_tl.y, roi_br.x - roi_tl.x, roi_br.y - roi_tl.y);
 }
 
+// K and P of the full image at the given binning
+static void binCalibration(const cv::Matx33d& K_full, const cv::Matx34d& P_full,
+                           uint32_t binning_x, uint32_t binning_y,
+                           cv::Matx33d& K_binned, cv::Matx34d& P_binned)
+{
+  K_binned = K_full;
+  P_binned = P_full;
+  if (binning_x > 1) {
+    double scale_x = 1.0 / binning_x;
+    K_binned(0,0) *= scale_x;
+    K_binned(0,2) *= scale_x;
+    P_binned(0,0) *= scale_x;
+    P_binned(0,2) *= scale_x;
+    P_binned(0,3) *= scale_x;
+  }
+  if (binning_y > 1) {
+    double scale_y = 1.0 / binning_y;
+    K_binned(1,1) *= scale_y;
+    K_binned(1,2) *= scale_y;
+    P_binned(1,1) *= scale_y;
+    P_binned(1,2) *= scale_y;
+    P_binned(1,3) *= scale_y;
+  }
+}
+
+// Crops full-size fixed-point maps to the raw ROI
+static void reduceMaps(const sensor_msgs::CameraInfo& cam_info,
+                       const cv::Mat& full_map1, const cv::Mat& full_map2,
+                       cv::Mat& reduced_map1, cv::Mat& reduced_map2)
+{
+  /// @todo Use rectified ROI
+  cv::Rect roi(cam_info.roi.x_offset, cam_info.roi.y_offset,
+               cam_info.roi.width, cam_info.roi.height);
+  if (roi.x != 0 || roi.y != 0 ||
+      roi.height != (int)cam_info.height ||
+      roi.width  != (int)cam_info.width) {
+
+    // map1 contains integer (x,y) offsets, which we adjust by the ROI offset
+    // map2 contains LUT index for subpixel interpolation, which we can leave as-is
+    roi.x /= cam_info.binning_x;
+    roi.y /= cam_info.binning_y;
+    roi.width  /= cam_info.binning_x;
+    roi.height /= cam_info.binning_y;
+    reduced_map1 = full_map1(roi) - cv::Scalar(roi.x, roi.y);
+    reduced_map2 = full_map2(roi);
+  }
+  else {
+    // Otherwise we're rectifying the full image
+    reduced_map1 = full_map1;
+    reduced_map2 = full_map2;
+  }
+}
+
 void PinholeCameraModel::initRectificationMaps() const
 {
   /// @todo For large binning settings, can drop extra rows/cols at bottom/right boundary.
   /// Make sure we're handling that 100% correctly.
   
-  if (cache_->full_maps_dirty) {
+  Cache::FullMaps& full = cache_->fullMaps(binningX(), binningY());
+  if (full.map1.empty()) {
     // Create the full-size map at the binned resolution
     /// @todo Should binned resolution, K, P be part of public API?
     cv::Size binned_resolution = fullResolution();
@@ -418,61 +865,46 @@ void PinholeCameraModel::initRectificationMaps() const
 
     cv::Matx33d K_binned;
     cv::Matx34d P_binned;
-    if (binningX() == 1 && binningY() == 1) {
-      K_binned = K_full_;
-      P_binned = P_full_;
-    }
-    else {
-      K_binned = K_full_;
-      P_binned = P_full_;
-      if (binningX() > 1) {
-        double scale_x = 1.0 / binningX();
-        K_binned(0,0) *= scale_x;
-        K_binned(0,2) *= scale_x;
-        P_binned(0,0) *= scale_x;
-        P_binned(0,2) *= scale_x;
-        P_binned(0,3) *= scale_x;
-      }
-      if (binningY() > 1) {
-        double scale_y = 1.0 / binningY();
-        K_binned(1,1) *= scale_y;
-        K_binned(1,2) *= scale_y;
-        P_binned(1,1) *= scale_y;
-        P_binned(1,2) *= scale_y;
-        P_binned(1,3) *= scale_y;
-      }
-    }
+    binCalibration(K_full_, P_full_, binningX(), binningY(), K_binned, P_binned);
     
     // Note: m1type=CV_16SC2 to use fast fixed-point maps (see cv::remap)
     cv::initUndistortRectifyMap(K_binned, D_, R_, P_binned, binned_resolution,
-                                CV_16SC2, cache_->full_map1, cache_->full_map2);
-    cache_->full_maps_dirty = false;
+                                CV_16SC2, full.map1, full.map2);
   }
 
   if (cache_->reduced_maps_dirty) {
-    /// @todo Use rectified ROI
-    cv::Rect roi(cam_info_.roi.x_offset, cam_info_.roi.y_offset,
-                 cam_info_.roi.width, cam_info_.roi.height);
-    if (roi.x != 0 || roi.y != 0 ||
-        roi.height != (int)cam_info_.height ||
-        roi.width  != (int)cam_info_.width) {
-
-      // map1 contains integer (x,y) offsets, which we adjust by the ROI offset
-      // map2 contains LUT index for subpixel interpolation, which we can leave as-is
-      roi.x /= binningX();
-      roi.y /= binningY();
-      roi.width  /= binningX();
-      roi.height /= binningY();
-      cache_->reduced_map1 = cache_->full_map1(roi) - cv::Scalar(roi.x, roi.y);
-      cache_->reduced_map2 = cache_->full_map2(roi);
-    }
-    else {
-      // Otherwise we're rectifying the full image
-      cache_->reduced_map1 = cache_->full_map1;
-      cache_->reduced_map2 = cache_->full_map2;
-    }
+    reduceMaps(cam_info_, full.map1, full.map2, cache_->reduced_map1, cache_->reduced_map2);
     cache_->reduced_maps_dirty = false;
   }
 }
 
+void PinholeCameraModel::initUnrectificationMaps() const
+{
+  Cache::FullMaps& full = cache_->fullMaps(binningX(), binningY());
+  if (full.inverse_map1.empty()) {
+    cv::Size binned_resolution = fullResolution();
+    binned_resolution.width  /= binningX();
+    binned_resolution.height /= binningY();
+
+    cv::Matx33d K_binned;
+    cv::Matx34d P_binned;
+    binCalibration(K_full_, P_full_, binningX(), binningY(), K_binned, P_binned);
+
+    // Rectify the coordinates of every raw pixel, then convert them to fast
+    // fixed-point maps like the rectification maps
+    cv::Mat_<cv::Point2f> raw_points(binned_resolution);
+    for (int y = 0; y < raw_points.rows; ++y)
+      for (int x = 0; x < raw_points.cols; ++x)
+        raw_points(y, x) = cv::Point2f(x, y);
+    rectifyPixels(K_binned, D_, R_, P_binned, raw_points, raw_points);
+    cv::convertMaps(raw_points, cv::Mat(), full.inverse_map1, full.inverse_map2, CV_16SC2);
+  }
+
+  if (cache_->reduced_inverse_maps_dirty) {
+    reduceMaps(cam_info_, full.inverse_map1, full.inverse_map2,
+               cache_->reduced_inverse_map1, cache_->reduced_inverse_map2);
+    cache_->reduced_inverse_maps_dirty = false;
+  }
+}
+
 } //namespace image_geometry
@@ -1,6 +1,7 @@
 #include "image_geometry/pinhole_camera_model.h"
 #include <sensor_msgs/distortion_models.h>
 #include <gtest/gtest.h>
+#include <cmath>
 
 /// @todo Tests with simple values (R = identity, D = 0, P = K or simple scaling)
 /// @todo Test projection functions for right stereo values, P(:,3) != 0
@@ -252,6 +253,105 @@ TEST_F(PinholeTest, rectifyIfCalibrated)
   model_.fromCameraInfo(cam_info_);
 }
 
+// Laid out like pcl::PointXYZRGB
+struct PaddedPoint
+{
+  float x, y, z, pad[5];
+};
+
+TEST_F(PinholeTest, batchMatchesSinglePoint)
+{
+  cv::Mat_<cv::Point2f> uv_raw(cam_info_.height / 10, cam_info_.width / 10);
+  for (int row = 0; row < uv_raw.rows; ++row)
+    for (int col = 0; col < uv_raw.cols; ++col)
+      uv_raw(row, col) = cv::Point2f(col * 10.25f, row * 10.5f);
+
+  cv::Mat_<cv::Point2f> uv_rect;
+  model_.rectifyPoints(uv_raw, uv_rect);
+  cv::Mat_<cv::Point2d> uv_rect64, uv_unrect64;
+  uv_rect.convertTo(uv_rect64, CV_64F);
+  model_.unrectifyPoints(uv_rect64, uv_unrect64);
+  for (int row = 0; row < uv_raw.rows; ++row) {
+    for (int col = 0; col < uv_raw.cols; ++col) {
+      cv::Point2d rect = model_.rectifyPoint(uv_raw(row, col));
+      EXPECT_FLOAT_EQ(rect.x, uv_rect(row, col).x) << "at (" << row << ", " << col << ")";
+      EXPECT_FLOAT_EQ(rect.y, uv_rect(row, col).y) << "at (" << row << ", " << col << ")";
+      cv::Point2d unrect = model_.unrectifyPoint(uv_rect64(row, col));
+      EXPECT_NEAR(unrect.x, uv_unrect64(row, col).x, 1e-9) << "at (" << row << ", " << col << ")";
+      EXPECT_NEAR(unrect.y, uv_unrect64(row, col).y, 1e-9) << "at (" << row << ", " << col << ")";
+    }
+  }
+
+  // Points padded like a point cloud, projected through a column header
+  std::vector<PaddedPoint> cloud(101);
+  for (size_t i = 0; i < cloud.size(); ++i) {
+    cloud[i].x = 0.01f * i - 0.5f;
+    cloud[i].y = 0.3f - 0.007f * i;
+    cloud[i].z = 0.5f + 0.02f * i;
+  }
+  const cv::Mat xyz(cloud.size(), 1, CV_32FC3, &cloud[0].x, sizeof(PaddedPoint));
+  cv::Mat_<cv::Point2f> uv;
+  model_.project3dToPixels(xyz, uv);
+  ASSERT_EQ((int)cloud.size(), uv.rows);
+  for (size_t i = 0; i < cloud.size(); ++i) {
+    cv::Point2d expected = model_.project3dToPixel(cv::Point3d(cloud[i].x, cloud[i].y, cloud[i].z));
+    EXPECT_NEAR(expected.x, uv(i).x, 1e-3) << "at " << i;
+    EXPECT_NEAR(expected.y, uv(i).y, 1e-3) << "at " << i;
+  }
+}
+
+TEST_F(PinholeTest, unrectifyImage)
+{
+  // A smooth image, so interpolation error stays small
+  cv::Mat_<float> raw(cam_info_.height, cam_info_.width);
+  for (int row = 0; row < raw.rows; ++row)
+    for (int col = 0; col < raw.cols; ++col)
+      raw(row, col) = 100.0f + 50.0f * std::sin(col * 0.05f) * std::cos(row * 0.04f);
+
+  cv::Mat rectified, unrectified;
+  model_.rectifyImage(raw, rectified);
+  model_.unrectifyImage(rectified, unrectified);
+  ASSERT_EQ(raw.size(), unrectified.size());
+
+  // Pixels far from the center may map outside the rectified image
+  const int border = 65;
+  cv::Rect center(border, border, raw.cols - 2 * border, raw.rows - 2 * border);
+  cv::Mat diff = cv::abs(raw(center) - unrectified(center));
+  double max_error;
+  cv::minMaxLoc(diff, NULL, &max_error);
+  EXPECT_LT(max_error, 1.0);
+
+  // Without distortion it is a copy
+  sensor_msgs::CameraInfo cam_info_2 = cam_info_;
+  cam_info_2.D.assign(cam_info_2.D.size(), 0);
+  model_.fromCameraInfo(cam_info_2);
+  model_.unrectifyImage(rectified, unrectified);
+  EXPECT_EQ(cv::norm(rectified, unrectified, cv::NORM_L1), 0);
+  model_.fromCameraInfo(cam_info_);
+}
+
+TEST_F(PinholeTest, mapsSurviveBinningChanges)
+{
+  cv::Mat raw(cam_info_.height, cam_info_.width, CV_8UC1);
+  cv::randu(raw, 0, 255);
+  cv::Mat rectified, rectified_again;
+  model_.rectifyImage(raw, rectified);
+
+  // Switching to 2x2 binning and back rectifies with the same maps
+  sensor_msgs::CameraInfo binned = cam_info_;
+  binned.binning_x = binned.binning_y = 2;
+  EXPECT_TRUE(model_.fromCameraInfo(binned));
+  cv::Mat raw_binned, rectified_binned;
+  cv::resize(raw, raw_binned, cv::Size(), 0.5, 0.5, cv::INTER_AREA);
+  model_.rectifyImage(raw_binned, rectified_binned);
+  EXPECT_EQ(raw_binned.size(), rectified_binned.size());
+
+  EXPECT_TRUE(model_.fromCameraInfo(cam_info_));
+  EXPECT_FALSE(model_.fromCameraInfo(cam_info_));
+  model_.rectifyImage(raw, rectified_again);
+  EXPECT_EQ(cv::norm(rectified, rectified_again, cv::NORM_L1), 0);
+}
+
 int main(int argc, char** argv)
 {
   testing::InitGoogleTest(&argc, argv);
@@ -175,6 +175,8 @@ class Apc3dVision {
     bool load_pcd_file(std::string fileName,
         boost::shared_ptr<pcl::PointCloud<pcl::PointXYZ>> output_cloud);
 
+    // Removes NaN points from input_cloud and saves a copy in the background,
+    // returns false if the save was dropped
     bool save_pcd_file(std::string fileName,
         boost::shared_ptr<pcl::PointCloud<pcl::PointXYZ>> input_cloud);
 
@@ -0,0 +1,286 @@
+/*
+Copyright 2017 Australian Centre for Robotic Vision
+*/
+
+#ifndef APC_3D_VISION_CLOUD_IO
+#define APC_3D_VISION_CLOUD_IO
+
+#include <pcl/io/pcd_io.h>
+#include <pcl/point_cloud.h>
+#include <pcl/point_types.h>
+
+#include <opencv2/core/core.hpp>
+#include <opencv2/highgui/highgui.hpp>
+
+#include <boost/shared_ptr.hpp>
+
+#include <cmath>
+#include <condition_variable>
+#include <deque>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <limits>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+/*
+Point cloud persistence shared by the vision nodes.
+
+Clouds can be written as ASCII, binary or binary-compressed PCD, or, for
+organised XYZRGB clouds from a pinhole camera, as an organised depth+RGB
+reconstruction (<file>.depth.png, <file>.rgb.png and <file>.intrinsics).
+Binary PCD is 10-50x faster to write than ASCII and several times smaller.
+
+save_cloud_async() hands the write to the process-wide CloudWriter thread,
+so saves never add to a service call.
+*/
+namespace cloud_io {
+
+enum Format {
+    PCD_ASCII,
+    PCD_BINARY,
+    PCD_BINARY_COMPRESSED,
+    ORGANISED_DEPTH_RGB
+};
+
+// Depth in the organised format is stored as uint16 in units of 0.1mm
+const double ORGANISED_DEPTH_UNIT = 0.0001;
+
+// Pinhole intrinsics of an organised cloud, fitted from its valid points
+struct OrganisedIntrinsics {
+    double fx, fy, cx, cy;
+};
+
+// Fit u = fx * x/z + cx and v = fy * y/z + cy over the valid points of an
+// organised cloud. Returns false if the cloud is not organised or too sparse.
+template <typename PointT>
+bool fit_organised_intrinsics(const pcl::PointCloud<PointT> &cloud, OrganisedIntrinsics &intrinsics) {
+    if (cloud.height <= 1) {
+        return false;
+    }
+    double sum_a[2] = {0, 0}, sum_aa[2] = {0, 0}, sum_p[2] = {0, 0}, sum_ap[2] = {0, 0};
+    std::size_t n = 0;
+    for (uint32_t v = 0; v < cloud.height; ++v) {
+        for (uint32_t u = 0; u < cloud.width; ++u) {
+            const PointT &point = cloud.points[v * cloud.width + u];
+            if (!pcl_isfinite(point.z) || point.z <= 0) {
+                continue;
+            }
+            double a[2] = {point.x / point.z, point.y / point.z};
+            double p[2] = {static_cast<double>(u), static_cast<double>(v)};
+            for (int i = 0; i < 2; ++i) {
+                sum_a[i] += a[i];
+                sum_aa[i] += a[i] * a[i];
+                sum_p[i] += p[i];
+                sum_ap[i] += a[i] * p[i];
+            }
+            ++n;
+        }
+    }
+    if (n < 16) {
+        return false;
+    }
+    double focal[2], centre[2];
+    for (int i = 0; i < 2; ++i) {
+        double denominator = n * sum_aa[i] - sum_a[i] * sum_a[i];
+        if (std::fabs(denominator) < std::numeric_limits<double>::epsilon()) {
+            return false;
+        }
+        focal[i] = (n * sum_ap[i] - sum_a[i] * sum_p[i]) / denominator;
+        centre[i] = (sum_p[i] - focal[i] * sum_a[i]) / n;
+    }
+    intrinsics.fx = focal[0];
+    intrinsics.fy = focal[1];
+    intrinsics.cx = centre[0];
+    intrinsics.cy = centre[1];
+    return true;
+}
+
+inline bool save_organised_depth_rgb(const std::string &filename, const pcl::PointCloud<pcl::PointXYZRGB> &cloud) {
+    OrganisedIntrinsics intrinsics;
+    if (!fit_organised_intrinsics(cloud, intrinsics)) {
+        return false;
+    }
+
+    cv::Mat depth(cloud.height, cloud.width, CV_16UC1, cv::Scalar(0));
+    cv::Mat bgr(cloud.height, cloud.width, CV_8UC3, cv::Scalar(0, 0, 0));
+    for (uint32_t v = 0; v < cloud.height; ++v) {
+        uint16_t *depth_row = depth.ptr<uint16_t>(v);
+        cv::Vec3b *bgr_row = bgr.ptr<cv::Vec3b>(v);
+        for (uint32_t u = 0; u < cloud.width; ++u) {
+            const pcl::PointXYZRGB &point = cloud.points[v * cloud.width + u];
+            bgr_row[u] = cv::Vec3b(point.b, point.g, point.r);
+            if (pcl_isfinite(point.z) && point.z > 0) {
+                depth_row[u] = cv::saturate_cast<uint16_t>(point.z / ORGANISED_DEPTH_UNIT);
+            }
+        }
+    }
+
+    std::vector<int> png_params;
+    png_params.push_back(cv::IMWRITE_PNG_COMPRESSION);
+    png_params.push_back(1);
+    if (!cv::imwrite(filename + ".depth.png", depth, png_params) ||
+        !cv::imwrite(filename + ".rgb.png", bgr, png_params)) {
+        return false;
+    }
+
+    std::ofstream file((filename + ".intrinsics").c_str());
+    file.precision(10);
+    file << intrinsics.fx << " " << intrinsics.fy << " " << intrinsics.cx << " " << intrinsics.cy << " "
+         << ORGANISED_DEPTH_UNIT << std::endl;
+    return static_cast<bool>(file);
+}
+
+// Rebuild an organised XYZRGB cloud written by save_organised_depth_rgb
+inline bool load_organised_depth_rgb(const std::string &filename, pcl::PointCloud<pcl::PointXYZRGB> &cloud) {
+    OrganisedIntrinsics intrinsics;
+    double depth_unit;
+    std::ifstream file((filename + ".intrinsics").c_str());
+    if (!(file >> intrinsics.fx >> intrinsics.fy >> intrinsics.cx >> intrinsics.cy >> depth_unit)) {
+        return false;
+    }
+    cv::Mat depth = cv::imread(filename + ".depth.png", CV_LOAD_IMAGE_ANYDEPTH);
+    cv::Mat bgr = cv::imread(filename + ".rgb.png", CV_LOAD_IMAGE_COLOR);
+    if (depth.empty() || bgr.empty() || depth.size() != bgr.size() || depth.type() != CV_16UC1) {
+        return false;
+    }
+
+    const float bad_point = std::numeric_limits<float>::quiet_NaN();
+    cloud.width = depth.cols;
+    cloud.height = depth.rows;
+    cloud.is_dense = false;
+    cloud.points.resize(cloud.width * cloud.height);
+    for (int v = 0; v < depth.rows; ++v) {
+        const uint16_t *depth_row = depth.ptr<uint16_t>(v);
+        const cv::Vec3b *bgr_row = bgr.ptr<cv::Vec3b>(v);
+        for (int u = 0; u < depth.cols; ++u) {
+            pcl::PointXYZRGB &point = cloud.points[v * cloud.width + u];
+            point.b = bgr_row[u][0];
+            point.g = bgr_row[u][1];
+            point.r = bgr_row[u][2];
+            if (depth_row[u] == 0) {
+                point.x = point.y = point.z = bad_point;
+                continue;
+            }
+            point.z = depth_row[u] * depth_unit;
+            point.x = (u - intrinsics.cx) * point.z / intrinsics.fx;
+            point.y = (v - intrinsics.cy) * point.z / intrinsics.fy;
+        }
+    }
+    return true;
+}
+
+// Formats other than ORGANISED_DEPTH_RGB for any point type. The organised
+// format falls back to binary-compressed PCD when the cloud does not fit it.
+template <typename PointT>
+bool save_cloud(const std::string &filename, const pcl::PointCloud<PointT> &cloud, Format format) {
+    if (cloud.points.empty()) {
+        return false;
+    }
+    pcl::PCDWriter writer;
+    switch (format) {
+        case PCD_ASCII:
+            return writer.writeASCII(filename, cloud) == 0;
+        case PCD_BINARY:
+            return writer.writeBinary(filename, cloud) == 0;
+        case PCD_BINARY_COMPRESSED:
+        case ORGANISED_DEPTH_RGB:
+        default:
+            return writer.writeBinaryCompressed(filename, cloud) == 0;
+    }
+}
+
+inline bool save_cloud(const std::string &filename, const pcl::PointCloud<pcl::PointXYZRGB> &cloud, Format format) {
+    if (format == ORGANISED_DEPTH_RGB && save_organised_depth_rgb(filename, cloud)) {
+        return true;
+    }
+    return save_cloud<pcl::PointXYZRGB>(filename, cloud, format);
+}
+
+// A single thread writing queued saves in order. Saves queued past the bound
+// are dropped rather than blocking the caller, and the queue is drained when
+// the writer is destroyed.
+class CloudWriter {
+   public:
+    explicit CloudWriter(std::size_t max_queue_size) : max_queue_size_(max_queue_size), stop_(false) {
+        thread_ = std::thread(&CloudWriter::run, this);
+    }
+
+    ~CloudWriter() {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            stop_ = true;
+        }
+        condition_.notify_all();
+        thread_.join();
+    }
+
+    CloudWriter(const CloudWriter &) = delete;
+    CloudWriter &operator=(const CloudWriter &) = delete;
+
+    // Returns false if the queue is full and the save was dropped
+    bool submit(const std::function<void()> &save) {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            if (queue_.size() >= max_queue_size_) {
+                return false;
+            }
+            queue_.push_back(save);
+        }
+        condition_.notify_one();
+        return true;
+    }
+
+   private:
+    void run() {
+        std::unique_lock<std::mutex> lock(mutex_);
+        while (true) {
+            condition_.wait(lock, [this]() { return stop_ || !queue_.empty(); });
+            if (queue_.empty()) {
+                return;
+            }
+            std::function<void()> save = queue_.front();
+            queue_.pop_front();
+            lock.unlock();
+            save();
+            lock.lock();
+        }
+    }
+
+    const std::size_t max_queue_size_;
+    bool stop_;
+    std::deque<std::function<void()>> queue_;
+    std::mutex mutex_;
+    std::condition_variable condition_;
+    std::thread thread_;
+};
+
+// The writer every asynchronous save in the process goes through
+inline CloudWriter &async_writer() {
+    static CloudWriter writer(32);
+    return writer;
+}
+
+// Copies the cloud and saves it on the shared writer. Returns false if the
+// save was dropped because the writer is backed up.
+template <typename PointT>
+bool save_cloud_async(const std::string &filename, const pcl::PointCloud<PointT> &cloud,
+                      Format format = PCD_BINARY) {
+    boost::shared_ptr<const pcl::PointCloud<PointT>> copy(new pcl::PointCloud<PointT>(cloud));
+    bool queued = async_writer().submit([filename, copy, format]() {
+        if (!save_cloud(filename, *copy, format)) {
+            std::cerr << "Could not save cloud " << filename << std::endl;
+        }
+    });
+    if (!queued) {
+        std::cerr << "Cloud writer backed up, dropped " << filename << std::endl;
+    }
+    return queued;
+}
+
+}  // namespace cloud_io
+
+#endif
@@ -3,6 +3,7 @@ Copyright 2016 Australian Centre for Robotic Vision
 */
 
 #include <apc_3d_vision.hpp>
+#include <cloud_io.hpp>
 
 #include <math.h> /* sin */
 #include <iostream>
@@ -35,8 +36,11 @@ bool Apc3dVision::save_pcd_file(
     std::vector<int> indices;
     pcl::removeNaNFromPointCloud(*input_cloud, *input_cloud, indices);
 
-    pcl::io::savePCDFileASCII(fileName, *input_cloud);
-    std::cerr << "Saved " << input_cloud->points.size() << " data points to "
+    // Written on the shared writer pool, the caller keeps its cloud
+    if (!cloud_io::save_cloud_async(fileName, *input_cloud, cloud_io::PCD_BINARY_COMPRESSED)) {
+        return false;
+    }
+    std::cerr << "Queued " << input_cloud->points.size() << " data points for "
               << fileName << std::endl;
 
     return true;
@@ -48,6 +48,8 @@
 #include <tf/transform_listener.h>
 #include <tf_conversions/tf_eigen.h>
 
+#include <cloud_io.hpp>
+
 /* Messages */
 #include "apc_msgs/BoundingBoxDepth.h"
 
@@ -307,8 +309,8 @@ void save_pointcloud_version_of_octree(pcl::octree::OctreePointCloudOccupancy<pc
         cloud.points[i].y = it->y;
         cloud.points[i].z = it->z;
     }
-    //save cloud
-    pcl::io::savePCDFileASCII(filename, cloud);
+    //save cloud off the service thread, this is only a debug dump
+    cloud_io::save_cloud_async(filename, cloud, cloud_io::PCD_BINARY);
 }
 
 bool get_valid_object_position_and_orientation(pcl::PointCloud<pcl::PointXYZRGB>::Ptr cloud,
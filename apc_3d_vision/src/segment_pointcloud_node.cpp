@@ -134,12 +134,18 @@ public:
         ROS_INFO_STREAM("Adding PC segments: " << (t2 - t1));
 
         t1 = ros::Time::now();
-        for(auto &point: *input_cloud_) {
+        // Project the whole cloud at once, straight from the x,y,z of its points
+        cv::Mat_<cv::Point2f> pixels;
+        if(!input_cloud_->empty()) {
+            const cv::Mat xyz(input_cloud_->size(), 1, CV_32FC3, &input_cloud_->points[0].x, sizeof(pcl::PointXYZRGB));
+            model_.project3dToPixels(xyz, pixels);
+        }
+        for(size_t i = 0; i < input_cloud_->size(); i++) {
+            const pcl::PointXYZRGB &point = input_cloud_->points[i];
             if(point.r == 0) {
                 continue;
             }
-            cv::Point3d xyz = cv::Point3d(point.x, point.y, point.z);
-            cv::Point2d pt = model_.project3dToPixel(xyz);
+            const cv::Point2f &pt = pixels((int)i);
             if (!std::isnan(pt.x) && !std::isnan(pt.y)){
                 int label = (int)labels.at<uchar>((int)pt.y, (int)pt.x);
                 if(label > 0) {